@@ -8,10 +8,12 @@ import java.net.URL;
 import java.security.MessageDigest;
 import java.security.NoSuchAlgorithmException;
 import java.util.Date;
+import java.util.HashMap;
+import java.util.Map;
+import java.util.zip.DataFormatException;
 
 import org.eclipse.paho.client.mqttv3.MqttMessage;
 import org.json.simple.JSONObject;
-import org.json.simple.parser.JSONParser;
 import org.json.simple.parser.ParseException;
 
 /**
@@ -20,12 +22,17 @@ import org.json.simple.parser.ParseException;
  */
 
 public class MQTT_REST_Translator {
+	// diagnostics of the watch (see mqtt.h), never data to write in the ledger
+	private static final String DIAG_SUFFIX = "/diag";
+	// root of the last batch written for each device, the paho callbacks come one at a time
+	private static final Map<String, String> lastRoots = new HashMap<String, String>();
+
 	public static void main(String[] args){
 		String MqttServer 	= "tcp://ec2-13-125-65-148.ap-northeast-2.compute.amazonaws.com:1883";
 		String client_id 	= "MQTT_REST_Translator_01";
 		String username 	= null;   
 		String passwd 		= null;   
-		String topic 		= "#";
+		String topic 		= "+";	// <deviceID>, but not <deviceID>/diag
 		
 		MQTT mqtt = new MQTT(MqttServer, client_id, username, passwd);
 		mqtt.init(topic);
@@ -47,40 +54,89 @@ public class MQTT_REST_Translator {
 	public static void postwork(String topic, MqttMessage mqttMessage) throws NoSuchAlgorithmException {
 		// write address of your Hyperledger network
 		String strUrl = "http://localhost:5000/api/org.oslab.ac.kr.COVIDAsset";
-		JSONParser parser = new JSONParser();
+		if (topic.endsWith(DIAG_SUFFIX))
+			return;
 		try {
-			JSONObject mainJson = new JSONObject();
-			JSONObject mqttMsgJson = (JSONObject) parser.parse(new String(mqttMessage.getPayload(), "UTF-8"));
-			//System.out.println("mqttMsgJson: " + mqttMsgJson.toJSONString());
-			
-			String cid = sha256("110, Sejong-daero, Jung-gu, Seoul, Republic of Korea" + mqttMsgJson.toString().replace("\\", "")); // SHA256(the address of Seoul City Hall + Health data from SmartWatch) 
-			String pid = sha256(topic);
-			JSONObject covid = new JSONObject();
-			covid.put("$class", "org.oslab.ac.kr.COVID");
-			JSONObject patientId = new JSONObject();
-			patientId.put("$class", "org.oslab.ac.kr.Patients");
-			patientId.put("PatientId", pid);
-			covid.put("patientId", patientId);
-			covid.put("name", topic);
-			covid.put("birthDate", "1988.01.29");
-			covid.put("infection", "Y");
-			Date date_now = new Date(System.currentTimeMillis());
-			covid.put("date", date_now.toString());
-			covid.put("travelRoute", "110, Sejong-daero, Jung-gu, Seoul, Republic of Korea");
-			covid.put("note", mqttMsgJson.toString().replace("\\", ""));
-			
-			mainJson.put("$class", "org.oslab.ac.kr.COVIDAsset");
-			mainJson.put("COVIDId", cid);
-			mainJson.put("covid", covid);
-			
-			//System.out.println("mainJson: " + mainJson.toJSONString());
-			
-			post(strUrl, mainJson.toJSONString());
+			// The watch publishes batches of records in JSON, binary or columnar format
+			RecordBatch batch = RecordBatch.decode(mqttMessage.getPayload());
+			if (batch.single) {
+				postRecord(strUrl, topic, (JSONObject) batch.records.get(0));
+				return;
+			}
+			postBatch(strUrl, topic, batch);
 		} catch (UnsupportedEncodingException e1) {
 			e1.printStackTrace();
 		} catch (ParseException e1) {
 			e1.printStackTrace();
+		} catch (DataFormatException e1) {
+			e1.printStackTrace();
+		}
+	}
+
+	/**
+	 * Writes a whole batch in one transaction: its records, and the root that
+	 * commits to them once they are verified against it. The prev_root of the
+	 * batch must be the root of the last batch of the device, a gap means
+	 * batches were lost on the way.
+	 */
+	@SuppressWarnings("unchecked")
+	public static void postBatch(String strUrl, String topic, RecordBatch batch) throws NoSuchAlgorithmException {
+		JSONObject note = new JSONObject();
+		String lastRoot = lastRoots.get(topic);
+
+		if (batch.root != null) {
+			String root = bytesToHex(batch.root);
+			String prevRoot;
+
+			if (!batch.verify()) {
+				System.err.println(topic + ": batch " + batch.batchId + " does not match its root, dropped");
+				return;
+			}
+			prevRoot = bytesToHex(batch.prevRoot);
+			// a QoS 1 redelivery of the last batch
+			if (root.equals(lastRoot))
+				return;
+			if (lastRoot != null && !lastRoot.equals(prevRoot))
+				System.err.println(topic + ": batch " + batch.batchId + " does not follow root " + lastRoot);
+
+			lastRoots.put(topic, root);
+			note.put("prev_root", prevRoot);
+			note.put("root", root);
+			note.put("chained", lastRoot == null || lastRoot.equals(prevRoot));
 		}
+		note.put("batch_id", batch.batchId);
+		note.put("count", batch.records.size());
+		note.put("records", batch.records);
+
+		postRecord(strUrl, topic, note);
+	}
+
+	@SuppressWarnings("unchecked")
+	public static void postRecord(String strUrl, String topic, JSONObject mqttMsgJson) throws NoSuchAlgorithmException {
+		JSONObject mainJson = new JSONObject();
+		String cid = sha256("110, Sejong-daero, Jung-gu, Seoul, Republic of Korea" + mqttMsgJson.toString().replace("\\", "")); // SHA256(the address of Seoul City Hall + Health data from SmartWatch) 
+		String pid = sha256(topic);
+		JSONObject covid = new JSONObject();
+		covid.put("$class", "org.oslab.ac.kr.COVID");
+		JSONObject patientId = new JSONObject();
+		patientId.put("$class", "org.oslab.ac.kr.Patients");
+		patientId.put("PatientId", pid);
+		covid.put("patientId", patientId);
+		covid.put("name", topic);
+		covid.put("birthDate", "1988.01.29");
+		covid.put("infection", "Y");
+		Date date_now = new Date(System.currentTimeMillis());
+		covid.put("date", date_now.toString());
+		covid.put("travelRoute", "110, Sejong-daero, Jung-gu, Seoul, Republic of Korea");
+		covid.put("note", mqttMsgJson.toString().replace("\\", ""));
+		
+		mainJson.put("$class", "org.oslab.ac.kr.COVIDAsset");
+		mainJson.put("COVIDId", cid);
+		mainJson.put("covid", covid);
+		
+		//System.out.println("mainJson: " + mainJson.toJSONString());
+		
+		post(strUrl, mainJson.toJSONString());
 	}
 	
 	public static void post(String strUrl, String jsonMessage){
@@ -0,0 +1,47 @@
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.util.List;
+
+/**
+ * Merkle root of the records of a batch, as merkle.c of KUSensors computes it.
+ * The tree is the one of RFC 6962: leaf = SHA-256(0x00 | record), node =
+ * SHA-256(0x01 | left | right), the left subtree of n leaves holding the
+ * largest power of two below n.
+ */
+public class Merkle {
+	private static final byte LEAF_PREFIX = 0x00;
+	private static final byte NODE_PREFIX = 0x01;
+
+	/**
+	 * @param records the bytes each record takes in the batch, see RecordBatch.leaves
+	 * @return the root, the hash of the empty string for no record
+	 * @throws NoSuchAlgorithmException
+	 */
+	public static byte[] root(List<byte[]> records) throws NoSuchAlgorithmException {
+		return subtreeRoot(records, 0, records.size(), MessageDigest.getInstance("SHA-256"));
+	}
+
+	private static byte[] subtreeRoot(List<byte[]> records, int from, int count, MessageDigest md) {
+		byte[] left;
+		byte[] right;
+		int split;
+
+		if (count == 0)
+			return md.digest();
+
+		if (count == 1) {
+			md.update(LEAF_PREFIX);
+			md.update(records.get(from));
+			return md.digest();
+		}
+
+		split = Integer.highestOneBit(count - 1);
+		left = subtreeRoot(records, from, split, md);
+		right = subtreeRoot(records, from + split, count - split, md);
+		md.update(NODE_PREFIX);
+		md.update(left);
+		md.update(right);
+
+		return md.digest();
+	}
+}
@@ -0,0 +1,498 @@
+import java.io.ByteArrayOutputStream;
+import java.io.UnsupportedEncodingException;
+import java.security.NoSuchAlgorithmException;
+import java.util.ArrayList;
+import java.util.Arrays;
+import java.util.List;
+import java.util.zip.DataFormatException;
+import java.util.zip.Inflater;
+
+import org.json.simple.JSONArray;
+import org.json.simple.JSONObject;
+import org.json.simple.parser.JSONParser;
+import org.json.simple.parser.ParseException;
+
+/**
+ * A batch of sensor records published by the watch, decoded from any of its
+ * wire formats (record.h and columnar.h of KUSensors). The first bytes of the
+ * payload tell the format:
+ *   "KS"  binary batch
+ *   "KC"  columnar batch, its streams possibly deflated
+ *   "{"   JSON batch {"batch_id":..,"prev_root":..,"records":[..],..}, or a single record
+ * The records of the binary formats are turned into the objects of the JSON
+ * format, without a transaction_id: they have none. The bytes each record
+ * takes in the Merkle tree of the batch (merkle.h) are kept to verify it.
+ */
+public class RecordBatch {
+	public static final int FORMAT_JSON = 0;
+	public static final int FORMAT_BINARY = 1;
+	public static final int FORMAT_COLUMNAR = 2;
+
+	private static final int RECORD_VERSION = 1;
+	private static final int RECORD_HEADER_SIZE = 20;
+	private static final int RECORD_MAX_VALUES = 4;
+	private static final int RECORD_FLAG_COMMITTED = 0x01;
+	private static final int RECORD_COMMITMENT_SIZE = 64;
+	private static final int RECORD_VALUES_FLOAT = 0;
+	private static final int RECORD_VALUES_CENTI16 = 1;
+	private static final int RECORD_VALUES_CENTI32 = 2;
+	private static final int RECORD_TYPE_ACTIVITY = 64;
+
+	private static final int COLUMNAR_VERSION = 1;
+	private static final int COLUMNAR_HEADER_SIZE = 12;
+	private static final int COLUMNAR_FLAG_DEFLATE = 0x01;
+	private static final int COLUMNAR_FLAG_COMMITTED = 0x02;
+	private static final int COLUMNAR_VALUES_QUANTIZED = 0;
+	private static final int COLUMNAR_VALUES_XOR = 1;
+
+	private static final int HASH_SIZE = 32;
+
+	// JSON field names of each sensor type, as in record.c
+	private static final String[][] FIELDS = {
+		{"x", "y", "z"},						// acceleration
+		{"x", "y", "z"},						// gravity
+		{"x", "y", "z"},						// linear acc
+		{"x", "y", "z"},						// magnetic
+		{"x", "y", "z", "v"},					// rot vector
+		{"x", "y", "z"},						// orientation
+		{"x", "y", "z"},						// gyroscope
+		{"lux"},								// light
+		{"proximity"},							// proximity
+		{"hPa"},								// pressure
+		{"UV"},									// UV
+		{"temperature"},						// temp
+		{"humidity"},							// humidity
+		{"HeartRate", "P2P", "RMSSD", "SDNN"},	// hrm
+	};
+	private static final String[][] DERIVED_FIELDS = {
+		{"steps", "activity", "intensity", "cadence"},	// RECORD_TYPE_ACTIVITY
+		{"w", "x", "y", "z"},							// RECORD_TYPE_QUATERNION
+	};
+
+	public int format;
+	public boolean single;						// a single JSON record, as the app published before batching
+	public long batchId = -1;
+	public JSONArray records = new JSONArray();
+	public byte[] prevRoot;						// commitment of the batch, null without one
+	public byte[] root;
+	public List<byte[]> leaves = new ArrayList<byte[]>();	// null for a single JSON record
+
+	/**
+	 * Decodes a payload of the data topic of a watch.
+	 *
+	 * @param payload
+	 * @return the batch
+	 * @throws ParseException the JSON payload is malformed
+	 * @throws DataFormatException the binary payload is malformed or of a newer version
+	 * @throws UnsupportedEncodingException
+	 */
+	public static RecordBatch decode(byte[] payload) throws ParseException, DataFormatException, UnsupportedEncodingException {
+		RecordBatch batch = new RecordBatch();
+
+		if (payload.length >= 2 && payload[0] == 'K' && payload[1] == 'S')
+			batch.decodeBinary(payload);
+		else if (payload.length >= 2 && payload[0] == 'K' && payload[1] == 'C')
+			batch.decodeColumnar(payload);
+		else
+			batch.decodeJson(payload);
+
+		return batch;
+	}
+
+	/**
+	 * Recomputes the Merkle root of the records and compares it with the one
+	 * the batch carries, as merkle_verify_batch() does.
+	 *
+	 * @return true if the batch is committed and its records match its root
+	 * @throws NoSuchAlgorithmException
+	 */
+	public boolean verify() throws NoSuchAlgorithmException {
+		return prevRoot != null && root != null && leaves != null && leaves.size() == records.size()
+				&& Arrays.equals(Merkle.root(leaves), root);
+	}
+
+	@SuppressWarnings("unchecked")
+	private void decodeJson(byte[] payload) throws ParseException, UnsupportedEncodingException {
+		Object parsed = new JSONParser().parse(new String(payload, "UTF-8"));
+		JSONObject json;
+
+		if (!(parsed instanceof JSONObject))
+			throw new ParseException(0, ParseException.ERROR_UNEXPECTED_TOKEN, parsed);
+		json = (JSONObject) parsed;
+		format = FORMAT_JSON;
+
+		if (!(json.get("records") instanceof JSONArray)) {
+			records.add(json);
+			single = true;
+			leaves = null;
+			return;
+		}
+		records = (JSONArray) json.get("records");
+		leaves = jsonLeaves(payload);
+		if (json.get("batch_id") instanceof Number)
+			batchId = ((Number) json.get("batch_id")).longValue();
+		prevRoot = fromHex(json.get("prev_root"));
+		root = fromHex(json.get("root"));
+	}
+
+	private void decodeBinary(byte[] data) throws DataFormatException {
+		int end = data.length;
+		Cursor cursor;
+		long timestamp;
+		int count;
+
+		if (data.length < RECORD_HEADER_SIZE || (data[2] & 0xff) > RECORD_VERSION)
+			throw new DataFormatException("Unsupported binary batch");
+		if ((data[3] & RECORD_FLAG_COMMITTED) != 0)
+			end = readCommitment(data, RECORD_HEADER_SIZE);
+
+		format = FORMAT_BINARY;
+		batchId = u32(data, 4);
+		timestamp = u32(data, 8) | (u32(data, 12) << 32);
+		count = u16(data, 16);
+		cursor = new Cursor(data, RECORD_HEADER_SIZE, end);
+
+		for (int i = 0; i < count; ++i) {
+			int start = cursor.pos;
+			int type = cursor.u8();
+			int desc = cursor.u8();
+			int encoding = (desc >> 4) & 0x03;
+			float[] values = new float[desc & 0x07];
+
+			if (values.length > RECORD_MAX_VALUES)
+				throw new DataFormatException("Too many values in record " + i);
+			timestamp += unzigzag(cursor.varint());
+
+			for (int j = 0; j < values.length; ++j) {
+				switch (encoding) {
+				case RECORD_VALUES_CENTI16:
+					values[j] = (short) cursor.u16() / 100.0f;
+					break;
+				case RECORD_VALUES_CENTI32:
+					values[j] = (int) cursor.u32() / 100.0f;
+					break;
+				case RECORD_VALUES_FLOAT:
+					values[j] = Float.intBitsToFloat((int) cursor.u32());
+					break;
+				default:
+					throw new DataFormatException("Unknown value encoding " + encoding);
+				}
+			}
+
+			addRecord(type, timestamp, values);
+			leaves.add(Arrays.copyOfRange(data, start, cursor.pos));
+		}
+	}
+
+	private void decodeColumnar(byte[] data) throws DataFormatException {
+		int end = data.length;
+		Cursor cursor;
+		int count;
+		int streams;
+
+		if (data.length < COLUMNAR_HEADER_SIZE || (data[2] & 0xff) > COLUMNAR_VERSION)
+			throw new DataFormatException("Unsupported columnar batch");
+		if ((data[3] & COLUMNAR_FLAG_COMMITTED) != 0)
+			end = readCommitment(data, COLUMNAR_HEADER_SIZE);
+
+		format = FORMAT_COLUMNAR;
+		batchId = u32(data, 4);
+		count = u16(data, 8);
+		streams = data[10] & 0xff;
+		if ((data[3] & COLUMNAR_FLAG_DEFLATE) != 0) {
+			byte[] raw = inflate(data, end, count);
+			cursor = new Cursor(raw, 0, raw.length);
+		} else {
+			cursor = new Cursor(data, COLUMNAR_HEADER_SIZE, end);
+		}
+
+		// the records come out stream by stream, as columnar_decode() returns them
+		for (int k = 0; k < streams; ++k) {
+			int type = cursor.u8();
+			int valueCount = cursor.u8();
+			int encoding = cursor.u8();
+			float quantum;
+			long n;
+
+			cursor.u8();		// reserved
+			quantum = Float.intBitsToFloat((int) cursor.u32());
+			n = cursor.varint();
+			if (valueCount > RECORD_MAX_VALUES || encoding > COLUMNAR_VALUES_XOR || n < 0 || n > count - records.size())
+				throw new DataFormatException("Malformed stream " + k);
+
+			long[] timestamps = new long[(int) n];
+			float[][] values = new float[(int) n][valueCount];
+			long ts = 0;
+			long delta = 0;
+
+			for (int i = 0; i < n; ++i) {
+				if (i == 0) {
+					ts = unzigzag(cursor.varint());
+				} else {
+					delta += unzigzag(cursor.varint());
+					ts += delta;
+				}
+				timestamps[i] = ts;
+			}
+
+			for (int j = 0; j < valueCount; ++j) {
+				long q = 0;
+				int bits = 0;
+
+				for (int i = 0; i < n; ++i) {
+					if (encoding == COLUMNAR_VALUES_QUANTIZED) {
+						q += unzigzag(cursor.varint());
+						values[i][j] = (float) (q * (double) quantum);
+					} else {
+						bits ^= (int) cursor.varint();
+						values[i][j] = Float.intBitsToFloat(bits);
+					}
+				}
+			}
+
+			for (int i = 0; i < n; ++i) {
+				addRecord(type, timestamps[i], values[i]);
+				leaves.add(encodeBinary(type, timestamps[i], values[i]));
+			}
+		}
+
+		if (records.size() != count)
+			throw new DataFormatException(records.size() + " records out of " + count);
+	}
+
+	/**
+	 * Reads the prev_root | root trailer of a binary batch.
+	 *
+	 * @return the end of the records
+	 */
+	private int readCommitment(byte[] data, int headerSize) throws DataFormatException {
+		int end = data.length - RECORD_COMMITMENT_SIZE;
+
+		if (end < headerSize)
+			throw new DataFormatException("Truncated commitment");
+		prevRoot = Arrays.copyOfRange(data, end, end + HASH_SIZE);
+		root = Arrays.copyOfRange(data, end + HASH_SIZE, end + RECORD_COMMITMENT_SIZE);
+
+		return end;
+	}
+
+	private static byte[] inflate(byte[] data, int end, int count) throws DataFormatException {
+		Inflater inflater = new Inflater();
+		long rawLen;
+		byte[] raw;
+		int len = 0;
+		int n;
+
+		if (end < COLUMNAR_HEADER_SIZE + 4)
+			throw new DataFormatException("Truncated deflated streams");
+		// COLUMNAR_MAX_SIZE(count)
+		rawLen = u32(data, COLUMNAR_HEADER_SIZE);
+		if (rawLen > COLUMNAR_HEADER_SIZE + 4 + (long) count * (8 + 5 + 10 + RECORD_MAX_VALUES * 10))
+			throw new DataFormatException("Deflated streams too large");
+
+		raw = new byte[(int) rawLen];
+		try {
+			inflater.setInput(data, COLUMNAR_HEADER_SIZE + 4, end - COLUMNAR_HEADER_SIZE - 4);
+			do {
+				n = inflater.inflate(raw, len, raw.length - len);
+				len += n;
+			} while (n > 0 && !inflater.finished());
+			if (!inflater.finished() || len != raw.length)
+				throw new DataFormatException("Truncated deflated streams");
+		} finally {
+			inflater.end();
+		}
+
+		return raw;
+	}
+
+	@SuppressWarnings("unchecked")
+	private void addRecord(int type, long timestampMs, float[] values) {
+		JSONObject record = new JSONObject();
+		JSONObject data = new JSONObject();
+		String[] names = new String[0];
+
+		if (type >= 0 && type < FIELDS.length)
+			names = FIELDS[type];
+		else if (type >= RECORD_TYPE_ACTIVITY && type - RECORD_TYPE_ACTIVITY < DERIVED_FIELDS.length)
+			names = DERIVED_FIELDS[type - RECORD_TYPE_ACTIVITY];
+
+		// the two decimals of "%0.2f"
+		for (int i = 0; i < values.length && i < names.length; ++i)
+			data.put(names[i], Math.rint(values[i] * 100.0) / 100.0);
+
+		record.put("timestamp", timestampMs / 1000);
+		record.put("sensor_type", type);
+		record.put("sensor_data", data);
+		records.add(record);
+	}
+
+	/**
+	 * Splits the records array of a JSON batch into the bytes of each record,
+	 * as _walk_json() of merkle.c does: the record objects hold no string with
+	 * a brace.
+	 *
+	 * @return the records, null if the array is malformed
+	 */
+	private static List<byte[]> jsonLeaves(byte[] payload) {
+		List<byte[]> leaves = new ArrayList<byte[]>();
+		byte[] needle = {'"', 'r', 'e', 'c', 'o', 'r', 'd', 's', '"', ':', '['};
+		int pos = -1;
+
+		for (int i = 0; pos < 0 && i + needle.length <= payload.length; ++i) {
+			if (Arrays.equals(Arrays.copyOfRange(payload, i, i + needle.length), needle))
+				pos = i + needle.length;
+		}
+		if (pos < 0)
+			return null;
+
+		while (pos < payload.length && payload[pos] != ']') {
+			int start = pos;
+			int depth = 0;
+
+			if (payload[pos] == ',') {
+				pos++;
+				continue;
+			}
+			if (payload[pos] != '{')
+				return null;
+			do {
+				if (payload[pos] == '{')
+					depth++;
+				else if (payload[pos] == '}')
+					depth--;
+				pos++;
+			} while (depth > 0 && pos < payload.length);
+			if (depth != 0)
+				return null;
+
+			leaves.add(Arrays.copyOfRange(payload, start, pos));
+		}
+
+		return leaves;
+	}
+
+	/**
+	 * record_write_binary() of a decoded record, relative to 0: the leaf of a
+	 * record of a columnar batch.
+	 */
+	private static byte[] encodeBinary(int type, long timestampMs, float[] values) {
+		ByteArrayOutputStream out = new ByteArrayOutputStream();
+		int encoding = RECORD_VALUES_CENTI16;
+		long zigzag = (timestampMs << 1) ^ (timestampMs >> 63);
+
+		// _values_encoding()
+		for (float value : values) {
+			double centi = Math.abs(value * 100.0);
+
+			if (Double.isNaN(centi) || centi > 2147483647.0) {
+				encoding = RECORD_VALUES_FLOAT;
+				break;
+			}
+			if (centi > 32767.0)
+				encoding = RECORD_VALUES_CENTI32;
+		}
+
+		out.write(type);
+		out.write((values.length & 0x07) | (encoding << 4));
+		while ((zigzag & ~0x7fL) != 0) {
+			out.write((int) (zigzag | 0x80));
+			zigzag >>>= 7;
+		}
+		out.write((int) zigzag);
+
+		for (float value : values) {
+			int bits = encoding == RECORD_VALUES_FLOAT ? Float.floatToRawIntBits(value) : (int) Math.rint(value * 100.0);
+
+			out.write(bits);
+			out.write(bits >> 8);
+			if (encoding != RECORD_VALUES_CENTI16) {
+				out.write(bits >> 16);
+				out.write(bits >> 24);
+			}
+		}
+
+		return out.toByteArray();
+	}
+
+	private static byte[] fromHex(Object value) {
+		String hex = value instanceof String ? (String) value : "";
+		byte[] hash = new byte[HASH_SIZE];
+
+		if (hex.length() != HASH_SIZE * 2)
+			return null;
+		for (int i = 0; i < HASH_SIZE; ++i) {
+			int high = Character.digit(hex.charAt(i * 2), 16);
+			int low = Character.digit(hex.charAt(i * 2 + 1), 16);
+
+			if (high < 0 || low < 0)
+				return null;
+			hash[i] = (byte) (high << 4 | low);
+		}
+
+		return hash;
+	}
+
+	private static long unzigzag(long v) {
+		return (v >>> 1) ^ -(v & 1);
+	}
+
+	private static int u16(byte[] data, int pos) {
+		return (data[pos] & 0xff) | ((data[pos + 1] & 0xff) << 8);
+	}
+
+	private static long u32(byte[] data, int pos) {
+		return u16(data, pos) | ((long) u16(data, pos + 2) << 16);
+	}
+
+	/** Bounded little endian reader over the records of a batch */
+	private static class Cursor {
+		private final byte[] data;
+		private final int end;
+		private int pos;
+
+		Cursor(byte[] data, int pos, int end) {
+			this.data = data;
+			this.pos = pos;
+			this.end = end;
+		}
+
+		int u8() throws DataFormatException {
+			need(1);
+			return data[pos++] & 0xff;
+		}
+
+		int u16() throws DataFormatException {
+			need(2);
+			pos += 2;
+			return RecordBatch.u16(data, pos - 2);
+		}
+
+		long u32() throws DataFormatException {
+			need(4);
+			pos += 4;
+			return RecordBatch.u32(data, pos - 4);
+		}
+
+		long varint() throws DataFormatException {
+			long v = 0;
+			int shift = 0;
+			int b;
+
+			do {
+				if (pos >= end || shift > 63)
+					throw new DataFormatException("Malformed varint");
+				b = data[pos++] & 0xff;
+				v |= (long) (b & 0x7f) << shift;
+				shift += 7;
+			} while ((b & 0x80) != 0);
+
+			return v;
+		}
+
+		private void need(int n) throws DataFormatException {
+			if (end - pos < n)
+				throw new DataFormatException("Truncated batch");
+		}
+	}
+}
@@ -0,0 +1,117 @@
+/*
+ * bench_window.c
+ *
+ * Publish throughput of the MQTT publisher for one PUBLISH_WINDOW, the
+ * window the binary is built with: payloads of a fixed size are kept queued
+ * to the sender thread, and the PUBACKs received per second are measured
+ * after a warm-up. Prints one line: msgs/s, the most payloads seen in flight
+ * and the p50 and p99 of the send to PUBACK latency. bench_window.sh runs
+ * the binaries of every window against mqtt_sink.py.
+ *
+ * usage: bench-window-N [-b broker] [-t seconds] [-s payload bytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <app_preference.h>
+#include "mqtt.h"
+
+#define BENCH_BROKER		"tcp://localhost:1883"
+#define BENCH_RUN_S			3
+#define BENCH_WARMUP_S		0.5
+#define BENCH_PAYLOAD		1024
+#define BENCH_QUEUED		128		// payloads kept waiting for the sender thread
+#define BENCH_CONNECT_S		10
+#define BENCH_POLL_US		200
+
+static double _now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* publishes until `until`, keeping BENCH_QUEUED payloads queued */
+static void _publish_until(char *payload, double until)
+{
+	mqtt_stats_t stats;
+
+	while (_now() < until) {
+		mqttGetStats(&stats);
+		if (stats.queue_depth < BENCH_QUEUED)
+			mqttPublish(payload);
+		else
+			usleep(BENCH_POLL_US);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *broker = BENCH_BROKER;
+	double run_s = BENCH_RUN_S;
+	int size = BENCH_PAYLOAD;
+	mqtt_stats_t before, after;
+	char *payload;
+	double start, deadline;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:t:s:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			broker = optarg;
+			break;
+		case 't':
+			run_s = atof(optarg);
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-b broker] [-t seconds] [-s payload bytes]\n", argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (preference_set_string(MQTT_BROKER_KEY, broker) != PREFERENCE_ERROR_NONE) {
+		fprintf(stderr, "Can't save the broker %s\n", broker);
+		return EXIT_FAILURE;
+	}
+
+	payload = malloc(size + 1);
+	if (payload == NULL)
+		return EXIT_FAILURE;
+	memset(payload, 'x', size);
+	payload[size] = '\0';
+
+	mqttInit();
+	deadline = _now() + BENCH_CONNECT_S;
+	while (!mqttIsConnected()) {
+		if (_now() >= deadline) {
+			fprintf(stderr, "Can't connect to %s\n", broker);
+			mqttExit();
+			free(payload);
+			return EXIT_FAILURE;
+		}
+		usleep(10000);
+	}
+
+	_publish_until(payload, _now() + BENCH_WARMUP_S);
+	mqttGetStats(&before);
+	start = _now();
+	_publish_until(payload, start + run_s);
+	mqttGetStats(&after);
+
+	printf("%8.0f  %12d  %10llu  %10llu\n", (after.acked - before.acked) / (_now() - start), after.inflight_max,
+			histogram_percentile(&after.ack_latency, 50), histogram_percentile(&after.ack_latency, 99));
+	fflush(stdout);
+
+	mqttExit();
+	free(payload);
+
+	return after.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
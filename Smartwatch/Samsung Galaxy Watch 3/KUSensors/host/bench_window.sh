@@ -0,0 +1,34 @@
+#!/bin/sh
+# Sweeps the publish window: runs the bench-window-N binaries against the
+# MQTT sink, first acknowledging at once, then holding the PUBACKs for
+# $ACK_DELAY ms as a remote broker would. Prints msgs/s per window.
+#
+# usage: bench_window.sh build-directory port window...
+
+OUT=$1
+PORT=${2:-18883}
+shift 2
+DELAYS="0 ${ACK_DELAY:-20}"
+SINK=
+
+rm -rf "$OUT/bench"
+mkdir -p "$OUT/bench"
+trap 'test -n "$SINK" && kill $SINK 2>/dev/null' EXIT
+
+for DELAY in $DELAYS; do
+	python3 "$(dirname "$0")/mqtt_sink.py" --port "$PORT" --ack-delay "$DELAY" > "$OUT/bench/sink-$DELAY.log" &
+	SINK=$!
+	sleep 1
+
+	echo "PUBACK delay $DELAY ms"
+	echo "window    msgs/s  inflight max  ack p50 us  ack p99 us"
+	for WINDOW in "$@"; do
+		printf "%6d  " "$WINDOW"
+		KUSENSORS_DATA_DIR="$OUT/bench/data-$DELAY-$WINDOW" "$OUT/bench-window-$WINDOW" -b "tcp://127.0.0.1:$PORT" \
+			2> "$OUT/bench/window-$DELAY-$WINDOW.log" || { echo "failed, see $OUT/bench/window-$DELAY-$WINDOW.log"; exit 1; }
+	done
+
+	kill -INT $SINK
+	wait $SINK
+	SINK=
+done
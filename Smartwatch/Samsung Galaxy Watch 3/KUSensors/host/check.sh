@@ -0,0 +1,52 @@
+#!/bin/sh
+# Runs the host build against the MQTT sink: a live capture recorded to a
+# trace, then the replay of the trace at max speed, then a live capture
+# while the sink is stopped and restarted. Fails when a run fails, when a
+# payload is not acknowledged, or when the payloads published while the
+# sink was down did not go through the spool and the reconnection.
+#
+# usage: check.sh binary port
+
+BIN=$1
+PORT=${2:-18883}
+OUT=$(dirname "$BIN")/check
+SINK=
+
+start_sink() {
+	python3 "$(dirname "$0")/mqtt_sink.py" --port "$PORT" --duration 60 --stats "$OUT/$1.json" > "$OUT/$1.log" &
+	SINK=$!
+	sleep 1
+}
+
+stop_sink() {
+	kill -INT $SINK
+	wait $SINK
+	SINK=
+}
+
+rm -rf "$OUT"
+mkdir -p "$OUT"
+trap 'test -n "$SINK" && kill $SINK 2>/dev/null' EXIT
+
+export KUSENSORS_DATA_DIR="$OUT/data"
+
+start_sink sink
+"$BIN" -b "tcp://127.0.0.1:$PORT" -t 5 -r "$OUT/trace.bin" || exit 1
+"$BIN" -b "tcp://127.0.0.1:$PORT" -p "$OUT/trace.bin" -s max || exit 1
+stop_sink
+cat "$OUT/sink.log"
+
+# the broker goes away for 4 s in the middle of a 14 s capture
+start_sink restart1
+"$BIN" -b "tcp://127.0.0.1:$PORT" -t 14 > "$OUT/restart.log" &
+HOST=$!
+sleep 4
+stop_sink
+sleep 4
+start_sink restart2
+wait $HOST || exit 1
+stop_sink
+cat "$OUT/restart.log"
+
+grep -q " [1-9][0-9]* spooled" "$OUT/restart.log" || { echo "nothing was spooled while the broker was down"; exit 1; }
+grep -q " [1-9][0-9]* reconnects" "$OUT/restart.log" || { echo "the publisher did not reconnect"; exit 1; }
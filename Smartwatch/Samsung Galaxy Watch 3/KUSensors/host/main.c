@@ -0,0 +1,246 @@
+/*
+ * main.c
+ *
+ * Host entry point of the capture pipeline. It runs what app_create() and
+ * app_terminate() run on the watch, without the views: the sensors of the
+ * shim go through the data module, the batches and the publisher to a real
+ * MQTT broker. A trace may be recorded from the live capture or replayed,
+ * the replay prints its report on stdout.
+ *
+ * usage: kusensors-host [-b broker] [-t seconds] [-r trace] [-p trace] [-s max|speed]
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <Ecore.h>
+#include <app_preference.h>
+#include <sensor.h>
+#include <sensors.h>
+#include "data.h"
+#include "view_defines.h"
+#include "mqtt.h"
+#include "replay.h"
+
+#define HOST_BROKER				"tcp://localhost:1883"
+#define HOST_RUN_S				10		// live capture when no trace is replayed
+#define HOST_CONNECT_TIMEOUT_S	10
+#define HOST_DRAIN_TIMEOUT_S	10		// wait for the PUBACKs of the last batches
+#define HOST_POLL_S				0.05
+
+enum host_state {
+	HOST_CONNECTING,
+	HOST_RUNNING,
+	HOST_DRAINING,
+};
+
+static struct host_info {
+	const char *broker;
+	const char *record_path;
+	const char *replay_path;
+	int speed;
+	int run_s;
+	enum host_state state;
+	double deadline;
+	int status;
+} s_info = {
+	.broker = HOST_BROKER,
+	.record_path = NULL,
+	.replay_path = NULL,
+	.speed = REPLAY_SPEED_REALTIME,
+	.run_s = HOST_RUN_S,
+	.state = HOST_CONNECTING,
+	.deadline = 0,
+	.status = EXIT_SUCCESS,
+};
+
+static void _usage(const char *name);
+static bool _host_create(void);
+static void _host_terminate(void);
+static Eina_Bool _poll_cb(void *data);
+static void _print_report(void);
+static void _update_sensor_values(int count, float *values);
+static void _signal_cb(int signo);
+
+int main(int argc, char *argv[])
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:t:r:p:s:h")) != -1) {
+		switch (opt) {
+		case 'b':
+			s_info.broker = optarg;
+			break;
+		case 't':
+			s_info.run_s = atoi(optarg);
+			break;
+		case 'r':
+			s_info.record_path = optarg;
+			break;
+		case 'p':
+			s_info.replay_path = optarg;
+			break;
+		case 's':
+			s_info.speed = strcmp(optarg, "max") == 0 ? REPLAY_SPEED_MAX : atoi(optarg);
+			break;
+		default:
+			_usage(argv[0]);
+			return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	/* the publisher takes the broker the discovery would have saved */
+	if (preference_set_string(MQTT_BROKER_KEY, s_info.broker) != PREFERENCE_ERROR_NONE) {
+		fprintf(stderr, "Can't save the broker %s\n", s_info.broker);
+		return EXIT_FAILURE;
+	}
+
+	signal(SIGINT, _signal_cb);
+	signal(SIGTERM, _signal_cb);
+
+	if (!_host_create())
+		return EXIT_FAILURE;
+
+	ecore_timer_add(HOST_POLL_S, _poll_cb, NULL);
+	s_info.deadline = ecore_time_get() + HOST_CONNECT_TIMEOUT_S;
+	ecore_main_loop_begin();
+
+	_host_terminate();
+
+	return s_info.status;
+}
+
+static void _usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-b broker] [-t seconds] [-r trace] [-p trace] [-s max|speed]\n"
+			"  -b  MQTT broker, %s by default\n"
+			"  -t  live capture duration, %d seconds by default\n"
+			"  -r  records the live capture to a trace\n"
+			"  -p  replays a trace instead of the live capture, then prints the report\n"
+			"  -s  replay speed, max or a multiple of the real time\n", name, HOST_BROKER, HOST_RUN_S);
+}
+
+/**
+ * @brief The pipeline of app_create(), without the views.
+ */
+static bool _host_create(void)
+{
+	int i;
+
+	data_initialize(_update_sensor_values, batch_add_records);
+
+	mqttInit();
+	batch_initialize(BATCH_MAX_SAMPLES, BATCH_MAX_AGE_MS, mqttPublishBatch);
+
+	for (i = 0; i < SENSOR_COUNT; ++i) {
+		if (data_get_sensor_support(i))
+			batch_set_quantum(i, data_get_sensor_resolution(i));
+	}
+
+	if (s_info.record_path && !replay_record_start(s_info.record_path)) {
+		fprintf(stderr, "Can't record to %s\n", s_info.record_path);
+		s_info.status = EXIT_FAILURE;
+	}
+
+	return true;
+}
+
+/**
+ * @brief The teardown of app_terminate(), without the views.
+ */
+static void _host_terminate(void)
+{
+	replay_stop();
+	replay_record_stop();
+	data_flush();
+	batch_finalize();
+	mqttExit();
+	data_finalize();
+}
+
+/**
+ * @brief Waits for the broker, then runs the live capture or the replay, then waits for the
+ * PUBACKs of what was published.
+ */
+static Eina_Bool _poll_cb(void *data)
+{
+	double now = ecore_time_get();
+	mqtt_stats_t stats;
+
+	switch (s_info.state) {
+	case HOST_CONNECTING:
+		if (mqttIsConnected()) {
+			if (s_info.replay_path && !replay_start(s_info.replay_path, s_info.speed)) {
+				fprintf(stderr, "Can't replay %s\n", s_info.replay_path);
+				s_info.status = EXIT_FAILURE;
+				ecore_main_loop_quit();
+				return ECORE_CALLBACK_CANCEL;
+			}
+			s_info.state = HOST_RUNNING;
+			s_info.deadline = now + s_info.run_s;
+		} else if (now >= s_info.deadline) {
+			fprintf(stderr, "Can't connect to %s\n", s_info.broker);
+			s_info.status = EXIT_FAILURE;
+			ecore_main_loop_quit();
+			return ECORE_CALLBACK_CANCEL;
+		}
+		break;
+	case HOST_RUNNING:
+		if (s_info.replay_path ? replay_is_running() : now < s_info.deadline)
+			break;
+		/* what app_pause() hands to the publisher */
+		data_flush();
+		batch_flush();
+		s_info.state = HOST_DRAINING;
+		s_info.deadline = now + HOST_DRAIN_TIMEOUT_S;
+		break;
+	case HOST_DRAINING:
+		mqttGetStats(&stats);
+		if (stats.acked + stats.failed < stats.enqueued && now < s_info.deadline)
+			break;
+		if (stats.acked < stats.enqueued)
+			s_info.status = EXIT_FAILURE;
+		_print_report();
+		ecore_main_loop_quit();
+		return ECORE_CALLBACK_CANCEL;
+	}
+
+	return ECORE_CALLBACK_RENEW;
+}
+
+static void _print_report(void)
+{
+	sensor_shim_stats_t shim;
+	replay_report_t report;
+	mqtt_stats_t stats;
+
+	mqttGetStats(&stats);
+	sensor_shim_get_stats(&shim);
+
+	if (s_info.replay_path) {
+		replay_get_report(&report);
+		printf("replay: %llu samples in %.3f s, %.0f samples/s, %.2f us CPU/sample\n",
+				report.samples, report.elapsed_s, report.samples_per_s, report.cpu_us_per_sample);
+		printf("replay: batch to PUBACK p50 %llu us, p90 %llu us, p99 %llu us, max %llu us\n",
+				report.latency_p50_us, report.latency_p90_us, report.latency_p99_us, report.latency_max_us);
+	} else {
+		printf("sensors: %llu events, %llu deliveries, %llu dropped\n", shim.events, shim.deliveries, shim.dropped);
+	}
+
+	printf("mqtt: %llu enqueued, %llu sent, %llu acked, %llu failed, %llu spooled, %llu reconnects\n",
+			stats.enqueued, stats.sent, stats.acked, stats.failed, stats.spooled, stats.reconnects);
+	fflush(stdout);
+}
+
+static void _update_sensor_values(int count, float *values)
+{
+	/* no data view on the host */
+}
+
+static void _signal_cb(int signo)
+{
+	s_info.status = EXIT_FAILURE;
+	ecore_main_loop_quit();
+}
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""Minimal MQTT 3.1.1 broker for the host build and its tests.
+
+Accepts any client, acknowledges CONNECT, SUBSCRIBE, PINGREQ and the QoS 1
+PUBLISH packets, and counts the messages and bytes received per topic. No
+message is routed to the subscribers. With --ack-delay, the PUBACKs are held
+for that many milliseconds, as the link of a watch to a remote broker would.
+The counters are printed on stdout when the sink stops (SIGINT, SIGTERM or
+--duration) and, with --stats, as JSON to a file.
+
+usage: mqtt_sink.py [--port 1883] [--duration seconds] [--ack-delay ms] [--stats file]
+"""
+
+import argparse
+import heapq
+import itertools
+import json
+import selectors
+import signal
+import socket
+import sys
+import time
+
+CONNECT, CONNACK, PUBLISH, PUBACK = 1, 2, 3, 4
+SUBSCRIBE, SUBACK, PINGREQ, PINGRESP, DISCONNECT = 8, 9, 12, 13, 14
+
+
+def _remaining_length(value):
+    out = bytearray()
+    while True:
+        byte = value % 128
+        value //= 128
+        out.append(byte | 0x80 if value else byte)
+        if not value:
+            return bytes(out)
+
+
+def _packet(kind, flags, body):
+    return bytes([kind << 4 | flags]) + _remaining_length(len(body)) + body
+
+
+class Client:
+    def __init__(self, sock):
+        self.sock = sock
+        self.buf = bytearray()
+        self.closed = False
+
+    def packets(self):
+        """Yields the complete packets of the buffer as (type, flags, body)."""
+        while len(self.buf) >= 2:
+            length, multiplier, pos = 0, 1, 1
+            while True:
+                if pos >= len(self.buf):
+                    return
+                byte = self.buf[pos]
+                length += (byte & 0x7F) * multiplier
+                multiplier *= 128
+                pos += 1
+                if not byte & 0x80:
+                    break
+            if len(self.buf) < pos + length:
+                return
+            header = self.buf[0]
+            body = bytes(self.buf[pos:pos + length])
+            del self.buf[:pos + length]
+            yield header >> 4, header & 0x0F, body
+
+
+class Sink:
+    def __init__(self, port, ack_delay=0):
+        self.selector = selectors.DefaultSelector()
+        self.server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.server.bind(("127.0.0.1", port))
+        self.server.listen(16)
+        self.server.setblocking(False)
+        self.selector.register(self.server, selectors.EVENT_READ)
+        self.running = True
+        self.connects = 0
+        self.topics = {}
+        self.ack_delay = ack_delay
+        self.acks = []  # heap of the held PUBACKs: (due, sequence, client, packet)
+        self.sequence = itertools.count()
+
+    def run(self, duration):
+        deadline = time.monotonic() + duration if duration else None
+        while self.running and (deadline is None or time.monotonic() < deadline):
+            timeout = 0.2
+            if self.acks:
+                timeout = min(timeout, max(0, self.acks[0][0] - time.monotonic()))
+            for key, _ in self.selector.select(timeout=timeout):
+                if key.fileobj is self.server:
+                    sock, _ = self.server.accept()
+                    sock.setblocking(False)
+                    # no Nagle delay on the PUBACKs, written a few bytes at a time
+                    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                    self.selector.register(sock, selectors.EVENT_READ, Client(sock))
+                else:
+                    self._read(key.data)
+            self._send_acks()
+
+    def _send_acks(self):
+        now = time.monotonic()
+        while self.acks and self.acks[0][0] <= now:
+            _, _, client, packet = heapq.heappop(self.acks)
+            if not client.closed:
+                self._send(client, packet)
+
+    def _send(self, client, packet):
+        try:
+            client.sock.sendall(packet)
+        except (ConnectionError, BlockingIOError):
+            self._close(client)
+
+    def _read(self, client):
+        try:
+            data = client.sock.recv(65536)
+        except (ConnectionError, BlockingIOError):
+            data = b""
+        if not data:
+            self._close(client)
+            return
+        client.buf += data
+        for kind, flags, body in client.packets():
+            reply = self._handle(kind, flags, body)
+            if reply is False:
+                self._close(client)
+                return
+            if reply and kind == PUBLISH and self.ack_delay:
+                heapq.heappush(self.acks, (time.monotonic() + self.ack_delay, next(self.sequence), client, reply))
+            elif reply:
+                self._send(client, reply)
+            if client.closed:
+                return
+
+    def _handle(self, kind, flags, body):
+        if kind == CONNECT:
+            self.connects += 1
+            return _packet(CONNACK, 0, b"\x00\x00")
+        if kind == PUBLISH:
+            qos = (flags >> 1) & 3
+            topic_len = int.from_bytes(body[0:2], "big")
+            topic = body[2:2 + topic_len].decode("utf-8", "replace")
+            pos = 2 + topic_len
+            packet_id = body[pos:pos + 2] if qos else b""
+            payload = body[pos + len(packet_id):]
+            count, size = self.topics.get(topic, (0, 0))
+            self.topics[topic] = (count + 1, size + len(payload))
+            if qos == 1:
+                return _packet(PUBACK, 0, packet_id)
+            return None
+        if kind == SUBSCRIBE:
+            granted = bytes(min(qos, 1) for qos in self._requested_qos(body[2:]))
+            return _packet(SUBACK, 0, body[0:2] + granted)
+        if kind == PINGREQ:
+            return _packet(PINGRESP, 0, b"")
+        if kind == DISCONNECT:
+            return False
+        return None
+
+    @staticmethod
+    def _requested_qos(filters):
+        """Requested QoS of every topic filter of a SUBSCRIBE payload."""
+        pos = 0
+        while pos + 2 < len(filters):
+            pos += 2 + int.from_bytes(filters[pos:pos + 2], "big")
+            yield filters[pos]
+            pos += 1
+
+    def _close(self, client):
+        if client.closed:
+            return
+        client.closed = True
+        self.selector.unregister(client.sock)
+        client.sock.close()
+
+    def report(self):
+        return {
+            "connects": self.connects,
+            "topics": {t: {"messages": c, "bytes": b} for t, (c, b) in self.topics.items()},
+        }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--duration", type=float, default=0)
+    parser.add_argument("--ack-delay", type=float, default=0, help="milliseconds")
+    parser.add_argument("--stats")
+    args = parser.parse_args()
+
+    sink = Sink(args.port, args.ack_delay / 1000)
+
+    def stop(signo, frame):
+        sink.running = False
+
+    signal.signal(signal.SIGINT, stop)
+    signal.signal(signal.SIGTERM, stop)
+    sink.run(args.duration)
+
+    report = sink.report()
+    for topic, counters in sorted(report["topics"].items()):
+        print("%s: %d messages, %d bytes" % (topic, counters["messages"], counters["bytes"]))
+    if args.stats:
+        with open(args.stats, "w") as out:
+            json.dump(report, out)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,37 @@
+/*
+ * Ecore.h
+ *
+ * Host stub of the Ecore main loop: timers and idlers, run by
+ * ecore_main_loop_begin() in the calling thread. Like Ecore, none of these
+ * functions may be called from another thread.
+ */
+
+#ifndef HOST_ECORE_H_
+#define HOST_ECORE_H_
+
+#include <Eina.h>
+
+#define ECORE_CALLBACK_CANCEL	EINA_FALSE
+#define ECORE_CALLBACK_RENEW	EINA_TRUE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _Ecore_Timer Ecore_Timer;
+typedef struct _Ecore_Idler Ecore_Idler;
+typedef Eina_Bool (*Ecore_Task_Cb)(void *data);
+
+Ecore_Timer *ecore_timer_add(double in, Ecore_Task_Cb func, const void *data);
+void *ecore_timer_del(Ecore_Timer *timer);
+Ecore_Idler *ecore_idler_add(Ecore_Task_Cb func, const void *data);
+void *ecore_idler_del(Ecore_Idler *idler);
+void ecore_main_loop_begin(void);
+void ecore_main_loop_quit(void);
+double ecore_time_get(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_ECORE_H_ */
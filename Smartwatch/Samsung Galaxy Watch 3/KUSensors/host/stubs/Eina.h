@@ -0,0 +1,15 @@
+/*
+ * Eina.h
+ *
+ * Host stub of the Eina types used by the capture pipeline.
+ */
+
+#ifndef HOST_EINA_H_
+#define HOST_EINA_H_
+
+typedef unsigned char Eina_Bool;
+
+#define EINA_TRUE	((Eina_Bool)1)
+#define EINA_FALSE	((Eina_Bool)0)
+
+#endif /* HOST_EINA_H_ */
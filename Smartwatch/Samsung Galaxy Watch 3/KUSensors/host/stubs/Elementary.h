@@ -0,0 +1,17 @@
+/*
+ * Elementary.h
+ *
+ * Host stub of Elementary. The host build leaves the views out, the capture
+ * pipeline only needs the types of their prototypes.
+ */
+
+#ifndef HOST_ELEMENTARY_H_
+#define HOST_ELEMENTARY_H_
+
+#include <stdbool.h>
+#include <Eina.h>
+#include <Ecore.h>
+
+typedef struct _Evas_Object Evas_Object;
+
+#endif /* HOST_ELEMENTARY_H_ */
@@ -0,0 +1,22 @@
+/*
+ * app.h
+ *
+ * Host stub of the application framework calls used by the capture pipeline.
+ */
+
+#ifndef HOST_APP_H_
+#define HOST_APP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* $KUSENSORS_DATA_DIR, or ./data/ by default, created if needed */
+char *app_get_data_path(void);
+const char *get_error_message(int err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_APP_H_ */
@@ -0,0 +1,29 @@
+/*
+ * app_preference.h
+ *
+ * Host stub of the preference store. The preferences are kept in the file
+ * "preference" of the data directory, so they survive a restart like on the
+ * watch.
+ */
+
+#ifndef HOST_APP_PREFERENCE_H_
+#define HOST_APP_PREFERENCE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PREFERENCE_ERROR_NONE				0
+#define PREFERENCE_ERROR_INVALID_PARAMETER	-22
+#define PREFERENCE_ERROR_OUT_OF_MEMORY		-12
+#define PREFERENCE_ERROR_NO_KEY				-2
+#define PREFERENCE_ERROR_IO_ERROR			-5
+
+int preference_set_string(const char *key, const char *value);
+int preference_get_string(const char *key, char **value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_APP_PREFERENCE_H_ */
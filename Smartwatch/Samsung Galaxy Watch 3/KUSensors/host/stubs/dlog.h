@@ -0,0 +1,33 @@
+/*
+ * dlog.h
+ *
+ * Host stub of dlog, the messages go to stderr. $KUSENSORS_LOG sets the
+ * lowest priority printed: debug, info (default), warn or error.
+ */
+
+#ifndef HOST_DLOG_H_
+#define HOST_DLOG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	DLOG_UNKNOWN = 0,
+	DLOG_DEFAULT,
+	DLOG_VERBOSE,
+	DLOG_DEBUG,
+	DLOG_INFO,
+	DLOG_WARN,
+	DLOG_ERROR,
+	DLOG_FATAL,
+	DLOG_SILENT,
+} log_priority;
+
+int dlog_print(log_priority prio, const char *tag, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_DLOG_H_ */
@@ -0,0 +1,223 @@
+/*
+ * ecore.c
+ *
+ * Host stub of the Ecore main loop. The timers and idlers live in two lists,
+ * the loop runs the due timers, then the idlers, and sleeps until the next
+ * timer when no idler is left. A callback may add or delete any timer or
+ * idler, the deleted ones are released once the pass is over.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <Ecore.h>
+
+struct _Ecore_Timer {
+	double interval;
+	double due;
+	Ecore_Task_Cb func;
+	void *data;
+	bool deleted;
+	Ecore_Timer *next;
+};
+
+struct _Ecore_Idler {
+	Ecore_Task_Cb func;
+	void *data;
+	bool deleted;
+	Ecore_Idler *next;
+};
+
+static struct ecore_info {
+	Ecore_Timer *timers;
+	Ecore_Idler *idlers;
+	volatile bool quit;
+} s_info = {
+	.timers = NULL,
+	.idlers = NULL,
+	.quit = false,
+};
+
+static void _run_timers(double now);
+static void _run_idlers(void);
+static void _sweep(void);
+static double _next_due(void);
+
+Ecore_Timer *ecore_timer_add(double in, Ecore_Task_Cb func, const void *data)
+{
+	Ecore_Timer *timer;
+
+	if (!func)
+		return NULL;
+
+	timer = calloc(1, sizeof(*timer));
+	if (!timer)
+		return NULL;
+
+	timer->interval = in > 0 ? in : 0;
+	timer->due = ecore_time_get() + timer->interval;
+	timer->func = func;
+	timer->data = (void *)data;
+	timer->next = s_info.timers;
+	s_info.timers = timer;
+
+	return timer;
+}
+
+void *ecore_timer_del(Ecore_Timer *timer)
+{
+	if (!timer || timer->deleted)
+		return NULL;
+
+	timer->deleted = true;
+	return timer->data;
+}
+
+Ecore_Idler *ecore_idler_add(Ecore_Task_Cb func, const void *data)
+{
+	Ecore_Idler *idler;
+
+	if (!func)
+		return NULL;
+
+	idler = calloc(1, sizeof(*idler));
+	if (!idler)
+		return NULL;
+
+	idler->func = func;
+	idler->data = (void *)data;
+	idler->next = s_info.idlers;
+	s_info.idlers = idler;
+
+	return idler;
+}
+
+void *ecore_idler_del(Ecore_Idler *idler)
+{
+	if (!idler || idler->deleted)
+		return NULL;
+
+	idler->deleted = true;
+	return idler->data;
+}
+
+/**
+ * @brief Runs the loop until ecore_main_loop_quit() is called. A signal interrupts the sleep,
+ * so a handler calling ecore_main_loop_quit() stops the loop right away.
+ */
+void ecore_main_loop_begin(void)
+{
+	struct timespec ts;
+	double wait;
+
+	s_info.quit = false;
+
+	while (!s_info.quit) {
+		_run_timers(ecore_time_get());
+		if (!s_info.quit)
+			_run_idlers();
+		_sweep();
+
+		if (s_info.quit || s_info.idlers)
+			continue;
+
+		wait = _next_due() - ecore_time_get();
+		if (wait <= 0)
+			continue;
+
+		/* nothing to do before the next timer, or for a second without timers */
+		ts.tv_sec = (time_t)wait;
+		ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+		nanosleep(&ts, NULL);
+	}
+}
+
+void ecore_main_loop_quit(void)
+{
+	s_info.quit = true;
+}
+
+double ecore_time_get(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Runs the timers due at the given time. The timers added meanwhile are at the head of
+ * the list, before the ones of this pass, so they wait for the next one.
+ */
+static void _run_timers(double now)
+{
+	Ecore_Timer *timer;
+
+	for (timer = s_info.timers; timer; timer = timer->next) {
+		if (timer->deleted || timer->due > now)
+			continue;
+
+		if (timer->func(timer->data) == ECORE_CALLBACK_CANCEL) {
+			timer->deleted = true;
+			continue;
+		}
+
+		/* keep the period, unless the loop fell a whole period behind */
+		timer->due += timer->interval;
+		if (timer->due <= now)
+			timer->due = now + timer->interval;
+	}
+}
+
+static void _run_idlers(void)
+{
+	Ecore_Idler *idler;
+
+	for (idler = s_info.idlers; idler && !s_info.quit; idler = idler->next) {
+		if (!idler->deleted && idler->func(idler->data) == ECORE_CALLBACK_CANCEL)
+			idler->deleted = true;
+	}
+}
+
+/**
+ * @brief Releases the deleted timers and idlers.
+ */
+static void _sweep(void)
+{
+	Ecore_Timer **timer = &s_info.timers;
+	Ecore_Idler **idler = &s_info.idlers;
+	void *dead;
+
+	while (*timer) {
+		if ((*timer)->deleted) {
+			dead = *timer;
+			*timer = (*timer)->next;
+			free(dead);
+		} else {
+			timer = &(*timer)->next;
+		}
+	}
+
+	while (*idler) {
+		if ((*idler)->deleted) {
+			dead = *idler;
+			*idler = (*idler)->next;
+			free(dead);
+		} else {
+			idler = &(*idler)->next;
+		}
+	}
+}
+
+static double _next_due(void)
+{
+	double next = ecore_time_get() + 1.0;
+	Ecore_Timer *timer;
+
+	for (timer = s_info.timers; timer; timer = timer->next) {
+		if (!timer->deleted && timer->due < next)
+			next = timer->due;
+	}
+
+	return next;
+}
@@ -0,0 +1,14 @@
+/*
+ * efl_extension.h
+ *
+ * Host stub of the EFL extension types used by the view prototypes.
+ */
+
+#ifndef HOST_EFL_EXTENSION_H_
+#define HOST_EFL_EXTENSION_H_
+
+#include <Elementary.h>
+
+typedef void (*Eext_Event_Cb)(void *data, Evas_Object *obj, void *event_info);
+
+#endif /* HOST_EFL_EXTENSION_H_ */
@@ -0,0 +1,313 @@
+/*
+ * platform.c
+ *
+ * Host stubs of dlog, the application data path, the preference store and
+ * the system information.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <app.h>
+#include <app_preference.h>
+#include <dlog.h>
+#include <sensor.h>
+#include <system_info.h>
+
+#define PREFERENCE_FILE		"preference"
+#define PREFERENCE_MAX		64		// keys of the store
+#define PREFERENCE_LINE_MAX	1024
+
+typedef struct preference {
+	char *key;
+	char *value;
+} preference_t;
+
+static struct platform_info {
+	pthread_mutex_t lock;
+	bool loaded;
+	int log_priority;
+	preference_t preferences[PREFERENCE_MAX];
+	int preference_count;
+} s_info = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.loaded = false,
+	.log_priority = DLOG_UNKNOWN,
+	.preference_count = 0,
+};
+
+static void _preference_load(void);
+static int _preference_save(void);
+static preference_t *_preference_find(const char *key);
+
+int dlog_print(log_priority prio, const char *tag, const char *fmt, ...)
+{
+	static const char letters[] = "??VDIWEFS";
+	const char *level;
+	char line[1024];
+	va_list ap;
+
+	if (s_info.log_priority == DLOG_UNKNOWN) {
+		level = getenv("KUSENSORS_LOG");
+		if (level && strcasecmp(level, "debug") == 0)
+			s_info.log_priority = DLOG_DEBUG;
+		else if (level && strcasecmp(level, "warn") == 0)
+			s_info.log_priority = DLOG_WARN;
+		else if (level && strcasecmp(level, "error") == 0)
+			s_info.log_priority = DLOG_ERROR;
+		else
+			s_info.log_priority = DLOG_INFO;
+	}
+
+	if ((int)prio < s_info.log_priority)
+		return 0;
+
+	/* one write per message, the sender thread logs too */
+	va_start(ap, fmt);
+	vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+
+	return fprintf(stderr, "%c/%s: %s\n", prio < DLOG_SILENT ? letters[prio] : '?', tag, line);
+}
+
+/**
+ * @brief The data directory, with the trailing slash of the Tizen one.
+ * @return A path to be released by the caller, or NULL on error.
+ */
+char *app_get_data_path(void)
+{
+	const char *dir = getenv("KUSENSORS_DATA_DIR");
+	size_t len;
+	char *path;
+
+	if (!dir || !*dir)
+		dir = "data";
+
+	len = strlen(dir);
+	path = malloc(len + 2);
+	if (!path)
+		return NULL;
+
+	memcpy(path, dir, len);
+	if (path[len - 1] != '/')
+		path[len++] = '/';
+	path[len] = '\0';
+
+	if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+		free(path);
+		return NULL;
+	}
+
+	return path;
+}
+
+const char *get_error_message(int err)
+{
+	static __thread char unknown[32];
+
+	switch (err) {
+	case SENSOR_ERROR_NONE:
+		return "Successful";
+	case SENSOR_ERROR_INVALID_PARAMETER:
+		return "Invalid parameter";
+	case SENSOR_ERROR_OUT_OF_MEMORY:
+		return "Out of memory";
+	case SENSOR_ERROR_IO_ERROR:
+		return "I/O error";
+	case SENSOR_ERROR_NOT_SUPPORTED:
+		return "Not supported";
+	case SENSOR_ERROR_OPERATION_FAILED:
+		return "Operation failed";
+	default:
+		snprintf(unknown, sizeof(unknown), "Unknown error %d", err);
+		return unknown;
+	}
+}
+
+int preference_set_string(const char *key, const char *value)
+{
+	preference_t *preference;
+	char *copy;
+	int ret;
+
+	if (!key || !value || strchr(key, '=') || strchr(key, '\n') || strchr(value, '\n'))
+		return PREFERENCE_ERROR_INVALID_PARAMETER;
+
+	pthread_mutex_lock(&s_info.lock);
+	_preference_load();
+
+	preference = _preference_find(key);
+	if (!preference && s_info.preference_count < PREFERENCE_MAX) {
+		preference = &s_info.preferences[s_info.preference_count];
+		preference->key = strdup(key);
+		preference->value = NULL;
+		if (preference->key)
+			s_info.preference_count++;
+		else
+			preference = NULL;
+	}
+
+	copy = preference ? strdup(value) : NULL;
+	if (!copy) {
+		pthread_mutex_unlock(&s_info.lock);
+		return PREFERENCE_ERROR_OUT_OF_MEMORY;
+	}
+
+	free(preference->value);
+	preference->value = copy;
+	ret = _preference_save();
+
+	pthread_mutex_unlock(&s_info.lock);
+
+	return ret;
+}
+
+int preference_get_string(const char *key, char **value)
+{
+	preference_t *preference;
+
+	if (!key || !value)
+		return PREFERENCE_ERROR_INVALID_PARAMETER;
+
+	pthread_mutex_lock(&s_info.lock);
+	_preference_load();
+
+	preference = _preference_find(key);
+	*value = preference ? strdup(preference->value) : NULL;
+
+	pthread_mutex_unlock(&s_info.lock);
+
+	if (!preference)
+		return PREFERENCE_ERROR_NO_KEY;
+
+	return *value ? PREFERENCE_ERROR_NONE : PREFERENCE_ERROR_OUT_OF_MEMORY;
+}
+
+int system_info_get_platform_string(const char *key, char **value)
+{
+	const char *id = getenv("KUSENSORS_TIZEN_ID");
+	char host[256];
+
+	if (!key || !value || strcmp(key, "http://tizen.org/system/tizenid") != 0)
+		return SYSTEM_INFO_ERROR_INVALID_PARAMETER;
+
+	if (!id || !*id) {
+		if (gethostname(host, sizeof(host)) != 0)
+			snprintf(host, sizeof(host), "localhost");
+		host[sizeof(host) - 1] = '\0';
+		id = host;
+	}
+
+	*value = strdup(id);
+
+	return *value ? SYSTEM_INFO_ERROR_NONE : SYSTEM_INFO_ERROR_OUT_OF_MEMORY;
+}
+
+/**
+ * @brief Reads the preference file of the data directory, one key=value per line.
+ * Notice: Caller MUST hold the lock.
+ */
+static void _preference_load(void)
+{
+	char line[PREFERENCE_LINE_MAX];
+	preference_t *preference;
+	char *path;
+	char *value;
+	FILE *file;
+
+	if (s_info.loaded)
+		return;
+	s_info.loaded = true;
+
+	path = app_get_data_path();
+	if (!path)
+		return;
+
+	if (asprintf(&value, "%s%s", path, PREFERENCE_FILE) < 0)
+		value = NULL;
+	free(path);
+	file = value ? fopen(value, "r") : NULL;
+	free(value);
+	if (!file)
+		return;
+
+	while (s_info.preference_count < PREFERENCE_MAX && fgets(line, sizeof(line), file)) {
+		line[strcspn(line, "\n")] = '\0';
+		value = strchr(line, '=');
+		if (!value)
+			continue;
+		*value++ = '\0';
+
+		preference = &s_info.preferences[s_info.preference_count];
+		preference->key = strdup(line);
+		preference->value = strdup(value);
+		if (preference->key && preference->value) {
+			s_info.preference_count++;
+		} else {
+			free(preference->key);
+			free(preference->value);
+		}
+	}
+
+	fclose(file);
+}
+
+/**
+ * @brief Rewrites the preference file, through a temporary file so that a crash keeps the previous one.
+ * Notice: Caller MUST hold the lock.
+ */
+static int _preference_save(void)
+{
+	char *dir = app_get_data_path();
+	char *path = NULL;
+	char *tmp = NULL;
+	FILE *file = NULL;
+	int ret = PREFERENCE_ERROR_IO_ERROR;
+	int i;
+
+	if (!dir)
+		return ret;
+
+	if (asprintf(&path, "%s%s", dir, PREFERENCE_FILE) < 0)
+		path = NULL;
+	if (!path || asprintf(&tmp, "%s.tmp", path) < 0)
+		tmp = NULL;
+	if (tmp)
+		file = fopen(tmp, "w");
+
+	if (file) {
+		for (i = 0; i < s_info.preference_count; ++i)
+			fprintf(file, "%s=%s\n", s_info.preferences[i].key, s_info.preferences[i].value);
+		if (fclose(file) == 0 && rename(tmp, path) == 0)
+			ret = PREFERENCE_ERROR_NONE;
+	}
+
+	free(tmp);
+	free(path);
+	free(dir);
+
+	return ret;
+}
+
+/**
+ * Notice: Caller MUST hold the lock.
+ */
+static preference_t *_preference_find(const char *key)
+{
+	int i;
+
+	for (i = 0; i < s_info.preference_count; ++i) {
+		if (strcmp(s_info.preferences[i].key, key) == 0)
+			return &s_info.preferences[i];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,442 @@
+/*
+ * sensor.c
+ *
+ * Host shim of the Tizen sensor API. Each listener runs an Ecore timer with a
+ * period of its interval, or of its max batch latency when the sensor has a
+ * FIFO, and generates the samples due since the previous tick from a
+ * synthetic signal: a wrist walking at 1.8 steps per second, a slow drift of
+ * the slow sensors and a heart beating around 70 bpm with some variability.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <Ecore.h>
+#include <sensor.h>
+
+#define SHIM_QUEUE_MAX	256		// events per tick without a FIFO, the oldest are dropped beyond
+#define SHIM_GRAVITY	9.81f
+#define SHIM_STEP_HZ	1.8
+#define SHIM_RR_MS		857.0	// 70 bpm
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+struct sensor_shim {
+	sensor_type_e type;
+	float min_range;
+	float max_range;
+	float resolution;
+	unsigned int min_interval_ms;
+	int fifo_count;				/* 0 without a hardware FIFO */
+};
+
+struct sensor_listener_shim {
+	struct sensor_shim *sensor;
+	sensor_event_cb event_cb;
+	sensor_events_cb events_cb;
+	void *data;
+	unsigned int interval_ms;
+	unsigned int max_batch_latency_ms;
+	bool started;
+	Ecore_Timer *timer;
+	unsigned long long next_us;	/* timestamp of the next sample */
+	unsigned long long beat_us;	/* next heart beat */
+	unsigned int beats;
+	float rr_ms;				/* last peak-to-peak interval */
+	float heart_rate;			/* averaged rate reported by the sensor */
+	sensor_event_s *queue;
+	int queue_size;
+};
+
+static struct sensor_shim s_sensors[SENSOR_LAST] = {
+	/* type, min, max, resolution, min interval, FIFO */
+	{ SENSOR_ACCELEROMETER, -78.4532f, 78.4532f, 0.0023946f, 10, 448 },
+	{ SENSOR_GRAVITY, -19.6133f, 19.6133f, 0.0023946f, 10, 448 },
+	{ SENSOR_LINEAR_ACCELERATION, -78.4532f, 78.4532f, 0.0023946f, 10, 448 },
+	{ SENSOR_MAGNETIC, -4912.0f, 4912.0f, 0.15f, 20, 448 },
+	{ SENSOR_ROTATION_VECTOR, -1.0f, 1.0f, 0.000001f, 10, 0 },
+	{ SENSOR_ORIENTATION, -180.0f, 360.0f, 0.01f, 10, 0 },
+	{ SENSOR_GYROSCOPE, -573.0f, 573.0f, 0.0175f, 10, 448 },
+	{ SENSOR_LIGHT, 0.0f, 60000.0f, 1.0f, 100, 0 },
+	{ SENSOR_PROXIMITY, 0.0f, 5.0f, 5.0f, 100, 0 },
+	{ SENSOR_PRESSURE, 260.0f, 1260.0f, 0.01f, 40, 448 },
+	{ SENSOR_ULTRAVIOLET, 0.0f, 15.0f, 0.01f, 100, 0 },
+	{ SENSOR_TEMPERATURE, -40.0f, 85.0f, 0.01f, 100, 0 },
+	{ SENSOR_HUMIDITY, 0.0f, 100.0f, 0.01f, 100, 0 },
+	{ SENSOR_HRM, 0.0f, 220.0f, 1.0f, 20, 0 },
+};
+
+static sensor_shim_stats_t s_stats;
+
+static Eina_Bool _listener_tick(void *data);
+static void _listener_schedule(struct sensor_listener_shim *listener);
+static void _sample(struct sensor_listener_shim *listener, unsigned long long timestamp_us, sensor_event_s *event);
+static unsigned long long _now_us(void);
+
+int sensor_is_supported(sensor_type_e type, bool *supported)
+{
+	if (!supported || type <= SENSOR_ALL || type >= SENSOR_LAST)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	*supported = true;
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_get_default_sensor(sensor_type_e type, sensor_h *sensor)
+{
+	if (!sensor || type <= SENSOR_ALL || type >= SENSOR_LAST)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	*sensor = &s_sensors[type];
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_get_min_range(sensor_h sensor, float *min_range)
+{
+	if (!sensor || !min_range)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	*min_range = sensor->min_range;
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_get_max_range(sensor_h sensor, float *max_range)
+{
+	if (!sensor || !max_range)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	*max_range = sensor->max_range;
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_get_resolution(sensor_h sensor, float *resolution)
+{
+	if (!sensor || !resolution)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	*resolution = sensor->resolution;
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_get_vendor(sensor_h sensor, char **vendor)
+{
+	if (!sensor || !vendor)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	*vendor = strdup("KUSensors host shim");
+	return *vendor ? SENSOR_ERROR_NONE : SENSOR_ERROR_OUT_OF_MEMORY;
+}
+
+int sensor_get_fifo_count(sensor_h sensor, int *fifo_count)
+{
+	if (!sensor || !fifo_count)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	*fifo_count = sensor->fifo_count;
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_create_listener(sensor_h sensor, sensor_listener_h *listener)
+{
+	struct sensor_listener_shim *created;
+
+	if (!sensor || !listener)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	created = calloc(1, sizeof(*created));
+	if (!created)
+		return SENSOR_ERROR_OUT_OF_MEMORY;
+
+	/* sized once, the callback may change the latency while it holds the events */
+	created->queue_size = sensor->fifo_count > SHIM_QUEUE_MAX ? sensor->fifo_count : SHIM_QUEUE_MAX;
+	created->queue = calloc(created->queue_size, sizeof(sensor_event_s));
+	if (!created->queue) {
+		free(created);
+		return SENSOR_ERROR_OUT_OF_MEMORY;
+	}
+
+	created->sensor = sensor;
+	created->interval_ms = 100;
+	created->rr_ms = SHIM_RR_MS;
+	created->heart_rate = 60000.0f / SHIM_RR_MS;
+
+	*listener = created;
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_destroy_listener(sensor_listener_h listener)
+{
+	if (!listener)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	sensor_listener_stop(listener);
+	free(listener->queue);
+	free(listener);
+
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_listener_set_event_cb(sensor_listener_h listener, unsigned int interval_ms, sensor_event_cb callback, void *data)
+{
+	if (!listener || !callback)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	listener->event_cb = callback;
+	listener->events_cb = NULL;
+	listener->data = data;
+
+	return sensor_listener_set_interval(listener, interval_ms);
+}
+
+int sensor_listener_set_events_cb(sensor_listener_h listener, sensor_events_cb callback, void *data)
+{
+	if (!listener || !callback)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	listener->events_cb = callback;
+	listener->event_cb = NULL;
+	listener->data = data;
+
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_listener_set_interval(sensor_listener_h listener, unsigned int interval_ms)
+{
+	if (!listener)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	listener->interval_ms = interval_ms > listener->sensor->min_interval_ms ? interval_ms : listener->sensor->min_interval_ms;
+	if (listener->started)
+		_listener_schedule(listener);
+
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_listener_set_max_batch_latency(sensor_listener_h listener, unsigned int max_batch_latency)
+{
+	if (!listener)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	if (max_batch_latency > 0 && !listener->sensor->fifo_count)
+		return SENSOR_ERROR_NOT_SUPPORTED;
+
+	listener->max_batch_latency_ms = max_batch_latency;
+	if (listener->started)
+		_listener_schedule(listener);
+
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_listener_set_option(sensor_listener_h listener, sensor_option_e option)
+{
+	if (!listener || option < SENSOR_OPTION_DEFAULT || option > SENSOR_OPTION_ALWAYS_ON)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_listener_start(sensor_listener_h listener)
+{
+	unsigned long long now_us;
+
+	if (!listener)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	if (listener->started)
+		return SENSOR_ERROR_NONE;
+
+	now_us = _now_us();
+	listener->next_us = now_us + listener->interval_ms * 1000ULL;
+	if (!listener->beat_us)
+		listener->beat_us = now_us + (unsigned long long)(listener->rr_ms * 1000.0f);
+	listener->started = true;
+	_listener_schedule(listener);
+
+	return listener->timer ? SENSOR_ERROR_NONE : SENSOR_ERROR_OPERATION_FAILED;
+}
+
+int sensor_listener_stop(sensor_listener_h listener)
+{
+	if (!listener)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	if (listener->timer)
+		ecore_timer_del(listener->timer);
+	listener->timer = NULL;
+	listener->started = false;
+
+	return SENSOR_ERROR_NONE;
+}
+
+int sensor_listener_read_data(sensor_listener_h listener, sensor_event_s *event)
+{
+	if (!listener || !event)
+		return SENSOR_ERROR_INVALID_PARAMETER;
+
+	if (!listener->started)
+		return SENSOR_ERROR_OPERATION_FAILED;
+
+	_sample(listener, _now_us(), event);
+	return SENSOR_ERROR_NONE;
+}
+
+void sensor_shim_get_stats(sensor_shim_stats_t *stats)
+{
+	if (stats)
+		*stats = s_stats;
+}
+
+/**
+ * @brief Delivers the samples due since the previous tick, in one array with the events
+ * callback or one by one with the event callback. A sensor with a FIFO keeps the newest
+ * fifo_count samples, the others SHIM_QUEUE_MAX.
+ */
+static Eina_Bool _listener_tick(void *data)
+{
+	struct sensor_listener_shim *listener = data;
+	unsigned long long interval_us = listener->interval_ms * 1000ULL;
+	unsigned long long now_us = _now_us();
+	unsigned long long due;
+	int capacity = listener->max_batch_latency_ms > 0 ? listener->sensor->fifo_count : SHIM_QUEUE_MAX;
+	sensor_events_cb events_cb = listener->events_cb;
+	sensor_event_cb event_cb = listener->event_cb;
+	void *user_data = listener->data;
+	int count = 0;
+	int i;
+
+	if (listener->next_us > now_us)
+		return ECORE_CALLBACK_RENEW;
+
+	due = (now_us - listener->next_us) / interval_us + 1;
+	s_stats.events += due;
+	if (due > (unsigned long long)capacity) {
+		s_stats.dropped += due - capacity;
+		listener->next_us += (due - capacity) * interval_us;
+		due = capacity;
+	}
+
+	for (; count < (int)due; listener->next_us += interval_us)
+		_sample(listener, listener->next_us, &listener->queue[count++]);
+
+	/* the callback may stop, restart or reconfigure this listener */
+	if (events_cb) {
+		s_stats.deliveries++;
+		events_cb(listener->sensor, listener->queue, count, user_data);
+	} else if (event_cb) {
+		for (i = 0; i < count; ++i) {
+			s_stats.deliveries++;
+			event_cb(listener->sensor, &listener->queue[i], user_data);
+		}
+	}
+
+	return ECORE_CALLBACK_RENEW;
+}
+
+/**
+ * @brief (Re)starts the timer of a started listener with the period of its current configuration.
+ */
+static void _listener_schedule(struct sensor_listener_shim *listener)
+{
+	unsigned int period_ms = listener->interval_ms;
+
+	if (listener->max_batch_latency_ms > period_ms)
+		period_ms = listener->max_batch_latency_ms;
+
+	if (listener->timer)
+		ecore_timer_del(listener->timer);
+	listener->timer = ecore_timer_add(period_ms / 1000.0, _listener_tick, listener);
+}
+
+/**
+ * @brief Fills an event with the signal of the listener's sensor at the given time.
+ */
+static void _sample(struct sensor_listener_shim *listener, unsigned long long timestamp_us, sensor_event_s *event)
+{
+	double t = timestamp_us / 1e6;
+	double step = sin(2 * M_PI * SHIM_STEP_HZ * t);
+	double sway = cos(2 * M_PI * SHIM_STEP_HZ * t);
+	double turn = 0.3 * sin(2 * M_PI * 0.05 * t);
+
+	memset(event, 0, sizeof(*event));
+	event->accuracy = 3;
+	event->timestamp = timestamp_us;
+	event->value_count = 1;
+
+	switch (listener->sensor->type) {
+	case SENSOR_ACCELEROMETER:
+	case SENSOR_LINEAR_ACCELERATION:
+		event->values[0] = 0.6f * sway;
+		event->values[1] = 0.4f * step;
+		event->values[2] = 2.5f * step + (listener->sensor->type == SENSOR_ACCELEROMETER ? SHIM_GRAVITY : 0.0f);
+		event->value_count = 3;
+		break;
+	case SENSOR_GRAVITY:
+		event->values[2] = SHIM_GRAVITY;
+		event->value_count = 3;
+		break;
+	case SENSOR_MAGNETIC:
+		event->values[0] = 20.0f * cos(turn);
+		event->values[1] = -20.0f * sin(turn);
+		event->values[2] = -40.0f;
+		event->value_count = 3;
+		break;
+	case SENSOR_ROTATION_VECTOR:
+		event->values[2] = sin(turn / 2);
+		event->values[3] = cos(turn / 2);
+		event->value_count = 4;
+		break;
+	case SENSOR_ORIENTATION:
+		event->values[0] = fmod(turn * 180 / M_PI + 360, 360);
+		event->value_count = 3;
+		break;
+	case SENSOR_GYROSCOPE:
+		/* the derivative of the turn, in degrees per second, and the wrist swing */
+		event->values[0] = 5.0f * sway;
+		event->values[1] = 3.0f * step;
+		event->values[2] = 0.3 * 2 * M_PI * 0.05 * cos(2 * M_PI * 0.05 * t) * 180 / M_PI;
+		event->value_count = 3;
+		break;
+	case SENSOR_LIGHT:
+		event->values[0] = 300.0f + 5.0f * sin(2 * M_PI * 0.01 * t);
+		break;
+	case SENSOR_PROXIMITY:
+		event->values[0] = 5.0f;
+		break;
+	case SENSOR_PRESSURE:
+		event->values[0] = 1013.25f + 0.02f * sin(2 * M_PI * 0.01 * t);
+		break;
+	case SENSOR_ULTRAVIOLET:
+		event->values[0] = 0.5f;
+		break;
+	case SENSOR_TEMPERATURE:
+		event->values[0] = 24.5f + 0.05f * sin(2 * M_PI * 0.002 * t);
+		break;
+	case SENSOR_HUMIDITY:
+		event->values[0] = 45.0f;
+		break;
+	case SENSOR_HRM:
+		/* the respiratory sinus arrhythmia, one breath every four beats */
+		while (listener->beat_us && listener->beat_us <= timestamp_us) {
+			listener->rr_ms = SHIM_RR_MS + 40.0 * sin(2 * M_PI * listener->beats++ / 4.0);
+			listener->heart_rate += (60000.0f / listener->rr_ms - listener->heart_rate) / 8;
+			listener->beat_us += (unsigned long long)(listener->rr_ms * 1000.0f);
+		}
+		event->values[0] = listener->heart_rate;
+		event->values[2] = listener->rr_ms;
+		event->value_count = 3;
+		break;
+	default:
+		break;
+	}
+}
+
+static unsigned long long _now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,101 @@
+/*
+ * sensor.h
+ *
+ * Host shim of the Tizen sensor API. Every sensor of the watch is emulated
+ * with a synthetic signal, sampled at the listener interval. The sensors
+ * with a hardware FIFO honor the max batch latency: their samples are
+ * queued and handed to the events callback in one array per latency, the
+ * way the sensor hub wakes the application processor. The callbacks run in
+ * the Ecore main loop.
+ */
+
+#ifndef HOST_SENSOR_H_
+#define HOST_SENSOR_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAX_VALUE_SIZE	16
+
+#define SENSOR_ERROR_NONE				0
+#define SENSOR_ERROR_IO_ERROR			-5
+#define SENSOR_ERROR_OUT_OF_MEMORY		-12
+#define SENSOR_ERROR_INVALID_PARAMETER	-22
+#define SENSOR_ERROR_NOT_SUPPORTED		-1073741822
+#define SENSOR_ERROR_OPERATION_FAILED	-1073741823
+
+typedef enum {
+	SENSOR_ALL = -1,
+	SENSOR_ACCELEROMETER,
+	SENSOR_GRAVITY,
+	SENSOR_LINEAR_ACCELERATION,
+	SENSOR_MAGNETIC,
+	SENSOR_ROTATION_VECTOR,
+	SENSOR_ORIENTATION,
+	SENSOR_GYROSCOPE,
+	SENSOR_LIGHT,
+	SENSOR_PROXIMITY,
+	SENSOR_PRESSURE,
+	SENSOR_ULTRAVIOLET,
+	SENSOR_TEMPERATURE,
+	SENSOR_HUMIDITY,
+	SENSOR_HRM,
+	SENSOR_LAST,
+} sensor_type_e;
+
+typedef enum {
+	SENSOR_OPTION_DEFAULT,
+	SENSOR_OPTION_ON_IN_SCREEN_OFF,
+	SENSOR_OPTION_ON_IN_POWERSAVE_MODE,
+	SENSOR_OPTION_ALWAYS_ON,
+} sensor_option_e;
+
+typedef struct {
+	int accuracy;
+	unsigned long long timestamp;	/* microseconds of CLOCK_MONOTONIC */
+	int value_count;
+	float values[MAX_VALUE_SIZE];
+} sensor_event_s;
+
+typedef struct sensor_shim *sensor_h;
+typedef struct sensor_listener_shim *sensor_listener_h;
+
+typedef void (*sensor_event_cb)(sensor_h sensor, sensor_event_s *event, void *data);
+typedef void (*sensor_events_cb)(sensor_h sensor, sensor_event_s events[], int events_count, void *data);
+
+int sensor_is_supported(sensor_type_e type, bool *supported);
+int sensor_get_default_sensor(sensor_type_e type, sensor_h *sensor);
+int sensor_get_min_range(sensor_h sensor, float *min_range);
+int sensor_get_max_range(sensor_h sensor, float *max_range);
+int sensor_get_resolution(sensor_h sensor, float *resolution);
+int sensor_get_vendor(sensor_h sensor, char **vendor);
+int sensor_get_fifo_count(sensor_h sensor, int *fifo_count);
+
+int sensor_create_listener(sensor_h sensor, sensor_listener_h *listener);
+int sensor_destroy_listener(sensor_listener_h listener);
+int sensor_listener_set_event_cb(sensor_listener_h listener, unsigned int interval_ms, sensor_event_cb callback, void *data);
+int sensor_listener_set_events_cb(sensor_listener_h listener, sensor_events_cb callback, void *data);
+int sensor_listener_set_interval(sensor_listener_h listener, unsigned int interval_ms);
+int sensor_listener_set_max_batch_latency(sensor_listener_h listener, unsigned int max_batch_latency);
+int sensor_listener_set_option(sensor_listener_h listener, sensor_option_e option);
+int sensor_listener_start(sensor_listener_h listener);
+int sensor_listener_stop(sensor_listener_h listener);
+int sensor_listener_read_data(sensor_listener_h listener, sensor_event_s *event);
+
+/* Host only: counters of the shim, for the tests and benchmarks */
+typedef struct sensor_shim_stats {
+	unsigned long long events;		/* events generated */
+	unsigned long long deliveries;	/* callback calls, one per array with the events callback */
+	unsigned long long dropped;		/* events lost to a full FIFO */
+} sensor_shim_stats_t;
+
+void sensor_shim_get_stats(sensor_shim_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_SENSOR_H_ */
@@ -0,0 +1,25 @@
+/*
+ * system_info.h
+ *
+ * Host stub of the system information. The Tizen ID is $KUSENSORS_TIZEN_ID,
+ * or the host name.
+ */
+
+#ifndef HOST_SYSTEM_INFO_H_
+#define HOST_SYSTEM_INFO_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SYSTEM_INFO_ERROR_NONE				0
+#define SYSTEM_INFO_ERROR_INVALID_PARAMETER	-22
+#define SYSTEM_INFO_ERROR_OUT_OF_MEMORY		-12
+
+int system_info_get_platform_string(const char *key, char **value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_SYSTEM_INFO_H_ */
@@ -0,0 +1,39 @@
+/*
+ * activity.h
+ *
+ * Step counting and activity classification of an acceleration stream. The
+ * magnitude of every sample is band-passed around the walking cadence, steps
+ * are the regular peaks of the filtered signal and every ACTIVITY_WINDOW_MS
+ * window is classified from its steps and intensity. The raw samples are
+ * replaced by one RECORD_TYPE_ACTIVITY summary per minute:
+ *   values[0] steps, values[1] ACTIVITY_* class, values[2] intensity (m/s2 rms),
+ *   values[3] cadence while walking or running (steps/min)
+ */
+
+#ifndef ACTIVITY_H_
+#define ACTIVITY_H_
+
+#include "record.h"
+
+#define ACTIVITY_SUMMARY_MS		60000
+#define ACTIVITY_WINDOW_MS		10000
+
+#define ACTIVITY_STILL			0
+#define ACTIVITY_LIGHT			1	// moving without a walking rhythm
+#define ACTIVITY_WALKING		2
+#define ACTIVITY_RUNNING		3
+#define ACTIVITY_CLASS_COUNT	4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void activity_reset(void);
+int activity_summarize(record_t *records, int count);
+int activity_flush(record_t *summary);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ACTIVITY_H_ */
@@ -0,0 +1,54 @@
+/*
+ * batch.h
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "record.h"
+#include "columnar.h"
+#include "merkle.h"
+
+#define BATCH_MAX_SAMPLES	50		// flush after this many records
+#define BATCH_MAX_AGE_MS	2000	// or once the oldest record is this old
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A batch of serialized sensor records. The batch owns its payload; whoever
+ * receives it from the flush callback must release it with batch_destroy().
+ */
+typedef struct batch {
+	int id;					/* sequence number of the batch */
+	int format;				/* RECORD_FORMAT_* of the payload */
+	int count;				/* number of records in the batch */
+	size_t len;				/* bytes used in data */
+	size_t size;			/* bytes allocated for data */
+	long long created_ms;	/* monotonic time of the first record */
+	long long last_ms;		/* wall clock time of the last record */
+	char *data;				/* payload, NUL terminated in the JSON format, raw records until the columnar batch is closed */
+	merkle_t tree;			/* records serialized so far */
+	merkle_hash_t prev_root;	/* root of the previous batch, zero for the first one */
+	merkle_hash_t root;		/* root of the records, set once the batch is closed */
+} batch_t;
+
+typedef void (*Batch_Flush_Cb)(batch_t *batch);
+
+bool batch_initialize(int max_samples, int max_age_ms, Batch_Flush_Cb flush_cb);
+void batch_set_window(int max_samples, int max_age_ms);
+void batch_set_format(int format);
+void batch_set_quantum(int sensor_type, float quantum);
+bool batch_add_records(const record_t *records, int count);
+void batch_flush(void);
+void batch_finalize(void);
+void batch_destroy(batch_t *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BATCH_H_ */
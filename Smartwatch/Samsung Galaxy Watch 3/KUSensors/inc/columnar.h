@@ -0,0 +1,53 @@
+/*
+ * columnar.h
+ *
+ * Columnar encoding of a whole batch of records (RECORD_FORMAT_COLUMNAR). The
+ * records are split in one stream per sensor, and each stream is stored column
+ * by column so that consecutive, highly correlated samples sit next to each
+ * other. Depends on the C library only, plus zlib when COLUMNAR_USE_ZLIB is
+ * defined. RecordBatch.java of the translator decodes the same layout.
+ *
+ * Batch (little endian):
+ *   header  "KC" | version u8 | flags u8 | batch_id u32 | count u16 | streams u8 | reserved u8
+ *           [COLUMNAR_FLAG_DEFLATE: raw length u32, then the deflated streams]
+ *   stream  type u8 | value_count u8 | encoding u8 | reserved u8 | quantum f32 | n varint
+ *           timestamps  first (zigzag varint, ms), then delta-of-delta (zigzag varint)
+ *           columns     COLUMNAR_VALUES_QUANTIZED: delta of round(value / quantum) (zigzag varint)
+ *                       COLUMNAR_VALUES_XOR: float bits xor the previous ones (varint)
+ *   [COLUMNAR_FLAG_COMMITTED: prev_root | root (RECORD_COMMITMENT_SIZE), see merkle.h]
+ *
+ * Quantized values are rounded to the resolution of their sensor, nothing finer
+ * than what the hardware measures is lost.
+ */
+
+#ifndef COLUMNAR_H_
+#define COLUMNAR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "record.h"
+
+#define COLUMNAR_VERSION			1
+#define COLUMNAR_HEADER_SIZE		12
+#define COLUMNAR_MAX_TYPES			256
+#define COLUMNAR_FLAG_DEFLATE		0x01
+#define COLUMNAR_FLAG_COMMITTED		0x02
+
+#define COLUMNAR_VALUES_QUANTIZED	0
+#define COLUMNAR_VALUES_XOR			1
+
+/* bound of an encoded batch, every record may open its own stream */
+#define COLUMNAR_MAX_SIZE(count)	(COLUMNAR_HEADER_SIZE + 4 + (size_t)(count) * (8 + 5 + 10 + RECORD_MAX_VALUES * 10))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t columnar_encode(const record_t *records, int count, unsigned int batch_id, const float *quantum, bool deflate, unsigned char *buf, size_t size);
+int columnar_decode(const void *data, size_t len, unsigned int *batch_id, record_t *records, int max_records);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COLUMNAR_H_ */
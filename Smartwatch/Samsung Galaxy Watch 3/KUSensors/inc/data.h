@@ -19,9 +19,12 @@
 
 #include <sensor.h>
 #include "view.h"
+#include "record.h"
+
+typedef bool (*Publish_Sensor_Records_Cb)(const record_t *records, int count);
 
 void data_finalize(void);
-bool data_initialize(Update_Sensor_Values_Cb callback);
+bool data_initialize(Update_Sensor_Values_Cb callback, Publish_Sensor_Records_Cb publish_cb);
 void data_set_selected_sensor(sensor_type_e type);
 bool data_get_sensor_support(sensor_type_e type);
 void data_get_sensor_range(sensor_type_e type, float *min, float *max);
@@ -29,5 +32,11 @@ float data_get_sensor_resolution(sensor_type_e type);
 char *data_get_sensor_vendor(sensor_type_e type);
 void data_get_sensor_data(sensor_type_e type);
 void data_stop_sensor(void);
+bool data_capture_start(sensor_type_e type, int interval_ms, int max_batch_latency_ms);
+void data_capture_stop(sensor_type_e type);
+bool data_capture_is_running(sensor_type_e type);
+void data_flush(void);
+void data_set_replay_mode(bool replaying);
+void data_inject_events(sensor_type_e type, sensor_event_s events[], int events_count);
 
 #endif
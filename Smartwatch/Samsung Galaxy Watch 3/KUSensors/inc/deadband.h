@@ -0,0 +1,43 @@
+/*
+ * deadband.h
+ */
+
+#ifndef DEADBAND_H_
+#define DEADBAND_H_
+
+#include <stdbool.h>
+#include "record.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Change detection policy of a sensor. A record is sent when one of its values
+ * moved by more than both bands since the last sent record, or when nothing was
+ * sent for max_silence_ms.
+ */
+typedef struct deadband_policy {
+	float abs_band;			/* minimum absolute change */
+	float rel_band;			/* minimum change relative to the last sent value, 0.05 = 5% */
+	int max_silence_ms;		/* heartbeat period of an unchanged sensor, 0 for none */
+	int fast_interval_ms;	/* sampling interval while the values change, 0 to keep the capture interval */
+	int hold_ms;			/* how long the fast interval is kept after the last change */
+} deadband_policy_t;
+
+typedef struct deadband_stats {
+	unsigned long long sent;
+	unsigned long long suppressed;
+} deadband_stats_t;
+
+void deadband_set_policy(int sensor_type, const deadband_policy_t *policy);
+int deadband_filter(record_t *records, int count);
+int deadband_interval(int sensor_type, int interval_ms);
+void deadband_get_stats(int sensor_type, deadband_stats_t *stats);
+void deadband_reset(int sensor_type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DEADBAND_H_ */
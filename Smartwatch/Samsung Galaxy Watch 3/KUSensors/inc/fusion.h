@@ -0,0 +1,36 @@
+/*
+ * fusion.h
+ *
+ * Orientation of the watch fused from the gyroscope, the accelerometer and the
+ * magnetic sensor, published as one RECORD_TYPE_QUATERNION stream (w, x, y, z,
+ * earth frame to device frame) in place of the gyroscope, magnetic and
+ * orientation streams. The filter is the complementary filter of Mahony on the
+ * quaternion: the gyroscope is integrated at its rate and the error to the
+ * latest gravity and magnetic references is fed back through a PI controller,
+ * which also cancels the gyroscope bias.
+ *
+ * Defining FUSION_FIXED_POINT runs the filter on Q8.24 integers instead of floats.
+ */
+
+#ifndef FUSION_H_
+#define FUSION_H_
+
+#include <stdbool.h>
+
+#define FUSION_OUTPUT_INTERVAL_MS	100		// period of the published quaternions
+#define FUSION_REFERENCE_MAX_AGE_MS	3000	// older references are not used, the gyroscope is integrated alone
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void fusion_reset(void);
+void fusion_set_gravity(unsigned long long timestamp_us, const float *acceleration);
+void fusion_set_magnetic(unsigned long long timestamp_us, const float *field);
+bool fusion_update(unsigned long long timestamp_us, const float *rotation_rate, float *quaternion);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FUSION_H_ */
@@ -0,0 +1,37 @@
+/*
+ * histogram.h
+ *
+ * Log-linear histogram of latencies, in the spirit of HdrHistogram: each power
+ * of two is split in 8 buckets, which bounds the error of a percentile to 12.5%.
+ * Recording is lock-free and never allocates, so it can sit on the hot path.
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#define HISTOGRAM_SUB_BITS	4
+#define HISTOGRAM_MAX_BITS	40		// values up to 2^40 us, about 12 days
+#define HISTOGRAM_BUCKETS	((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 2) << (HISTOGRAM_SUB_BITS - 1))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct histogram {
+	unsigned int counts[HISTOGRAM_BUCKETS];
+	unsigned long long count;
+	unsigned long long sum;
+	unsigned long long max;
+} histogram_t;
+
+void histogram_reset(histogram_t *histogram);
+void histogram_record(histogram_t *histogram, unsigned long long value);
+void histogram_copy(histogram_t *dst, const histogram_t *src);
+unsigned long long histogram_percentile(const histogram_t *histogram, double percentile);
+unsigned long long histogram_mean(const histogram_t *histogram);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HISTOGRAM_H_ */
@@ -0,0 +1,49 @@
+/*
+ * hrv.h
+ *
+ * Streaming beat extraction and heart rate variability of the HRM sensor. The
+ * sensor hub detects the pulse peaks and reports the last peak-to-peak interval
+ * with every event; the events are turned back into a beat train, each beat is
+ * given a confidence and the plausible ones update rolling RMSSD and SDNN over
+ * the last HRV_WINDOW beats. Every update is O(1) and the memory is fixed.
+ */
+
+#ifndef HRV_H_
+#define HRV_H_
+
+#include <stdbool.h>
+
+#define HRV_WINDOW			64		// beats of the rolling statistics
+#define HRV_MIN_RR_MS		300		// 200 bpm
+#define HRV_MAX_RR_MS		2000	// 30 bpm
+#define HRV_MIN_CONFIDENCE	0.5f	// beats below are left out of the statistics
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct hrv_beat {
+	unsigned long long timestamp_us;	/* sensor time of the report of the beat */
+	float rr_ms;						/* interval since the previous beat */
+	float confidence;					/* 0 to 1 */
+} hrv_beat_t;
+
+typedef struct hrv_stats {
+	float heart_rate;	/* beats per minute, from the mean interval of the window */
+	float rr_ms;		/* last accepted interval */
+	float rmssd_ms;		/* root mean square of the successive differences */
+	float sdnn_ms;		/* standard deviation of the intervals */
+	int beats;			/* intervals in the window */
+	unsigned long long accepted;
+	unsigned long long rejected;
+} hrv_stats_t;
+
+void hrv_reset(void);
+bool hrv_add_event(unsigned long long timestamp_us, float heart_rate, float peak_to_peak_ms, hrv_beat_t *beat);
+void hrv_get_stats(hrv_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HRV_H_ */
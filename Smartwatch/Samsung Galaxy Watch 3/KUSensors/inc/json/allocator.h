@@ -6,8 +6,13 @@
 #ifndef JSON_ALLOCATOR_H_INCLUDED
 #define JSON_ALLOCATOR_H_INCLUDED
 
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <new>
+#include <type_traits>
 
 #pragma pack(push, 8)
 
@@ -81,6 +86,182 @@ bool operator!=(const SecureAllocator<T>&, const SecureAllocator<U>&) {
   return false;
 }
 
+/** \brief Bump allocator holding the nodes and strings of whole documents.
+ *
+ * While an Arena::Scope is alive, every string and container that a Value
+ * allocates on the thread comes from the arena, whoever builds the Value:
+ * Reader, CharReader or user code. Nothing of it is freed one by one, the
+ * whole region goes at once with reset() or the destructor. An arena reused
+ * through reset() keeps its first chunk, so parsing one small message after
+ * the other does not call malloc for the tree anymore.
+ *
+ * Every Value built in the scope must be destroyed, or assigned a Value
+ * built outside of it, before the arena is reset. Copying a Value outside of
+ * the scope gives a tree on the heap that outlives the arena.
+ *
+ * \code
+ * Json::Arena arena;
+ * for (const std::string& message : messages) {
+ *   Json::Arena::Scope scope(arena);
+ *   Json::Value root;
+ *   if (reader.parse(message, root))
+ *     handle(root);
+ *   root = Json::Value();
+ *   arena.reset();
+ * }
+ * \endcode
+ */
+class Arena {
+public:
+  /// Makes \c arena the arena of the calling thread until destruction, the
+  /// scopes can be nested.
+  class Scope {
+  public:
+    explicit Scope(Arena& arena) : previous_(current()) { slot() = &arena; }
+    ~Scope() { slot() = previous_; }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    Arena* previous_;
+  };
+
+  explicit Arena(size_t chunkSize = 4096)
+      : chunks_(nullptr), cursor_(nullptr), limit_(nullptr),
+        chunkSize_(chunkSize), used_(0) {}
+  ~Arena() {
+    while (chunks_) {
+      Chunk* next = chunks_->next;
+      free(chunks_);
+      chunks_ = next;
+    }
+  }
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  /// The arena of the calling thread, or nullptr outside of any Scope.
+  static Arena* current() { return slot(); }
+
+  void* allocate(size_t size, size_t align) {
+    uintptr_t cursor = reinterpret_cast<uintptr_t>(cursor_);
+    size_t pad = (align - cursor % align) % align;
+    if (cursor_ == nullptr ||
+        size + pad > static_cast<size_t>(limit_ - cursor_)) {
+      // big blocks get a chunk of their own, the current one stays open
+      if (size > chunkSize_ / 4 && cursor_ != nullptr)
+        return addChunk(size, false);
+      addChunk(chunkSize_ > size ? chunkSize_ : size, true);
+      pad = 0;
+    }
+    void* block = cursor_ + pad;
+    cursor_ += pad + size;
+    used_ += size;
+    return block;
+  }
+
+  /// Release everything but the first chunk, which is reused.
+  void reset() {
+    Chunk* keep = nullptr;
+    while (chunks_) {
+      Chunk* next = chunks_->next;
+      if (keep == nullptr && chunks_->size == chunkSize_ && next == nullptr)
+        keep = chunks_;
+      else
+        free(chunks_);
+      chunks_ = next;
+    }
+    chunks_ = keep;
+    cursor_ = keep ? reinterpret_cast<char*>(keep + 1) : nullptr;
+    limit_ = keep ? cursor_ + keep->size : nullptr;
+    used_ = 0;
+  }
+
+  /// Bytes handed out since the last reset.
+  size_t used() const { return used_; }
+
+private:
+  struct alignas(std::max_align_t) Chunk {
+    Chunk* next;
+    size_t size;
+  };
+
+  static Arena*& slot() {
+    static thread_local Arena* arena = nullptr;
+    return arena;
+  }
+
+  void* addChunk(size_t size, bool open) {
+    Chunk* chunk = static_cast<Chunk*>(malloc(sizeof(Chunk) + size));
+    if (chunk == nullptr)
+      throw std::bad_alloc();
+    chunk->size = size;
+    char* data = reinterpret_cast<char*>(chunk + 1);
+    if (open || chunks_ == nullptr) {
+      chunk->next = chunks_;
+      chunks_ = chunk;
+      cursor_ = data;
+      limit_ = data + size;
+    } else {
+      chunk->next = chunks_->next;
+      chunks_->next = chunk;
+      used_ += size;
+    }
+    return data;
+  }
+
+  Chunk* chunks_; // the open chunk first
+  char* cursor_;
+  char* limit_;
+  size_t chunkSize_;
+  size_t used_;
+};
+
+/** \brief STL allocator of the containers of Value: from an Arena, or from
+ * operator new without one. A copied container takes the arena of the
+ * current Arena::Scope.
+ */
+template <typename T> class ArenaAllocator {
+public:
+  using value_type = T;
+  using propagate_on_container_move_assignment = std::true_type;
+  using propagate_on_container_swap = std::true_type;
+
+  ArenaAllocator() noexcept : arena_(nullptr) {}
+  explicit ArenaAllocator(Arena* arena) noexcept : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+      : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    if (arena_)
+      return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T* p, size_t) noexcept {
+    if (!arena_)
+      ::operator delete(p);
+  }
+
+  ArenaAllocator select_on_container_copy_construction() const {
+    return ArenaAllocator(Arena::current());
+  }
+
+  Arena* arena() const noexcept { return arena_; }
+
+private:
+  Arena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
 } // namespace Json
 
 #pragma pack(pop)
@@ -25,6 +25,22 @@
 #define JSON_USE_NULLREF 1
 #endif
 
+// If non-zero, the members of objects and arrays are stored in a sorted
+// array (Json::FlatMap) with room for JSON_FLAT_OBJECT_INLINE of them inside
+// the container, instead of a std::map. Parsing and lookups are faster and
+// allocate less, the iteration order is the same. As with std::vector, adding
+// or removing a member invalidates the iterators and the references to the
+// other members of the same object. A member added out of key order moves the
+// members after it: the readers sort the members of a large object once it is
+// read, but building one member by member in random order costs O(n^2).
+#ifndef JSON_USE_FLAT_OBJECT
+#define JSON_USE_FLAT_OBJECT 0
+#endif
+
+#ifndef JSON_FLAT_OBJECT_INLINE
+#define JSON_FLAT_OBJECT_INLINE 8
+#endif
+
 /// If defined, indicates that the source file is amalgamated
 /// to prevent private header inclusion.
 /// Remarks: it is automatically defined in the generated amalgamated header.
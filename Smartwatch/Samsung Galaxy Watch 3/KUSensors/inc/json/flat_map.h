@@ -0,0 +1,262 @@
+// Copyright 2007-2010 Baptiste Lepilleur and The JsonCpp Authors
+// Distributed under MIT license, or public domain if desired and
+// recognized in your jurisdiction.
+// See file LICENSE for detail or copy at http://jsoncpp.sourceforge.net/LICENSE
+
+#ifndef JSON_FLAT_MAP_H_INCLUDED
+#define JSON_FLAT_MAP_H_INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#pragma pack(push, 8)
+
+namespace Json {
+
+/** \brief Sorted associative array used as Value::ObjectValues when
+ * JSON_USE_FLAT_OBJECT is non-zero.
+ *
+ * The members are kept ordered by key in one contiguous block, so iteration
+ * yields the same order as std::map. The first N members live inside the
+ * container itself: the small objects of a sensor record cost a single
+ * allocation, and a lookup is a binary search over adjacent memory instead
+ * of a walk through tree nodes.
+ *
+ * Only the part of the std::map interface used by Value is provided. Unlike
+ * std::map, an insertion or an erase invalidates the iterators and the
+ * references to the other members, and costs O(n) unless it is at the end:
+ * the readers collect the members of a large object read out of key order
+ * and insert them sorted, see ObjectBuilder in json_reader.cpp. The members that do not fit inline are
+ * allocated with Alloc, rebound to value_type.
+ */
+template <typename Key, typename T, std::size_t N,
+          typename Alloc = std::allocator<std::pair<const Key, T>>>
+class FlatMap {
+  static_assert(N > 0, "FlatMap needs room for at least one inline member");
+
+public:
+  using key_type = Key;
+  using mapped_type = T;
+  using value_type = std::pair<Key, T>;
+  using size_type = std::size_t;
+  using iterator = value_type*;
+  using const_iterator = const value_type*;
+  using allocator_type = typename std::allocator_traits<
+      Alloc>::template rebind_alloc<value_type>;
+
+  explicit FlatMap(const allocator_type& alloc = allocator_type())
+      : alloc_(alloc), data_(inlineData()), size_(0), capacity_(N) {}
+  FlatMap(const FlatMap& other)
+      : alloc_(Traits::select_on_container_copy_construction(other.alloc_)),
+        data_(inlineData()), size_(0), capacity_(N) {
+    reserve(other.size_);
+    for (const_iterator it = other.begin(); it != other.end(); ++it)
+      new (data_ + size_++) value_type(*it);
+  }
+  FlatMap& operator=(const FlatMap& other) {
+    if (this != &other) {
+      FlatMap copy(other);
+      swap(copy);
+    }
+    return *this;
+  }
+  ~FlatMap() {
+    clear();
+    releaseData();
+  }
+
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+
+  size_type size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  void clear() {
+    for (iterator it = begin(); it != end(); ++it)
+      it->~value_type();
+    size_ = 0;
+  }
+
+  iterator lower_bound(const Key& key) {
+    return std::lower_bound(begin(), end(), key, KeyLess());
+  }
+  const_iterator lower_bound(const Key& key) const {
+    return std::lower_bound(begin(), end(), key, KeyLess());
+  }
+
+  iterator find(const Key& key) {
+    iterator it = lower_bound(key);
+    return it != end() && !(key < it->first) ? it : end();
+  }
+  const_iterator find(const Key& key) const {
+    const_iterator it = lower_bound(key);
+    return it != end() && !(key < it->first) ? it : end();
+  }
+
+  /// Insert \c value before \c hint, which should be its lower bound. An
+  /// existing member with the same key is returned unchanged.
+  iterator insert(const_iterator hint, const value_type& value) {
+    if (!isLowerBound(hint, value.first))
+      hint = lower_bound(value.first);
+    if (hint != end() && !(value.first < hint->first))
+      return begin() + (hint - begin());
+    return insertAt(static_cast<size_type>(hint - begin()), value_type(value));
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(Args&&... args) {
+    value_type value(std::forward<Args>(args)...);
+    // arrays are filled in key order: append without searching
+    iterator it = empty() || (end() - 1)->first < value.first
+                      ? end()
+                      : lower_bound(value.first);
+    if (it != end() && !(value.first < it->first))
+      return std::make_pair(it, false);
+    return std::make_pair(
+        insertAt(static_cast<size_type>(it - begin()), std::move(value)),
+        true);
+  }
+
+  T& operator[](const Key& key) {
+    iterator it = lower_bound(key);
+    if (it == end() || key < it->first)
+      it = insertAt(static_cast<size_type>(it - begin()),
+                    value_type(key, T()));
+    return it->second;
+  }
+
+  iterator erase(const_iterator position) {
+    size_type index = static_cast<size_type>(position - begin());
+    data_[index].~value_type();
+    for (size_type i = index + 1; i < size_; ++i)
+      relocate(data_ + i, data_ + i - 1);
+    --size_;
+    return data_ + index;
+  }
+  size_type erase(const Key& key) {
+    iterator it = find(key);
+    if (it == end())
+      return 0;
+    erase(it);
+    return 1;
+  }
+
+  void swap(FlatMap& other) {
+    if (data_ != inlineData() && other.data_ != other.inlineData()) {
+      std::swap(data_, other.data_);
+      std::swap(size_, other.size_);
+      std::swap(capacity_, other.capacity_);
+      std::swap(alloc_, other.alloc_);
+      return;
+    }
+    FlatMap tmp;
+    tmp.takeFrom(*this);
+    takeFrom(other);
+    other.takeFrom(tmp);
+  }
+
+private:
+  using Traits = std::allocator_traits<allocator_type>;
+
+  struct KeyLess {
+    bool operator()(const value_type& lhs, const Key& rhs) const {
+      return lhs.first < rhs;
+    }
+  };
+
+  value_type* inlineData() {
+    return reinterpret_cast<value_type*>(&inline_);
+  }
+
+  bool isLowerBound(const_iterator it, const Key& key) const {
+    return (it == begin() || (it - 1)->first < key) &&
+           (it == end() || !(it->first < key));
+  }
+
+  // The members are only ever moved by construction: the assignment
+  // operators of Value::CZString do not release the string they replace.
+  static void relocate(value_type* from, value_type* to) {
+    new (to) value_type(std::move(*from));
+    from->~value_type();
+  }
+
+  void reserve(size_type capacity) {
+    if (capacity <= capacity_)
+      return;
+    value_type* data = Traits::allocate(alloc_, capacity);
+    for (size_type i = 0; i < size_; ++i)
+      relocate(data_ + i, data + i);
+    releaseData();
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  iterator insertAt(size_type index, value_type&& value) {
+    if (size_ == capacity_)
+      reserve(capacity_ * 2);
+    for (size_type i = size_; i > index; --i)
+      relocate(data_ + i - 1, data_ + i);
+    new (data_ + index) value_type(std::move(value));
+    ++size_;
+    return data_ + index;
+  }
+
+  void releaseData() {
+    if (data_ != inlineData())
+      Traits::deallocate(alloc_, data_, capacity_);
+    data_ = inlineData();
+    capacity_ = N;
+  }
+
+  // Move the members and the allocator of other, which is left empty with
+  // its inline storage.
+  void takeFrom(FlatMap& other) {
+    clear();
+    releaseData();
+    alloc_ = other.alloc_;
+    if (other.data_ != other.inlineData()) {
+      data_ = other.data_;
+      capacity_ = other.capacity_;
+    } else {
+      for (size_type i = 0; i < other.size_; ++i)
+        relocate(other.data_ + i, data_ + i);
+    }
+    size_ = other.size_;
+    other.data_ = other.inlineData();
+    other.size_ = 0;
+    other.capacity_ = N;
+  }
+
+  allocator_type alloc_;
+  value_type* data_;
+  size_type size_;
+  size_type capacity_;
+  typename std::aligned_storage<sizeof(value_type) * N,
+                                alignof(value_type)>::type inline_;
+};
+
+template <typename Key, typename T, std::size_t N, typename Alloc>
+bool operator<(const FlatMap<Key, T, N, Alloc>& lhs,
+               const FlatMap<Key, T, N, Alloc>& rhs) {
+  return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(),
+                                      rhs.end());
+}
+
+template <typename Key, typename T, std::size_t N, typename Alloc>
+bool operator==(const FlatMap<Key, T, N, Alloc>& lhs,
+                const FlatMap<Key, T, N, Alloc>& rhs) {
+  return lhs.size() == rhs.size() &&
+         std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+} // namespace Json
+
+#pragma pack(pop)
+
+#endif // JSON_FLAT_MAP_H_INCLUDED
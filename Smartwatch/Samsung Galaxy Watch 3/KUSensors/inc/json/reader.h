@@ -13,6 +13,7 @@
 #include <deque>
 #include <iosfwd>
 #include <istream>
+#include <memory>
 #include <stack>
 #include <string>
 
@@ -359,6 +360,120 @@ public:
   static void strictMode(Json::Value* settings);
 };
 
+/** \brief Receives the events of a SaxReader.
+ *
+ * The callbacks follow the order of the document. Each of them returns
+ * \c false to stop reading, e.g. once the wanted member was found. The
+ * default implementations ignore the event.
+ */
+class JSON_API SaxHandler {
+public:
+  virtual ~SaxHandler() = default;
+  virtual bool startObject() { return true; }
+  virtual bool endObject() { return true; }
+  virtual bool startArray() { return true; }
+  virtual bool endArray() { return true; }
+  /// Name of the member of the current object whose value comes next.
+  virtual bool key(const String& /*name*/) { return true; }
+  /// A null, boolean, number or string value.
+  virtual bool scalar(const Value& /*value*/) { return true; }
+};
+
+class OurReader;
+
+/** \brief Reads a <a HREF="http://www.json.org">JSON</a> document as a
+ * stream of events for a SaxHandler, without building a Value tree.
+ *
+ * The document may be given in chunks of any size with feed(), then
+ * finish(): only a token cut by the end of a chunk is kept until the next
+ * one, the memory used does not grow with the document. The tokens are read
+ * and decoded as by the CharReader of a CharReaderBuilder, with its
+ * settings, except "collectComments" and "rejectDupKeys" which are ignored.
+ *
+ * Usage:
+ *   \code
+ *   Json::SaxReader reader(handler);
+ *   while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+ *     if (!reader.feed(buffer, buffer + length))
+ *       break;
+ *   bool ok = reader.finish();
+ *   \endcode
+ */
+class JSON_API SaxReader {
+public:
+  explicit SaxReader(SaxHandler& handler,
+                     const CharReaderBuilder& builder = CharReaderBuilder());
+  ~SaxReader();
+
+  /** \brief Read the next chunk of the document.
+   * \return \c false if the document is invalid or the handler stopped the
+   * reading, the following chunks are then ignored.
+   */
+  bool feed(const char* begin, const char* end);
+
+  /** \brief Signal the end of the document.
+   * \return \c true if a whole document was read, or the handler stopped the
+   * reading without error.
+   */
+  bool finish();
+
+  /// Read a whole document: feed() then finish().
+  bool parse(const char* beginDoc, const char* endDoc);
+  /// Read a whole stream by chunks.
+  bool parse(IStream& is);
+
+  /// Forget the current document, to read a new one with the same handler.
+  void reset();
+
+  /// \c true if a callback of the handler stopped the reading.
+  bool stopped() const;
+
+  /** \brief Returns a user friendly string describing the error, with its
+   * byte offset in the document, or an empty string.
+   */
+  String getFormattedErrorMessages() const;
+
+private:
+  enum State {
+    expectValue,
+    expectFirstValue, // just after '['
+    expectFirstKey,   // just after '{'
+    expectKey,
+    expectColon,
+    expectSeparator,
+    expectEnd,
+    stoppedByHandler,
+    failed
+  };
+
+  class Token;
+
+  SaxReader(SaxReader const&);      // no impl
+  void operator=(SaxReader const&); // no impl
+
+  bool consume(const char* begin, const char* end, bool final);
+  bool isCut(const Token& token, bool final) const;
+  bool readToken(Token& token);
+  bool readValue(Token& token);
+  bool readKey(Token& token);
+  bool readSeparator(Token& token);
+  bool endContainer();
+  bool afterValue();
+  bool handled(bool keepReading);
+  bool addError(const String& message, const Token& token);
+
+  SaxHandler& handler_;
+  std::unique_ptr<OurReader> tokenizer_;
+  String pending_;    // start of a token cut by the end of the last chunk
+  String containers_; // 'o' or 'a' per open object or array
+  State state_;
+  bool afterComma_;
+  bool started_;
+  size_t offset_; // of the current chunk in the document
+  size_t errorOffset_;
+  String error_;
+};
+
 /** Consume entire stream and use its begin/end.
  * Someday we might have a real StreamReader, but for now this
  * is convenient.
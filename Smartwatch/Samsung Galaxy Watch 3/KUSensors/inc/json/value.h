@@ -7,6 +7,7 @@
 #define JSON_H_INCLUDED
 
 #if !defined(JSON_IS_AMALGAMATION)
+#include "flat_map.h"
 #include "forwards.h"
 #endif // if !defined(JSON_IS_AMALGAMATION)
 
@@ -184,6 +185,12 @@ private:
  * It is possible to iterate over the list of member keys of an object using
  * the getMemberNames() method.
  *
+ * \note With JSON_USE_FLAT_OBJECT, the members of an object or an array are
+ * kept in one sorted block: adding a member with operator[], append() or
+ * insert(), or removing one, invalidates the iterators, references and
+ * pointers to the other members of the same object or array, as it would
+ * for a std::vector. Members added out of key order cost O(n) each.
+ *
  * \note #Value string-length fit in size_t, but keys must be < 2^30.
  * (The reason is an implementation detail.) A #CharReader will raise an
  * exception if a bound is exceeded to avoid security holes in your app,
@@ -259,7 +266,12 @@ private:
 #ifndef JSONCPP_DOC_EXCLUDE_IMPLEMENTATION
   class CZString {
   public:
-    enum DuplicationPolicy { noDuplication = 0, duplicate, duplicateOnCopy };
+    enum DuplicationPolicy {
+      noDuplication = 0,
+      duplicate,
+      duplicateOnCopy,
+      inArena // duplicated in an Arena, not freed
+    };
     CZString(ArrayIndex index);
     CZString(char const* str, unsigned length, DuplicationPolicy allocate);
     CZString(CZString const& other);
@@ -292,7 +304,14 @@ private:
   };
 
 public:
-  typedef std::map<CZString, Value> ObjectValues;
+  typedef ArenaAllocator<std::pair<const CZString, Value>> ObjectAllocator;
+#if JSON_USE_FLAT_OBJECT
+  typedef FlatMap<CZString, Value, JSON_FLAT_OBJECT_INLINE, ObjectAllocator>
+      ObjectValues;
+#else
+  typedef std::map<CZString, Value, std::less<CZString>, ObjectAllocator>
+      ObjectValues;
+#endif
 #endif // ifndef JSONCPP_DOC_EXCLUDE_IMPLEMENTATION
 
 public:
@@ -597,11 +616,15 @@ private:
   }
   bool isAllocated() const { return bits_.allocated_; }
   void setIsAllocated(bool v) { bits_.allocated_ = v; }
+  bool isInArena() const { return bits_.arena_; }
+  void setIsInArena(bool v) { bits_.arena_ = v; }
 
   void initBasic(ValueType type, bool allocated = false);
   void dupPayload(const Value& other);
   void releasePayload();
   void dupMeta(const Value& other);
+  Arena* arenaForPayload();
+  ObjectValues* newObjectValues(const ObjectValues* other);
 
   Value& resolveReference(const char* key);
   Value& resolveReference(const char* key, const char* end);
@@ -629,6 +652,8 @@ private:
     unsigned int value_type_ : 8;
     // Unless allocated_, string_ must be null-terminated.
     unsigned int allocated_ : 1;
+    // The string or the container lives in an Arena, it is not freed.
+    unsigned int arena_ : 1;
   } bits_;
 
   class Comments {
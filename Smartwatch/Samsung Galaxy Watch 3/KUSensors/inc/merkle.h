@@ -0,0 +1,64 @@
+/*
+ * merkle.h
+ *
+ * Integrity commitments of the published batches. Every batch carries the
+ * Merkle root of its records and the root of the previous batch, so that the
+ * ledger anchors one hash per batch and any record can be proven against it.
+ * The tree is the one of RFC 6962: leaf = SHA-256(0x00 | record), node =
+ * SHA-256(0x01 | left | right), the left subtree of n leaves holding the
+ * largest power of two below n. A record is the bytes it takes in the payload:
+ *   RECORD_FORMAT_JSON      the record object, without the separating comma
+ *   RECORD_FORMAT_BINARY    the record encoding
+ *   RECORD_FORMAT_COLUMNAR  record_write_binary() of the decoded record, relative to 0
+ * Binary and columnar batches end with prev_root | root when their
+ * RECORD_FLAG_COMMITTED / COLUMNAR_FLAG_COMMITTED flag is set, JSON batches have
+ * "prev_root" in their header and "root" in their trailer, in hex. This file
+ * and merkle.c only depend on the C library and sha256.c, the verifier can be
+ * linked into the ingest side as is.
+ */
+
+#ifndef MERKLE_H_
+#define MERKLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "sha256.h"
+
+#define MERKLE_HASH_SIZE	SHA256_BLOCK_SIZE
+#define MERKLE_MAX_DEPTH	32
+#define MERKLE_LEAF_BATCH	(SHA256_LANES * 2)	// records worth handing to merkle_leaf_hashes() together
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef unsigned char merkle_hash_t[MERKLE_HASH_SIZE];
+
+/* Tree built leaf by leaf: only the roots of the complete subtrees on its right edge are kept */
+typedef struct merkle {
+	merkle_hash_t subtrees[MERKLE_MAX_DEPTH];	/* subtrees[i] holds 2^i leaves, if bit i of count is set */
+	unsigned int count;
+} merkle_t;
+
+/* builder */
+void merkle_init(merkle_t *tree);
+void merkle_leaf_hash(const void *data, size_t len, merkle_hash_t leaf);
+void merkle_leaf_hashes(const void *const data[], const size_t len[], int count, merkle_hash_t *leaves);
+void merkle_add(merkle_t *tree, const void *data, size_t len);
+void merkle_add_leaf(merkle_t *tree, const merkle_hash_t leaf);
+void merkle_root(const merkle_t *tree, merkle_hash_t root);
+void merkle_to_hex(const merkle_hash_t hash, char *hex);
+
+/* proofs */
+int merkle_proof(const merkle_hash_t *leaves, int count, int index, merkle_hash_t *path, int max_path);
+bool merkle_verify_proof(const merkle_hash_t leaf, int index, int count, const merkle_hash_t *path, int path_len, const merkle_hash_t root);
+
+/* verifier */
+int merkle_batch_leaves(const void *payload, size_t len, merkle_hash_t *leaves, int max_leaves, merkle_hash_t prev_root, merkle_hash_t root);
+int merkle_verify_batch(const void *payload, size_t len, const merkle_hash_t expected_prev_root, merkle_hash_t root);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MERKLE_H_ */
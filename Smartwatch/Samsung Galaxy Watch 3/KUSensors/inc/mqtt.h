@@ -11,7 +11,9 @@
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
-#include "mqtt/MQTTClient.h"
+#include "mqtt/MQTTAsync.h"
+#include "batch.h"
+#include "histogram.h"
 
 #define REST_API_ADDR 	"http://ec2-13-125-65-148.ap-northeast-2.compute.amazonaws.com:8080/KUHealth/GetMqttInfo"
 #define MQTT_ADDRESS    "tcp://ec2-13-125-65-148.ap-northeast-2.compute.amazonaws.com:1883"
@@ -19,12 +21,40 @@
 #define QOS         	1
 #define TIMEOUT     	10000L
 
+#if !defined(PUBLISH_WINDOW)
+#define PUBLISH_WINDOW	16		// QoS 1 messages in flight
+#endif
+#define DIAG_INTERVAL	60		// seconds between two messages on the <deviceID>/diag topic
+#define MQTT_BROKER_KEY	"mqtt_broker_uri"	// preference keeping the last discovered broker
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Publisher counters, all latencies in microseconds */
+typedef struct mqtt_stats {
+	unsigned long long enqueued;	/* payloads handed to the publisher */
+	unsigned long long sent;		/* payloads accepted by MQTTAsync */
+	unsigned long long acked;		/* payloads acknowledged by the broker */
+	unsigned long long failed;		/* send and delivery failures */
+	unsigned long long spooled;		/* payloads written to the spool */
+	unsigned long long reconnects;
+	int queue_depth;				/* payloads waiting for the sender thread */
+	int queue_depth_max;
+	int inflight;					/* payloads waiting for their PUBACK */
+	int inflight_max;
+	histogram_t queue_latency;		/* enqueue to send */
+	histogram_t ack_latency;		/* send to PUBACK */
+	histogram_t total_latency;		/* enqueue to PUBACK */
+	histogram_t batch_latency;		/* batch creation to PUBACK */
+} mqtt_stats_t;
+
 int mqttInit();
 void mqttPublish(void * msg);
+void mqttPublishBatch(batch_t * batch);
+void mqttGetAckLatency(histogram_t * latency, bool reset);
+void mqttGetStats(mqtt_stats_t * stats);
+bool mqttIsConnected();
 int mqttSubscribe();
 void mqttExit();
 
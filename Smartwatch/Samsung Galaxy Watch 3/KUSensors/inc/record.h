@@ -0,0 +1,84 @@
+/*
+ * record.h
+ *
+ * Wire formats of the sensor records published by the watch. This file and
+ * record.c only depend on the C library so that the decoder can be linked
+ * into the ingest side as is. The translator decodes them in RecordBatch.java,
+ * which must follow any change of the layout.
+ *
+ * Binary batch (little endian):
+ *   header  "KS" | version u8 | flags u8 | batch_id u32 | base_ms u64 | count u16 | reserved u16
+ *   record  type u8 | desc u8 | ts delta (zigzag varint, ms) | values
+ *           desc bits 0-2: value count, bits 4-5: RECORD_VALUES_*
+ *   [RECORD_FLAG_COMMITTED: prev_root | root, see merkle.h]
+ */
+
+#ifndef RECORD_H_
+#define RECORD_H_
+
+#include <stddef.h>
+
+#define RECORD_FORMAT_JSON		0
+#define RECORD_FORMAT_BINARY	1
+#define RECORD_FORMAT_COLUMNAR	2	// see columnar.h
+
+/* records computed on the watch, numbered after the sensor types */
+#define RECORD_TYPE_ACTIVITY	64	// see activity.h
+#define RECORD_TYPE_QUATERNION	65	// see fusion.h
+
+#if !defined(RECORD_DEFAULT_FORMAT)
+#define RECORD_DEFAULT_FORMAT	RECORD_FORMAT_JSON
+#endif
+
+#define RECORD_VERSION			1
+#define RECORD_MAX_VALUES		4
+#define RECORD_HEADER_SIZE		20
+#define RECORD_MAX_BINARY_SIZE	(2 + 10 + RECORD_MAX_VALUES * 4)
+#define RECORD_MAX_JSON_SIZE	512
+
+#define RECORD_FLAG_COMMITTED	0x01	// the batch ends with its commitment
+#define RECORD_COMMITMENT_SIZE	64		// root of the previous batch and of this one
+
+#define RECORD_VALUES_FLOAT		0	// IEEE 754 single precision
+#define RECORD_VALUES_CENTI16	1	// int16, value * 100
+#define RECORD_VALUES_CENTI32	2	// int32, value * 100
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct record {
+	int sensor_type;
+	long long timestamp_ms;		/* wall clock, milliseconds since the epoch */
+	int value_count;
+	float values[RECORD_MAX_VALUES];
+} record_t;
+
+typedef struct record_reader {
+	const unsigned char *data;
+	size_t len;
+	size_t pos;
+	int version;
+	int flags;
+	unsigned int batch_id;
+	int count;
+	int read;
+	long long timestamp_ms;		/* timestamp of the last decoded record */
+} record_reader_t;
+
+/* encoder */
+size_t record_write_json(const record_t *record, int transaction_id, char *buf, size_t size);
+size_t record_write_header(unsigned char *buf, size_t size, unsigned int batch_id, long long base_ms);
+void record_set_header_count(unsigned char *buf, int count);
+void record_set_header_flags(unsigned char *buf, int flags);
+size_t record_write_binary(const record_t *record, long long prev_ms, unsigned char *buf, size_t size);
+
+/* decoder */
+int record_reader_init(record_reader_t *reader, const void *data, size_t len);
+int record_reader_next(record_reader_t *reader, record_t *record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RECORD_H_ */
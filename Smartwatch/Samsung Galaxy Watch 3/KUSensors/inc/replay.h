@@ -0,0 +1,48 @@
+/*
+ * replay.h
+ *
+ * Records the sensor events to a trace file and replays them through the
+ * capture path (data.c -> batch -> MQTT), so that pipeline changes can be
+ * measured with the same input. The listeners are muted during a replay, and
+ * the derived streams start from a fresh state at both ends of it. A trace is
+ * a text file, one event per line:
+ *   sensor_type timestamp_us value_count value...
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdbool.h>
+#include <sensor.h>
+
+#define REPLAY_SPEED_MAX		0	// as fast as the pipeline takes the events
+#define REPLAY_SPEED_REALTIME	1	// with the timing of the trace
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct replay_report {
+	unsigned long long samples;
+	double elapsed_s;
+	double samples_per_s;
+	double cpu_us_per_sample;	/* CPU time of the whole process */
+	unsigned long long latency_p50_us;	/* batch creation to PUBACK */
+	unsigned long long latency_p90_us;
+	unsigned long long latency_p99_us;
+	unsigned long long latency_max_us;
+} replay_report_t;
+
+bool replay_record_start(const char *path);
+void replay_record_stop(void);
+void replay_record_events(int sensor_type, const sensor_event_s events[], int events_count);
+bool replay_start(const char *path, int speed);
+void replay_stop(void);
+bool replay_is_running(void);
+void replay_get_report(replay_report_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REPLAY_H_ */
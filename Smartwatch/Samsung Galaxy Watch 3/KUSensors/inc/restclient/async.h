@@ -0,0 +1,111 @@
+/*
+ * async.h
+ */
+
+#ifndef RESTCLIENT_ASYNC_H_
+#define RESTCLIENT_ASYNC_H_
+
+
+#include <curl/curl.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <future>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "restclient/restclient.h"
+
+#define RESTCLIENT_ASYNC_MAX_CONCURRENT	16		// transfers in progress by default
+
+/**
+ * @brief namespace for all RestClient definitions
+ */
+namespace RestClient {
+
+/**
+ * @brief Runs many requests at once on a single thread with the curl multi
+ * interface, e.g. to post a batch to several endpoints.
+ *
+ * Requests are queued and started in order, at most maxConcurrent of them
+ * at a time. Their result is delivered through a std::future or a
+ * callback. The callbacks run on the thread of the client, they should
+ * not block. The transfers share the connection cache of the multi
+ * handle, so the keep-alive connections of a host are reused. Errors are
+ * reported in Response::code as by Connection: the HTTP status, or the
+ * curl error code with its message in the body.
+ */
+class AsyncClient {
+public:
+	typedef std::function<void(const RestClient::Response&)> Callback;
+
+	explicit AsyncClient(int maxConcurrent = RESTCLIENT_ASYNC_MAX_CONCURRENT);
+	// the requests not finished yet fail with CURLE_ABORTED_BY_CALLBACK
+	~AsyncClient();
+
+	// set the default timeout of the requests, 0 for none
+	void SetTimeout(int milliseconds);
+	// append a header sent with every request
+	void AppendHeader(const std::string& key, const std::string& value);
+
+	// Basic HTTP verb methods, timeoutMs < 0 takes the default timeout
+	std::future<RestClient::Response> get(const std::string& url,
+			int timeoutMs = -1);
+	std::future<RestClient::Response> post(const std::string& url,
+			const std::string& ctype, const std::string& data,
+			int timeoutMs = -1);
+	void get(const std::string& url, Callback callback, int timeoutMs = -1);
+	void post(const std::string& url, const std::string& ctype,
+			const std::string& data, Callback callback, int timeoutMs = -1);
+
+	// wait until all the requests submitted so far are finished
+	void Wait();
+	// requests queued or in progress
+	int Pending();
+
+private:
+	typedef struct Request {
+		std::string url;
+		bool post;
+		std::string data;
+		curl_slist* headers;
+		long timeoutMs;
+		RestClient::Response response;
+		Callback callback;
+		std::shared_ptr<std::promise<RestClient::Response> > promise;
+	} Request;
+
+	AsyncClient(const AsyncClient&);
+	AsyncClient& operator=(const AsyncClient&);
+
+	Request* newRequest(const std::string& url, bool post,
+			const std::string& ctype, const std::string& data, int timeoutMs);
+	void submit(Request* request);
+	void start(Request* request);
+	void finish(CURL* handle, CURLcode result);
+	void complete(Request* request);
+	void wake();
+	void run();
+
+	CURLM* multi;
+	int maxConcurrent;
+	long defaultTimeoutMs;
+	RestClient::HeaderFields headerFields;
+	std::vector<CURL*> running;		// on the thread of the client only
+	std::vector<CURL*> freeHandles;
+
+	std::mutex lock;
+	std::condition_variable idle;
+	std::deque<Request*> queue;		// under lock
+	int pending;					// under lock
+	bool stopping;					// under lock
+	int wakeFds[2];
+	std::thread worker;
+};
+};  // namespace RestClient
+
+
+#endif /* RESTCLIENT_ASYNC_H_ */
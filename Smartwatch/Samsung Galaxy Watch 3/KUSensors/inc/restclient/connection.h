@@ -150,11 +150,16 @@ public:
 
 
 	explicit Connection(const std::string& baseUrl);
+	// use a curl handle created elsewhere, e.g. taken from the ConnectionPool
+	Connection(const std::string& baseUrl, CURL* handle);
 	~Connection();
 
 	// Terminate open connection
 	void Terminate();
 
+	// Give up the curl handle and its open connection, without closing them
+	CURL* Detach();
+
 	// Instance configuration methods
 	// configure basic auth
 	void SetBasicAuth(const std::string& username,
@@ -240,6 +245,7 @@ public:
 	get(const std::string& uri, RestClient::Response* response);
 
 private:
+	void init(const std::string& baseUrl);
 	CURL* getCurlHandle();
 	CURL* curlHandle;
 	std::string baseUrl;
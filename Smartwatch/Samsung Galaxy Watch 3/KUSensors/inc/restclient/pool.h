@@ -0,0 +1,94 @@
+/*
+ * pool.h
+ */
+
+#ifndef RESTCLIENT_POOL_H_
+#define RESTCLIENT_POOL_H_
+
+
+#include <curl/curl.h>
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <ctime>
+
+#define RESTCLIENT_POOL_MAX_IDLE		4		// idle handles kept per origin
+#define RESTCLIENT_POOL_IDLE_TIMEOUT	60		// seconds an idle handle is kept
+
+/**
+ * @brief namespace for all RestClient definitions
+ */
+namespace RestClient {
+
+/**
+ *  @struct PoolStats
+ *  @brief counters of the connection pool
+ *  @var PoolStats::acquired
+ *  Member 'acquired' contains the number of handles handed to requests
+ *  @var PoolStats::reused
+ *  Member 'reused' contains the number of them taken from the pool, with
+ *  their open connection, DNS entry and TLS session
+ *  @var PoolStats::created
+ *  Member 'created' contains the number of handles created
+ *  @var PoolStats::evicted
+ *  Member 'evicted' contains the number of idle handles closed because
+ *  their origin had RESTCLIENT_POOL_MAX_IDLE of them or they expired
+ *  @var PoolStats::idle
+ *  Member 'idle' contains the number of handles waiting in the pool
+ */
+typedef struct {
+	unsigned long long acquired;
+	unsigned long long reused;
+	unsigned long long created;
+	unsigned long long evicted;
+	int idle;
+} PoolStats;
+
+/**
+ * @brief Thread-safe pool of curl easy handles behind the simple API.
+ *
+ * A handle keeps the connections it opened, so a request taking a handle
+ * used before for the same scheme/host/port skips the DNS lookup and the
+ * TCP and TLS handshakes. All the handles of the pool share their DNS
+ * cache and TLS sessions through a curl share handle, a new handle to a
+ * known host resumes the TLS session.
+ */
+class ConnectionPool {
+public:
+	static ConnectionPool& Instance();
+
+	CURL* Acquire(const std::string& url);
+	void Release(const std::string& url, CURL* handle);
+	void Clear();
+	void Close();
+	PoolStats GetStats();
+
+	static std::string Origin(const std::string& url);
+
+private:
+	typedef struct {
+		CURL* handle;
+		time_t since;
+	} IdleHandle;
+
+	ConnectionPool();
+	~ConnectionPool();
+	ConnectionPool(const ConnectionPool&);
+	ConnectionPool& operator=(const ConnectionPool&);
+
+	CURLSH* NewShare();
+	static void lockShare(CURL* handle, curl_lock_data data,
+			curl_lock_access access, void* userptr);
+	static void unlockShare(CURL* handle, curl_lock_data data, void* userptr);
+
+	std::mutex lock;
+	std::map<std::string, std::vector<IdleHandle> > idle;
+	CURLSH* share;
+	std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+	PoolStats stats;
+};
+};  // namespace RestClient
+
+
+#endif /* RESTCLIENT_POOL_H_ */
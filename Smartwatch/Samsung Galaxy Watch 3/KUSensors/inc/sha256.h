@@ -9,6 +9,10 @@ extern "C" {
 #endif
 /****************************** MACROS ******************************/
 #define SHA256_BLOCK_SIZE 32            // SHA256 outputs a 32 byte digest
+#define SHA256_LANES      4             // messages hashed together by sha256_multi() without the crypto extensions
+
+// sha256.c picks the SHA-NI or ARMv8 crypto kernel at run time when the CPU has it,
+// define SHA256_NO_ACCELERATION to build the portable transform only.
 
 /**************************** DATA TYPES ****************************/
 typedef unsigned char BYTE;             // 8-bit byte
@@ -24,6 +28,8 @@ typedef struct {
 void sha256_init(SHA256_CTX *ctx);
 void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len);
 void sha256_final(SHA256_CTX *ctx, BYTE hash[]);
+void sha256_multi(const BYTE *const data[], const size_t len[], BYTE hash[][SHA256_BLOCK_SIZE], int count);
+const char *sha256_implementation(void);
 
 #ifdef __cplusplus
 }
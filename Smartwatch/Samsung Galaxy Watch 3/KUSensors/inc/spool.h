@@ -0,0 +1,55 @@
+/*
+ * spool.h
+ *
+ * Bounded store-and-forward queue of the payloads that could not be published.
+ * The spool is a directory of fixed size segment files, mapped in memory and
+ * filled in append-only mode. Each segment keeps its own write offset and read
+ * cursor in its header, so the queue survives a restart of the app. When the
+ * spool is full the oldest segment is evicted. Only depends on POSIX.
+ *
+ * Segment (little endian, host order):
+ *   header  "KSPL" | version u32 | seq u32 | write_off u32 | read_off u32 | reserved u32 | created_s u64
+ *   entry   len u32 | checksum u32 | payload, padded to 4 bytes
+ */
+
+#ifndef SPOOL_H_
+#define SPOOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define SPOOL_SEGMENT_SIZE		(256 * 1024)
+#define SPOOL_MAX_SEGMENTS		16				// 4 MB on the watch
+#define SPOOL_RETENTION_S		(24 * 60 * 60)	// segments older than a day are dropped
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Position of a peeked entry, handed back to spool_consume() */
+typedef struct spool_pos {
+	unsigned int seq;
+	unsigned int offset;
+	unsigned int next;
+} spool_pos_t;
+
+typedef struct spool_stats {
+	unsigned long long appended;	/* entries written to the spool */
+	unsigned long long consumed;	/* entries drained */
+	unsigned long long dropped;		/* entries lost to eviction, retention or corruption */
+	int segments;					/* segment files on disk */
+} spool_stats_t;
+
+bool spool_open(const char *dir, size_t segment_size, int max_segments, int retention_s);
+void spool_close(void);
+bool spool_append(const void *data, size_t len);
+int spool_peek(void **data, size_t *len, spool_pos_t *pos);
+void spool_consume(const spool_pos_t *pos);
+bool spool_is_empty(void);
+void spool_get_stats(spool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPOOL_H_ */
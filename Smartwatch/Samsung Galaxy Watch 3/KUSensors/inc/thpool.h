@@ -67,6 +67,65 @@ threadpool thpool_init(int num_threads);
 int thpool_add_work(threadpool, void (*function_p)(void*), void* arg_p);
 
 
+/**
+ * @brief Add several jobs to the job queue at once
+ *
+ * Adds one job per argument, all running the same function, and wakes the
+ * idle threads once for the whole batch instead of once per job.
+ *
+ * When the pool is built with THPOOL_WORK_STEALING, the jobs added from one
+ * of its own threads go to the deque of that thread, where the idle threads
+ * steal them from.
+ *
+ * @example
+ *
+ *    void hash_block(void* block){
+ *       ..
+ *    }
+ *
+ *    int main() {
+ *       ..
+ *       void* blocks[16];
+ *       ..
+ *       thpool_add_work_batch(thpool, hash_block, blocks, 16);
+ *       thpool_wait(thpool);
+ *       ..
+ *    }
+ *
+ * @param  threadpool    threadpool to which the work will be added
+ * @param  function_p    pointer to function to add as work
+ * @param  args_p        array of count arguments, one per job
+ * @param  count         number of jobs to add
+ * @return 0 on success, -1 otherwise. On failure, only the jobs before the
+ *         one that could not be added are queued.
+ */
+int thpool_add_work_batch(threadpool, void (*function_p)(void*), void** args_p, int count);
+
+
+/**
+ * @brief Add work to the shared job queue
+ *
+ * As thpool_add_work, except that the job always goes to the shared queue,
+ * also when the pool is built with THPOOL_WORK_STEALING and the job is added
+ * from one of its own threads. The job then runs after the jobs queued
+ * before it, instead of ahead of them from the deque of the thread.
+ *
+ * @example
+ *
+ *    void drain(void* arg){
+ *       ..
+ *       // the next part runs behind what was queued meanwhile
+ *       thpool_add_work_shared(thpool, drain, NULL);
+ *    }
+ *
+ * @param  threadpool    threadpool to which the work will be added
+ * @param  function_p    pointer to function to add as work
+ * @param  arg_p         pointer to an argument
+ * @return 0 on success, -1 otherwise.
+ */
+int thpool_add_work_shared(threadpool, void (*function_p)(void*), void* arg_p);
+
+
 /**
  * @brief Wait for all queued jobs to finish
  *
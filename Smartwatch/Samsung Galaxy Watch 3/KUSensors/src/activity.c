@@ -0,0 +1,285 @@
+/*
+ * activity.c
+ */
+
+#include <stdbool.h>
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include "activity.h"
+
+#define ACTIVITY_CHUNK			64		// samples of a pass over the magnitudes
+#define ACTIVITY_HIGH_PASS_HZ	0.5f	// below the slowest walk
+#define ACTIVITY_LOW_PASS_HZ	3.0f	// above the fastest run
+#define ACTIVITY_MAX_GAP_MS		1000	// longer gaps restart the filters
+#define ACTIVITY_MIN_STEP_MS	250
+#define ACTIVITY_MAX_STEP_MS	2000	// a peak later than this starts a new walk
+#define ACTIVITY_MIN_PEAK		0.6f	// m/s2, smallest filtered peak taken as a step
+#define ACTIVITY_ENVELOPE_DECAY	0.98f	// per peak, the threshold follows the recent peaks
+#define ACTIVITY_STILL_RMS		0.15f	// m/s2
+#define ACTIVITY_WALK_STEPS		4		// steps per window
+#define ACTIVITY_RUN_CADENCE	140		// steps/min
+
+typedef struct activity_window {
+	long long start_ms;
+	int steps;
+	double energy;
+	int samples;
+} activity_window_t;
+
+static struct activity_info {
+	pthread_mutex_t lock;
+	bool primed;
+	long long last_ms;
+	float last_magnitude;
+	float high_pass;
+	float low_pass;
+	float prev_low_pass;		/* the two previous filtered samples, to find the peaks */
+	float prev2_low_pass;
+	float envelope;
+	long long last_step_ms;
+	bool step_pending;			/* a first peak waiting for a second one to be counted */
+	activity_window_t window;
+	activity_window_t minute;
+	int class_ms[ACTIVITY_CLASS_COUNT];
+	int active_steps;
+} s_info = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void _filter_reset(void);
+static void _add_sample(long long timestamp_ms, float magnitude);
+static void _close_window(long long end_ms);
+static void _close_minute(record_t *summary);
+
+/**
+ * @brief Drops the current minute and the state of the filters.
+ */
+void activity_reset(void)
+{
+	pthread_mutex_lock(&s_info.lock);
+	s_info.primed = false;
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Feeds acceleration samples and replaces them by the summaries of the minutes they complete.
+ * @param records The samples of one sensor, oldest first, compacted in place into the summaries.
+ * @param count Number of samples.
+ * @return Number of summaries left in records.
+ */
+int activity_summarize(record_t *records, int count)
+{
+	float magnitudes[ACTIVITY_CHUNK];
+	long long timestamp_ms;
+	const float *v;
+	int kept = 0;
+	int base;
+	int n;
+	int i;
+
+	pthread_mutex_lock(&s_info.lock);
+
+	for (base = 0; base < count; base += n) {
+		n = count - base < ACTIVITY_CHUNK ? count - base : ACTIVITY_CHUNK;
+
+		/* independent per sample, left to the vectorizer */
+		for (i = 0; i < n; ++i) {
+			v = records[base + i].values;
+			magnitudes[i] = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		}
+
+		for (i = 0; i < n; ++i) {
+			timestamp_ms = records[base + i].timestamp_ms;
+
+			if (!s_info.primed) {
+				memset(&s_info.minute, 0, sizeof(s_info.minute));
+				memset(s_info.class_ms, 0, sizeof(s_info.class_ms));
+				s_info.minute.start_ms = timestamp_ms - timestamp_ms % ACTIVITY_SUMMARY_MS;
+				s_info.window = s_info.minute;
+				s_info.active_steps = 0;
+				_filter_reset();
+				s_info.primed = true;
+			} else if (timestamp_ms >= s_info.minute.start_ms + ACTIVITY_SUMMARY_MS) {
+				/* kept never passes base + i, the sample was read before being overwritten */
+				_close_window(s_info.minute.start_ms + ACTIVITY_SUMMARY_MS);
+				_close_minute(&records[kept++]);
+				s_info.minute.start_ms = timestamp_ms - timestamp_ms % ACTIVITY_SUMMARY_MS;
+				s_info.window.start_ms = s_info.minute.start_ms;
+			}
+
+			while (timestamp_ms >= s_info.window.start_ms + ACTIVITY_WINDOW_MS)
+				_close_window(s_info.window.start_ms + ACTIVITY_WINDOW_MS);
+
+			_add_sample(timestamp_ms, magnitudes[i]);
+		}
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+
+	return kept;
+}
+
+/**
+ * @brief Writes the summary of the minute in progress, so that its samples are published before
+ * the app goes to the background or stops. The rest of the minute gets its own summary, with the
+ * same timestamp.
+ * @param summary The record receiving the summary.
+ * @return 1 if a summary was written, 0 if no sample was fed since the previous summary.
+ */
+int activity_flush(record_t *summary)
+{
+	long long start_ms;
+	int written = 0;
+
+	pthread_mutex_lock(&s_info.lock);
+
+	if (s_info.primed) {
+		_close_window(s_info.last_ms + 1);
+		if (s_info.minute.samples > 0 || s_info.minute.steps > 0) {
+			start_ms = s_info.minute.start_ms;
+			_close_minute(summary);
+			s_info.minute.start_ms = start_ms;
+			written = 1;
+		}
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+
+	return written;
+}
+
+static void _filter_reset(void)
+{
+	s_info.last_ms = 0;
+	s_info.high_pass = 0;
+	s_info.low_pass = 0;
+	s_info.prev_low_pass = 0;
+	s_info.prev2_low_pass = 0;
+	s_info.envelope = 0;
+	s_info.last_step_ms = 0;
+	s_info.step_pending = false;
+}
+
+/**
+ * @brief Band-passes one magnitude and counts the step it may end. The coefficients follow the
+ * actual sampling interval, the listener interval changes with the data view.
+ */
+static void _add_sample(long long timestamp_ms, float magnitude)
+{
+	float dt;
+	float rc;
+	float peak;
+	long long peak_ms;
+
+	if (s_info.last_ms == 0 || timestamp_ms - s_info.last_ms > ACTIVITY_MAX_GAP_MS) {
+		_filter_reset();
+		s_info.last_ms = timestamp_ms;
+		s_info.last_magnitude = magnitude;
+		return;
+	}
+
+	if (timestamp_ms <= s_info.last_ms)
+		return;
+
+	dt = (timestamp_ms - s_info.last_ms) / 1000.0f;
+	peak_ms = s_info.last_ms;
+
+	rc = 1.0f / (2 * M_PI * ACTIVITY_HIGH_PASS_HZ);
+	s_info.high_pass = rc / (rc + dt) * (s_info.high_pass + magnitude - s_info.last_magnitude);
+	rc = 1.0f / (2 * M_PI * ACTIVITY_LOW_PASS_HZ);
+	s_info.prev2_low_pass = s_info.prev_low_pass;
+	s_info.prev_low_pass = s_info.low_pass;
+	s_info.low_pass += dt / (rc + dt) * (s_info.high_pass - s_info.low_pass);
+
+	s_info.last_ms = timestamp_ms;
+	s_info.last_magnitude = magnitude;
+
+	s_info.window.energy += s_info.low_pass * s_info.low_pass;
+	s_info.window.samples++;
+
+	/* the previous sample is a peak */
+	peak = s_info.prev_low_pass;
+	if (peak <= s_info.prev2_low_pass || peak < s_info.low_pass)
+		return;
+
+	if (peak < ACTIVITY_MIN_PEAK)
+		return;
+
+	s_info.envelope = peak > s_info.envelope * ACTIVITY_ENVELOPE_DECAY ? peak : s_info.envelope * ACTIVITY_ENVELOPE_DECAY;
+	if (peak < s_info.envelope * 0.5f)
+		return;
+
+	if (s_info.last_step_ms && peak_ms - s_info.last_step_ms < ACTIVITY_MIN_STEP_MS)
+		return;
+
+	if (s_info.last_step_ms && peak_ms - s_info.last_step_ms <= ACTIVITY_MAX_STEP_MS) {
+		/* a rhythm, the peak that started it is a step as well */
+		s_info.window.steps += s_info.step_pending ? 2 : 1;
+		s_info.step_pending = false;
+	} else {
+		s_info.step_pending = true;
+	}
+
+	s_info.last_step_ms = peak_ms;
+}
+
+/**
+ * @brief Classifies the current window, adds it to the minute and starts the next one.
+ * @param end_ms End of the window, shorter than ACTIVITY_WINDOW_MS at the end of a minute.
+ */
+static void _close_window(long long end_ms)
+{
+	activity_window_t *window = &s_info.window;
+	int duration_ms = end_ms - window->start_ms;
+	float rms = window->samples ? sqrtf(window->energy / window->samples) : 0;
+	int cadence = duration_ms > 0 ? window->steps * 60000 / duration_ms : 0;
+	int class;
+
+	if (window->steps > 0 && window->steps * ACTIVITY_WINDOW_MS >= ACTIVITY_WALK_STEPS * duration_ms)
+		class = cadence >= ACTIVITY_RUN_CADENCE ? ACTIVITY_RUNNING : ACTIVITY_WALKING;
+	else if (rms >= ACTIVITY_STILL_RMS)
+		class = ACTIVITY_LIGHT;
+	else
+		class = ACTIVITY_STILL;
+
+	if (window->samples > 0) {
+		s_info.class_ms[class] += duration_ms;
+		if (class == ACTIVITY_WALKING || class == ACTIVITY_RUNNING)
+			s_info.active_steps += window->steps;
+	}
+
+	s_info.minute.steps += window->steps;
+	s_info.minute.energy += window->energy;
+	s_info.minute.samples += window->samples;
+
+	memset(window, 0, sizeof(*window));
+	window->start_ms = end_ms;
+}
+
+/**
+ * @brief Writes the summary of the current minute and clears it.
+ */
+static void _close_minute(record_t *summary)
+{
+	int active_ms = s_info.class_ms[ACTIVITY_WALKING] + s_info.class_ms[ACTIVITY_RUNNING];
+	int class = ACTIVITY_STILL;
+	int i;
+
+	for (i = 1; i < ACTIVITY_CLASS_COUNT; ++i) {
+		if (s_info.class_ms[i] > s_info.class_ms[class])
+			class = i;
+	}
+
+	summary->sensor_type = RECORD_TYPE_ACTIVITY;
+	summary->timestamp_ms = s_info.minute.start_ms;
+	summary->values[0] = s_info.minute.steps;
+	summary->values[1] = class;
+	summary->values[2] = s_info.minute.samples ? sqrt(s_info.minute.energy / s_info.minute.samples) : 0;
+	summary->values[3] = active_ms > 0 ? s_info.active_steps * 60000.0f / active_ms : 0;
+	summary->value_count = 4;
+
+	memset(&s_info.minute, 0, sizeof(s_info.minute));
+	memset(s_info.class_ms, 0, sizeof(s_info.class_ms));
+	s_info.active_steps = 0;
+}
@@ -19,10 +19,17 @@
 #include <linux/limits.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <time.h>
 #include <sensor.h>
 #include <sensors.h>
 #include "data.h"
+#include "activity.h"
+#include "deadband.h"
+#include "fusion.h"
+#include "hrv.h"
+#include "replay.h"
 #include "view_defines.h"
 
 #define MAX_GYRO_VALUE 571.0
@@ -31,37 +38,100 @@
 //#define LISTENER_TIMEOUT 1000
 #define LISTENER_TIMEOUT 1000
 #define LISTENER_TIMEOUT_FINAL ((LISTENER_TIMEOUT != 0) ? LISTENER_TIMEOUT : 100)
+#define PUBLISH_CHUNK 64
 
 typedef struct _sensor_data {
 	sensor_h handle;
 	sensor_listener_h listener;
+	bool started;
+	bool capturing;
+	int interval_ms;
+	int applied_interval_ms;
+	int max_batch_latency_ms;
 } sensor_data_t;
 
+/*
+ * Sensors streamed to the publisher from the start, whatever the data view shows.
+ * The batch latency lets the sensor hub queue the samples in its FIFO and wake
+ * the application processor once per latency instead of once per sample.
+ */
+static const struct {
+	sensor_type_e type;
+	int interval_ms;
+	int max_batch_latency_ms;
+} s_capture_defaults[] = {
+	{ SENSOR_HRM, 250, 0 },		/* faster than the shortest beat, so that no peak-to-peak report is missed */
+	{ SENSOR_ACCELEROMETER, 100, 2000 },
+	{ SENSOR_PRESSURE, 1000, 10000 },
+	/* fused into the orientation, see _publish_events() */
+	{ SENSOR_GYROSCOPE, 40, 2000 },
+	{ SENSOR_MAGNETIC, 100, 2000 },
+};
+
+/*
+ * Change detection of the slow sensors: a reading is only published when it
+ * moved out of the band or after max_silence_ms without any change.
+ */
+static const struct {
+	sensor_type_e type;
+	deadband_policy_t policy;
+} s_deadband_defaults[] = {
+	/* abs_band, rel_band, max_silence_ms, fast_interval_ms, hold_ms */
+	{ SENSOR_LIGHT, { 2.0, 0.05, 60000, 0, 0 } },
+	{ SENSOR_PROXIMITY, { 0.5, 0.0, 60000, 0, 0 } },
+	{ SENSOR_PRESSURE, { 0.05, 0.0, 60000, 250, 5000 } },
+	{ SENSOR_TEMPERATURE, { 0.1, 0.0, 60000, 0, 0 } },
+};
+
 static struct data_info {
 	sensor_type_e current_sensor;
+	bool ui_active;
+	bool replaying;
 	sensor_data_t sensors[SENSOR_COUNT];
 	Update_Sensor_Values_Cb sensor_update_cb;
+	Publish_Sensor_Records_Cb sensor_publish_cb;
 	Ecore_Timer *timer;
 } s_info = {
 	.sensors = { {0}, },
 	.current_sensor = 0,
+	.ui_active = false,
+	.replaying = false,
 	.sensor_update_cb = NULL,
+	.sensor_publish_cb = NULL,
 	.timer = NULL,
 };
 
 static void _initialize_sensors(void);
+static bool _listener_start(sensor_type_e type, int interval_ms);
+static void _listener_stop(sensor_type_e type);
+static void _listener_set_batch_latency(sensor_type_e type, int max_batch_latency_ms);
+static void _publish_events(sensor_type_e type, sensor_event_s events[], int events_count);
+static void _publish_records(sensor_type_e type, record_t records[], int count);
+static bool _is_activity_source(sensor_type_e type);
+static bool _is_fused(sensor_type_e type);
+static void _sensor_events_cb(sensor_h sensor, sensor_event_s events[], int events_count, void *data);
 static void _sensor_event_cb(sensor_h sensor, sensor_event_s *event, void *data);
 static void _timer_stop(void);
 
 /**
- * @brief Function that initializes the data module.
+ * @brief Function that initializes the data module and starts the background capture of the default sensors.
  * @param sensor_update_cb Callback used to update the data displayed in the data view.
+ * @param sensor_publish_cb Callback receiving the records of every captured sensor.
  * @return True on success or false on error.
  */
-bool data_initialize(Update_Sensor_Values_Cb sensor_update_cb)
+bool data_initialize(Update_Sensor_Values_Cb sensor_update_cb, Publish_Sensor_Records_Cb sensor_publish_cb)
 {
+	int i;
+
 	_initialize_sensors();
 	s_info.sensor_update_cb = sensor_update_cb;
+	s_info.sensor_publish_cb = sensor_publish_cb;
+
+	for (i = 0; i < sizeof(s_deadband_defaults) / sizeof(s_deadband_defaults[0]); ++i)
+		deadband_set_policy(s_deadband_defaults[i].type, &s_deadband_defaults[i].policy);
+
+	for (i = 0; i < sizeof(s_capture_defaults) / sizeof(s_capture_defaults[0]); ++i)
+		data_capture_start(s_capture_defaults[i].type, s_capture_defaults[i].interval_ms, s_capture_defaults[i].max_batch_latency_ms);
 
 	return true;
 }
@@ -72,9 +142,20 @@ bool data_initialize(Update_Sensor_Values_Cb sensor_update_cb)
 void data_finalize(void)
 {
 	int ret = SENSOR_ERROR_NONE;
+	deadband_stats_t stats;
+	hrv_stats_t hrv;
 	int i;
 
+	hrv_get_stats(&hrv);
+	if (hrv.accepted + hrv.rejected > 0)
+		dlog_print(DLOG_INFO, LOG_TAG, "hrm: %llu beats accepted, %llu rejected, RMSSD %.1f ms, SDNN %.1f ms",
+				hrv.accepted, hrv.rejected, hrv.rmssd_ms, hrv.sdnn_ms);
+
 	for (i = 0; i < SENSOR_COUNT; ++i) {
+		deadband_get_stats(i, &stats);
+		if (stats.sent + stats.suppressed > 0)
+			dlog_print(DLOG_INFO, LOG_TAG, "sensor %d: %llu records sent, %llu suppressed", i, stats.sent, stats.suppressed);
+
 		ret = sensor_destroy_listener(s_info.sensors[i].listener);
 		if (ret != SENSOR_ERROR_NONE) {
 			dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] sensor_get_default_sensor() error: %s", __FILE__, __LINE__, get_error_message(ret));
@@ -175,15 +256,19 @@ char *data_get_sensor_vendor(sensor_type_e type)
 }
 
 /**
- * @brief Stops the current listener.
+ * @brief Stops the current listener, unless the sensor is captured in the background.
  */
 void data_stop_sensor(void)
 {
-	int ret = sensor_listener_stop(s_info.sensors[s_info.current_sensor].listener);
-	if (ret != SENSOR_ERROR_NONE) {
-		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] sensor_listener_stop() error: %s", __FILE__, __LINE__, get_error_message(ret));
-		return;
-	}
+	sensor_data_t *sensor = &s_info.sensors[s_info.current_sensor];
+
+	if (s_info.ui_active && sensor->capturing)
+		_listener_set_batch_latency(s_info.current_sensor, sensor->max_batch_latency_ms);
+
+	s_info.ui_active = false;
+
+	if (!sensor->capturing)
+		_listener_stop(s_info.current_sensor);
 
 	_timer_stop();
 }
@@ -194,16 +279,141 @@ void data_stop_sensor(void)
  */
 void data_set_selected_sensor(sensor_type_e type)
 {
-	int ret;
+	sensor_data_t *sensor = &s_info.sensors[type];
+
 	data_stop_sensor();
 
-	ret = sensor_listener_start(s_info.sensors[type].listener);
-	if (ret != SENSOR_ERROR_NONE) {
-		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] sensor_listener_start() error: %s", __FILE__, __LINE__, get_error_message(ret));
+	if (!_listener_start(type, sensor->capturing ? sensor->interval_ms : LISTENER_TIMEOUT_FINAL))
 		return;
-	}
+
+	/* the data view draws every sample as it comes */
+	if (sensor->capturing)
+		_listener_set_batch_latency(type, 0);
 
 	s_info.current_sensor = type;
+	s_info.ui_active = true;
+}
+
+/**
+ * @brief Starts streaming the given sensor to the publisher, independently of the data view.
+ * @param type The sensor to capture.
+ * @param interval_ms The sampling interval of the sensor.
+ * @param max_batch_latency_ms How long the samples may stay in the hardware FIFO, 0 to deliver them one by one.
+ * @return True on success or false on error.
+ */
+bool data_capture_start(sensor_type_e type, int interval_ms, int max_batch_latency_ms)
+{
+	sensor_data_t *sensor = &s_info.sensors[type];
+	int ret;
+
+	if (!sensor->listener) {
+		dlog_print(DLOG_WARN, LOG_TAG, "[%s:%d] sensor %d is not available for capture", __FILE__, __LINE__, type);
+		return false;
+	}
+
+	/* keep receiving events when the display is off or the app is in the background */
+	ret = sensor_listener_set_option(sensor->listener, SENSOR_OPTION_ALWAYS_ON);
+	if (ret != SENSOR_ERROR_NONE)
+		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] sensor_listener_set_option() error: %s", __FILE__, __LINE__, get_error_message(ret));
+
+	sensor->interval_ms = interval_ms > 0 ? interval_ms : LISTENER_TIMEOUT_FINAL;
+	deadband_reset(type);
+	if (type == SENSOR_HRM)
+		hrv_reset();
+	else if (type == SENSOR_ACCELEROMETER || type == SENSOR_LINEAR_ACCELERATION)
+		activity_reset();
+	else if (type == SENSOR_GYROSCOPE)
+		fusion_reset();
+	if (!_listener_start(type, sensor->interval_ms))
+		return false;
+
+	sensor->max_batch_latency_ms = max_batch_latency_ms > 0 ? max_batch_latency_ms : 0;
+	if (!(s_info.ui_active && s_info.current_sensor == type))
+		_listener_set_batch_latency(type, sensor->max_batch_latency_ms);
+
+	sensor->capturing = true;
+
+	return true;
+}
+
+/**
+ * @brief Stops streaming the given sensor to the publisher. The data view keeps its listener running.
+ * @param type The captured sensor.
+ */
+void data_capture_stop(sensor_type_e type)
+{
+	sensor_data_t *sensor = &s_info.sensors[type];
+
+	if (!sensor->capturing)
+		return;
+
+	sensor->capturing = false;
+	sensor_listener_set_option(sensor->listener, SENSOR_OPTION_DEFAULT);
+	_listener_set_batch_latency(type, 0);
+
+	if (s_info.ui_active && s_info.current_sensor == type)
+		_listener_start(type, LISTENER_TIMEOUT_FINAL);
+	else
+		_listener_stop(type);
+}
+
+/**
+ * @brief Checks if the given sensor is captured in the background.
+ * @param type The sensor's type.
+ * @return true - sensor is captured, false - sensor is not captured.
+ */
+bool data_capture_is_running(sensor_type_e type)
+{
+	return s_info.sensors[type].capturing;
+}
+
+/**
+ * @brief Hands the partial records still held by the capture path to the publisher,
+ * such as the activity summary of the minute in progress.
+ */
+void data_flush(void)
+{
+	record_t summary;
+
+	if (s_info.sensor_publish_cb && activity_flush(&summary))
+		s_info.sensor_publish_cb(&summary, 1);
+}
+
+/**
+ * @brief Mutes the listeners while a trace is replayed. The derived streams (HRV, activity,
+ * orientation) and the change detection start over when the replay starts and when it ends,
+ * so the trace and the live capture never feed each other's state.
+ * @param replaying True when a replay starts, false when it ends.
+ */
+void data_set_replay_mode(bool replaying)
+{
+	int i;
+
+	if (s_info.replaying == replaying)
+		return;
+
+	/* the partial minute belongs to the stream that ends */
+	data_flush();
+
+	s_info.replaying = replaying;
+	hrv_reset();
+	activity_reset();
+	fusion_reset();
+	for (i = 0; i < SENSOR_COUNT; ++i)
+		deadband_reset(i);
+}
+
+/**
+ * @brief Feeds events that did not come from a listener, such as a replayed trace, to the publisher.
+ * The listeners should be muted with data_set_replay_mode() first.
+ * @param type The sensor the events belong to.
+ * @param events The events, oldest first.
+ * @param events_count Number of events.
+ */
+void data_inject_events(sensor_type_e type, sensor_event_s events[], int events_count)
+{
+	if (events_count > 0)
+		_publish_events(type, events, events_count);
 }
 
 /**
@@ -227,6 +437,13 @@ static void _initialize_sensors(void)
 			continue;
 		}
 
+		/* the batched callback receives the whole hardware FIFO in one call, older platforms only have the single event one */
+		ret = sensor_listener_set_events_cb(s_info.sensors[i].listener, _sensor_events_cb, (void *)i);
+		if (ret == SENSOR_ERROR_NONE)
+			continue;
+
+		dlog_print(DLOG_WARN, LOG_TAG, "[%s:%d] sensor_listener_set_events_cb() error: %s", __FILE__, __LINE__, get_error_message(ret));
+
 		ret = sensor_listener_set_event_cb(s_info.sensors[i].listener, LISTENER_TIMEOUT, _sensor_event_cb, (void *)i);
 		if (ret != SENSOR_ERROR_NONE) {
 			dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] sensor_listener_set_event_cb() error: %s", __FILE__, __LINE__, get_error_message(ret));
@@ -235,6 +452,75 @@ static void _initialize_sensors(void)
 	}
 }
 
+/**
+ * @brief Starts the listener of the given sensor if needed and applies the sampling interval.
+ * @param type The sensor's type.
+ * @param interval_ms The sampling interval.
+ * @return True on success or false on error.
+ */
+static bool _listener_start(sensor_type_e type, int interval_ms)
+{
+	sensor_data_t *sensor = &s_info.sensors[type];
+	int ret;
+
+	ret = sensor_listener_set_interval(sensor->listener, interval_ms);
+	if (ret != SENSOR_ERROR_NONE)
+		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] sensor_listener_set_interval() error: %s", __FILE__, __LINE__, get_error_message(ret));
+	sensor->applied_interval_ms = interval_ms;
+
+	if (sensor->started)
+		return true;
+
+	ret = sensor_listener_start(sensor->listener);
+	if (ret != SENSOR_ERROR_NONE) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] sensor_listener_start() error: %s", __FILE__, __LINE__, get_error_message(ret));
+		return false;
+	}
+
+	sensor->started = true;
+
+	return true;
+}
+
+/**
+ * @brief Stops the listener of the given sensor.
+ * @param type The sensor's type.
+ */
+static void _listener_stop(sensor_type_e type)
+{
+	sensor_data_t *sensor = &s_info.sensors[type];
+	int ret;
+
+	if (!sensor->started)
+		return;
+
+	ret = sensor_listener_stop(sensor->listener);
+	if (ret != SENSOR_ERROR_NONE) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] sensor_listener_stop() error: %s", __FILE__, __LINE__, get_error_message(ret));
+		return;
+	}
+
+	sensor->started = false;
+}
+
+/**
+ * @brief Sets how long the sensor hub may hold the samples of the given sensor before waking the application.
+ * Sensors without a hardware FIFO reject the request and keep delivering every sample.
+ * @param type The sensor's type.
+ * @param max_batch_latency_ms The latency, 0 to disable batching.
+ */
+static void _listener_set_batch_latency(sensor_type_e type, int max_batch_latency_ms)
+{
+	int ret;
+
+	if (!s_info.sensors[type].listener)
+		return;
+
+	ret = sensor_listener_set_max_batch_latency(s_info.sensors[type].listener, max_batch_latency_ms);
+	if (ret != SENSOR_ERROR_NONE && max_batch_latency_ms > 0)
+		dlog_print(DLOG_WARN, LOG_TAG, "[%s:%d] sensor_listener_set_max_batch_latency() error: %s", __FILE__, __LINE__, get_error_message(ret));
+}
+
 /**
  * @brief A ecore timer callback used when the proximity timer is the current one. This is needed because the proximity sensor works differently than most of the other sensors.
  * @param data
@@ -273,24 +559,27 @@ static void _timer_start(int value)
 
 /**
  * @brief Function used when the hrm sensor is the current one. The hrm sensor works differently than most of the other sensors.
+ * The chart draws a pulse for every beat extracted by the hrv module and the displayed interval is the last accepted one.
  * @param event The event object storing the sensor data.
  */
 static void _set_hrm_values(sensor_event_s *event)
 {
-	static int timeout = 0;
+	static unsigned long long drawn_beats = 0;
 	static int draw_phase = 0;
+	hrv_stats_t stats;
 	float min = 0;
 	float max = 0;
 
 	data_get_sensor_range(SENSOR_HRM, &min, &max);
+	hrv_get_stats(&stats);
 
 	event->value_count = 2;
+	if (stats.beats > 0)
+		event->values[2] = stats.rr_ms;
 
-	if (timeout >= (int)event->values[2]) {
-		timeout = 0;
+	if (stats.accepted + stats.rejected != drawn_beats) {
+		drawn_beats = stats.accepted + stats.rejected;
 		draw_phase = 2;
-	} else {
-		timeout += LISTENER_TIMEOUT_FINAL;
 	}
 
 	if (draw_phase == 2) {
@@ -326,14 +615,160 @@ void data_get_sensor_data(sensor_type_e type)
 }
 
 /**
- * @brief Callback invoked by a sensor's listener.
+ * @brief Converts the events delivered by a listener into records and hands them to the publisher.
+ * The events of a FIFO delivery were sampled earlier than the callback, so their wall clock time is
+ * rebuilt from the sensor timestamps relative to the newest event. Readings within the dead-band of
+ * their sensor are dropped here, before any serialization. The HRM readings are replaced by one record
+ * per plausible beat, the gyroscope, magnetic and orientation ones by the fused orientation.
+ * @param type The sensor the events come from.
+ * @param events The events, oldest first.
+ * @param events_count Number of events.
+ */
+static void _publish_events(sensor_type_e type, sensor_event_s events[], int events_count)
+{
+	record_t records[PUBLISH_CHUNK];
+	unsigned long long newest_us = events[events_count - 1].timestamp;
+	long long now_ms;
+	struct timespec ts;
+	sensor_event_s *event;
+	record_t *record;
+	hrv_beat_t beat;
+	hrv_stats_t hrv;
+	int n = 0;
+	int i;
+
+	if (!s_info.sensor_publish_cb)
+		return;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	now_ms = (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+	for (i = 0; i < events_count; ++i) {
+		event = &events[i];
+		record = &records[n++];
+
+		record->sensor_type = type;
+		record->timestamp_ms = now_ms - (long long)(newest_us - event->timestamp) / 1000;
+
+		if (type == SENSOR_ACCELEROMETER)
+			fusion_set_gravity(event->timestamp, event->values);
+
+		/* the layout used by the data view */
+		if (type == SENSOR_HRM) {
+			/* heart rate, beat interval, RMSSD and SDNN */
+			if (!hrv_add_event(event->timestamp, event->values[0], event->values[2], &beat) || beat.confidence < HRV_MIN_CONFIDENCE) {
+				n--;
+				continue;
+			}
+			hrv_get_stats(&hrv);
+			record->values[0] = hrv.heart_rate;
+			record->values[1] = beat.rr_ms;
+			record->values[2] = hrv.rmssd_ms;
+			record->values[3] = hrv.sdnn_ms;
+			record->value_count = 4;
+		} else if (type == SENSOR_PRESSURE) {
+			record->values[0] = event->values[0];
+			record->value_count = 1;
+		} else if (_is_fused(type)) {
+			/* w, x, y and z of the orientation, at the output rate of the filter */
+			if (type == SENSOR_MAGNETIC)
+				fusion_set_magnetic(event->timestamp, event->values);
+			if (type != SENSOR_GYROSCOPE || !fusion_update(event->timestamp, event->values, record->values)) {
+				n--;
+				continue;
+			}
+			record->sensor_type = RECORD_TYPE_QUATERNION;
+			record->value_count = 4;
+		} else {
+			record->value_count = event->value_count < RECORD_MAX_VALUES ? event->value_count : RECORD_MAX_VALUES;
+			memcpy(record->values, event->values, record->value_count * sizeof(float));
+		}
+
+		if (n == PUBLISH_CHUNK) {
+			_publish_records(type, records, n);
+			n = 0;
+		}
+	}
+
+	_publish_records(type, records, n);
+}
+
+/**
+ * @brief Reduces a chunk of records of one sensor and hands what is left to the publisher.
+ * The samples of the activity source are replaced by the per-minute activity summaries.
+ * @param type The sensor the records come from.
+ * @param records The records, modified in place.
+ * @param count Number of records.
+ */
+static void _publish_records(sensor_type_e type, record_t records[], int count)
+{
+	if (count > 0 && _is_activity_source(type))
+		count = activity_summarize(records, count);
+
+	count = deadband_filter(records, count);
+	if (count > 0)
+		s_info.sensor_publish_cb(records, count);
+}
+
+/**
+ * @brief Checks if the given sensor feeds the activity classifier. The linear acceleration is
+ * preferred when it is captured, it comes without the gravity.
+ * @param type The sensor's type.
+ */
+static bool _is_activity_source(sensor_type_e type)
+{
+	if (s_info.sensors[SENSOR_LINEAR_ACCELERATION].capturing)
+		return type == SENSOR_LINEAR_ACCELERATION;
+
+	return type == SENSOR_ACCELEROMETER;
+}
+
+/**
+ * @brief Checks if the given sensor is replaced by the fused orientation, which runs while the gyroscope is captured.
+ * @param type The sensor's type.
+ */
+static bool _is_fused(sensor_type_e type)
+{
+	if (!s_info.sensors[SENSOR_GYROSCOPE].capturing)
+		return false;
+
+	return type == SENSOR_GYROSCOPE || type == SENSOR_MAGNETIC || type == SENSOR_ORIENTATION;
+}
+
+/**
+ * @brief Callback invoked by a sensor's listener with the events queued since the previous call.
+ * Every captured sensor is published, only the newest event of the current one is displayed.
  * @param sensor The sensor's handle.
- * @param event The event data.
+ * @param events The events, oldest first.
+ * @param events_count Number of events.
  * @param data The user data.
  */
-static void _sensor_event_cb(sensor_h sensor, sensor_event_s *event, void *data)
+static void _sensor_events_cb(sensor_h sensor, sensor_event_s events[], int events_count, void *data)
 {
 	sensor_type_e type = (sensor_type_e)data;
+	bool displayed = s_info.ui_active && type == s_info.current_sensor;
+	sensor_data_t *sensor_data = &s_info.sensors[type];
+	sensor_event_s *event;
+	int interval_ms;
+
+	if (events_count <= 0)
+		return;
+
+	replay_record_events(type, events, events_count);
+
+	/* the replayed trace is the only input of the publisher while it runs */
+	if ((sensor_data->capturing || displayed) && !s_info.replaying)
+		_publish_events(type, events, events_count);
+
+	if (!displayed) {
+		/* sample faster while the values change, the data view keeps its own rate */
+		interval_ms = deadband_interval(type, sensor_data->interval_ms);
+		if (sensor_data->capturing && interval_ms != sensor_data->applied_interval_ms)
+			_listener_start(type, interval_ms);
+		return;
+	}
+
+	event = &events[events_count - 1];
 
 	_timer_stop();
 
@@ -346,3 +781,14 @@ static void _sensor_event_cb(sensor_h sensor, sensor_event_s *event, void *data)
 
 	s_info.sensor_update_cb(event->value_count, &event->values[0]);
 }
+
+/**
+ * @brief Callback invoked by a sensor's listener on platforms without the batched callback.
+ * @param sensor The sensor's handle.
+ * @param event The event data.
+ * @param data The user data.
+ */
+static void _sensor_event_cb(sensor_h sensor, sensor_event_s *event, void *data)
+{
+	_sensor_events_cb(sensor, event, 1, data);
+}
@@ -0,0 +1,186 @@
+/*
+ * deadband.c
+ */
+
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include "deadband.h"
+
+#define DEADBAND_SENSOR_COUNT	14
+
+typedef struct deadband_state {
+	bool enabled;
+	bool primed;				/* a record was sent since the last reset */
+	deadband_policy_t policy;
+	record_t last_sent;
+	long long last_change_ms;	/* timestamp of the last record that left the band */
+	long long last_seen_ms;		/* timestamp of the last filtered record */
+	deadband_stats_t stats;
+} deadband_state_t;
+
+static struct deadband_info {
+	deadband_state_t sensors[DEADBAND_SENSOR_COUNT];
+	pthread_mutex_t lock;
+} s_info = {
+	.sensors = { {0}, },
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static bool _is_changed(const deadband_state_t *state, const record_t *record);
+
+/**
+ * @brief Sets the change detection policy of a sensor. Sensors without a policy send every record.
+ * @param sensor_type The sensor's type.
+ * @param policy The policy or NULL to send every record.
+ */
+void deadband_set_policy(int sensor_type, const deadband_policy_t *policy)
+{
+	deadband_state_t *state;
+
+	if (sensor_type < 0 || sensor_type >= DEADBAND_SENSOR_COUNT)
+		return;
+
+	pthread_mutex_lock(&s_info.lock);
+	state = &s_info.sensors[sensor_type];
+	state->enabled = policy != NULL;
+	if (policy)
+		state->policy = *policy;
+	state->primed = false;
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Drops the records that did not leave the dead-band of their sensor.
+ * @param records The records, compacted in place.
+ * @param count Number of records.
+ * @return Number of records left to send.
+ */
+int deadband_filter(record_t *records, int count)
+{
+	deadband_state_t *state;
+	record_t *record;
+	bool changed;
+	int kept = 0;
+	int i;
+
+	pthread_mutex_lock(&s_info.lock);
+
+	for (i = 0; i < count; ++i) {
+		record = &records[i];
+
+		if (record->sensor_type < 0 || record->sensor_type >= DEADBAND_SENSOR_COUNT) {
+			records[kept++] = *record;
+			continue;
+		}
+
+		state = &s_info.sensors[record->sensor_type];
+		state->last_seen_ms = record->timestamp_ms;
+
+		if (!state->enabled) {
+			state->stats.sent++;
+			records[kept++] = *record;
+			continue;
+		}
+
+		changed = !state->primed || _is_changed(state, record);
+		if (changed)
+			state->last_change_ms = record->timestamp_ms;
+
+		if (!changed && (state->policy.max_silence_ms <= 0 ||
+				record->timestamp_ms - state->last_sent.timestamp_ms < state->policy.max_silence_ms)) {
+			state->stats.suppressed++;
+			continue;
+		}
+
+		state->primed = true;
+		state->last_sent = *record;
+		state->stats.sent++;
+		records[kept++] = *record;
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+
+	return kept;
+}
+
+/**
+ * @brief Picks the sampling interval of a sensor: the fast one of its policy right after a change, the given one otherwise.
+ * @param sensor_type The sensor's type.
+ * @param interval_ms The capture interval of the sensor.
+ * @return The interval to apply to the listener.
+ */
+int deadband_interval(int sensor_type, int interval_ms)
+{
+	deadband_state_t *state;
+	int interval = interval_ms;
+
+	if (sensor_type < 0 || sensor_type >= DEADBAND_SENSOR_COUNT)
+		return interval_ms;
+
+	pthread_mutex_lock(&s_info.lock);
+	state = &s_info.sensors[sensor_type];
+	if (state->enabled && state->primed && state->policy.fast_interval_ms > 0 &&
+			state->policy.fast_interval_ms < interval_ms &&
+			state->last_seen_ms - state->last_change_ms < state->policy.hold_ms)
+		interval = state->policy.fast_interval_ms;
+	pthread_mutex_unlock(&s_info.lock);
+
+	return interval;
+}
+
+/**
+ * @brief Reads the number of sent and suppressed records of a sensor.
+ * @param sensor_type The sensor's type.
+ * @param[out] stats The counters.
+ */
+void deadband_get_stats(int sensor_type, deadband_stats_t *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	if (sensor_type < 0 || sensor_type >= DEADBAND_SENSOR_COUNT)
+		return;
+
+	pthread_mutex_lock(&s_info.lock);
+	*stats = s_info.sensors[sensor_type].stats;
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Forgets the last sent record of a sensor so that its next record is sent. Should be invoked when its capture restarts.
+ * @param sensor_type The sensor's type.
+ */
+void deadband_reset(int sensor_type)
+{
+	if (sensor_type < 0 || sensor_type >= DEADBAND_SENSOR_COUNT)
+		return;
+
+	pthread_mutex_lock(&s_info.lock);
+	s_info.sensors[sensor_type].primed = false;
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Checks if one of the values of the record left the band around the last sent record.
+ */
+static bool _is_changed(const deadband_state_t *state, const record_t *record)
+{
+	float band;
+	float diff;
+	int i;
+
+	if (record->value_count != state->last_sent.value_count)
+		return true;
+
+	for (i = 0; i < record->value_count; ++i) {
+		diff = fabsf(record->values[i] - state->last_sent.values[i]);
+		band = state->policy.rel_band * fabsf(state->last_sent.values[i]);
+		if (band < state->policy.abs_band)
+			band = state->policy.abs_band;
+
+		if (diff > band || isnan(diff))
+			return true;
+	}
+
+	return false;
+}
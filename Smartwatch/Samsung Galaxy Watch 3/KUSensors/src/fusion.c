@@ -0,0 +1,302 @@
+/*
+ * fusion.c
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "fusion.h"
+
+#define FUSION_KP				1.0f	// proportional gain, s^-1
+#define FUSION_KI				0.02f	// integral gain, s^-2
+#define FUSION_KP_STARTUP		10.0f	// converges from the identity in a few samples
+#define FUSION_STARTUP_US		2000000
+#define FUSION_MAX_STEP_US		1000000	// longer gaps restart the integration
+#define FUSION_GRAVITY_SCALE	(1.0f / 16)		// m/s2, keeps the squares of 4 g in range, the vectors are normalized anyway
+#define FUSION_MAGNETIC_SCALE	(1.0f / 128)	// uT
+#define FUSION_DEG_TO_RAD		0.017453293f
+
+#ifdef FUSION_FIXED_POINT
+#define FX_FRAC_BITS	24
+typedef int32_t fx_t;
+#define FX_ONE			((fx_t)1 << FX_FRAC_BITS)
+#define FX(x)			((fx_t)((x) * (float)FX_ONE + ((x) >= 0 ? 0.5f : -0.5f)))
+#define FX_FLOAT(a)		((float)(a) / FX_ONE)
+#define FX_MUL(a, b)	((fx_t)(((int64_t)(a) * (b) + ((int64_t)1 << (FX_FRAC_BITS - 1))) >> FX_FRAC_BITS))
+#define FX_INV_SQRT(a)	_fx_inv_sqrt(a)
+static fx_t _fx_inv_sqrt(fx_t x);
+#else
+typedef float fx_t;
+#define FX_ONE			1.0f
+#define FX(x)			((fx_t)(x))
+#define FX_FLOAT(a)		(a)
+#define FX_MUL(a, b)	((a) * (b))
+#define FX_INV_SQRT(a)	((a) > 0 ? 1.0f / sqrtf(a) : 0.0f)
+#endif
+
+#define FX_HALF			(FX_ONE / 2)
+
+typedef struct fusion_reference {
+	fx_t v[3];						/* normalized */
+	unsigned long long timestamp_us;
+	bool valid;
+} fusion_reference_t;
+
+static struct fusion_info {
+	pthread_mutex_t lock;
+	fx_t q[4];
+	fx_t integral[3];
+	fusion_reference_t gravity;
+	fusion_reference_t magnetic;
+	unsigned long long start_us;
+	unsigned long long last_us;
+	unsigned long long output_us;
+} s_info = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.q = { FX_ONE, 0, 0, 0 },
+};
+
+static void _set_reference(fusion_reference_t *reference, unsigned long long timestamp_us, const float *values, float scale);
+static bool _is_fresh(const fusion_reference_t *reference, unsigned long long timestamp_us);
+static bool _normalize(fx_t *v, int count);
+
+/**
+ * @brief Restarts the filter from the identity orientation.
+ */
+void fusion_reset(void)
+{
+	pthread_mutex_lock(&s_info.lock);
+	memset(s_info.q, 0, sizeof(s_info.q));
+	s_info.q[0] = FX_ONE;
+	memset(s_info.integral, 0, sizeof(s_info.integral));
+	s_info.gravity.valid = false;
+	s_info.magnetic.valid = false;
+	s_info.start_us = 0;
+	s_info.last_us = 0;
+	s_info.output_us = 0;
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Updates the gravity reference with an accelerometer sample.
+ * @param timestamp_us Sensor timestamp of the sample.
+ * @param acceleration x, y and z in m/s2.
+ */
+void fusion_set_gravity(unsigned long long timestamp_us, const float *acceleration)
+{
+	pthread_mutex_lock(&s_info.lock);
+	_set_reference(&s_info.gravity, timestamp_us, acceleration, FUSION_GRAVITY_SCALE);
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Updates the magnetic reference with a magnetic sensor sample.
+ * @param timestamp_us Sensor timestamp of the sample.
+ * @param field x, y and z in uT.
+ */
+void fusion_set_magnetic(unsigned long long timestamp_us, const float *field)
+{
+	pthread_mutex_lock(&s_info.lock);
+	_set_reference(&s_info.magnetic, timestamp_us, field, FUSION_MAGNETIC_SCALE);
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Integrates one gyroscope sample, corrected by the latest references.
+ * @param timestamp_us Sensor timestamp of the sample.
+ * @param rotation_rate x, y and z in degrees/s.
+ * @param[out] quaternion w, x, y and z, written when an output is due.
+ * @return True if an output is due, once per FUSION_OUTPUT_INTERVAL_MS.
+ */
+bool fusion_update(unsigned long long timestamp_us, const float *rotation_rate, float *quaternion)
+{
+	fx_t q0, q1, q2, q3;
+	fx_t q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+	fx_t ax, ay, az, mx, my, mz;
+	fx_t hx, hy, bx, bz;
+	fx_t halfvx, halfvy, halfvz, halfwx, halfwy, halfwz;
+	fx_t halfex = 0, halfey = 0, halfez = 0;
+	fx_t g[3];
+	fx_t dt;
+	fx_t kp;
+	bool due;
+	int i;
+
+	pthread_mutex_lock(&s_info.lock);
+
+	if (s_info.last_us == 0 || timestamp_us <= s_info.last_us || timestamp_us - s_info.last_us > FUSION_MAX_STEP_US) {
+		if (s_info.start_us == 0)
+			s_info.start_us = timestamp_us;
+		s_info.last_us = timestamp_us;
+		pthread_mutex_unlock(&s_info.lock);
+		return false;
+	}
+
+	dt = FX((timestamp_us - s_info.last_us) / 1000000.0f);
+	s_info.last_us = timestamp_us;
+
+	for (i = 0; i < 3; ++i)
+		g[i] = FX(rotation_rate[i] * FUSION_DEG_TO_RAD);
+
+	q0 = s_info.q[0];
+	q1 = s_info.q[1];
+	q2 = s_info.q[2];
+	q3 = s_info.q[3];
+
+	if (_is_fresh(&s_info.gravity, timestamp_us)) {
+		q0q0 = FX_MUL(q0, q0);
+		q0q1 = FX_MUL(q0, q1);
+		q0q2 = FX_MUL(q0, q2);
+		q0q3 = FX_MUL(q0, q3);
+		q1q1 = FX_MUL(q1, q1);
+		q1q2 = FX_MUL(q1, q2);
+		q1q3 = FX_MUL(q1, q3);
+		q2q2 = FX_MUL(q2, q2);
+		q2q3 = FX_MUL(q2, q3);
+		q3q3 = FX_MUL(q3, q3);
+
+		/* error between the measured gravity and the one of the estimated orientation */
+		ax = s_info.gravity.v[0];
+		ay = s_info.gravity.v[1];
+		az = s_info.gravity.v[2];
+		halfvx = q1q3 - q0q2;
+		halfvy = q0q1 + q2q3;
+		halfvz = q0q0 - FX_HALF + q3q3;
+		halfex = FX_MUL(ay, halfvz) - FX_MUL(az, halfvy);
+		halfey = FX_MUL(az, halfvx) - FX_MUL(ax, halfvz);
+		halfez = FX_MUL(ax, halfvy) - FX_MUL(ay, halfvx);
+
+		if (_is_fresh(&s_info.magnetic, timestamp_us)) {
+			/* the field rotated to the earth frame, with its horizontal part on the north axis */
+			mx = s_info.magnetic.v[0];
+			my = s_info.magnetic.v[1];
+			mz = s_info.magnetic.v[2];
+			hx = 2 * (FX_MUL(mx, FX_HALF - q2q2 - q3q3) + FX_MUL(my, q1q2 - q0q3) + FX_MUL(mz, q1q3 + q0q2));
+			hy = 2 * (FX_MUL(mx, q1q2 + q0q3) + FX_MUL(my, FX_HALF - q1q1 - q3q3) + FX_MUL(mz, q2q3 - q0q1));
+			bx = FX_MUL(hx, hx) + FX_MUL(hy, hy);
+			bx = FX_MUL(bx, FX_INV_SQRT(bx));
+			bz = 2 * (FX_MUL(mx, q1q3 - q0q2) + FX_MUL(my, q2q3 + q0q1) + FX_MUL(mz, FX_HALF - q1q1 - q2q2));
+
+			halfwx = FX_MUL(bx, FX_HALF - q2q2 - q3q3) + FX_MUL(bz, q1q3 - q0q2);
+			halfwy = FX_MUL(bx, q1q2 - q0q3) + FX_MUL(bz, q0q1 + q2q3);
+			halfwz = FX_MUL(bx, q0q2 + q1q3) + FX_MUL(bz, FX_HALF - q1q1 - q2q2);
+			halfex += FX_MUL(my, halfwz) - FX_MUL(mz, halfwy);
+			halfey += FX_MUL(mz, halfwx) - FX_MUL(mx, halfwz);
+			halfez += FX_MUL(mx, halfwy) - FX_MUL(my, halfwx);
+		}
+
+		/* PI feedback, the integral converges to the gyroscope bias */
+		kp = timestamp_us - s_info.start_us < FUSION_STARTUP_US ? FX(2 * FUSION_KP_STARTUP) : FX(2 * FUSION_KP);
+		s_info.integral[0] += FX_MUL(FX(2 * FUSION_KI), FX_MUL(halfex, dt));
+		s_info.integral[1] += FX_MUL(FX(2 * FUSION_KI), FX_MUL(halfey, dt));
+		s_info.integral[2] += FX_MUL(FX(2 * FUSION_KI), FX_MUL(halfez, dt));
+		g[0] += FX_MUL(kp, halfex) + s_info.integral[0];
+		g[1] += FX_MUL(kp, halfey) + s_info.integral[1];
+		g[2] += FX_MUL(kp, halfez) + s_info.integral[2];
+	}
+
+	/* q += q * (0, g) * dt / 2 */
+	for (i = 0; i < 3; ++i)
+		g[i] = FX_MUL(g[i], FX_MUL(dt, FX_HALF));
+
+	s_info.q[0] = q0 - FX_MUL(q1, g[0]) - FX_MUL(q2, g[1]) - FX_MUL(q3, g[2]);
+	s_info.q[1] = q1 + FX_MUL(q0, g[0]) + FX_MUL(q2, g[2]) - FX_MUL(q3, g[1]);
+	s_info.q[2] = q2 + FX_MUL(q0, g[1]) - FX_MUL(q1, g[2]) + FX_MUL(q3, g[0]);
+	s_info.q[3] = q3 + FX_MUL(q0, g[2]) + FX_MUL(q1, g[1]) - FX_MUL(q2, g[0]);
+	_normalize(s_info.q, 4);
+
+	due = timestamp_us - s_info.output_us >= FUSION_OUTPUT_INTERVAL_MS * 1000ULL;
+	if (due) {
+		s_info.output_us = timestamp_us;
+		for (i = 0; i < 4; ++i)
+			quaternion[i] = FX_FLOAT(s_info.q[i]);
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+
+	return due;
+}
+
+static void _set_reference(fusion_reference_t *reference, unsigned long long timestamp_us, const float *values, float scale)
+{
+	int i;
+
+	for (i = 0; i < 3; ++i)
+		reference->v[i] = FX(values[i] * scale);
+
+	reference->valid = _normalize(reference->v, 3);
+	reference->timestamp_us = timestamp_us;
+}
+
+/**
+ * @brief Checks if a reference is recent enough for a gyroscope sample. Batched sensors deliver
+ * their samples late and in any order, a reference slightly newer than the sample is fine.
+ */
+static bool _is_fresh(const fusion_reference_t *reference, unsigned long long timestamp_us)
+{
+	unsigned long long age_us;
+
+	if (!reference->valid)
+		return false;
+
+	age_us = timestamp_us > reference->timestamp_us ? timestamp_us - reference->timestamp_us : reference->timestamp_us - timestamp_us;
+
+	return age_us <= FUSION_REFERENCE_MAX_AGE_MS * 1000ULL;
+}
+
+/**
+ * @brief Scales a vector to the unit length.
+ * @return False for the null vector, left untouched.
+ */
+static bool _normalize(fx_t *v, int count)
+{
+	fx_t norm = 0;
+	fx_t inv;
+	int i;
+
+	for (i = 0; i < count; ++i)
+		norm += FX_MUL(v[i], v[i]);
+
+	if (norm <= 0)
+		return false;
+
+	inv = FX_INV_SQRT(norm);
+	for (i = 0; i < count; ++i)
+		v[i] = FX_MUL(v[i], inv);
+
+	return true;
+}
+
+#ifdef FUSION_FIXED_POINT
+/**
+ * @brief Inverse square root in fixed point. The argument is brought to [0.25, 1) by an even shift,
+ * where four Newton iterations from a linear guess reach the full precision.
+ */
+static fx_t _fx_inv_sqrt(fx_t x)
+{
+	int64_t m;
+	int64_t y;
+	int shift;
+	int i;
+
+	if (x <= 0)
+		return 0;
+
+	/* x = m * 2^shift, with the most significant bit of m at FX_FRAC_BITS - 1 or - 2 */
+	shift = 31 - __builtin_clz(x) - (FX_FRAC_BITS - 1);
+	if (shift & 1)
+		shift++;
+	m = shift >= 0 ? (int64_t)x >> shift : (int64_t)x << -shift;
+
+	/* 1/sqrt(m) is in (1, 2], 1.75 - 0.75 m stays below it, from where Newton converges */
+	y = FX(1.75f) - ((m * FX(0.75f)) >> FX_FRAC_BITS);
+	for (i = 0; i < 4; ++i)
+		y = (y * (3 * (int64_t)FX_ONE - ((m * ((y * y) >> FX_FRAC_BITS)) >> FX_FRAC_BITS))) >> (FX_FRAC_BITS + 1);
+
+	/* 1/sqrt(x) = 1/sqrt(m) * 2^(-shift / 2) */
+	y = shift >= 0 ? y >> (shift / 2) : y << (-shift / 2);
+
+	return y > INT32_MAX ? INT32_MAX : (fx_t)y;
+}
+#endif
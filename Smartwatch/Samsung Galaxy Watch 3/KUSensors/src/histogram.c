@@ -0,0 +1,131 @@
+/*
+ * histogram.c
+ */
+
+#include <string.h>
+#include "histogram.h"
+
+#define SUB_COUNT	(1 << HISTOGRAM_SUB_BITS)
+#define HALF_COUNT	(SUB_COUNT >> 1)
+
+static int _bucket_index(unsigned long long value);
+static unsigned long long _bucket_lowest(int index);
+
+/**
+ * @brief Clears the histogram. Not safe against concurrent recording.
+ */
+void histogram_reset(histogram_t *histogram)
+{
+	memset(histogram, 0, sizeof(*histogram));
+}
+
+/**
+ * @brief Records one value. Safe to call from any thread.
+ * @param histogram The histogram.
+ * @param value The value, clamped to the range of the histogram.
+ */
+void histogram_record(histogram_t *histogram, unsigned long long value)
+{
+	unsigned long long max;
+
+	__sync_fetch_and_add(&histogram->counts[_bucket_index(value)], 1);
+	__sync_fetch_and_add(&histogram->count, 1);
+	__sync_fetch_and_add(&histogram->sum, value);
+
+	max = histogram->max;
+	while (value > max && !__sync_bool_compare_and_swap(&histogram->max, max, value))
+		max = histogram->max;
+}
+
+/**
+ * @brief Takes a snapshot of a histogram that may still be recorded into. The snapshot is not atomic as a whole.
+ */
+void histogram_copy(histogram_t *dst, const histogram_t *src)
+{
+	int i;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; ++i)
+		dst->counts[i] = __sync_fetch_and_add((unsigned int *)&src->counts[i], 0);
+	dst->count = __sync_fetch_and_add((unsigned long long *)&src->count, 0);
+	dst->sum = __sync_fetch_and_add((unsigned long long *)&src->sum, 0);
+	dst->max = __sync_fetch_and_add((unsigned long long *)&src->max, 0);
+}
+
+/**
+ * @brief Computes a percentile of the recorded values.
+ * @param histogram The histogram.
+ * @param percentile The percentile, between 0 and 100.
+ * @return The highest value of the bucket holding the percentile, 0 if nothing was recorded.
+ */
+unsigned long long histogram_percentile(const histogram_t *histogram, double percentile)
+{
+	unsigned long long total = 0;
+	unsigned long long rank;
+	unsigned long long highest;
+	int i;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; ++i)
+		total += histogram->counts[i];
+
+	if (total == 0)
+		return 0;
+
+	rank = (unsigned long long)(percentile / 100.0 * total + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+		if (histogram->counts[i] == 0)
+			continue;
+
+		rank = rank > histogram->counts[i] ? rank - histogram->counts[i] : 0;
+		if (rank == 0)
+			break;
+	}
+
+	if (i >= HISTOGRAM_BUCKETS - 1)
+		return histogram->max;
+
+	highest = _bucket_lowest(i + 1) - 1;
+	return highest < histogram->max ? highest : histogram->max;
+}
+
+/**
+ * @brief Computes the mean of the recorded values.
+ */
+unsigned long long histogram_mean(const histogram_t *histogram)
+{
+	return histogram->count ? histogram->sum / histogram->count : 0;
+}
+
+/**
+ * @brief Maps a value to its bucket: values below SUB_COUNT have their own bucket,
+ * every following power of two is split in HALF_COUNT buckets.
+ */
+static int _bucket_index(unsigned long long value)
+{
+	int msb;
+	int shift;
+
+	if (value < SUB_COUNT)
+		return (int)value;
+
+	if (value >> HISTOGRAM_MAX_BITS)
+		return HISTOGRAM_BUCKETS - 1;
+
+	msb = 63 - __builtin_clzll(value);
+	shift = msb - (HISTOGRAM_SUB_BITS - 1);
+
+	return shift * HALF_COUNT + (int)(value >> shift);
+}
+
+static unsigned long long _bucket_lowest(int index)
+{
+	int shift;
+
+	if (index < SUB_COUNT)
+		return index;
+
+	shift = index / HALF_COUNT - 1;
+	return (unsigned long long)(index % HALF_COUNT + HALF_COUNT) << shift;
+}
@@ -0,0 +1,210 @@
+/*
+ * hrv.c
+ */
+
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include "hrv.h"
+
+#define HRV_TOLERANCE		0.25f	// relative deviation that halves the confidence of a beat
+#define HRV_DERIVED_WEIGHT	0.4f	// intervals derived from the averaged rate stay out of the statistics
+#define HRV_MIN_MEAN_BEATS	4		// beats needed before the mean interval is trusted
+
+/* fixed size window keeping the running sums of its values */
+typedef struct hrv_ring {
+	float values[HRV_WINDOW];
+	int head;
+	int count;
+	double sum;
+	double sum2;
+} hrv_ring_t;
+
+static struct hrv_info {
+	pthread_mutex_t lock;
+	hrv_ring_t rr;				/* accepted intervals */
+	hrv_ring_t diffs;			/* differences of consecutive accepted intervals */
+	unsigned long long last_event_us;
+	unsigned long long last_beat_us;	/* report time of the last beat, 0 before the first one */
+	float last_report_ms;		/* interval reported with the last beat */
+	float last_rr_ms;			/* last accepted interval, 0 when the chain of consecutive beats is broken */
+	unsigned long long accepted;
+	unsigned long long rejected;
+} s_info = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void _ring_push(hrv_ring_t *ring, float value);
+static float _clamp_confidence(float confidence);
+
+/**
+ * @brief Forgets the beats and the statistics, for instance when the capture restarts.
+ */
+void hrv_reset(void)
+{
+	pthread_mutex_lock(&s_info.lock);
+	memset(&s_info.rr, 0, sizeof(s_info.rr));
+	memset(&s_info.diffs, 0, sizeof(s_info.diffs));
+	s_info.last_event_us = 0;
+	s_info.last_beat_us = 0;
+	s_info.last_report_ms = 0;
+	s_info.last_rr_ms = 0;
+	s_info.accepted = 0;
+	s_info.rejected = 0;
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Feeds one HRM event. The sensor repeats the interval of the last peak until the next one,
+ * so a new beat is recognized by a new interval.
+ * @param timestamp_us Sensor timestamp of the event.
+ * @param heart_rate Heart rate reported by the sensor, 0 or less without skin contact.
+ * @param peak_to_peak_ms Last peak-to-peak interval reported by the sensor, 0 if unknown.
+ * @param[out] beat The new beat, may be NULL.
+ * @return True if the event carries a new beat.
+ */
+bool hrv_add_event(unsigned long long timestamp_us, float heart_rate, float peak_to_peak_ms, hrv_beat_t *beat)
+{
+	bool derived = peak_to_peak_ms <= 0;
+	bool consecutive;
+	unsigned long long spacing_us;
+	unsigned long long elapsed_us;
+	float rr_ms;
+	float mean_ms;
+	float confidence = 1.0f;
+
+	pthread_mutex_lock(&s_info.lock);
+
+	spacing_us = s_info.last_event_us && timestamp_us > s_info.last_event_us ? timestamp_us - s_info.last_event_us : 0;
+	s_info.last_event_us = timestamp_us;
+
+	if (heart_rate <= 0) {
+		/* off the wrist, the next beat starts a new chain */
+		s_info.last_beat_us = 0;
+		s_info.last_rr_ms = 0;
+		pthread_mutex_unlock(&s_info.lock);
+		return false;
+	}
+
+	rr_ms = derived ? 60000.0f / heart_rate : peak_to_peak_ms;
+
+	if (s_info.last_beat_us) {
+		elapsed_us = timestamp_us > s_info.last_beat_us ? timestamp_us - s_info.last_beat_us : 0;
+
+		/*
+		 * The same interval reported again is the same beat, unless the next one is overdue. Two equal
+		 * intervals in a row are then counted as a missed beat, the rate derived from the averaged heart
+		 * rate only tells when the next beat is due.
+		 */
+		if ((derived && elapsed_us + spacing_us / 2 < rr_ms * 1000.0f) ||
+				(!derived && rr_ms == s_info.last_report_ms && elapsed_us < rr_ms * 1500.0f)) {
+			pthread_mutex_unlock(&s_info.lock);
+			return false;
+		}
+
+		/* a longer gap means at least one beat was reported between two events and missed */
+		consecutive = elapsed_us < rr_ms * 1500.0f;
+	} else {
+		consecutive = false;
+	}
+
+	s_info.last_beat_us = timestamp_us;
+	s_info.last_report_ms = rr_ms;
+
+	if (rr_ms < HRV_MIN_RR_MS || rr_ms > HRV_MAX_RR_MS) {
+		confidence = 0.0f;
+	} else {
+		/* agreement with the averaged rate of the sensor, then with the recent beats */
+		if (!derived)
+			confidence *= _clamp_confidence(1.0f - fabsf(60000.0f / rr_ms - heart_rate) / heart_rate / (2 * HRV_TOLERANCE));
+		else
+			confidence *= HRV_DERIVED_WEIGHT;
+
+		if (s_info.rr.count >= HRV_MIN_MEAN_BEATS) {
+			mean_ms = s_info.rr.sum / s_info.rr.count;
+			confidence *= _clamp_confidence(1.0f - fabsf(rr_ms - mean_ms) / mean_ms / (2 * HRV_TOLERANCE));
+		}
+	}
+
+	if (confidence >= HRV_MIN_CONFIDENCE) {
+		_ring_push(&s_info.rr, rr_ms);
+		if (consecutive && s_info.last_rr_ms > 0)
+			_ring_push(&s_info.diffs, rr_ms - s_info.last_rr_ms);
+		s_info.last_rr_ms = rr_ms;
+		s_info.accepted++;
+	} else {
+		/* an artifact or an ectopic beat, its neighbours are not successive normal beats */
+		s_info.last_rr_ms = 0;
+		s_info.rejected++;
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+
+	if (beat) {
+		beat->timestamp_us = timestamp_us;
+		beat->rr_ms = rr_ms;
+		beat->confidence = confidence;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Gets the statistics over the last HRV_WINDOW accepted beats.
+ * @param[out] stats The statistics, zero while there are not enough beats.
+ */
+void hrv_get_stats(hrv_stats_t *stats)
+{
+	double variance;
+
+	memset(stats, 0, sizeof(*stats));
+
+	pthread_mutex_lock(&s_info.lock);
+
+	stats->beats = s_info.rr.count;
+	stats->accepted = s_info.accepted;
+	stats->rejected = s_info.rejected;
+	stats->rr_ms = s_info.rr.count ? s_info.rr.values[(s_info.rr.head + HRV_WINDOW - 1) % HRV_WINDOW] : 0;
+
+	if (s_info.rr.count > 0)
+		stats->heart_rate = 60000.0 * s_info.rr.count / s_info.rr.sum;
+
+	if (s_info.rr.count > 1) {
+		variance = (s_info.rr.sum2 - s_info.rr.sum * s_info.rr.sum / s_info.rr.count) / (s_info.rr.count - 1);
+		stats->sdnn_ms = variance > 0 ? sqrt(variance) : 0;
+	}
+
+	if (s_info.diffs.count > 0)
+		stats->rmssd_ms = sqrt(s_info.diffs.sum2 / s_info.diffs.count);
+
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Appends a value, replacing the oldest one once the window is full.
+ */
+static void _ring_push(hrv_ring_t *ring, float value)
+{
+	float oldest;
+
+	if (ring->count == HRV_WINDOW) {
+		oldest = ring->values[ring->head];
+		ring->sum -= oldest;
+		ring->sum2 -= (double)oldest * oldest;
+	} else {
+		ring->count++;
+	}
+
+	ring->values[ring->head] = value;
+	ring->sum += value;
+	ring->sum2 += (double)value * value;
+	ring->head = (ring->head + 1) % HRV_WINDOW;
+}
+
+static float _clamp_confidence(float confidence)
+{
+	if (confidence < 0.0f)
+		return 0.0f;
+
+	return confidence > 1.0f ? 1.0f : confidence;
+}
@@ -20,6 +20,7 @@
 #include <set>
 #include <sstream>
 #include <utility>
+#include <vector>
 
 #include <cstdio>
 #if __cplusplus >= 201103L
@@ -74,6 +75,104 @@ Features Features::strictMode() {
   return features;
 }
 
+// Implementation of class ObjectBuilder
+// ////////////////////////////////
+
+// Adds the members of an object being read. With the flat storage of
+// JSON_USE_FLAT_OBJECT, inserting a member moves the members after it, so a
+// large object read with its keys out of order would cost O(n^2): past
+// flatReorderMin_ members, the first key out of order moves the members to a
+// list kept in document order, sorted and inserted in key order by finish().
+// Of equal keys, the last one is kept, as operator[] keeps it. With std::map,
+// the members are inserted as they come.
+class ObjectBuilder {
+public:
+  explicit ObjectBuilder(Value& object) : object_(object) {}
+  ~ObjectBuilder() { finish(); }
+
+  Value& member(const String& name);
+  bool isMember(const String& name) const;
+  void finish();
+
+private:
+  ObjectBuilder(ObjectBuilder const&);  // no impl
+  void operator=(ObjectBuilder const&); // no impl
+
+#if JSON_USE_FLAT_OBJECT
+  static const ArrayIndex flatReorderMin_ = 64;
+
+  struct NameLess {
+    const std::vector<std::pair<String, Value>>& members;
+    bool operator()(size_t lhs, size_t rhs) const {
+      return members[lhs].first < members[rhs].first;
+    }
+  };
+
+  std::vector<std::pair<String, Value>> members_;
+  std::set<String> names_;
+  String last_;
+#endif
+  Value& object_;
+};
+
+#if JSON_USE_FLAT_OBJECT
+Value& ObjectBuilder::member(const String& name) {
+  if (members_.empty()) {
+    if (object_.size() < flatReorderMin_)
+      return object_[name];
+    if (last_.empty())
+      last_ = (--object_.end()).name();
+    if (last_ < name) {
+      last_ = name;
+      return object_[name];
+    }
+    for (ValueIterator it = object_.begin(); it != object_.end(); ++it) {
+      names_.insert(it.name());
+      members_.emplace_back(it.name(), Value());
+      members_.back().second.swap(*it);
+    }
+    // clear() also resets the offsets
+    ptrdiff_t start = object_.getOffsetStart();
+    object_.clear();
+    object_.setOffsetStart(start);
+  }
+  names_.insert(name);
+  members_.emplace_back(name, Value());
+  return members_.back().second;
+}
+
+bool ObjectBuilder::isMember(const String& name) const {
+  return members_.empty() ? object_.isMember(name) : names_.count(name) != 0;
+}
+
+void ObjectBuilder::finish() {
+  std::vector<size_t> order(members_.size());
+  size_t i;
+
+  if (members_.empty())
+    return;
+  for (i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), NameLess{members_});
+  for (i = 0; i < order.size(); ++i) {
+    std::pair<String, Value>& member = members_[order[i]];
+    if (i + 1 < order.size() && member.first == members_[order[i + 1]].first)
+      continue;
+    object_[member.first].swap(member.second);
+  }
+  members_.clear();
+  names_.clear();
+}
+#else
+Value& ObjectBuilder::member(const String& name) { return object_[name]; }
+
+bool ObjectBuilder::isMember(const String& name) const {
+  return object_.isMember(name);
+}
+
+void ObjectBuilder::finish() {}
+#endif
+
 // Implementation of class Reader
 // ////////////////////////////////
 
@@ -446,6 +545,7 @@ bool Reader::readObject(Token& token) {
   Value init(objectValue);
   currentValue().swapPayload(init);
   currentValue().setOffsetStart(token.start_ - begin_);
+  ObjectBuilder object(currentValue());
   while (readToken(tokenName)) {
     bool initialTokenOk = true;
     while (tokenName.type_ == tokenComment && initialTokenOk)
@@ -472,7 +572,7 @@ bool Reader::readObject(Token& token) {
       return addErrorAndRecover("Missing ':' after object member name", colon,
                                 tokenObjectEnd);
     }
-    Value& value = currentValue()[name];
+    Value& value = object.member(name);
     nodes_.push(&value);
     bool ok = readValue();
     nodes_.pop();
@@ -599,6 +699,10 @@ bool Reader::decodeDouble(Token& token) {
 
 bool Reader::decodeDouble(Token& token, Value& decoded) {
   double value = 0;
+  if (decodeDoubleFast(token.start_, token.end_, value)) {
+    decoded = value;
+    return true;
+  }
   String buffer(token.start_, token.end_);
   IStringStream is(buffer);
   if (!(is >> value))
@@ -990,6 +1094,8 @@ private:
 
   OurFeatures const features_;
   bool collectComments_ = false;
+
+  friend class SaxReader; // shares the tokenizer
 }; // OurReader
 
 // complete copy of Read impl, for OurReader
@@ -1443,6 +1549,7 @@ bool OurReader::readObject(Token& token) {
   Value init(objectValue);
   currentValue().swapPayload(init);
   currentValue().setOffsetStart(token.start_ - begin_);
+  ObjectBuilder object(currentValue());
   while (readToken(tokenName)) {
     bool initialTokenOk = true;
     while (tokenName.type_ == tokenComment && initialTokenOk)
@@ -1467,7 +1574,7 @@ bool OurReader::readObject(Token& token) {
     }
     if (name.length() >= (1U << 30))
       throwRuntimeError("keylength >= 2^30");
-    if (features_.rejectDupKeys_ && currentValue().isMember(name)) {
+    if (features_.rejectDupKeys_ && object.isMember(name)) {
       String msg = "Duplicate key: '" + name + "'";
       return addErrorAndRecover(msg, tokenName, tokenObjectEnd);
     }
@@ -1477,7 +1584,7 @@ bool OurReader::readObject(Token& token) {
       return addErrorAndRecover("Missing ':' after object member name", colon,
                                 tokenObjectEnd);
     }
-    Value& value = currentValue()[name];
+    Value& value = object.member(name);
     nodes_.push(&value);
     bool ok = readValue();
     nodes_.pop();
@@ -1645,6 +1752,10 @@ bool OurReader::decodeDouble(Token& token) {
 
 bool OurReader::decodeDouble(Token& token, Value& decoded) {
   double value = 0;
+  if (decodeDoubleFast(token.start_, token.end_, value)) {
+    decoded = value;
+    return true;
+  }
   const String buffer(token.start_, token.end_);
   IStringStream is(buffer);
   if (!(is >> value)) {
@@ -1878,27 +1989,31 @@ public:
   }
 };
 
-CharReaderBuilder::CharReaderBuilder() { setDefaults(&settings_); }
-CharReaderBuilder::~CharReaderBuilder() = default;
-CharReader* CharReaderBuilder::newCharReader() const {
-  bool collectComments = settings_["collectComments"].asBool();
+static OurFeatures ourFeatures(const Value& settings) {
   OurFeatures features = OurFeatures::all();
-  features.allowComments_ = settings_["allowComments"].asBool();
-  features.allowTrailingCommas_ = settings_["allowTrailingCommas"].asBool();
-  features.strictRoot_ = settings_["strictRoot"].asBool();
+  features.allowComments_ = settings["allowComments"].asBool();
+  features.allowTrailingCommas_ = settings["allowTrailingCommas"].asBool();
+  features.strictRoot_ = settings["strictRoot"].asBool();
   features.allowDroppedNullPlaceholders_ =
-      settings_["allowDroppedNullPlaceholders"].asBool();
-  features.allowNumericKeys_ = settings_["allowNumericKeys"].asBool();
-  features.allowSingleQuotes_ = settings_["allowSingleQuotes"].asBool();
+      settings["allowDroppedNullPlaceholders"].asBool();
+  features.allowNumericKeys_ = settings["allowNumericKeys"].asBool();
+  features.allowSingleQuotes_ = settings["allowSingleQuotes"].asBool();
 
   // Stack limit is always a size_t, so we get this as an unsigned int
   // regardless of it we have 64-bit integer support enabled.
-  features.stackLimit_ = static_cast<size_t>(settings_["stackLimit"].asUInt());
-  features.failIfExtra_ = settings_["failIfExtra"].asBool();
-  features.rejectDupKeys_ = settings_["rejectDupKeys"].asBool();
-  features.allowSpecialFloats_ = settings_["allowSpecialFloats"].asBool();
-  features.skipBom_ = settings_["skipBom"].asBool();
-  return new OurCharReader(collectComments, features);
+  features.stackLimit_ = static_cast<size_t>(settings["stackLimit"].asUInt());
+  features.failIfExtra_ = settings["failIfExtra"].asBool();
+  features.rejectDupKeys_ = settings["rejectDupKeys"].asBool();
+  features.allowSpecialFloats_ = settings["allowSpecialFloats"].asBool();
+  features.skipBom_ = settings["skipBom"].asBool();
+  return features;
+}
+
+CharReaderBuilder::CharReaderBuilder() { setDefaults(&settings_); }
+CharReaderBuilder::~CharReaderBuilder() = default;
+CharReader* CharReaderBuilder::newCharReader() const {
+  bool collectComments = settings_["collectComments"].asBool();
+  return new OurCharReader(collectComments, ourFeatures(settings_));
 }
 
 bool CharReaderBuilder::validate(Json::Value* invalid) const {
@@ -1965,6 +2080,296 @@ void CharReaderBuilder::setDefaults(Json::Value* settings) {
   //! [CharReaderBuilderDefaults]
 }
 
+// class SaxReader
+// //////////////////////////////////
+
+class SaxReader::Token : public OurReader::Token {};
+
+SaxReader::SaxReader(SaxHandler& handler, const CharReaderBuilder& builder)
+    : handler_(handler),
+      tokenizer_(new OurReader(ourFeatures(builder.settings_))) {
+  reset();
+}
+
+SaxReader::~SaxReader() = default;
+
+void SaxReader::reset() {
+  tokenizer_->errors_.clear();
+  pending_.clear();
+  containers_.clear();
+  state_ = expectValue;
+  afterComma_ = false;
+  started_ = false;
+  offset_ = 0;
+  errorOffset_ = 0;
+  error_.clear();
+}
+
+bool SaxReader::stopped() const { return state_ == stoppedByHandler; }
+
+bool SaxReader::feed(const char* begin, const char* end) {
+  if (state_ == stoppedByHandler || state_ == failed)
+    return false;
+  if (pending_.empty())
+    return consume(begin, end, false);
+  // complete the token cut by the end of the last chunk
+  String buffer;
+  buffer.swap(pending_);
+  buffer.append(begin, end);
+  return consume(buffer.data(), buffer.data() + buffer.size(), false);
+}
+
+bool SaxReader::finish() {
+  if (state_ == stoppedByHandler)
+    return true;
+  if (state_ == failed)
+    return false;
+  if (!pending_.empty()) {
+    String buffer;
+    buffer.swap(pending_);
+    if (!consume(buffer.data(), buffer.data() + buffer.size(), true))
+      return state_ == stoppedByHandler;
+  }
+  if (state_ != expectEnd) {
+    error_ = "Unexpected end of document.";
+    errorOffset_ = offset_;
+    state_ = failed;
+    return false;
+  }
+  return true;
+}
+
+bool SaxReader::parse(const char* beginDoc, const char* endDoc) {
+  feed(beginDoc, endDoc);
+  return finish();
+}
+
+bool SaxReader::parse(IStream& is) {
+  char buffer[4096];
+  while (is) {
+    is.read(buffer, sizeof(buffer));
+    if (is.gcount() > 0 && !feed(buffer, buffer + is.gcount()))
+      break;
+  }
+  return finish();
+}
+
+String SaxReader::getFormattedErrorMessages() const {
+  if (error_.empty())
+    return "";
+  char buffer[32];
+  jsoncpp_snprintf(buffer, sizeof(buffer), "* Offset %lu\n",
+                   static_cast<unsigned long>(errorOffset_));
+  return buffer + ("  " + error_ + "\n");
+}
+
+bool SaxReader::consume(const char* begin, const char* end, bool final) {
+  OurReader& tokenizer = *tokenizer_;
+  tokenizer.begin_ = begin;
+  tokenizer.end_ = end;
+  tokenizer.current_ = begin;
+
+  if (!started_ && tokenizer.features_.skipBom_) {
+    if (end - begin < 3 && !final) {
+      pending_.assign(begin, end);
+      return true;
+    }
+    if (end - begin >= 3 && strncmp(begin, "\xEF\xBB\xBF", 3) == 0)
+      tokenizer.current_ += 3;
+  }
+  started_ = true;
+
+  Token token;
+  for (;;) {
+    // the root value is complete, the rest is not read
+    if (state_ == expectEnd && !tokenizer.features_.failIfExtra_)
+      break;
+    tokenizer.readToken(token);
+    if (token.type_ == OurReader::tokenEndOfStream && token.start_ == end)
+      break;
+    if (isCut(token, final)) {
+      pending_.assign(token.start_, end);
+      offset_ += static_cast<size_t>(token.start_ - begin);
+      return true;
+    }
+    if (!readToken(token))
+      return false;
+  }
+  offset_ += static_cast<size_t>(end - begin);
+  return true;
+}
+
+// A token reaching the end of the chunk may go on in the next one, as may a
+// literal still too short to be matched: "tr" of "true".
+bool SaxReader::isCut(const Token& token, bool final) const {
+  if (final)
+    return false;
+  if (token.end_ == tokenizer_->end_)
+    return true;
+  return token.type_ == OurReader::tokenError &&
+         tokenizer_->end_ - token.start_ < 9; // "-Infinity"
+}
+
+bool SaxReader::readToken(Token& token) {
+  const OurFeatures& features = tokenizer_->features_;
+  if (token.type_ == OurReader::tokenComment && features.allowComments_)
+    return true;
+
+  switch (state_) {
+  case expectFirstValue:
+  case expectValue:
+    if (token.type_ == OurReader::tokenArrayEnd &&
+        (state_ == expectFirstValue ||
+         (afterComma_ && features.allowTrailingCommas_)))
+      return endContainer();
+    return readValue(token);
+  case expectFirstKey:
+  case expectKey:
+    return readKey(token);
+  case expectColon:
+    if (token.type_ != OurReader::tokenMemberSeparator)
+      return addError("Missing ':' after object member name", token);
+    state_ = expectValue;
+    afterComma_ = false;
+    return true;
+  case expectSeparator:
+    return readSeparator(token);
+  case expectEnd:
+    return addError("Extra non-whitespace after JSON value.", token);
+  default:
+    return false;
+  }
+}
+
+bool SaxReader::readValue(Token& token) {
+  const OurFeatures& features = tokenizer_->features_;
+  if (containers_.empty() && features.strictRoot_ &&
+      token.type_ != OurReader::tokenObjectBegin &&
+      token.type_ != OurReader::tokenArrayBegin)
+    return addError(
+        "A valid JSON document must be either an array or an object value.",
+        token);
+
+  Value decoded;
+  switch (token.type_) {
+  case OurReader::tokenObjectBegin:
+  case OurReader::tokenArrayBegin: {
+    if (containers_.size() >= features.stackLimit_)
+      throwRuntimeError("Exceeded stackLimit in readValue().");
+    bool object = token.type_ == OurReader::tokenObjectBegin;
+    containers_ += object ? 'o' : 'a';
+    state_ = object ? expectFirstKey : expectFirstValue;
+    afterComma_ = false;
+    return handled(object ? handler_.startObject() : handler_.startArray());
+  }
+  case OurReader::tokenNumber:
+    if (!tokenizer_->decodeNumber(token, decoded))
+      return addError(tokenizer_->errors_.back().message_, token);
+    break;
+  case OurReader::tokenString: {
+    String decodedString;
+    if (!tokenizer_->decodeString(token, decodedString))
+      return addError(tokenizer_->errors_.back().message_, token);
+    decoded = decodedString;
+  } break;
+  case OurReader::tokenTrue:
+    decoded = true;
+    break;
+  case OurReader::tokenFalse:
+    decoded = false;
+    break;
+  case OurReader::tokenNull:
+    break;
+  case OurReader::tokenNaN:
+    decoded = std::numeric_limits<double>::quiet_NaN();
+    break;
+  case OurReader::tokenPosInf:
+    decoded = std::numeric_limits<double>::infinity();
+    break;
+  case OurReader::tokenNegInf:
+    decoded = -std::numeric_limits<double>::infinity();
+    break;
+  case OurReader::tokenArraySeparator:
+  case OurReader::tokenObjectEnd:
+  case OurReader::tokenArrayEnd:
+    if (features.allowDroppedNullPlaceholders_ && !containers_.empty()) {
+      // a null for the missing value, then the token is read again
+      afterValue();
+      return handled(handler_.scalar(decoded)) && readSeparator(token);
+    } // Else, fall through...
+  default:
+    return addError("Syntax error: value, object or array expected.", token);
+  }
+  afterValue();
+  return handled(handler_.scalar(decoded));
+}
+
+bool SaxReader::readKey(Token& token) {
+  const OurFeatures& features = tokenizer_->features_;
+  if (token.type_ == OurReader::tokenObjectEnd &&
+      (state_ == expectFirstKey ||
+       (afterComma_ && features.allowTrailingCommas_)))
+    return endContainer();
+
+  String name;
+  if (token.type_ == OurReader::tokenString) {
+    if (!tokenizer_->decodeString(token, name))
+      return addError(tokenizer_->errors_.back().message_, token);
+  } else if (token.type_ == OurReader::tokenNumber &&
+             features.allowNumericKeys_) {
+    Value numberName;
+    if (!tokenizer_->decodeNumber(token, numberName))
+      return addError(tokenizer_->errors_.back().message_, token);
+    name = numberName.asString();
+  } else {
+    return addError("Missing '}' or object member name", token);
+  }
+  state_ = expectColon;
+  return handled(handler_.key(name));
+}
+
+bool SaxReader::readSeparator(Token& token) {
+  bool object = containers_.back() == 'o';
+  if (token.type_ == OurReader::tokenArraySeparator) {
+    state_ = object ? expectKey : expectValue;
+    afterComma_ = true;
+    return true;
+  }
+  if (token.type_ ==
+      (object ? OurReader::tokenObjectEnd : OurReader::tokenArrayEnd))
+    return endContainer();
+  return addError(object ? "Missing ',' or '}' in object declaration"
+                         : "Missing ',' or ']' in array declaration",
+                  token);
+}
+
+bool SaxReader::endContainer() {
+  bool object = containers_.back() == 'o';
+  containers_.erase(containers_.size() - 1);
+  afterValue();
+  return handled(object ? handler_.endObject() : handler_.endArray());
+}
+
+bool SaxReader::afterValue() {
+  state_ = containers_.empty() ? expectEnd : expectSeparator;
+  afterComma_ = false;
+  return true;
+}
+
+bool SaxReader::handled(bool keepReading) {
+  if (!keepReading)
+    state_ = stoppedByHandler;
+  return keepReading;
+}
+
+bool SaxReader::addError(const String& message, const Token& token) {
+  error_ = message;
+  errorOffset_ = offset_ + static_cast<size_t>(token.start_ - tokenizer_->begin_);
+  tokenizer_->errors_.clear();
+  state_ = failed;
+  return false;
+}
+
 //////////////////////////////////
 // global functions
 
@@ -19,6 +19,9 @@
 #include <clocale>
 #endif
 
+#include <cfloat>
+#include <cstdint>
+
 /* This header provides common string manipulation support, such as UTF-8,
  * portable conversion from/to string...
  *
@@ -86,6 +89,108 @@ static inline void uintToString(LargestUInt value, char*& current) {
   } while (value != 0);
 }
 
+/// Exact powers of ten representable as a double.
+static const double exactPowersOfTen[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+enum {
+  /// Largest exponent in exactPowersOfTen.
+  maxExactPowerOfTen = 22
+};
+
+/** Converts the decimal number m * 10^exponent to the nearest double.
+ *
+ * This is exact, but only when m is below 2^53 and the power of ten is
+ * itself a double (Clinger's fast path): the result then comes out of a
+ * single correctly rounded multiplication or division.
+ * @return false when the conversion cannot be done this way.
+ */
+static inline bool decimalToDouble(uint64_t m, int exponent, double& value) {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD != 0
+  // extended precision intermediates would round twice
+  return false;
+#endif
+  const uint64_t maxMantissa = uint64_t(1) << 53;
+  if (m > maxMantissa)
+    return false;
+  if (exponent > maxExactPowerOfTen) {
+    // 12e25 is also 120000e22
+    for (; exponent > maxExactPowerOfTen && m < maxMantissa / 10; --exponent)
+      m *= 10;
+    if (exponent > maxExactPowerOfTen)
+      return false;
+  }
+  if (exponent < -maxExactPowerOfTen)
+    return false;
+  if (exponent < 0)
+    value = static_cast<double>(m) / exactPowersOfTen[-exponent];
+  else
+    value = static_cast<double>(m) * exactPowersOfTen[exponent];
+  return true;
+}
+
+/** Converts a JSON number token to a double without going through a stream,
+ * independently of the locale.
+ *
+ * The token has already been validated by the reader. Only the numbers whose
+ * value can be computed exactly with decimalToDouble() are converted, which
+ * covers the measurements of up to 15 digits sent by the sensors.
+ * @return false when the caller has to fall back to a full conversion.
+ */
+static inline bool decodeDoubleFast(const char* begin, const char* end,
+                                    double& value) {
+  const char* current = begin;
+  bool isNegative = current != end && *current == '-';
+  if (isNegative)
+    ++current;
+  uint64_t m = 0;
+  int digits = 0;   // significant digits in m
+  int exponent = 0; // decimal exponent of the last digit in m
+  for (; current != end && *current >= '0' && *current <= '9'; ++current) {
+    if (m == 0 && *current == '0')
+      continue;
+    if (++digits > 19)
+      return false;
+    m = m * 10 + static_cast<unsigned>(*current - '0');
+  }
+  if (current != end && *current == '.') {
+    for (++current; current != end && *current >= '0' && *current <= '9';
+         ++current) {
+      --exponent;
+      if (m == 0 && *current == '0')
+        continue;
+      if (++digits > 19)
+        return false;
+      m = m * 10 + static_cast<unsigned>(*current - '0');
+    }
+  }
+  if (current != end && (*current == 'e' || *current == 'E')) {
+    ++current;
+    bool isNegativeExponent = current != end && *current == '-';
+    if (current != end && (*current == '-' || *current == '+'))
+      ++current;
+    int e = 0;
+    for (; current != end && *current >= '0' && *current <= '9'; ++current) {
+      if (e > 9999)
+        return false;
+      e = e * 10 + (*current - '0');
+    }
+    exponent += isNegativeExponent ? -e : e;
+  }
+  if (current != end)
+    return false;
+  if (m == 0) {
+    value = isNegative ? -0.0 : 0.0;
+    return true;
+  }
+  if (!decimalToDouble(m, exponent, value))
+    return false;
+  if (isNegative)
+    value = -value;
+  return true;
+}
+
 /** Change ',' to '.' everywhere in buffer.
  *
  * We had a sophisticated way, but it did not work in WinCE.
@@ -105,20 +105,31 @@ static inline bool InRange(double d, T min, U max) {
 }
 #endif // if !defined(JSON_USE_INT64_DOUBLE_CONVERSION)
 
+/** Allocates a string buffer from the arena of the thread, if any, or with
+ * malloc.
+ */
+static inline char* allocateStringValue(size_t size, Arena* arena) {
+  if (arena)
+    return static_cast<char*>(arena->allocate(size, alignof(unsigned)));
+  return static_cast<char*>(malloc(size));
+}
+
 /** Duplicates the specified string value.
  * @param value Pointer to the string to duplicate. Must be zero-terminated if
  *              length is "unknown".
  * @param length Length of the value. if equals to unknown, then it will be
  *               computed using strlen(value).
+ * @param arena Arena to allocate from, nullptr for the heap.
  * @return Pointer on the duplicate instance of string.
  */
-static inline char* duplicateStringValue(const char* value, size_t length) {
+static inline char* duplicateStringValue(const char* value, size_t length,
+                                         Arena* arena = nullptr) {
   // Avoid an integer overflow in the call to malloc below by limiting length
   // to a sane value.
   if (length >= static_cast<size_t>(Value::maxInt))
     length = Value::maxInt - 1;
 
-  auto newString = static_cast<char*>(malloc(length + 1));
+  auto newString = allocateStringValue(length + 1, arena);
   if (newString == nullptr) {
     throwRuntimeError("in Json::Value::duplicateStringValue(): "
                       "Failed to allocate string value buffer");
@@ -131,7 +142,8 @@ static inline char* duplicateStringValue(const char* value, size_t length) {
 /* Record the length as a prefix.
  */
 static inline char* duplicateAndPrefixStringValue(const char* value,
-                                                  unsigned int length) {
+                                                  unsigned int length,
+                                                  Arena* arena = nullptr) {
   // Avoid an integer overflow in the call to malloc below by limiting length
   // to a sane value.
   JSON_ASSERT_MESSAGE(length <= static_cast<unsigned>(Value::maxInt) -
@@ -139,7 +151,7 @@ static inline char* duplicateAndPrefixStringValue(const char* value,
                       "in Json::Value::duplicateAndPrefixStringValue(): "
                       "length too big for prefixing");
   size_t actualLength = sizeof(length) + length + 1;
-  auto newString = static_cast<char*>(malloc(actualLength));
+  auto newString = allocateStringValue(actualLength, arena);
   if (newString == nullptr) {
     throwRuntimeError("in Json::Value::duplicateAndPrefixStringValue(): "
                       "Failed to allocate string value buffer");
@@ -244,16 +256,18 @@ Value::CZString::CZString(char const* str, unsigned length,
 }
 
 Value::CZString::CZString(const CZString& other) {
-  cstr_ = (other.storage_.policy_ != noDuplication && other.cstr_ != nullptr
-               ? duplicateStringValue(other.cstr_, other.storage_.length_)
-               : other.cstr_);
+  Arena* arena = Arena::current();
+  cstr_ =
+      (other.storage_.policy_ != noDuplication && other.cstr_ != nullptr
+           ? duplicateStringValue(other.cstr_, other.storage_.length_, arena)
+           : other.cstr_);
   storage_.policy_ =
       static_cast<unsigned>(
           other.cstr_
               ? (static_cast<DuplicationPolicy>(other.storage_.policy_) ==
                          noDuplication
                      ? noDuplication
-                     : duplicate)
+                     : (arena ? inArena : duplicate))
               : static_cast<DuplicationPolicy>(other.storage_.policy_)) &
       3U;
   storage_.length_ = other.storage_.length_;
@@ -363,7 +377,7 @@ Value::Value(ValueType type) {
     break;
   case arrayValue:
   case objectValue:
-    value_.map_ = new ObjectValues();
+    value_.map_ = newObjectValues(nullptr);
     break;
   case booleanValue:
     value_.bool_ = false;
@@ -403,19 +417,19 @@ Value::Value(const char* value) {
   JSON_ASSERT_MESSAGE(value != nullptr,
                       "Null Value Passed to Value Constructor");
   value_.string_ = duplicateAndPrefixStringValue(
-      value, static_cast<unsigned>(strlen(value)));
+      value, static_cast<unsigned>(strlen(value)), arenaForPayload());
 }
 
 Value::Value(const char* begin, const char* end) {
   initBasic(stringValue, true);
-  value_.string_ =
-      duplicateAndPrefixStringValue(begin, static_cast<unsigned>(end - begin));
+  value_.string_ = duplicateAndPrefixStringValue(
+      begin, static_cast<unsigned>(end - begin), arenaForPayload());
 }
 
 Value::Value(const String& value) {
   initBasic(stringValue, true);
   value_.string_ = duplicateAndPrefixStringValue(
-      value.data(), static_cast<unsigned>(value.length()));
+      value.data(), static_cast<unsigned>(value.length()), arenaForPayload());
 }
 
 Value::Value(const StaticString& value) {
@@ -968,6 +982,7 @@ const Value& Value::operator[](int index) const {
 void Value::initBasic(ValueType type, bool allocated) {
   setType(type);
   setIsAllocated(allocated);
+  setIsInArena(false);
   comments_ = Comments{};
   start_ = 0;
   limit_ = 0;
@@ -976,6 +991,7 @@ void Value::initBasic(ValueType type, bool allocated) {
 void Value::dupPayload(const Value& other) {
   setType(other.type());
   setIsAllocated(false);
+  setIsInArena(false);
   switch (type()) {
   case nullValue:
   case intValue:
@@ -990,7 +1006,7 @@ void Value::dupPayload(const Value& other) {
       char const* str;
       decodePrefixedString(other.isAllocated(), other.value_.string_, &len,
                            &str);
-      value_.string_ = duplicateAndPrefixStringValue(str, len);
+      value_.string_ = duplicateAndPrefixStringValue(str, len, arenaForPayload());
       setIsAllocated(true);
     } else {
       value_.string_ = other.value_.string_;
@@ -998,7 +1014,7 @@ void Value::dupPayload(const Value& other) {
     break;
   case arrayValue:
   case objectValue:
-    value_.map_ = new ObjectValues(*other.value_.map_);
+    value_.map_ = newObjectValues(other.value_.map_);
     break;
   default:
     JSON_ASSERT_UNREACHABLE;
@@ -1014,18 +1030,37 @@ void Value::releasePayload() {
   case booleanValue:
     break;
   case stringValue:
-    if (isAllocated())
+    if (isAllocated() && !isInArena())
       releasePrefixedStringValue(value_.string_);
     break;
   case arrayValue:
   case objectValue:
-    delete value_.map_;
+    if (isInArena())
+      value_.map_->~ObjectValues();
+    else
+      delete value_.map_;
     break;
   default:
     JSON_ASSERT_UNREACHABLE;
   }
 }
 
+Arena* Value::arenaForPayload() {
+  Arena* arena = Arena::current();
+  setIsInArena(arena != nullptr);
+  return arena;
+}
+
+Value::ObjectValues* Value::newObjectValues(const ObjectValues* other) {
+  Arena* arena = arenaForPayload();
+  if (!arena)
+    return other ? new ObjectValues(*other) : new ObjectValues();
+  void* storage = arena->allocate(sizeof(ObjectValues), alignof(ObjectValues));
+  // a copy takes the arena of the thread from ArenaAllocator
+  return other ? new (storage) ObjectValues(*other)
+               : new (storage) ObjectValues(ObjectAllocator(arena));
+}
+
 void Value::dupMeta(const Value& other) {
   comments_ = other.comments_;
   start_ = other.start_;
@@ -10,6 +10,8 @@
 #include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <cfloat>
+#include <cstdlib>
 #include <cstring>
 #include <iomanip>
 #include <memory>
@@ -124,6 +126,102 @@ String valueToString(UInt value) { return valueToString(LargestUInt(value)); }
 #endif // # if defined(JSON_HAS_INT64)
 
 namespace {
+/** Find the shortest decimal m * 10^exponent that reads back as value, which
+ * must be positive.
+ *
+ * For each precision, the nearest decimal is one of the two integers around
+ * the scaled value, and the round trip is checked exactly by
+ * decimalToDouble(). That works as long as m fits in 53 bits and the scale is
+ * an exact power of ten, which covers up to 15 or 16 digits for the values
+ * from 1e-8 to 1e23.
+ * @param digits On failure, the precision from which the search has to go on
+ *        with printf and strtod: 17 when value is known to need 17 digits.
+ */
+bool shortestDecimal(double value, uint64_t& m, int& exponent, int& digits) {
+  if (!(value >= 1e-8 && value < 1e23)) {
+    // below DBL_DIG only the subnormal values can fail to round trip
+    digits = value < DBL_MIN ? 1 : 15;
+    return false;
+  }
+  const int e10 = static_cast<int>(std::floor(std::log10(value)));
+  for (digits = 1; digits <= 16; ++digits) {
+    const int scale = digits - 1 - e10;
+    if (scale > maxExactPowerOfTen || scale < -maxExactPowerOfTen)
+      return false;
+    const double scaled = scale < 0 ? value / exactPowersOfTen[-scale]
+                                    : value * exactPowersOfTen[scale];
+    uint64_t candidates[2];
+    candidates[0] = static_cast<uint64_t>(scaled);
+    candidates[1] = candidates[0] + 1;
+    if (scaled - static_cast<double>(candidates[0]) > 0.5)
+      std::swap(candidates[0], candidates[1]);
+    bool isChecked = true;
+    for (uint64_t candidate : candidates) {
+      double back = 0;
+      if (candidate == 0)
+        continue;
+      if (!decimalToDouble(candidate, -scale, back)) {
+        isChecked = false;
+      } else if (back == value) {
+        m = candidate;
+        exponent = -scale;
+        return true;
+      }
+    }
+    if (!isChecked)
+      return false;
+  }
+  return false;
+}
+
+/** Print m * 10^exponent the way "%.17g" prints a double, without the
+ * trailing zeros.
+ * @param current End of a buffer of at least 32 chars, moved to the start
+ *        of the text.
+ */
+void writeDecimal(bool isNegative, uint64_t m, int exponent, char*& current) {
+  for (; m % 10 == 0; m /= 10)
+    ++exponent;
+  UIntToStringBuffer digitBuffer;
+  char* digits = digitBuffer + sizeof(digitBuffer);
+  uintToString(m, digits);
+  const int count = static_cast<int>(digitBuffer + sizeof(digitBuffer) - 1 -
+                                     digits);
+  const int e10 = count - 1 + exponent;
+  *--current = 0;
+  if (e10 < -4 || e10 >= static_cast<int>(Value::defaultRealPrecision)) {
+    // at least two exponent digits, as printf does
+    unsigned int e = static_cast<unsigned int>(e10 < 0 ? -e10 : e10);
+    for (int i = 0; i < 2 || e != 0; ++i, e /= 10)
+      *--current = static_cast<char>('0' + e % 10);
+    *--current = e10 < 0 ? '-' : '+';
+    *--current = 'e';
+    for (int i = count - 1; i > 0; --i)
+      *--current = digits[i];
+    if (count > 1)
+      *--current = '.';
+    *--current = digits[0];
+  } else if (exponent >= 0) {
+    for (int i = 0; i < exponent; ++i)
+      *--current = '0';
+    for (int i = count - 1; i >= 0; --i)
+      *--current = digits[i];
+  } else {
+    const int integerDigits = count + exponent;
+    for (int i = count - 1; i >= 0 && i >= integerDigits; --i)
+      *--current = digits[i];
+    for (int i = integerDigits; i < 0; ++i)
+      *--current = '0';
+    *--current = '.';
+    if (integerDigits <= 0)
+      *--current = '0';
+    for (int i = integerDigits - 1; i >= 0; --i)
+      *--current = digits[i];
+  }
+  if (isNegative)
+    *--current = '-';
+}
+
 String valueToString(double value, bool useSpecialFloats,
                      unsigned int precision, PrecisionType precisionType) {
   // Print into the buffer. We need not request the alternative representation
@@ -136,6 +234,47 @@ String valueToString(double value, bool useSpecialFloats,
                [isnan(value) ? 0 : (value < 0) ? 1 : 2];
   }
 
+  // The default precision is the one that guarantees a round trip: print the
+  // shortest text that reads back as the same double instead.
+  if (precisionType == PrecisionType::significantDigits &&
+      precision == Value::defaultRealPrecision) {
+    char buffer[32];
+    char* current = buffer + sizeof(buffer);
+    const bool isNegative = std::signbit(value);
+    uint64_t m = 0;
+    int exponent = 0;
+    int digits = 0;
+    if (value == 0) {
+      *--current = 0;
+      *--current = '0';
+      if (isNegative)
+        *--current = '-';
+    } else if (shortestDecimal(isNegative ? -value : value, m, exponent,
+                               digits)) {
+      writeDecimal(isNegative, m, exponent, current);
+    } else {
+      // Go on with the first of "%.{digits}e" to "%.17e" that reads back as
+      // value. The digits are taken whatever the decimal point of the locale.
+      char text[32];
+      for (;; ++digits) {
+        jsoncpp_snprintf(text, sizeof(text), "%.*e", digits - 1, value);
+        if (digits == 17 || std::strtod(text, nullptr) == value)
+          break;
+      }
+      const char* c = text;
+      for (; *c != 'e'; ++c) {
+        if (*c >= '0' && *c <= '9')
+          m = m * 10 + static_cast<unsigned>(*c - '0');
+      }
+      exponent = std::atoi(c + 1) - (digits - 1);
+      writeDecimal(isNegative, m, exponent, current);
+    }
+    String result(current);
+    if (result.find('.') == result.npos && result.find('e') == result.npos)
+      result += ".0";
+    return result;
+  }
+
   String buffer(size_t(36), '\0');
   while (true) {
     int len = jsoncpp_snprintf(
@@ -20,8 +20,10 @@
 #include "view.h"
 #include "view/view_data.h"
 #include "data.h"
+#include "view_defines.h"
 // added by dmkang
 #include "mqtt.h"
+#include "replay.h"
 
 /**
  * @brief: Hook to take necessary actions before main event loop starts
@@ -31,10 +33,17 @@
  */
 static bool app_create(void *user_data)
 {
-	data_initialize(view_data_update_sensor_values);
+	int i;
+
+	data_initialize(view_data_update_sensor_values, batch_add_records);
 	view_create();
 	// added by dmkang
 	mqttInit();
+	batch_initialize(BATCH_MAX_SAMPLES, BATCH_MAX_AGE_MS, mqttPublishBatch);
+	for (i = 0; i < SENSOR_COUNT; ++i) {
+		if (data_get_sensor_support(i))
+			batch_set_quantum(i, data_get_sensor_resolution(i));
+	}
 
 	return true;
 }
@@ -46,6 +55,22 @@ static bool app_create(void *user_data)
 static void app_control(app_control_h app_control, void *user_data)
 {
 	/* Handle the launch request. */
+	char *path = NULL;
+	char *speed = NULL;
+
+	/* e.g. app_launcher -s <app id> replay_trace /path/to/trace replay_speed max */
+	if (app_control_get_extra_data(app_control, "record_trace", &path) == APP_CONTROL_ERROR_NONE && path) {
+		replay_record_start(path);
+		free(path);
+		path = NULL;
+	}
+
+	if (app_control_get_extra_data(app_control, "replay_trace", &path) == APP_CONTROL_ERROR_NONE && path) {
+		app_control_get_extra_data(app_control, "replay_speed", &speed);
+		replay_start(path, (speed && strcmp(speed, "max") == 0) ? REPLAY_SPEED_MAX : (speed ? atoi(speed) : REPLAY_SPEED_REALTIME));
+		free(speed);
+		free(path);
+	}
 }
 
 /**
@@ -56,6 +81,8 @@ static void app_control(app_control_h app_control, void *user_data)
 static void app_pause(void *user_data)
 {
 	/* Take necessary actions when application becomes invisible. */
+	data_flush();
+	batch_flush();
 }
 
 /**
@@ -73,6 +100,10 @@ static void app_resume(void *user_data)
 static void app_terminate(void *user_data)
 {
 	// added by dmkang
+	replay_stop();
+	replay_record_stop();
+	data_flush();
+	batch_finalize();
 	mqttExit();
 	view_destroy();
 	data_finalize();
@@ -0,0 +1,460 @@
+/*
+ * batch.c
+ */
+
+#include <Ecore.h>
+#include <app_preference.h>
+#include <sensors.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "batch.h"
+
+#define BATCH_INITIAL_SIZE	4096
+#define BATCH_HEADER_FMT	"{\"batch_id\":%d,\"prev_root\":\"%s\",\"records\":["
+#define BATCH_TRAILER_FMT	"],\"count\":%d,\"root\":\"%s\"}"
+#define BATCH_TRAILER_MAX	(32 + MERKLE_HASH_SIZE * 2)	// also covers the commitment of the binary format
+#define BATCH_ROOT_KEY		"batch_last_root"	// preference keeping the chain of roots across launches
+
+static struct batch_info {
+	batch_t *current;
+	int next_id;
+	int transaction_id;
+	int format;
+	int max_samples;
+	int max_age_ms;
+	Batch_Flush_Cb flush_cb;
+	Ecore_Timer *timer;
+	float quantum[COLUMNAR_MAX_TYPES];	/* resolution of each sensor for the columnar format */
+	merkle_hash_t last_root;			/* root of the last closed batch */
+	merkle_hash_t saved_root;			/* root in the preference store */
+	pthread_mutex_t lock;
+	pthread_mutex_t save_lock;			/* orders the writes of the preference, taken before lock */
+} s_info = {
+	.current = NULL,
+	.next_id = 0,
+	.transaction_id = 0,
+	.format = RECORD_DEFAULT_FORMAT,
+	.max_samples = BATCH_MAX_SAMPLES,
+	.max_age_ms = BATCH_MAX_AGE_MS,
+	.flush_cb = NULL,
+	.timer = NULL,
+	.quantum = { 0, },
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.save_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static long long _now_ms(void);
+static batch_t *_batch_create(long long timestamp_ms);
+static bool _batch_reserve(batch_t *batch, size_t extra);
+static batch_t *_batch_detach(void);
+static bool _batch_commit_columnar(batch_t *batch, record_t *scratch);
+static void _load_last_root(void);
+static void _save_last_root(void);
+static Eina_Bool _age_timer_cb(void *data);
+
+/**
+ * @brief Initializes the batching stage placed between the sensor callbacks and the publisher.
+ * @param max_samples Number of records after which a batch is flushed.
+ * @param max_age_ms Age of the oldest record after which a batch is flushed.
+ * @param flush_cb Callback receiving the ownership of every flushed batch.
+ * @return True on success or false on error.
+ */
+bool batch_initialize(int max_samples, int max_age_ms, Batch_Flush_Cb flush_cb)
+{
+	if (!flush_cb)
+		return false;
+
+	s_info.flush_cb = flush_cb;
+	batch_set_window(max_samples, max_age_ms);
+	_load_last_root();
+	dlog_print(DLOG_INFO, LOG_TAG, "SHA-256 transform: %s", sha256_implementation());
+
+	return true;
+}
+
+/**
+ * @brief Changes the count/age window of the batches.
+ * @param max_samples Number of records after which a batch is flushed.
+ * @param max_age_ms Age of the oldest record after which a batch is flushed.
+ */
+void batch_set_window(int max_samples, int max_age_ms)
+{
+	pthread_mutex_lock(&s_info.lock);
+	/* the binary header stores the record count on 16 bits */
+	s_info.max_samples = max_samples > 0 ? (max_samples < 0xffff ? max_samples : 0xffff) : 1;
+	s_info.max_age_ms = max_age_ms > 0 ? max_age_ms : BATCH_MAX_AGE_MS;
+	pthread_mutex_unlock(&s_info.lock);
+
+	/* The timer only catches batches that stopped growing, so a quarter of the window is precise enough. */
+	if (s_info.timer)
+		ecore_timer_del(s_info.timer);
+	s_info.timer = ecore_timer_add(s_info.max_age_ms / 4000.0, _age_timer_cb, NULL);
+}
+
+/**
+ * @brief Selects the wire format of the batches created from now on.
+ * @param format RECORD_FORMAT_JSON, RECORD_FORMAT_BINARY or RECORD_FORMAT_COLUMNAR.
+ */
+void batch_set_format(int format)
+{
+	pthread_mutex_lock(&s_info.lock);
+	s_info.format = format;
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Sets the resolution the values of a sensor are rounded to in the columnar format.
+ * @param sensor_type The sensor's type.
+ * @param quantum The resolution, 0 to keep the exact float values.
+ */
+void batch_set_quantum(int sensor_type, float quantum)
+{
+	if (sensor_type < 0 || sensor_type >= COLUMNAR_MAX_TYPES)
+		return;
+
+	pthread_mutex_lock(&s_info.lock);
+	s_info.quantum[sensor_type] = quantum > 0.0f ? quantum : 0.0f;
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Serializes sensor records into the current batch, flushing it whenever the window is full.
+ * The records of one hardware FIFO delivery are appended under a single lock.
+ * @param records The records, in chronological order.
+ * @param count Number of records.
+ * @return True on success or false on error.
+ */
+bool batch_add_records(const record_t *records, int count)
+{
+	batch_t *full;
+	batch_t *batch;
+	size_t len;
+	int i;
+
+	pthread_mutex_lock(&s_info.lock);
+
+	for (i = 0; i < count; ++i) {
+		if (!s_info.current)
+			s_info.current = _batch_create(records[i].timestamp_ms);
+
+		batch = s_info.current;
+		if (!batch || !_batch_reserve(batch, RECORD_MAX_JSON_SIZE + BATCH_TRAILER_MAX)) {
+			pthread_mutex_unlock(&s_info.lock);
+			dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] Can't allocate the batch buffer", __FILE__, __LINE__);
+			return false;
+		}
+
+		if (batch->format == RECORD_FORMAT_COLUMNAR) {
+			/* the columns are only known once the batch is complete, see _batch_detach() */
+			memcpy(batch->data + batch->len, &records[i], sizeof(record_t));
+			len = sizeof(record_t);
+		} else if (batch->format == RECORD_FORMAT_BINARY) {
+			len = record_write_binary(&records[i], batch->last_ms, (unsigned char *)batch->data + batch->len, batch->size - batch->len);
+		} else {
+			if (batch->count > 0)
+				batch->data[batch->len++] = ',';
+			len = record_write_json(&records[i], s_info.transaction_id++, batch->data + batch->len, batch->size - batch->len);
+		}
+
+		if (batch->format != RECORD_FORMAT_COLUMNAR)
+			merkle_add(&batch->tree, batch->data + batch->len, len);
+
+		batch->len += len;
+		batch->last_ms = records[i].timestamp_ms;
+		batch->count++;
+
+		if (batch->count < s_info.max_samples && _now_ms() - batch->created_ms < s_info.max_age_ms)
+			continue;
+
+		/* a FIFO delivery can fill several batches, hand each one over as soon as it is closed */
+		full = _batch_detach();
+		pthread_mutex_unlock(&s_info.lock);
+		if (full) {
+			_save_last_root();
+			s_info.flush_cb(full);
+		}
+		pthread_mutex_lock(&s_info.lock);
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+
+	return true;
+}
+
+/**
+ * @brief Hands the current batch to the flush callback, whatever its size. Should be invoked when the app is paused.
+ */
+void batch_flush(void)
+{
+	batch_t *batch;
+
+	pthread_mutex_lock(&s_info.lock);
+	batch = _batch_detach();
+	pthread_mutex_unlock(&s_info.lock);
+
+	if (batch) {
+		_save_last_root();
+		s_info.flush_cb(batch);
+	}
+}
+
+/**
+ * @brief Flushes the pending records and stops the age timer. Should be invoked when the app is terminated.
+ */
+void batch_finalize(void)
+{
+	if (s_info.timer) {
+		ecore_timer_del(s_info.timer);
+		s_info.timer = NULL;
+	}
+
+	if (s_info.flush_cb)
+		batch_flush();
+}
+
+/**
+ * @brief Releases a flushed batch.
+ * @param batch The batch to be released.
+ */
+void batch_destroy(batch_t *batch)
+{
+	if (!batch)
+		return;
+
+	free(batch->data);
+	free(batch);
+}
+
+static long long _now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Allocates an empty batch holding only the payload header.
+ * @param timestamp_ms Wall clock time of the first record.
+ * @return The new batch or NULL on error.
+ */
+static batch_t *_batch_create(long long timestamp_ms)
+{
+	char hex[MERKLE_HASH_SIZE * 2 + 1];
+	batch_t *batch = calloc(1, sizeof(batch_t));
+	if (!batch)
+		return NULL;
+
+	batch->data = malloc(BATCH_INITIAL_SIZE);
+	if (!batch->data) {
+		free(batch);
+		return NULL;
+	}
+
+	batch->id = s_info.next_id++;
+	batch->format = s_info.format;
+	batch->size = BATCH_INITIAL_SIZE;
+	merkle_init(&batch->tree);
+	memcpy(batch->prev_root, s_info.last_root, MERKLE_HASH_SIZE);
+	if (batch->format == RECORD_FORMAT_COLUMNAR) {
+		batch->len = 0;
+	} else if (batch->format == RECORD_FORMAT_BINARY) {
+		batch->len = record_write_header((unsigned char *)batch->data, batch->size, batch->id, timestamp_ms);
+		record_set_header_flags((unsigned char *)batch->data, RECORD_FLAG_COMMITTED);
+	} else {
+		merkle_to_hex(batch->prev_root, hex);
+		batch->len = snprintf(batch->data, batch->size, BATCH_HEADER_FMT, batch->id, hex);
+	}
+	batch->created_ms = _now_ms();
+	batch->last_ms = timestamp_ms;
+
+	return batch;
+}
+
+/**
+ * @brief Makes sure the batch can take extra bytes after its current content.
+ */
+static bool _batch_reserve(batch_t *batch, size_t extra)
+{
+	size_t size = batch->size;
+	char *data;
+
+	if (batch->len + extra < size)
+		return true;
+
+	while (batch->len + extra >= size)
+		size *= 2;
+
+	data = realloc(batch->data, size);
+	if (!data)
+		return false;
+
+	batch->data = data;
+	batch->size = size;
+
+	return true;
+}
+
+/**
+ * @brief Closes the current batch and takes it out of the batching stage. The caller saves the new
+ * last root with _save_last_root() once the lock is released, before handing the batch over: a crash
+ * must not restart the chain from an older root.
+ * Notice: Caller MUST hold the lock.
+ * @return The closed batch or NULL if there was nothing to flush.
+ */
+static batch_t *_batch_detach(void)
+{
+	char hex[MERKLE_HASH_SIZE * 2 + 1];
+	batch_t *batch = s_info.current;
+	size_t size;
+	char *data;
+	char *records;
+
+	if (!batch || batch->count == 0)
+		return NULL;
+
+	if (batch->format == RECORD_FORMAT_COLUMNAR) {
+		size = COLUMNAR_MAX_SIZE(batch->count) + RECORD_COMMITMENT_SIZE;
+		data = malloc(size);
+		records = batch->data;
+		if (data) {
+			batch->len = columnar_encode((const record_t *)records, batch->count, batch->id, s_info.quantum, true,
+					(unsigned char *)data, size);
+			batch->data = data;
+			batch->size = size;
+		}
+		if (!data || batch->len == 0 || !_batch_commit_columnar(batch, (record_t *)records)) {
+			dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] Can't encode batch %d", __FILE__, __LINE__, batch->id);
+			if (data)
+				free(records);
+			s_info.current = NULL;
+			batch_destroy(batch);
+			return NULL;
+		}
+		free(records);
+	}
+
+	merkle_root(&batch->tree, batch->root);
+	memcpy(s_info.last_root, batch->root, MERKLE_HASH_SIZE);
+
+	/* _batch_reserve() always leaves room for the trailer and the commitment */
+	if (batch->format == RECORD_FORMAT_JSON) {
+		merkle_to_hex(batch->root, hex);
+		batch->len += snprintf(batch->data + batch->len, batch->size - batch->len, BATCH_TRAILER_FMT, batch->count, hex);
+	} else {
+		if (batch->format == RECORD_FORMAT_BINARY)
+			record_set_header_count((unsigned char *)batch->data, batch->count);
+		memcpy(batch->data + batch->len, batch->prev_root, MERKLE_HASH_SIZE);
+		memcpy(batch->data + batch->len + MERKLE_HASH_SIZE, batch->root, MERKLE_HASH_SIZE);
+		batch->len += RECORD_COMMITMENT_SIZE;
+	}
+	s_info.current = NULL;
+
+	return batch;
+}
+
+/**
+ * @brief Builds the tree of a columnar batch from the records as the receiver decodes them, rounded
+ * to their quantum, and flags the batch as committed.
+ * @param batch The encoded batch.
+ * @param scratch Room for the records of the batch.
+ * @return True on success or false on error.
+ */
+static bool _batch_commit_columnar(batch_t *batch, record_t *scratch)
+{
+	unsigned char buf[MERKLE_LEAF_BATCH][RECORD_MAX_BINARY_SIZE];
+	const void *data[MERKLE_LEAF_BATCH];
+	size_t len[MERKLE_LEAF_BATCH];
+	merkle_hash_t leaves[MERKLE_LEAF_BATCH];
+	int n;
+	int i;
+	int j;
+
+	if (columnar_decode(batch->data, batch->len, NULL, scratch, batch->count) != batch->count)
+		return false;
+
+	for (i = 0; i < batch->count; i += n) {
+		n = batch->count - i < MERKLE_LEAF_BATCH ? batch->count - i : MERKLE_LEAF_BATCH;
+		for (j = 0; j < n; ++j) {
+			len[j] = record_write_binary(&scratch[i + j], 0, buf[j], sizeof(buf[j]));
+			data[j] = buf[j];
+		}
+
+		merkle_leaf_hashes(data, len, n, leaves);
+		for (j = 0; j < n; ++j)
+			merkle_add_leaf(&batch->tree, leaves[j]);
+	}
+
+	batch->data[3] |= COLUMNAR_FLAG_COMMITTED;
+
+	return true;
+}
+
+/**
+ * @brief Restores the root of the last batch published by the previous launch.
+ */
+static void _load_last_root(void)
+{
+	char *hex = NULL;
+	unsigned int byte;
+	int i;
+
+	if (preference_get_string(BATCH_ROOT_KEY, &hex) != PREFERENCE_ERROR_NONE || !hex)
+		return;
+
+	if (strlen(hex) == MERKLE_HASH_SIZE * 2) {
+		for (i = 0; i < MERKLE_HASH_SIZE && sscanf(hex + i * 2, "%2x", &byte) == 1; ++i)
+			s_info.last_root[i] = byte;
+		memcpy(s_info.saved_root, s_info.last_root, MERKLE_HASH_SIZE);
+	}
+
+	free(hex);
+}
+
+/**
+ * @brief Keeps the root of the last closed batch for the next launch. The flash write happens
+ * outside of the lock, the producers are not held up by it.
+ * Notice: Caller MUST NOT hold the lock.
+ */
+static void _save_last_root(void)
+{
+	char hex[MERKLE_HASH_SIZE * 2 + 1];
+	merkle_hash_t root;
+	int ret;
+
+	/* every save writes the newest root, and the saves run one at a time: an older root never comes last */
+	pthread_mutex_lock(&s_info.save_lock);
+	pthread_mutex_lock(&s_info.lock);
+	memcpy(root, s_info.last_root, MERKLE_HASH_SIZE);
+	pthread_mutex_unlock(&s_info.lock);
+
+	if (memcmp(root, s_info.saved_root, MERKLE_HASH_SIZE) != 0) {
+		merkle_to_hex(root, hex);
+		ret = preference_set_string(BATCH_ROOT_KEY, hex);
+		if (ret == PREFERENCE_ERROR_NONE)
+			memcpy(s_info.saved_root, root, MERKLE_HASH_SIZE);
+		else
+			dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] preference_set_string() error: %d", __FILE__, __LINE__, ret);
+	}
+	pthread_mutex_unlock(&s_info.save_lock);
+}
+
+/**
+ * @brief Ecore timer callback flushing a batch that has not reached its sample count in time.
+ */
+static Eina_Bool _age_timer_cb(void *data)
+{
+	bool expired;
+
+	pthread_mutex_lock(&s_info.lock);
+	expired = s_info.current && _now_ms() - s_info.current->created_ms >= s_info.max_age_ms;
+	pthread_mutex_unlock(&s_info.lock);
+
+	if (expired)
+		batch_flush();
+
+	return ECORE_CALLBACK_RENEW;
+}
@@ -0,0 +1,401 @@
+/*
+ * columnar.c
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(COLUMNAR_USE_ZLIB)
+#include <zlib.h>
+#endif
+#include "columnar.h"
+
+#define COLUMNAR_MAX_STREAMS	255
+#define QUANTIZED_LIMIT			9007199254740992.0	/* 2^53, beyond a double loses the integer */
+
+typedef struct stream_key {
+	int type;
+	int value_count;
+} stream_key_t;
+
+typedef struct reader {
+	const unsigned char *data;
+	size_t len;
+	size_t pos;
+} reader_t;
+
+static size_t _put_varint(unsigned char *buf, unsigned long long v);
+static unsigned long long _zigzag(long long v);
+static long long _unzigzag(unsigned long long v);
+static int _get_varint(reader_t *reader, unsigned long long *v);
+static int _stream_encoding(const record_t *records, int count, const stream_key_t *key, float quantum);
+static size_t _encode_stream(const record_t *records, int count, const stream_key_t *key, float quantum, unsigned char *buf);
+static int _decode_streams(reader_t *reader, int streams, record_t *records, int max_records);
+
+/**
+ * @brief Encodes a batch of records in the columnar format.
+ * @param records The records.
+ * @param count Number of records, at most 0xffff.
+ * @param batch_id The sequence number of the batch.
+ * @param quantum Resolution of each sensor type (COLUMNAR_MAX_TYPES entries), 0 to keep the float bits.
+ * @param deflate Compresses the streams with zlib, ignored without COLUMNAR_USE_ZLIB.
+ * @param[out] buf The output buffer.
+ * @param size The size of the output buffer, COLUMNAR_MAX_SIZE(count) is always enough.
+ * @return The length of the encoded batch or 0 on error.
+ */
+size_t columnar_encode(const record_t *records, int count, unsigned int batch_id, const float *quantum, bool deflate, unsigned char *buf, size_t size)
+{
+	stream_key_t keys[COLUMNAR_MAX_STREAMS];
+	int streams = 0;
+	size_t len = COLUMNAR_HEADER_SIZE;
+	int i;
+	int k;
+
+	if (count < 0 || count > 0xffff || size < COLUMNAR_MAX_SIZE(count))
+		return 0;
+
+	/* one stream per sensor and value count, in the order of their first record */
+	for (i = 0; i < count; ++i) {
+		for (k = 0; k < streams; ++k)
+			if (keys[k].type == records[i].sensor_type && keys[k].value_count == records[i].value_count)
+				break;
+
+		if (k < streams)
+			continue;
+		if (streams == COLUMNAR_MAX_STREAMS || records[i].sensor_type < 0 || records[i].sensor_type >= COLUMNAR_MAX_TYPES ||
+				records[i].value_count < 0 || records[i].value_count > RECORD_MAX_VALUES)
+			return 0;
+
+		keys[streams].type = records[i].sensor_type;
+		keys[streams].value_count = records[i].value_count;
+		streams++;
+	}
+
+	buf[0] = 'K';
+	buf[1] = 'C';
+	buf[2] = COLUMNAR_VERSION;
+	buf[3] = 0;
+	buf[4] = batch_id & 0xff;
+	buf[5] = (batch_id >> 8) & 0xff;
+	buf[6] = (batch_id >> 16) & 0xff;
+	buf[7] = (batch_id >> 24) & 0xff;
+	buf[8] = count & 0xff;
+	buf[9] = (count >> 8) & 0xff;
+	buf[10] = (unsigned char)streams;
+	buf[11] = 0;
+
+	for (k = 0; k < streams; ++k)
+		len += _encode_stream(records, count, &keys[k], quantum ? quantum[keys[k].type] : 0.0f, buf + len);
+
+#if defined(COLUMNAR_USE_ZLIB)
+	if (deflate) {
+		uLongf packed_len = compressBound(len - COLUMNAR_HEADER_SIZE);
+		unsigned char *packed = malloc(packed_len);
+		size_t raw_len = len - COLUMNAR_HEADER_SIZE;
+
+		/* keep the raw streams when deflate does not pay off */
+		if (packed && compress2(packed, &packed_len, buf + COLUMNAR_HEADER_SIZE, raw_len, Z_BEST_SPEED) == Z_OK &&
+				packed_len + 4 < raw_len) {
+			buf[3] |= COLUMNAR_FLAG_DEFLATE;
+			buf[12] = raw_len & 0xff;
+			buf[13] = (raw_len >> 8) & 0xff;
+			buf[14] = (raw_len >> 16) & 0xff;
+			buf[15] = (raw_len >> 24) & 0xff;
+			memcpy(buf + COLUMNAR_HEADER_SIZE + 4, packed, packed_len);
+			len = COLUMNAR_HEADER_SIZE + 4 + packed_len;
+		}
+		free(packed);
+	}
+#else
+	(void)deflate;
+#endif
+
+	return len;
+}
+
+/**
+ * @brief Decodes a columnar batch. The records come out stream by stream, in chronological order within a sensor.
+ * @param data The batch payload.
+ * @param len The size of the payload.
+ * @param[out] batch_id The sequence number of the batch, may be NULL.
+ * @param[out] records The decoded records.
+ * @param max_records The capacity of records.
+ * @return The number of records or -1 on malformed or unsupported input.
+ */
+int columnar_decode(const void *data, size_t len, unsigned int *batch_id, record_t *records, int max_records)
+{
+	const unsigned char *buf = data;
+	reader_t reader;
+	int count;
+	int ret;
+
+	if (len < COLUMNAR_HEADER_SIZE || buf[0] != 'K' || buf[1] != 'C' || buf[2] > COLUMNAR_VERSION)
+		return -1;
+
+	count = buf[8] | (buf[9] << 8);
+	if (count > max_records)
+		return -1;
+	if (buf[3] & COLUMNAR_FLAG_COMMITTED) {
+		if (len < COLUMNAR_HEADER_SIZE + RECORD_COMMITMENT_SIZE)
+			return -1;
+		len -= RECORD_COMMITMENT_SIZE;
+	}
+	if (batch_id)
+		*batch_id = buf[4] | (buf[5] << 8) | (buf[6] << 16) | ((unsigned int)buf[7] << 24);
+
+	reader.data = buf;
+	reader.len = len;
+	reader.pos = COLUMNAR_HEADER_SIZE;
+
+	if (buf[3] & COLUMNAR_FLAG_DEFLATE) {
+#if defined(COLUMNAR_USE_ZLIB)
+		uLongf raw_len;
+		unsigned char *raw;
+
+		if (len < COLUMNAR_HEADER_SIZE + 4)
+			return -1;
+
+		raw_len = buf[12] | (buf[13] << 8) | (buf[14] << 16) | ((unsigned long)buf[15] << 24);
+		if (raw_len > COLUMNAR_MAX_SIZE(count) || (raw = malloc(raw_len)) == NULL)
+			return -1;
+
+		if (uncompress(raw, &raw_len, buf + COLUMNAR_HEADER_SIZE + 4, len - COLUMNAR_HEADER_SIZE - 4) != Z_OK) {
+			free(raw);
+			return -1;
+		}
+
+		reader.data = raw;
+		reader.len = raw_len;
+		reader.pos = 0;
+		ret = _decode_streams(&reader, buf[10], records, count);
+		free(raw);
+#else
+		return -1;
+#endif
+	} else {
+		ret = _decode_streams(&reader, buf[10], records, count);
+	}
+
+	return ret == count ? count : -1;
+}
+
+/**
+ * @brief Picks the quantized encoding when every value of the stream fits, the float bits otherwise.
+ */
+static int _stream_encoding(const record_t *records, int count, const stream_key_t *key, float quantum)
+{
+	double q;
+	int i;
+	int j;
+
+	if (!(quantum > 0.0f))
+		return COLUMNAR_VALUES_XOR;
+
+	for (i = 0; i < count; ++i) {
+		if (records[i].sensor_type != key->type || records[i].value_count != key->value_count)
+			continue;
+
+		for (j = 0; j < key->value_count; ++j) {
+			q = records[i].values[j] / (double)quantum;
+			if (isnan(q) || fabs(q) >= QUANTIZED_LIMIT)
+				return COLUMNAR_VALUES_XOR;
+		}
+	}
+
+	return COLUMNAR_VALUES_QUANTIZED;
+}
+
+/**
+ * @brief Writes the stream of one sensor: its header, the timestamp column, then one column per value.
+ */
+static size_t _encode_stream(const record_t *records, int count, const stream_key_t *key, float quantum, unsigned char *buf)
+{
+	int encoding = _stream_encoding(records, count, key, quantum);
+	long long prev_ts = 0;
+	long long prev_delta = 0;
+	long long prev_q;
+	long long q;
+	unsigned int prev_bits;
+	unsigned int bits;
+	size_t len = 0;
+	int n = 0;
+	int i;
+	int j;
+
+	for (i = 0; i < count; ++i)
+		if (records[i].sensor_type == key->type && records[i].value_count == key->value_count)
+			n++;
+
+	if (encoding == COLUMNAR_VALUES_XOR)
+		quantum = 0.0f;
+
+	buf[len++] = (unsigned char)key->type;
+	buf[len++] = (unsigned char)key->value_count;
+	buf[len++] = (unsigned char)encoding;
+	buf[len++] = 0;
+	memcpy(&bits, &quantum, sizeof(bits));
+	buf[len++] = bits & 0xff;
+	buf[len++] = (bits >> 8) & 0xff;
+	buf[len++] = (bits >> 16) & 0xff;
+	buf[len++] = (bits >> 24) & 0xff;
+	len += _put_varint(buf + len, n);
+
+	/* timestamps: a steady sampling rate turns into a run of zeros */
+	for (i = 0, j = 0; i < count; ++i) {
+		if (records[i].sensor_type != key->type || records[i].value_count != key->value_count)
+			continue;
+
+		if (j++ == 0) {
+			len += _put_varint(buf + len, _zigzag(records[i].timestamp_ms));
+		} else {
+			len += _put_varint(buf + len, _zigzag((records[i].timestamp_ms - prev_ts) - prev_delta));
+			prev_delta = records[i].timestamp_ms - prev_ts;
+		}
+		prev_ts = records[i].timestamp_ms;
+	}
+
+	for (j = 0; j < key->value_count; ++j) {
+		prev_q = 0;
+		prev_bits = 0;
+
+		for (i = 0; i < count; ++i) {
+			if (records[i].sensor_type != key->type || records[i].value_count != key->value_count)
+				continue;
+
+			if (encoding == COLUMNAR_VALUES_QUANTIZED) {
+				q = (long long)llround(records[i].values[j] / (double)quantum);
+				len += _put_varint(buf + len, _zigzag(q - prev_q));
+				prev_q = q;
+			} else {
+				memcpy(&bits, &records[i].values[j], sizeof(bits));
+				len += _put_varint(buf + len, bits ^ prev_bits);
+				prev_bits = bits;
+			}
+		}
+	}
+
+	return len;
+}
+
+/**
+ * @brief Decodes the streams of a batch.
+ * @return The number of decoded records or -1 on malformed input.
+ */
+static int _decode_streams(reader_t *reader, int streams, record_t *records, int max_records)
+{
+	unsigned long long v;
+	unsigned int bits;
+	long long ts;
+	long long delta;
+	long long q;
+	float quantum;
+	int type;
+	int value_count;
+	int encoding;
+	int first;
+	int total = 0;
+	int n;
+	int i;
+	int j;
+	int k;
+
+	for (k = 0; k < streams; ++k) {
+		if (reader->len - reader->pos < 8)
+			return -1;
+
+		type = reader->data[reader->pos];
+		value_count = reader->data[reader->pos + 1];
+		encoding = reader->data[reader->pos + 2];
+		bits = reader->data[reader->pos + 4] | (reader->data[reader->pos + 5] << 8) |
+				(reader->data[reader->pos + 6] << 16) | ((unsigned int)reader->data[reader->pos + 7] << 24);
+		memcpy(&quantum, &bits, sizeof(quantum));
+		reader->pos += 8;
+
+		if (value_count > RECORD_MAX_VALUES || encoding > COLUMNAR_VALUES_XOR || _get_varint(reader, &v) != 0 ||
+				v > (unsigned long long)(max_records - total))
+			return -1;
+
+		n = (int)v;
+		first = total;
+		ts = 0;
+		delta = 0;
+
+		for (i = 0; i < n; ++i) {
+			if (_get_varint(reader, &v) != 0)
+				return -1;
+
+			if (i == 0) {
+				ts = _unzigzag(v);
+			} else {
+				delta += _unzigzag(v);
+				ts += delta;
+			}
+
+			records[first + i].sensor_type = type;
+			records[first + i].value_count = value_count;
+			records[first + i].timestamp_ms = ts;
+		}
+
+		for (j = 0; j < value_count; ++j) {
+			q = 0;
+			bits = 0;
+
+			for (i = 0; i < n; ++i) {
+				if (_get_varint(reader, &v) != 0)
+					return -1;
+
+				if (encoding == COLUMNAR_VALUES_QUANTIZED) {
+					q += _unzigzag(v);
+					records[first + i].values[j] = (float)(q * (double)quantum);
+				} else {
+					bits ^= (unsigned int)v;
+					memcpy(&records[first + i].values[j], &bits, sizeof(bits));
+				}
+			}
+		}
+
+		total += n;
+	}
+
+	return total;
+}
+
+static size_t _put_varint(unsigned char *buf, unsigned long long v)
+{
+	size_t len = 0;
+
+	while (v >= 0x80) {
+		buf[len++] = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	buf[len++] = (unsigned char)v;
+
+	return len;
+}
+
+static unsigned long long _zigzag(long long v)
+{
+	return ((unsigned long long)v << 1) ^ (unsigned long long)(v >> 63);
+}
+
+static long long _unzigzag(unsigned long long v)
+{
+	return (long long)(v >> 1) ^ -(long long)(v & 1);
+}
+
+static int _get_varint(reader_t *reader, unsigned long long *v)
+{
+	int shift = 0;
+	unsigned char byte;
+
+	*v = 0;
+	do {
+		if (reader->pos >= reader->len || shift > 63)
+			return -1;
+		byte = reader->data[reader->pos++];
+		*v |= (unsigned long long)(byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	return 0;
+}
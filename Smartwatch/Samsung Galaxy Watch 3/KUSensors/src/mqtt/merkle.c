@@ -0,0 +1,554 @@
+/*
+ * merkle.c
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "merkle.h"
+#include "record.h"
+#include "columnar.h"
+
+#define MERKLE_LEAF_PREFIX	0x00
+#define MERKLE_NODE_PREFIX	0x01
+#define MERKLE_LEAF_SCRATCH	256		// larger records are hashed alone by merkle_leaf_hashes()
+
+typedef void (*record_cb)(const void *data, size_t len, void *user_data);
+
+static void _node_hash(const merkle_hash_t left, const merkle_hash_t right, merkle_hash_t node);
+static void _subtree_root(const merkle_hash_t *leaves, int count, merkle_hash_t root);
+static int _walk_batch(const unsigned char *payload, size_t len, record_cb cb, void *user_data, merkle_hash_t prev_root, merkle_hash_t root);
+static int _walk_json(const unsigned char *payload, size_t len, record_cb cb, void *user_data, merkle_hash_t prev_root, merkle_hash_t root);
+static int _walk_binary(const unsigned char *payload, size_t len, record_cb cb, void *user_data);
+static int _walk_columnar(const unsigned char *payload, size_t len, record_cb cb, void *user_data);
+static const unsigned char *_find(const unsigned char *from, const unsigned char *end, const char *needle);
+static bool _from_hex(const unsigned char *hex, const unsigned char *end, merkle_hash_t hash);
+static void _queue_leaf(const void *data, size_t len, void *user_data);
+
+/* records of a walk, hashed MERKLE_LEAF_BATCH at a time into the list or the tree */
+typedef struct leaf_queue {
+	merkle_hash_t *leaves;
+	int max;
+	merkle_t *tree;
+	int count;
+	const void *pending[MERKLE_LEAF_BATCH];
+	size_t pending_len[MERKLE_LEAF_BATCH];
+	int pending_count;
+} leaf_queue_t;
+
+static void _flush_leaves(leaf_queue_t *queue);
+
+/**
+ * @brief Starts an empty tree.
+ */
+void merkle_init(merkle_t *tree)
+{
+	memset(tree, 0, sizeof(*tree));
+}
+
+/**
+ * @brief Computes the hash of a leaf.
+ * @param data The record.
+ * @param len The size of the record.
+ * @param[out] leaf The leaf hash.
+ */
+void merkle_leaf_hash(const void *data, size_t len, merkle_hash_t leaf)
+{
+	SHA256_CTX ctx;
+	BYTE prefix = MERKLE_LEAF_PREFIX;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, &prefix, 1);
+	sha256_update(&ctx, data, len);
+	sha256_final(&ctx, leaf);
+}
+
+/**
+ * @brief Computes the hashes of several leaves together, side by side in the lanes of sha256_multi().
+ * @param data The records.
+ * @param len The sizes of the records.
+ * @param count Number of records.
+ * @param[out] leaves The leaf hashes, in the order of the records.
+ */
+void merkle_leaf_hashes(const void *const data[], const size_t len[], int count, merkle_hash_t *leaves)
+{
+	BYTE scratch[MERKLE_LEAF_BATCH][1 + MERKLE_LEAF_SCRATCH];
+	const BYTE *messages[MERKLE_LEAF_BATCH];
+	size_t sizes[MERKLE_LEAF_BATCH];
+	merkle_hash_t hashes[MERKLE_LEAF_BATCH];
+	int index[MERKLE_LEAF_BATCH];
+	int n;
+	int i;
+
+	while (count > 0) {
+		n = 0;
+		for (i = 0; i < count && n < MERKLE_LEAF_BATCH; ++i) {
+			if (len[i] > MERKLE_LEAF_SCRATCH) {
+				merkle_leaf_hash(data[i], len[i], leaves[i]);
+				continue;
+			}
+
+			scratch[n][0] = MERKLE_LEAF_PREFIX;
+			memcpy(&scratch[n][1], data[i], len[i]);
+			messages[n] = scratch[n];
+			sizes[n] = 1 + len[i];
+			index[n++] = i;
+		}
+
+		sha256_multi(messages, sizes, hashes, n);
+		while (n-- > 0)
+			memcpy(leaves[index[n]], hashes[n], MERKLE_HASH_SIZE);
+
+		data += i;
+		len += i;
+		leaves += i;
+		count -= i;
+	}
+}
+
+/**
+ * @brief Appends a record to the tree.
+ */
+void merkle_add(merkle_t *tree, const void *data, size_t len)
+{
+	merkle_hash_t leaf;
+
+	merkle_leaf_hash(data, len, leaf);
+	merkle_add_leaf(tree, leaf);
+}
+
+/**
+ * @brief Appends a leaf hash to the tree. The complete subtrees of equal size are merged
+ * as soon as they exist, every leaf costs one node hash on average.
+ */
+void merkle_add_leaf(merkle_t *tree, const merkle_hash_t leaf)
+{
+	merkle_hash_t node;
+	int level = 0;
+
+	memcpy(node, leaf, MERKLE_HASH_SIZE);
+
+	while (level < MERKLE_MAX_DEPTH - 1 && (tree->count & (1u << level))) {
+		_node_hash(tree->subtrees[level], node, node);
+		level++;
+	}
+
+	memcpy(tree->subtrees[level], node, MERKLE_HASH_SIZE);
+	tree->count++;
+}
+
+/**
+ * @brief Computes the root of the leaves added so far. The tree can still grow afterwards.
+ * @param tree The tree.
+ * @param[out] root The root, the hash of the empty string for an empty tree.
+ */
+void merkle_root(const merkle_t *tree, merkle_hash_t root)
+{
+	SHA256_CTX ctx;
+	bool found = false;
+	int level;
+
+	if (tree->count == 0) {
+		sha256_init(&ctx);
+		sha256_final(&ctx, root);
+		return;
+	}
+
+	/* the smaller subtrees are on the right */
+	for (level = 0; level < MERKLE_MAX_DEPTH; ++level) {
+		if (!(tree->count & (1u << level)))
+			continue;
+
+		if (found) {
+			_node_hash(tree->subtrees[level], root, root);
+		} else {
+			memcpy(root, tree->subtrees[level], MERKLE_HASH_SIZE);
+			found = true;
+		}
+	}
+}
+
+/**
+ * @brief Formats a hash in lowercase hex.
+ * @param hash The hash.
+ * @param[out] hex At least MERKLE_HASH_SIZE * 2 + 1 characters.
+ */
+void merkle_to_hex(const merkle_hash_t hash, char *hex)
+{
+	static const char digits[] = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < MERKLE_HASH_SIZE; ++i) {
+		hex[i * 2] = digits[hash[i] >> 4];
+		hex[i * 2 + 1] = digits[hash[i] & 0x0f];
+	}
+	hex[MERKLE_HASH_SIZE * 2] = '\0';
+}
+
+/**
+ * @brief Computes the audit path of a leaf, from the leaf up to the root.
+ * @param leaves The leaf hashes of the tree.
+ * @param count Number of leaves.
+ * @param index Index of the proven leaf.
+ * @param[out] path The sibling hashes.
+ * @param max_path The capacity of path, MERKLE_MAX_DEPTH is always enough.
+ * @return The length of the path or -1 on error.
+ */
+int merkle_proof(const merkle_hash_t *leaves, int count, int index, merkle_hash_t *path, int max_path)
+{
+	int len;
+	int k;
+
+	if (index < 0 || index >= count)
+		return -1;
+
+	if (count == 1)
+		return 0;
+
+	for (k = 1; k * 2 < count; k *= 2)
+		;
+
+	/* PATH(m, D[n]) = PATH(m, D[0:k]) : MTH(D[k:n]) or PATH(m - k, D[k:n]) : MTH(D[0:k]) */
+	if (index < k)
+		len = merkle_proof(leaves, k, index, path, max_path);
+	else
+		len = merkle_proof(leaves + k, count - k, index - k, path, max_path);
+
+	if (len < 0 || len >= max_path)
+		return -1;
+
+	if (index < k)
+		_subtree_root(leaves + k, count - k, path[len]);
+	else
+		_subtree_root(leaves, k, path[len]);
+
+	return len + 1;
+}
+
+/**
+ * @brief Checks that a leaf is part of a tree (RFC 9162, 2.1.3.2).
+ * @param leaf The leaf hash.
+ * @param index Index of the leaf.
+ * @param count Number of leaves of the tree.
+ * @param path The audit path of the leaf.
+ * @param path_len Length of the path.
+ * @param root The root of the tree.
+ * @return True if the path leads from the leaf to the root.
+ */
+bool merkle_verify_proof(const merkle_hash_t leaf, int index, int count, const merkle_hash_t *path, int path_len, const merkle_hash_t root)
+{
+	merkle_hash_t r;
+	unsigned int fn = index;
+	unsigned int sn = count - 1;
+	int i;
+
+	if (index < 0 || index >= count)
+		return false;
+
+	memcpy(r, leaf, MERKLE_HASH_SIZE);
+
+	for (i = 0; i < path_len; ++i) {
+		if (sn == 0)
+			return false;
+
+		if ((fn & 1) || fn == sn) {
+			_node_hash(path[i], r, r);
+			while (!(fn & 1) && fn != 0) {
+				fn >>= 1;
+				sn >>= 1;
+			}
+		} else {
+			_node_hash(r, path[i], r);
+		}
+
+		fn >>= 1;
+		sn >>= 1;
+	}
+
+	return sn == 0 && memcmp(r, root, MERKLE_HASH_SIZE) == 0;
+}
+
+/**
+ * @brief Extracts the leaves and the commitment of a published batch, in any format.
+ * @param payload The batch.
+ * @param len The size of the batch.
+ * @param[out] leaves The leaf hashes, may be NULL.
+ * @param max_leaves The capacity of leaves.
+ * @param[out] prev_root The root of the previous batch stored in the batch.
+ * @param[out] root The root stored in the batch.
+ * @return The number of records or -1 if the batch is malformed, not committed or too large.
+ */
+int merkle_batch_leaves(const void *payload, size_t len, merkle_hash_t *leaves, int max_leaves, merkle_hash_t prev_root, merkle_hash_t root)
+{
+	leaf_queue_t queue = { .leaves = leaves, .max = max_leaves };
+	int count;
+
+	count = _walk_batch(payload, len, leaves ? _queue_leaf : NULL, &queue, prev_root, root);
+	_flush_leaves(&queue);
+	if (count < 0 || (leaves && queue.count > max_leaves))
+		return -1;
+
+	return count;
+}
+
+/**
+ * @brief Verifies a published batch: recomputes the root of its records and compares it, and the
+ * root of the previous batch, with the commitment the batch carries.
+ * @param payload The batch.
+ * @param len The size of the batch.
+ * @param expected_prev_root Root of the previous batch of the device, NULL to skip the chain check.
+ * @param[out] root The verified root, to check the next batch with. May be NULL.
+ * @return The number of records or -1 if the batch does not match its commitment.
+ */
+int merkle_verify_batch(const void *payload, size_t len, const merkle_hash_t expected_prev_root, merkle_hash_t root)
+{
+	merkle_hash_t prev_root;
+	merkle_hash_t stored_root;
+	merkle_hash_t computed_root;
+	merkle_t tree;
+	leaf_queue_t queue = { .tree = &tree };
+	int count;
+
+	merkle_init(&tree);
+	count = _walk_batch(payload, len, _queue_leaf, &queue, prev_root, stored_root);
+	_flush_leaves(&queue);
+	if (count < 0 || (unsigned int)count != tree.count)
+		return -1;
+
+	merkle_root(&tree, computed_root);
+	if (memcmp(computed_root, stored_root, MERKLE_HASH_SIZE) != 0)
+		return -1;
+
+	if (expected_prev_root && memcmp(prev_root, expected_prev_root, MERKLE_HASH_SIZE) != 0)
+		return -1;
+
+	if (root)
+		memcpy(root, computed_root, MERKLE_HASH_SIZE);
+
+	return count;
+}
+
+static void _node_hash(const merkle_hash_t left, const merkle_hash_t right, merkle_hash_t node)
+{
+	SHA256_CTX ctx;
+	BYTE prefix = MERKLE_NODE_PREFIX;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, &prefix, 1);
+	sha256_update(&ctx, left, MERKLE_HASH_SIZE);
+	sha256_update(&ctx, right, MERKLE_HASH_SIZE);
+	sha256_final(&ctx, node);
+}
+
+static void _subtree_root(const merkle_hash_t *leaves, int count, merkle_hash_t root)
+{
+	merkle_t tree;
+	int i;
+
+	merkle_init(&tree);
+	for (i = 0; i < count; ++i)
+		merkle_add_leaf(&tree, leaves[i]);
+	merkle_root(&tree, root);
+}
+
+/**
+ * @brief Hands every record of a batch to the callback, in order, and reads its commitment.
+ * @return The number of records or -1 on error.
+ */
+static int _walk_batch(const unsigned char *payload, size_t len, record_cb cb, void *user_data, merkle_hash_t prev_root, merkle_hash_t root)
+{
+	const unsigned char *commitment;
+
+	if (len >= 1 && payload[0] == '{')
+		return _walk_json(payload, len, cb, user_data, prev_root, root);
+
+	if (len < RECORD_COMMITMENT_SIZE + 4)
+		return -1;
+
+	/* the binary formats end with the previous root and the root */
+	commitment = payload + len - RECORD_COMMITMENT_SIZE;
+	memcpy(prev_root, commitment, MERKLE_HASH_SIZE);
+	memcpy(root, commitment + MERKLE_HASH_SIZE, MERKLE_HASH_SIZE);
+
+	if (payload[0] == 'K' && payload[1] == 'S' && (payload[3] & RECORD_FLAG_COMMITTED))
+		return _walk_binary(payload, len, cb, user_data);
+
+	if (payload[0] == 'K' && payload[1] == 'C' && (payload[3] & COLUMNAR_FLAG_COMMITTED))
+		return _walk_columnar(payload, len, cb, user_data);
+
+	return -1;
+}
+
+static int _walk_json(const unsigned char *payload, size_t len, record_cb cb, void *user_data, merkle_hash_t prev_root, merkle_hash_t root)
+{
+	const unsigned char *end = payload + len;
+	const unsigned char *cursor;
+	const unsigned char *start;
+	int depth;
+	int count = 0;
+
+	cursor = _find(payload, end, "\"prev_root\":\"");
+	if (!cursor || !_from_hex(cursor, end, prev_root))
+		return -1;
+
+	cursor = _find(cursor, end, "\"records\":[");
+	if (!cursor)
+		return -1;
+
+	/* the record objects have no string holding a brace, counting them is enough */
+	while (cursor < end && *cursor != ']') {
+		if (*cursor == ',') {
+			cursor++;
+			continue;
+		}
+		if (*cursor != '{')
+			return -1;
+
+		start = cursor;
+		depth = 0;
+		do {
+			if (*cursor == '{')
+				depth++;
+			else if (*cursor == '}')
+				depth--;
+			cursor++;
+		} while (depth > 0 && cursor < end);
+
+		if (depth != 0)
+			return -1;
+
+		if (cb)
+			cb(start, cursor - start, user_data);
+		count++;
+	}
+
+	cursor = _find(cursor, end, "\"root\":\"");
+	if (!cursor || !_from_hex(cursor, end, root))
+		return -1;
+
+	return count;
+}
+
+static int _walk_binary(const unsigned char *payload, size_t len, record_cb cb, void *user_data)
+{
+	record_reader_t reader;
+	record_t record;
+	size_t start;
+	int ret;
+
+	if (record_reader_init(&reader, payload, len) != 0)
+		return -1;
+
+	for (;;) {
+		start = reader.pos;
+		ret = record_reader_next(&reader, &record);
+		if (ret < 0)
+			return -1;
+		if (ret == 0)
+			break;
+		if (cb)
+			cb(payload + start, reader.pos - start, user_data);
+	}
+
+	return reader.read;
+}
+
+static int _walk_columnar(const unsigned char *payload, size_t len, record_cb cb, void *user_data)
+{
+	unsigned char (*buf)[RECORD_MAX_BINARY_SIZE];
+	record_t *records;
+	size_t size;
+	int count = payload[8] | (payload[9] << 8);
+	int i;
+
+	/* the callback may keep the encoded records until the end of the walk */
+	records = malloc((count > 0 ? count : 1) * sizeof(record_t));
+	buf = malloc((count > 0 ? count : 1) * sizeof(*buf));
+	if (!records || !buf) {
+		free(records);
+		free(buf);
+		return -1;
+	}
+
+	count = columnar_decode(payload, len, NULL, records, count);
+	for (i = 0; cb && i < count; ++i) {
+		size = record_write_binary(&records[i], 0, buf[i], sizeof(buf[i]));
+		cb(buf[i], size, user_data);
+	}
+
+	free(records);
+	free(buf);
+
+	return count;
+}
+
+/**
+ * @brief Finds a string in the payload.
+ * @return The first byte after it or NULL.
+ */
+static const unsigned char *_find(const unsigned char *from, const unsigned char *end, const char *needle)
+{
+	size_t len = strlen(needle);
+
+	for (; from + len <= end; ++from) {
+		if (memcmp(from, needle, len) == 0)
+			return from + len;
+	}
+
+	return NULL;
+}
+
+static bool _from_hex(const unsigned char *hex, const unsigned char *end, merkle_hash_t hash)
+{
+	int nibble;
+	int i;
+
+	if (end - hex < MERKLE_HASH_SIZE * 2)
+		return false;
+
+	for (i = 0; i < MERKLE_HASH_SIZE * 2; ++i) {
+		if (hex[i] >= '0' && hex[i] <= '9')
+			nibble = hex[i] - '0';
+		else if (hex[i] >= 'a' && hex[i] <= 'f')
+			nibble = hex[i] - 'a' + 10;
+		else if (hex[i] >= 'A' && hex[i] <= 'F')
+			nibble = hex[i] - 'A' + 10;
+		else
+			return false;
+
+		if (i & 1)
+			hash[i / 2] |= nibble;
+		else
+			hash[i / 2] = nibble << 4;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Queues a record of the walk. The record must stay in place until the queue is flushed.
+ */
+static void _queue_leaf(const void *data, size_t len, void *user_data)
+{
+	leaf_queue_t *queue = user_data;
+
+	queue->pending[queue->pending_count] = data;
+	queue->pending_len[queue->pending_count] = len;
+	if (++queue->pending_count == MERKLE_LEAF_BATCH)
+		_flush_leaves(queue);
+}
+
+static void _flush_leaves(leaf_queue_t *queue)
+{
+	merkle_hash_t leaves[MERKLE_LEAF_BATCH];
+	int i;
+
+	merkle_leaf_hashes(queue->pending, queue->pending_len, queue->pending_count, leaves);
+
+	for (i = 0; i < queue->pending_count; ++i, ++queue->count) {
+		if (queue->tree)
+			merkle_add_leaf(queue->tree, leaves[i]);
+		else if (queue->count < queue->max)
+			memcpy(queue->leaves[queue->count], leaves[i], MERKLE_HASH_SIZE);
+	}
+	queue->pending_count = 0;
+}
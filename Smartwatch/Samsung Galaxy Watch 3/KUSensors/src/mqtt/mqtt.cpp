@@ -5,109 +5,617 @@
  *      Author: battl
  */
 
+#include <Ecore.h>
 #include <sensors.h>
 //#include <stdlib.h>
 #include "mqtt.h"
 #include "thpool.h"
 #include <system_info.h>
+#include <app_preference.h>
 #include <stdio.h>
 #include <string.h>
 #include <memory.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
 
 #include "restclient/restclient.h"
+#include "restclient/connection.h"
 #include "json/json.h"
 #include "sha256.h"
+#include "spool.h"
 
-#define THREAD_NUM	4
+/*
+ * A single sender keeps the payloads in the order they were produced, the
+ * in-flight window of MQTTAsync provides the parallelism.
+ */
+#define THREAD_NUM	1
+#define RECONNECT_INTERVAL	30		// longest wait between two connection attempts, in seconds
+#define SPOOL_DRAIN_BATCH	32		// spooled payloads sent per drain job
+#define DISCOVERY_TIMEOUT	5		// seconds of a REST request
+#if !defined(DISCOVERY_ATTEMPTS)
+#define DISCOVERY_ATTEMPTS	3		// REST requests before the cached broker is used, 0 to skip the discovery
+#endif
+#define BACKOFF_MIN			1		// seconds before the second attempt, doubled after every failure
+#define DEVICE_ID_KEY		"mqtt_device_id"	// preference keeping the hash of the Tizen ID
+
+/* A payload in flight, released by the completion callbacks */
+typedef struct publish_ctx {
+	void * payload;
+	int len;
+	batch_t * batch;	/* owner of the payload, NULL for a plain message */
+	const char * topic;
+	long long enqueueUs;	/* 0 for the payloads drained from the spool */
+	long long sendUs;
+} publish_ctx_t;
 
-MQTTClient client;
-MQTTClient_deliveryToken token;
+MQTTAsync client;
+MQTTAsync_connectOptions connOpts = MQTTAsync_connectOptions_initializer;
 threadpool thpool;
 char deviceID[SHA256_BLOCK_SIZE * 2 + 1];
+char diagTopic[sizeof(deviceID) + 5];
 
+/* Updated with atomic operations only, the publishing path never takes a lock for them */
+static mqtt_stats_t stats;
+static Ecore_Timer * diagTimer = NULL;
+static sem_t window;
+static pthread_mutex_t connLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t connCond = PTHREAD_COND_INITIALIZER;
+static pthread_t bringupThread;
+static bool bringupStarted = false;
+static bool stopRequested = false;	/* under connLock, ends the bring-up thread */
+static int connectResult = 0;		/* under connLock, 1 once connected and -1 on failure */
+static std::string cachedBroker;
+static volatile int clientCreated = 0;
+static volatile int everConnected = 0;
+static volatile int draining = 0;
+static volatile int firstAck = 0;
+static long long initUs = 0;
+
+static void _mqttOnConnected(void * context, char * cause);
+static void _mqttOnConnectFailure(void * context, MQTTAsync_failureData * response);
+static Eina_Bool _mqttDiagTimerCb(void * data);
+static void _mqttScheduleDrain();
+static void _mqttDrainSpool(void * arg);
+static long long _mqttNowUs();
+static void _mqttLoadDeviceID();
+static void * _mqttBringup(void * arg);
+
+/*
+ * Returns without touching the network: the deviceID and the broker come from the
+ * previous launch, the discovery and the connection run in the background and the
+ * payloads are spooled until the broker is reached.
+ */
 int mqttInit() {
-	Json::Reader reader;
-	Json::Value resJson;
-	std::string clientID = (CLIENTID + std::to_string(time(NULL)));
+	char * broker = NULL;
+	int rc;
 
-	// 1. Get MQTT connection information(broker address, port, etc.) through REST API
-	RestClient::Response r = RestClient::get(REST_API_ADDR);
-	std::string res = r.body;
-	dlog_print(DLOG_INFO, LOG_TAG, "r.body, %s", r.body.c_str());
+	initUs = _mqttNowUs();
 
-	if (r.code != 200) {
-		dlog_print(DLOG_ERROR, LOG_TAG, "Can't connect to REST API Server, %d", r.code);
-		// TODO Alert to users through a Tizen Pop-up message
-	}
-	else {
-		// 2. Parse the HTTP Response & Connect to MQTT Broker
-		reader.parse(res, resJson);
-	}
+	// 1. DeviceID and last known broker
+	_mqttLoadDeviceID();
+	snprintf(diagTopic, sizeof(diagTopic), "%s/diag", deviceID);
 
-	MQTTClient_connectOptions conn_opts = MQTTClient_connectOptions_initializer;
-	int rc;
-	dlog_print(DLOG_INFO, LOG_TAG, "MQTT_ADDRESS: %s, CID: %s", r.code == 200 ? resJson["uri_with_port"].asCString() : MQTT_ADDRESS, clientID.c_str());
-	if ((rc = MQTTClient_create(&client, (r.code == 200 ? resJson["uri_with_port"].asCString() : MQTT_ADDRESS),
-			clientID.c_str(), MQTTCLIENT_PERSISTENCE_NONE, NULL)) != MQTTCLIENT_SUCCESS) {
-		dlog_print(DLOG_ERROR, LOG_TAG, "Can't create MQTTClient object, %d", rc);
-		// TODO Alert to users through a Tizen Pop-up message
-	}
+	if (preference_get_string(MQTT_BROKER_KEY, &broker) == PREFERENCE_ERROR_NONE && broker)
+		cachedBroker = broker;
+	free(broker);
 
-	conn_opts.keepAliveInterval = 3600;
-	conn_opts.cleansession = 1;
+	thpool = thpool_init(THREAD_NUM);
 
-	if ((rc = MQTTClient_connect(client, &conn_opts)) != MQTTCLIENT_SUCCESS) {
-		dlog_print(DLOG_ERROR, LOG_TAG, "Client is not connected with MQTT Broker, %d", rc);
-		// TODO Alert to users through a Tizen Pop-up message
-		//exit(-1);
-	}
-	else {
-		dlog_print(DLOG_INFO, LOG_TAG, "MQTT Connected");
-	}
+	// 2. Open the store-and-forward spool, payloads left by the previous run are sent once connected
+	char * dataPath = app_get_data_path();
+	std::string spoolDir = std::string(dataPath ? dataPath : "") + "spool";
+	free(dataPath);
+	if (!spool_open(spoolDir.c_str(), SPOOL_SEGMENT_SIZE, SPOOL_MAX_SEGMENTS, SPOOL_RETENTION_S))
+		dlog_print(DLOG_ERROR, LOG_TAG, "Can't open the spool %s, unsent payloads will be lost", spoolDir.c_str());
+
+	sem_init(&window, 0, PUBLISH_WINDOW);
+
+	connOpts.keepAliveInterval = 3600;
+	connOpts.cleansession = 1;
+	connOpts.maxInflight = PUBLISH_WINDOW;
+	connOpts.automaticReconnect = 1;
+	connOpts.minRetryInterval = 1;
+	connOpts.maxRetryInterval = RECONNECT_INTERVAL;
+	connOpts.onFailure = _mqttOnConnectFailure;
+
+	// 3. Discover the broker and connect to it in the background
+	if ((rc = pthread_create(&bringupThread, NULL, _mqttBringup, NULL)) != 0)
+		dlog_print(DLOG_ERROR, LOG_TAG, "Can't start the MQTT bring-up thread, %d", rc);
+	else
+		bringupStarted = true;
+
+	diagTimer = ecore_timer_add(DIAG_INTERVAL, _mqttDiagTimerCb, NULL);
+
+	dlog_print(DLOG_INFO, LOG_TAG, "mqttInit returned in %lld us", _mqttNowUs() - initUs);
 
-	// 3. Make DeviceID & ThreadPool
-	char * tizenId;
+	return rc == 0 ? MQTTASYNC_SUCCESS : MQTTASYNC_FAILURE;
+}
+
+static long long _mqttNowUs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Takes the deviceID of the previous launch, the Tizen ID is only hashed on the first one */
+static void _mqttLoadDeviceID() {
+	char * cached = NULL;
+	char * tizenId = NULL;
 	int ret;
+
+	if (preference_get_string(DEVICE_ID_KEY, &cached) == PREFERENCE_ERROR_NONE && cached
+			&& strlen(cached) == SHA256_BLOCK_SIZE * 2) {
+		memcpy(deviceID, cached, sizeof(deviceID));
+		free(cached);
+		dlog_print(DLOG_INFO, LOG_TAG, "deviceID: %s (cached)", deviceID);
+		return;
+	}
+	free(cached);
+
 	ret = system_info_get_platform_string("http://tizen.org/system/tizenid", &tizenId);
-	if (ret != SYSTEM_INFO_ERROR_NONE) {
-		/* Error handling */
+	if (ret != SYSTEM_INFO_ERROR_NONE || tizenId == NULL) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "Can't get the Tizen ID, %d", ret);
 		// TODO Alert to users through a Tizen Pop-up message
 	}
 
 	SHA256_CTX ctx;
 	BYTE buf[SHA256_BLOCK_SIZE];
 	sha256_init(&ctx);
-	sha256_update(&ctx, (BYTE *) tizenId, strlen(tizenId));
+	if (tizenId)
+		sha256_update(&ctx, (BYTE *) tizenId, strlen(tizenId));
 	sha256_final(&ctx, buf);
 
-    for(int i = 0; i < SHA256_BLOCK_SIZE; i++)
-    {
-        sprintf(deviceID + (i * 2), "%02x", buf[i]);
-    }
-    deviceID[SHA256_BLOCK_SIZE * 2] = 0;
+	for (int i = 0; i < SHA256_BLOCK_SIZE; i++)
+		sprintf(deviceID + (i * 2), "%02x", buf[i]);
+	deviceID[SHA256_BLOCK_SIZE * 2] = 0;
 
 	dlog_print(DLOG_INFO, LOG_TAG, "deviceID: %s", deviceID);
 
-	thpool = thpool_init(THREAD_NUM);
+	/* A failed lookup is not cached, the next launch tries again */
+	if (tizenId && (ret = preference_set_string(DEVICE_ID_KEY, deviceID)) != PREFERENCE_ERROR_NONE)
+		dlog_print(DLOG_ERROR, LOG_TAG, "preference_set_string() error: %d", ret);
 	free(tizenId); /* Release after use */
-	return rc;
 }
 
-void _mqttPublish(void * msg) {
-	const char * topicName = deviceID;
+/* Takes "uri_with_port" out of the REST API response and stops reading there */
+class BrokerUriHandler : public Json::SaxHandler {
+public:
+	std::string uri;
+
+	bool startObject() { depth++; wanted = false; return true; }
+	bool endObject() { depth--; return true; }
+	bool startArray() { wanted = false; return true; }
+	bool key(const Json::String & name) { wanted = depth == 1 && name == "uri_with_port"; return true; }
+	bool scalar(const Json::Value & value) {
+		if (wanted && value.isString()) {
+			uri = value.asString();
+			return false;
+		}
+		wanted = false;
+		return true;
+	}
+
+private:
+	int depth = 0;
+	bool wanted = false;
+};
+
+/* Gets the MQTT connection information(broker address, port, etc.) through REST API and caches it */
+static bool _mqttDiscover(std::string & uri) {
+	BrokerUriHandler handler;
+	Json::SaxReader reader(handler);
+	RestClient::Connection conn("");
+	int ret;
+
+	conn.SetTimeout(DISCOVERY_TIMEOUT);
+	RestClient::Response r = conn.get(REST_API_ADDR);
+	dlog_print(DLOG_INFO, LOG_TAG, "r.body, %s", r.body.c_str());
+
+	if (r.code != 200) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "Can't connect to REST API Server, %d", r.code);
+		return false;
+	}
+
+	if (!reader.parse(r.body.data(), r.body.data() + r.body.size()) || handler.uri.empty()) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "Can't parse the REST API response");
+		return false;
+	}
+
+	uri = handler.uri;
+	if (uri != cachedBroker && (ret = preference_set_string(MQTT_BROKER_KEY, uri.c_str())) != PREFERENCE_ERROR_NONE)
+		dlog_print(DLOG_ERROR, LOG_TAG, "preference_set_string() error: %d", ret);
+
+	return true;
+}
+
+/* Waits before the next attempt, doubling the delay up to RECONNECT_INTERVAL. Returns false once mqttExit() was called. */
+static bool _mqttBackoff(int * delay) {
+	struct timespec deadline;
+	bool stop;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += *delay;
+	*delay = *delay * 2 < RECONNECT_INTERVAL ? *delay * 2 : RECONNECT_INTERVAL;
+
+	pthread_mutex_lock(&connLock);
+	while (!stopRequested && pthread_cond_timedwait(&connCond, &connLock, &deadline) == 0)
+		;
+	stop = stopRequested;
+	pthread_mutex_unlock(&connLock);
+
+	return !stop;
+}
+
+/* Starts a connection and waits for its outcome, the client reconnects by itself once it succeeded */
+static bool _mqttConnect() {
+	bool connected;
 	int rc;
-	MQTTClient_message pubMsg = MQTTClient_message_initializer;
-	pubMsg.payload = msg;
-	pubMsg.payloadlen = strlen((char *)msg);
-	pubMsg.qos = QOS;
-	pubMsg.retained = 0;
 
-	MQTTClient_publishMessage(client, topicName, &pubMsg, &token);
-	rc = MQTTClient_waitForCompletion(client, token, TIMEOUT);
+	pthread_mutex_lock(&connLock);
+	connectResult = 0;
+	if ((rc = MQTTAsync_connect(client, &connOpts)) != MQTTASYNC_SUCCESS) {
+		pthread_mutex_unlock(&connLock);
+		dlog_print(DLOG_ERROR, LOG_TAG, "Can't start connecting to MQTT Broker, %d", rc);
+		return false;
+	}
+
+	while (!stopRequested && connectResult == 0)
+		pthread_cond_wait(&connCond, &connLock);
+	connected = connectResult > 0;
+	pthread_mutex_unlock(&connLock);
+
+	return connected;
 }
 
+/*
+ * Bring-up of the connection: discovery with retries, then the cached broker,
+ * then MQTT_ADDRESS; connection attempts with an exponential backoff.
+ */
+static void * _mqttBringup(void * arg) {
+	std::string uri;
+	std::string clientID = (CLIENTID + std::to_string(time(NULL)));
+	int delay = BACKOFF_MIN;
+	int rc;
+
+	// 1. Discover the broker, or fall back to the last known one
+	for (int attempt = 1; attempt <= DISCOVERY_ATTEMPTS && !_mqttDiscover(uri); attempt++) {
+		if (attempt < DISCOVERY_ATTEMPTS && !_mqttBackoff(&delay))
+			return NULL;
+	}
+	if (uri.empty())
+		uri = cachedBroker.empty() ? MQTT_ADDRESS : cachedBroker;
+
+	// 2. Create the client, the publishing path uses it from now on
+	dlog_print(DLOG_INFO, LOG_TAG, "MQTT_ADDRESS: %s, CID: %s", uri.c_str(), clientID.c_str());
+	if ((rc = MQTTAsync_create(&client, uri.c_str(), clientID.c_str(), MQTTCLIENT_PERSISTENCE_NONE, NULL)) != MQTTASYNC_SUCCESS) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "Can't create MQTTAsync object, %d", rc);
+		// TODO Alert to users through a Tizen Pop-up message
+		return NULL;
+	}
+	MQTTAsync_setConnected(client, NULL, _mqttOnConnected);
+	__sync_lock_test_and_set(&clientCreated, 1);
+
+	// 3. Connect to MQTT Broker
+	delay = BACKOFF_MIN;
+	while (!_mqttConnect()) {
+		if (!_mqttBackoff(&delay))
+			return NULL;
+	}
+
+	dlog_print(DLOG_INFO, LOG_TAG, "MQTT bring-up done in %lld ms", (_mqttNowUs() - initUs) / 1000);
+
+	return NULL;
+}
+
+static bool _mqttIsConnected() {
+	return __sync_fetch_and_add(&clientCreated, 0) && MQTTAsync_isConnected(client);
+}
+
+/* True once the bring-up reached the broker, and while the client stays connected */
+bool mqttIsConnected() {
+	return _mqttIsConnected();
+}
+
+/* Adds to a gauge and keeps its high-water mark */
+static void _mqttGaugeAdd(int * gauge, int * max, int delta) {
+	int value = __sync_add_and_fetch(gauge, delta);
+	int seen = *max;
+	while (value > seen && !__sync_bool_compare_and_swap(max, seen, value))
+		seen = *max;
+}
+
+static void _mqttOnConnected(void * context, char * cause) {
+	dlog_print(DLOG_INFO, LOG_TAG, "MQTT Connected");
+	if (everConnected)
+		__sync_fetch_and_add(&stats.reconnects, 1);
+	everConnected = 1;
+
+	pthread_mutex_lock(&connLock);
+	connectResult = 1;
+	pthread_cond_broadcast(&connCond);
+	pthread_mutex_unlock(&connLock);
+
+	// MQTTAsync holds its mutex while calling this, MQTTAsync_isConnected() would deadlock
+	_mqttScheduleDrain();
+}
+
+static void _mqttOnConnectFailure(void * context, MQTTAsync_failureData * response) {
+	dlog_print(DLOG_ERROR, LOG_TAG, "Client is not connected with MQTT Broker, %d", response ? response->code : MQTTASYNC_FAILURE);
+
+	pthread_mutex_lock(&connLock);
+	connectResult = -1;
+	pthread_cond_broadcast(&connCond);
+	pthread_mutex_unlock(&connLock);
+}
+
+static publish_ctx_t * _mqttCtxCreate(void * payload, int len, batch_t * batch, const char * topic) {
+	publish_ctx_t * ctx = (publish_ctx_t *)malloc(sizeof(publish_ctx_t));
+	if (ctx == NULL)
+		return NULL;
+	ctx->payload = payload;
+	ctx->len = len;
+	ctx->batch = batch;
+	ctx->topic = topic;
+	ctx->enqueueUs = 0;
+	ctx->sendUs = 0;
+	return ctx;
+}
+
+/* Only the sensor data is kept for later, diagnostics are stale by then */
+static void _mqttSpool(publish_ctx_t * ctx) {
+	if (ctx->topic != deviceID)
+		return;
+
+	if (spool_append(ctx->payload, ctx->len))
+		__sync_fetch_and_add(&stats.spooled, 1);
+	else
+		dlog_print(DLOG_ERROR, LOG_TAG, "Can't spool %d bytes, the payload is lost", ctx->len);
+}
+
+static void _mqttCtxDestroy(publish_ctx_t * ctx) {
+	if (ctx->batch)
+		batch_destroy(ctx->batch);
+	else
+		free(ctx->payload);
+	free(ctx);
+}
+
+static void _mqttOnSent(void * context, MQTTAsync_successData * response) {
+	publish_ctx_t * ctx = (publish_ctx_t *)context;
+	long long nowUs = _mqttNowUs();
+
+	__sync_fetch_and_add(&stats.acked, 1);
+	__sync_sub_and_fetch(&stats.inflight, 1);
+	histogram_record(&stats.ack_latency, nowUs - ctx->sendUs);
+	if (ctx->enqueueUs)
+		histogram_record(&stats.total_latency, nowUs - ctx->enqueueUs);
+	if (ctx->batch && nowUs / 1000 > ctx->batch->created_ms)
+		histogram_record(&stats.batch_latency, nowUs - ctx->batch->created_ms * 1000);
+	if (__sync_bool_compare_and_swap(&firstAck, 0, 1))
+		dlog_print(DLOG_INFO, LOG_TAG, "First payload acknowledged %lld ms after mqttInit", (nowUs - initUs) / 1000);
+
+	_mqttCtxDestroy(ctx);
+	sem_post(&window);
+}
+
+/*
+ * The broker did not acknowledge the payload, it is spooled and sent again after the reconnection.
+ * The payloads sent after it are already on their way, so it reaches the broker after them.
+ */
+static void _mqttOnSendFailure(void * context, MQTTAsync_failureData * response) {
+	publish_ctx_t * ctx = (publish_ctx_t *)context;
+
+	dlog_print(DLOG_ERROR, LOG_TAG, "Failed to publish %d bytes, %d", ctx->len, response ? response->code : MQTTASYNC_FAILURE);
+	__sync_fetch_and_add(&stats.failed, 1);
+	__sync_sub_and_fetch(&stats.inflight, 1);
+	_mqttSpool(ctx);
+
+	_mqttCtxDestroy(ctx);
+	sem_post(&window);
+}
+
+/*
+ * Hands a payload to MQTTAsync once a slot of the in-flight window is free.
+ * The context belongs to the completion callbacks on success, it is released here on error.
+ */
+static int _mqttSubmit(publish_ctx_t * ctx, bool spoolOnError) {
+	MQTTAsync_message pubMsg = MQTTAsync_message_initializer;
+	MQTTAsync_responseOptions opts = MQTTAsync_responseOptions_initializer;
+	struct timespec deadline;
+	int rc;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += TIMEOUT / 1000;
+
+	if (sem_timedwait(&window, &deadline) != 0) {
+		rc = MQTTASYNC_MAX_MESSAGES_INFLIGHT;
+	} else {
+		pubMsg.payload = ctx->payload;
+		pubMsg.payloadlen = ctx->len;
+		pubMsg.qos = QOS;
+		pubMsg.retained = 0;
+		opts.onSuccess = _mqttOnSent;
+		opts.onFailure = _mqttOnSendFailure;
+		opts.context = ctx;
+
+		// The callbacks may run before MQTTAsync_sendMessage() returns
+		ctx->sendUs = _mqttNowUs();
+		_mqttGaugeAdd(&stats.inflight, &stats.inflight_max, 1);
+		if ((rc = MQTTAsync_sendMessage(client, ctx->topic, &pubMsg, &opts)) != MQTTASYNC_SUCCESS) {
+			__sync_sub_and_fetch(&stats.inflight, 1);
+			sem_post(&window);
+		}
+	}
+
+	if (rc != MQTTASYNC_SUCCESS) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "Failed to publish %d bytes, %d", ctx->len, rc);
+		__sync_fetch_and_add(&stats.failed, 1);
+		if (spoolOnError)
+			_mqttSpool(ctx);
+		_mqttCtxDestroy(ctx);
+	} else {
+		__sync_fetch_and_add(&stats.sent, 1);
+		if (ctx->enqueueUs)
+			histogram_record(&stats.queue_latency, ctx->sendUs - ctx->enqueueUs);
+	}
+
+	return rc;
+}
+
+/*
+ * Publishes a payload, or keeps it in the spool until the broker is reachable again.
+ * Nothing overtakes the spooled payloads, so a sensor stream only gets out of order
+ * when a payload fails in flight, see _mqttOnSendFailure(). The records keep their
+ * timestamps for the receiver to sort them.
+ */
+static void _mqttPublishPayload(publish_ctx_t * ctx) {
+	if (_mqttIsConnected() && (ctx->topic != deviceID || spool_is_empty())) {
+		_mqttSubmit(ctx, true);
+		return;
+	}
+
+	_mqttSpool(ctx);
+	_mqttCtxDestroy(ctx);
+
+	if (_mqttIsConnected())
+		_mqttScheduleDrain();
+}
+
+/* Caller MUST know the client is connected, a drain job stops at the first failed submit anyway */
+static void _mqttScheduleDrain() {
+	if (spool_is_empty() || !__sync_bool_compare_and_swap(&draining, 0, 1))
+		return;
+
+	if (thpool_add_work_shared(thpool, _mqttDrainSpool, NULL) != 0)
+		draining = 0;
+}
+
+/*
+ * Sends the oldest spooled payloads. A job sends at most SPOOL_DRAIN_BATCH payloads
+ * and queues the next one behind the live traffic, only one job runs at a time.
+ * The drain jobs go through the shared queue: from the deque of a work-stealing
+ * pool thread they would run ahead of the live payloads queued meanwhile.
+ * An entry leaves the spool once MQTTAsync accepted it, a later failure spools it again.
+ */
+static void _mqttDrainSpool(void * arg) {
+	publish_ctx_t * ctx;
+	spool_pos_t pos;
+	void * payload;
+	size_t len;
+	int sent = 0;
+	int ret = 0;
+
+	while (sent < SPOOL_DRAIN_BATCH && (ret = spool_peek(&payload, &len, &pos)) == 1) {
+		if ((ctx = _mqttCtxCreate(payload, len, NULL, deviceID)) == NULL) {
+			free(payload);
+			break;
+		}
+		if (_mqttSubmit(ctx, false) != MQTTASYNC_SUCCESS)
+			break;
+		spool_consume(&pos);
+		sent++;
+	}
+
+	if (sent == SPOOL_DRAIN_BATCH && ret == 1 && thpool_add_work_shared(thpool, _mqttDrainSpool, NULL) == 0)
+		return;
+
+	draining = 0;
+}
+
+void _mqttPublishJob(void * arg) {
+	publish_ctx_t * ctx = (publish_ctx_t *)arg;
+	__sync_sub_and_fetch(&stats.queue_depth, 1);
+	_mqttPublishPayload(ctx);
+}
+
+/* Hands a context to the sender thread, the context is released on error */
+static bool _mqttEnqueue(publish_ctx_t * ctx) {
+	ctx->enqueueUs = _mqttNowUs();
+	__sync_fetch_and_add(&stats.enqueued, 1);
+	_mqttGaugeAdd(&stats.queue_depth, &stats.queue_depth_max, 1);
+
+	if (thpool_add_work(thpool, _mqttPublishJob, ctx) != 0) {
+		__sync_sub_and_fetch(&stats.queue_depth, 1);
+		__sync_fetch_and_add(&stats.failed, 1);
+		_mqttCtxDestroy(ctx);
+		return false;
+	}
+	return true;
+}
+
+/* The message is copied, so callers may pass stack buffers */
 void mqttPublish(void * msg) {
-	thpool_add_work(thpool, _mqttPublish, msg);
+	char * copy = strdup((char *)msg);
+	publish_ctx_t * ctx = copy ? _mqttCtxCreate(copy, strlen(copy), NULL, deviceID) : NULL;
+	if (ctx == NULL)
+		free(copy);
+	if (ctx == NULL || !_mqttEnqueue(ctx))
+		dlog_print(DLOG_ERROR, LOG_TAG, "Can't queue a message for publishing");
+}
+
+/* Takes the ownership of the batch, it is released once published */
+void mqttPublishBatch(batch_t * batch) {
+	int id = batch->id;
+	publish_ctx_t * ctx = _mqttCtxCreate(batch->data, batch->len, batch, deviceID);
+	if (ctx == NULL)
+		batch_destroy(batch);
+	if (ctx == NULL || !_mqttEnqueue(ctx))
+		dlog_print(DLOG_ERROR, LOG_TAG, "Can't queue batch %d for publishing", id);
+}
+
+/* Copies the PUBACK latency of the batches published so far, and optionally starts a new measure */
+void mqttGetAckLatency(histogram_t * latency, bool reset) {
+	if (latency)
+		histogram_copy(latency, &stats.batch_latency);
+	if (reset)
+		histogram_reset(&stats.batch_latency);
+}
+
+/* Takes a snapshot of the publisher counters, the snapshot is not atomic as a whole */
+void mqttGetStats(mqtt_stats_t * out) {
+	out->enqueued = __sync_fetch_and_add(&stats.enqueued, 0);
+	out->sent = __sync_fetch_and_add(&stats.sent, 0);
+	out->acked = __sync_fetch_and_add(&stats.acked, 0);
+	out->failed = __sync_fetch_and_add(&stats.failed, 0);
+	out->spooled = __sync_fetch_and_add(&stats.spooled, 0);
+	out->reconnects = __sync_fetch_and_add(&stats.reconnects, 0);
+	out->queue_depth = stats.queue_depth;
+	out->queue_depth_max = stats.queue_depth_max;
+	out->inflight = stats.inflight;
+	out->inflight_max = stats.inflight_max;
+	histogram_copy(&out->queue_latency, &stats.queue_latency);
+	histogram_copy(&out->ack_latency, &stats.ack_latency);
+	histogram_copy(&out->total_latency, &stats.total_latency);
+	histogram_copy(&out->batch_latency, &stats.batch_latency);
+}
+
+/* Ecore timer callback publishing the counters on the diagnostics topic */
+static Eina_Bool _mqttDiagTimerCb(void * data) {
+	static mqtt_stats_t snapshot;
+	char msg[1024];
+
+	mqttGetStats(&snapshot);
+	snprintf(msg, sizeof(msg),
+			"{\"enqueued\":%llu,\"sent\":%llu,\"acked\":%llu,\"failed\":%llu,\"spooled\":%llu,\"reconnects\":%llu,"
+			"\"queue_depth\":%d,\"queue_depth_max\":%d,\"inflight\":%d,\"inflight_max\":%d,"
+			"\"queue_us\":{\"p50\":%llu,\"p99\":%llu,\"max\":%llu},"
+			"\"ack_us\":{\"p50\":%llu,\"p99\":%llu,\"max\":%llu},"
+			"\"total_us\":{\"p50\":%llu,\"p99\":%llu,\"max\":%llu}}",
+			snapshot.enqueued, snapshot.sent, snapshot.acked, snapshot.failed, snapshot.spooled, snapshot.reconnects,
+			snapshot.queue_depth, snapshot.queue_depth_max, snapshot.inflight, snapshot.inflight_max,
+			histogram_percentile(&snapshot.queue_latency, 50), histogram_percentile(&snapshot.queue_latency, 99), snapshot.queue_latency.max,
+			histogram_percentile(&snapshot.ack_latency, 50), histogram_percentile(&snapshot.ack_latency, 99), snapshot.ack_latency.max,
+			histogram_percentile(&snapshot.total_latency, 50), histogram_percentile(&snapshot.total_latency, 99), snapshot.total_latency.max);
+
+	char * copy = strdup(msg);
+	publish_ctx_t * ctx = copy ? _mqttCtxCreate(copy, strlen(copy), NULL, diagTopic) : NULL;
+	if (ctx == NULL)
+		free(copy);
+	else
+		_mqttEnqueue(ctx);
+
+	return ECORE_CALLBACK_RENEW;
 }
 
 int mqttSubscribe() {
@@ -116,6 +624,47 @@ int mqttSubscribe() {
 }
 
 void mqttExit() {
-	MQTTClient_disconnect(client, 10000);
-	MQTTClient_destroy(&client);
+	MQTTAsync_disconnectOptions opts = MQTTAsync_disconnectOptions_initializer;
+	struct timespec deadline;
+
+	if (diagTimer) {
+		ecore_timer_del(diagTimer);
+		diagTimer = NULL;
+	}
+
+	// Stop the bring-up, a discovery in progress ends within DISCOVERY_TIMEOUT
+	if (bringupStarted) {
+		pthread_mutex_lock(&connLock);
+		stopRequested = true;
+		pthread_cond_broadcast(&connCond);
+		pthread_mutex_unlock(&connLock);
+		pthread_join(bringupThread, NULL);
+		bringupStarted = false;
+	}
+
+	// No reconnection may queue a drain job from now on. The disconnection waits for
+	// the payloads in flight, the jobs left in the pool spool their payloads.
+	if (clientCreated) {
+		MQTTAsync_setConnected(client, NULL, NULL);
+		opts.timeout = 10000;
+		MQTTAsync_disconnect(client, &opts);
+	}
+
+	thpool_wait(thpool);
+	thpool_destroy(thpool);
+
+	// Wait for the completion callbacks by taking back every slot of the window
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += TIMEOUT / 1000;
+	for (int i = 0; i < PUBLISH_WINDOW; i++) {
+		if (sem_timedwait(&window, &deadline) != 0)
+			break;
+	}
+
+	if (clientCreated) {
+		clientCreated = 0;
+		MQTTAsync_destroy(&client);
+	}
+	spool_close();
+	sem_destroy(&window);
 }
@@ -0,0 +1,450 @@
+/*
+ * record.c
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "record.h"
+
+#define RECORD_TYPE_COUNT	14
+
+/* "name": prefix of a JSON field, with its length computed at compile time */
+typedef struct json_field {
+	const char *key;
+	size_t len;
+} json_field_t;
+
+#define FIELD(name)	{"\"" name "\":", sizeof(name) + 2}
+#define NO_FIELD	{NULL, 0}
+
+/* output cursor of the JSON writer; len reaches size once the buffer is full */
+typedef struct json_cursor {
+	char *buf;
+	size_t size;
+	size_t len;
+} json_cursor_t;
+
+/* JSON field names of each sensor, in the order of the sensor_type_e enum */
+static const json_field_t s_fields[RECORD_TYPE_COUNT][RECORD_MAX_VALUES] = {
+	{FIELD("x"), FIELD("y"), FIELD("z"), NO_FIELD},		/* acceleration */
+	{FIELD("x"), FIELD("y"), FIELD("z"), NO_FIELD},		/* gravity */
+	{FIELD("x"), FIELD("y"), FIELD("z"), NO_FIELD},		/* linear acc */
+	{FIELD("x"), FIELD("y"), FIELD("z"), NO_FIELD},		/* magnetic */
+	{FIELD("x"), FIELD("y"), FIELD("z"), FIELD("v")},	/* rot vector */
+	{FIELD("x"), FIELD("y"), FIELD("z"), NO_FIELD},		/* orientation */
+	{FIELD("x"), FIELD("y"), FIELD("z"), NO_FIELD},		/* gyroscope */
+	{FIELD("lux"), NO_FIELD, NO_FIELD, NO_FIELD},			/* light */
+	{FIELD("proximity"), NO_FIELD, NO_FIELD, NO_FIELD},	/* proximity */
+	{FIELD("hPa"), NO_FIELD, NO_FIELD, NO_FIELD},			/* pressure */
+	{FIELD("UV"), NO_FIELD, NO_FIELD, NO_FIELD},			/* UV */
+	{FIELD("temperature"), NO_FIELD, NO_FIELD, NO_FIELD},	/* temp */
+	{FIELD("humidity"), NO_FIELD, NO_FIELD, NO_FIELD},	/* humidity */
+	{FIELD("HeartRate"), FIELD("P2P"), FIELD("RMSSD"), FIELD("SDNN")},	/* hrm */
+};
+
+/* JSON field names of the records computed on the watch */
+static const json_field_t s_derived_fields[][RECORD_MAX_VALUES] = {
+	{FIELD("steps"), FIELD("activity"), FIELD("intensity"), FIELD("cadence")},	/* RECORD_TYPE_ACTIVITY */
+	{FIELD("w"), FIELD("x"), FIELD("y"), FIELD("z")},							/* RECORD_TYPE_QUATERNION */
+};
+
+static const json_field_t s_no_field = NO_FIELD;
+
+static void _json_put(json_cursor_t *cursor, const char *str, size_t len);
+static void _json_put_int(json_cursor_t *cursor, long long v);
+static void _json_put_fixed2(json_cursor_t *cursor, float value);
+static size_t _put_u16(unsigned char *buf, unsigned int v);
+static size_t _put_u32(unsigned char *buf, unsigned int v);
+static size_t _put_varint(unsigned char *buf, unsigned long long v);
+static unsigned int _get_u16(const unsigned char *buf);
+static unsigned int _get_u32(const unsigned char *buf);
+static int _get_varint(record_reader_t *reader, unsigned long long *v);
+static int _values_encoding(const record_t *record);
+static const json_field_t *_field(int sensor_type, int index);
+
+/**
+ * @brief Serializes a record into the JSON object published since the first release of the app.
+ * @param record The record.
+ * @param transaction_id The transaction id of the record.
+ * @param[out] buf The output buffer.
+ * @param size The size of the output buffer.
+ * @return The length of the JSON string or 0 if the buffer is too small.
+ */
+size_t record_write_json(const record_t *record, int transaction_id, char *buf, size_t size)
+{
+	json_cursor_t cursor = {buf, size, 0};
+	const json_field_t *field;
+	int fields = 0;
+	int i;
+
+#define PUT_LITERAL(str)	_json_put(&cursor, str, sizeof(str) - 1)
+	PUT_LITERAL("{\"transaction_id\":");
+	_json_put_int(&cursor, transaction_id);
+	PUT_LITERAL(",\"timestamp\":");
+	_json_put_int(&cursor, record->timestamp_ms / 1000);
+	PUT_LITERAL(",\"sensor_type\":");
+	_json_put_int(&cursor, record->sensor_type);
+	PUT_LITERAL(",\"sensor_data\":{");
+
+	for (i = 0; i < record->value_count; ++i) {
+		field = _field(record->sensor_type, i);
+		if (field->len == 0)
+			continue;
+
+		if (fields++ > 0)
+			PUT_LITERAL(",");
+		_json_put(&cursor, field->key, field->len);
+		_json_put_fixed2(&cursor, record->values[i]);
+	}
+
+	PUT_LITERAL("}}");
+#undef PUT_LITERAL
+
+	/* room is left for the terminating null byte */
+	if (cursor.len >= size)
+		return 0;
+	buf[cursor.len] = '\0';
+
+	return cursor.len;
+}
+
+/**
+ * @brief Writes the header of a binary batch. The record count is filled in by record_set_header_count().
+ * @param[out] buf The output buffer.
+ * @param size The size of the output buffer.
+ * @param batch_id The sequence number of the batch.
+ * @param base_ms The timestamp the first record delta is relative to.
+ * @return RECORD_HEADER_SIZE or 0 if the buffer is too small.
+ */
+size_t record_write_header(unsigned char *buf, size_t size, unsigned int batch_id, long long base_ms)
+{
+	size_t len = 0;
+
+	if (size < RECORD_HEADER_SIZE)
+		return 0;
+
+	buf[len++] = 'K';
+	buf[len++] = 'S';
+	buf[len++] = RECORD_VERSION;
+	buf[len++] = 0;
+	len += _put_u32(buf + len, batch_id);
+	len += _put_u32(buf + len, (unsigned long long)base_ms & 0xffffffff);
+	len += _put_u32(buf + len, (unsigned long long)base_ms >> 32);
+	len += _put_u16(buf + len, 0);
+	len += _put_u16(buf + len, 0);
+
+	return len;
+}
+
+/**
+ * @brief Stores the final record count in the header of a binary batch.
+ */
+void record_set_header_count(unsigned char *buf, int count)
+{
+	_put_u16(buf + 16, count);
+}
+
+/**
+ * @brief Sets flags in the header of a binary batch.
+ */
+void record_set_header_flags(unsigned char *buf, int flags)
+{
+	buf[3] |= flags;
+}
+
+/**
+ * @brief Serializes a record into the binary batch format.
+ * @param record The record.
+ * @param prev_ms Timestamp of the previous record of the batch, or the base timestamp of the header.
+ * @param[out] buf The output buffer.
+ * @param size The size of the output buffer.
+ * @return The number of bytes written or 0 if the buffer is too small.
+ */
+size_t record_write_binary(const record_t *record, long long prev_ms, unsigned char *buf, size_t size)
+{
+	long long delta = record->timestamp_ms - prev_ms;
+	int encoding = _values_encoding(record);
+	size_t len = 0;
+	float value;
+	unsigned int bits;
+	int i;
+
+	if (size < RECORD_MAX_BINARY_SIZE)
+		return 0;
+
+	buf[len++] = (unsigned char)record->sensor_type;
+	buf[len++] = (unsigned char)((record->value_count & 0x07) | (encoding << 4));
+	len += _put_varint(buf + len, ((unsigned long long)delta << 1) ^ (unsigned long long)(delta >> 63));
+
+	for (i = 0; i < record->value_count; ++i) {
+		value = record->values[i];
+
+		switch (encoding) {
+		case RECORD_VALUES_CENTI16:
+			len += _put_u16(buf + len, (unsigned int)(int)nearbyint(value * 100.0));
+			break;
+		case RECORD_VALUES_CENTI32:
+			len += _put_u32(buf + len, (unsigned int)(int)nearbyint(value * 100.0));
+			break;
+		default:
+			memcpy(&bits, &value, sizeof(bits));
+			len += _put_u32(buf + len, bits);
+			break;
+		}
+	}
+
+	return len;
+}
+
+/**
+ * @brief Starts decoding a binary batch.
+ * @param[out] reader The reader state.
+ * @param data The batch payload.
+ * @param len The size of the payload.
+ * @return 0 on success, -1 if the payload is not a supported binary batch.
+ */
+int record_reader_init(record_reader_t *reader, const void *data, size_t len)
+{
+	const unsigned char *buf = data;
+
+	memset(reader, 0, sizeof(*reader));
+
+	if (len < RECORD_HEADER_SIZE || buf[0] != 'K' || buf[1] != 'S' || buf[2] > RECORD_VERSION)
+		return -1;
+
+	if ((buf[3] & RECORD_FLAG_COMMITTED) && len < RECORD_HEADER_SIZE + RECORD_COMMITMENT_SIZE)
+		return -1;
+
+	reader->data = buf;
+	reader->len = (buf[3] & RECORD_FLAG_COMMITTED) ? len - RECORD_COMMITMENT_SIZE : len;
+	reader->pos = RECORD_HEADER_SIZE;
+	reader->version = buf[2];
+	reader->flags = buf[3];
+	reader->batch_id = _get_u32(buf + 4);
+	reader->timestamp_ms = (long long)(_get_u32(buf + 8) | ((unsigned long long)_get_u32(buf + 12) << 32));
+	reader->count = _get_u16(buf + 16);
+
+	return 0;
+}
+
+/**
+ * @brief Decodes the next record of a binary batch.
+ * @param reader The reader state.
+ * @param[out] record The decoded record.
+ * @return 1 if a record was decoded, 0 at the end of the batch, -1 on malformed input.
+ */
+int record_reader_next(record_reader_t *reader, record_t *record)
+{
+	unsigned long long zigzag;
+	unsigned int bits;
+	int encoding;
+	int i;
+
+	if (reader->read >= reader->count)
+		return 0;
+
+	if (reader->len - reader->pos < 2)
+		return -1;
+
+	record->sensor_type = reader->data[reader->pos++];
+	record->value_count = reader->data[reader->pos] & 0x07;
+	encoding = (reader->data[reader->pos++] >> 4) & 0x03;
+
+	if (record->value_count > RECORD_MAX_VALUES || _get_varint(reader, &zigzag) != 0)
+		return -1;
+
+	reader->timestamp_ms += (long long)(zigzag >> 1) ^ -(long long)(zigzag & 1);
+	record->timestamp_ms = reader->timestamp_ms;
+
+	for (i = 0; i < record->value_count; ++i) {
+		switch (encoding) {
+		case RECORD_VALUES_CENTI16:
+			if (reader->len - reader->pos < 2)
+				return -1;
+			record->values[i] = (short)_get_u16(reader->data + reader->pos) / 100.0f;
+			reader->pos += 2;
+			break;
+		case RECORD_VALUES_CENTI32:
+			if (reader->len - reader->pos < 4)
+				return -1;
+			record->values[i] = (int)_get_u32(reader->data + reader->pos) / 100.0f;
+			reader->pos += 4;
+			break;
+		case RECORD_VALUES_FLOAT:
+			if (reader->len - reader->pos < 4)
+				return -1;
+			bits = _get_u32(reader->data + reader->pos);
+			memcpy(&record->values[i], &bits, sizeof(bits));
+			reader->pos += 4;
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	reader->read++;
+	return 1;
+}
+
+/**
+ * @brief Picks the smallest value encoding that keeps the two decimals of the JSON format.
+ */
+static int _values_encoding(const record_t *record)
+{
+	int encoding = RECORD_VALUES_CENTI16;
+	double centi;
+	int i;
+
+	for (i = 0; i < record->value_count; ++i) {
+		centi = fabs(record->values[i] * 100.0);
+
+		if (isnan(centi) || centi > 2147483647.0)
+			return RECORD_VALUES_FLOAT;
+		if (centi > 32767.0)
+			encoding = RECORD_VALUES_CENTI32;
+	}
+
+	return encoding;
+}
+
+static size_t _put_u16(unsigned char *buf, unsigned int v)
+{
+	buf[0] = v & 0xff;
+	buf[1] = (v >> 8) & 0xff;
+	return 2;
+}
+
+static size_t _put_u32(unsigned char *buf, unsigned int v)
+{
+	buf[0] = v & 0xff;
+	buf[1] = (v >> 8) & 0xff;
+	buf[2] = (v >> 16) & 0xff;
+	buf[3] = (v >> 24) & 0xff;
+	return 4;
+}
+
+static size_t _put_varint(unsigned char *buf, unsigned long long v)
+{
+	size_t len = 0;
+
+	while (v >= 0x80) {
+		buf[len++] = (unsigned char)(v | 0x80);
+		v >>= 7;
+	}
+	buf[len++] = (unsigned char)v;
+
+	return len;
+}
+
+static unsigned int _get_u16(const unsigned char *buf)
+{
+	return buf[0] | (buf[1] << 8);
+}
+
+static unsigned int _get_u32(const unsigned char *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((unsigned int)buf[3] << 24);
+}
+
+static int _get_varint(record_reader_t *reader, unsigned long long *v)
+{
+	int shift = 0;
+	unsigned char byte;
+
+	*v = 0;
+	do {
+		if (reader->pos >= reader->len || shift > 63)
+			return -1;
+		byte = reader->data[reader->pos++];
+		*v |= (unsigned long long)(byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	return 0;
+}
+
+static const json_field_t *_field(int sensor_type, int index)
+{
+	if (sensor_type >= 0 && sensor_type < RECORD_TYPE_COUNT)
+		return &s_fields[sensor_type][index];
+
+	if (sensor_type >= RECORD_TYPE_ACTIVITY && sensor_type <= RECORD_TYPE_QUATERNION)
+		return &s_derived_fields[sensor_type - RECORD_TYPE_ACTIVITY][index];
+
+	return &s_no_field;
+}
+
+static void _json_put(json_cursor_t *cursor, const char *str, size_t len)
+{
+	if (cursor->size - cursor->len <= len) {
+		cursor->len = cursor->size;
+		return;
+	}
+
+	memcpy(cursor->buf + cursor->len, str, len);
+	cursor->len += len;
+}
+
+/**
+ * @brief Writes an integer as "%lld" does.
+ */
+static void _json_put_int(json_cursor_t *cursor, long long v)
+{
+	char digits[24];
+	char *p = digits + sizeof(digits);
+	unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+
+	do {
+		*--p = (char)('0' + u % 10);
+		u /= 10;
+	} while (u != 0);
+	if (v < 0)
+		*--p = '-';
+
+	_json_put(cursor, p, digits + sizeof(digits) - p);
+}
+
+/**
+ * @brief Writes a value as "%0.2f" does.
+ *
+ * The float is exact in a double and so is its product by 100 (24 + 7 bits), so
+ * rounding that product to an integer in the current rounding mode gives the
+ * digits printf would print, ties included. Values too large for a long long
+ * and the non-finite ones are left to snprintf.
+ */
+static void _json_put_fixed2(json_cursor_t *cursor, float value)
+{
+	double centi = nearbyint((double)value * 100.0);
+	char text[64];
+	char *p;
+	unsigned long long u;
+	int n;
+
+	if (!(fabs(centi) < 1e18)) {
+		n = snprintf(text, sizeof(text), "%0.2f", value);
+		if (n < 0 || (size_t)n >= sizeof(text)) {
+			cursor->len = cursor->size;
+			return;
+		}
+		_json_put(cursor, text, n);
+		return;
+	}
+
+	p = text + sizeof(text);
+	u = (unsigned long long)fabs(centi);
+	*--p = (char)('0' + u % 10);
+	u /= 10;
+	*--p = (char)('0' + u % 10);
+	u /= 10;
+	*--p = '.';
+	do {
+		*--p = (char)('0' + u % 10);
+		u /= 10;
+	} while (u != 0);
+	/* -0.001 prints as "-0.00" */
+	if (signbit(value))
+		*--p = '-';
+
+	_json_put(cursor, p, text + sizeof(text) - p);
+}
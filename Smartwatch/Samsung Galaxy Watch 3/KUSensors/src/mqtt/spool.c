@@ -0,0 +1,480 @@
+/*
+ * spool.c
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sensors.h>
+#include "spool.h"
+
+#define SPOOL_MAGIC			0x4c50534b	/* "KSPL" */
+#define SPOOL_VERSION		1
+#define SPOOL_HEADER_SIZE	32
+#define SPOOL_ENTRY_HEADER	8
+#define SPOOL_FILE_FMT		"%s/%08x.seg"
+#define SPOOL_FILE_NAME_MAX	14			/* "/%08x.seg" and the terminator */
+#define SPOOL_ALIGN(n)		(((n) + 3) & ~(size_t)3)
+
+typedef struct spool_header {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int seq;
+	unsigned int write_off;
+	unsigned int read_off;
+	unsigned int reserved;
+	unsigned long long created_s;
+} spool_header_t;
+
+typedef struct spool_segment {
+	unsigned int seq;
+	unsigned char *base;	/* NULL when not mapped */
+} spool_segment_t;
+
+static struct spool_info {
+	bool opened;
+	char dir[PATH_MAX - SPOOL_FILE_NAME_MAX];	/* leaves room for the segment names */
+	size_t segment_size;
+	int max_segments;
+	int retention_s;
+	unsigned int head_seq;	/* oldest segment, read side */
+	unsigned int tail_seq;	/* newest segment, write side */
+	spool_segment_t head;
+	spool_segment_t tail;
+	spool_stats_t stats;
+	pthread_mutex_t lock;
+} s_info = {
+	.opened = false,
+	.head = { 0, NULL },
+	.tail = { 0, NULL },
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static bool _segment_map(spool_segment_t *segment, unsigned int seq, bool create);
+static void _segment_unmap(spool_segment_t *segment);
+static void _segment_remove(unsigned int seq);
+static int _segment_pending(const spool_segment_t *segment);
+static bool _head_advance(void);
+static bool _tail_roll(void);
+static unsigned int _checksum(const unsigned char *data, size_t len);
+
+/**
+ * @brief Opens the spool stored in the given directory, creating it if needed. The entries left by a previous run are kept.
+ * @param dir The spool directory.
+ * @param segment_size Size of each segment file, which bounds the size of an entry.
+ * @param max_segments Number of segments after which the oldest one is evicted.
+ * @param retention_s Age after which a full segment is dropped, 0 to keep the segments until evicted.
+ * @return True on success or false on error.
+ */
+bool spool_open(const char *dir, size_t segment_size, int max_segments, int retention_s)
+{
+	struct dirent *entry;
+	unsigned int seq;
+	bool found = false;
+	DIR *d;
+
+	if (s_info.opened)
+		return true;
+
+	if (segment_size <= SPOOL_HEADER_SIZE + SPOOL_ENTRY_HEADER || max_segments < 2)
+		return false;
+
+	if (strlen(dir) >= sizeof(s_info.dir)) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] The spool directory path is too long: %s", __FILE__, __LINE__, dir);
+		return false;
+	}
+
+	if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] Can't create the spool directory %s, %d", __FILE__, __LINE__, dir, errno);
+		return false;
+	}
+
+	d = opendir(dir);
+	if (!d)
+		return false;
+
+	pthread_mutex_lock(&s_info.lock);
+
+	snprintf(s_info.dir, sizeof(s_info.dir), "%s", dir);
+	s_info.segment_size = SPOOL_ALIGN(segment_size);
+	s_info.max_segments = max_segments;
+	s_info.retention_s = retention_s;
+	memset(&s_info.stats, 0, sizeof(s_info.stats));
+
+	/* segment numbers are contiguous from the oldest to the newest file */
+	while ((entry = readdir(d)) != NULL) {
+		if (sscanf(entry->d_name, "%8x.seg", &seq) != 1)
+			continue;
+
+		if (!found || (int)(seq - s_info.head_seq) < 0)
+			s_info.head_seq = seq;
+		if (!found || (int)(seq - s_info.tail_seq) > 0)
+			s_info.tail_seq = seq;
+		found = true;
+	}
+	closedir(d);
+
+	if (!found)
+		s_info.head_seq = s_info.tail_seq = 0;
+
+	if (!_segment_map(&s_info.tail, s_info.tail_seq, true) || !_segment_map(&s_info.head, s_info.head_seq, true)) {
+		_segment_unmap(&s_info.tail);
+		_segment_unmap(&s_info.head);
+		pthread_mutex_unlock(&s_info.lock);
+		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] Can't map the spool segments of %s", __FILE__, __LINE__, dir);
+		return false;
+	}
+
+	s_info.stats.segments = s_info.tail_seq - s_info.head_seq + 1;
+	s_info.opened = true;
+
+	pthread_mutex_unlock(&s_info.lock);
+
+	return true;
+}
+
+/**
+ * @brief Syncs and unmaps the spool. The pending entries stay on disk for the next run.
+ */
+void spool_close(void)
+{
+	pthread_mutex_lock(&s_info.lock);
+	_segment_unmap(&s_info.head);
+	_segment_unmap(&s_info.tail);
+	s_info.opened = false;
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Appends a payload at the end of the spool, evicting the oldest segment when the spool is full.
+ * @param data The payload.
+ * @param len The size of the payload.
+ * @return True on success or false on error.
+ */
+bool spool_append(const void *data, size_t len)
+{
+	size_t entry_size = SPOOL_ALIGN(SPOOL_ENTRY_HEADER + len);
+	spool_header_t *header;
+	unsigned char *entry;
+	unsigned int word;
+
+	if (len == 0 || entry_size > s_info.segment_size - SPOOL_HEADER_SIZE)
+		return false;
+
+	pthread_mutex_lock(&s_info.lock);
+
+	if (!s_info.opened) {
+		pthread_mutex_unlock(&s_info.lock);
+		return false;
+	}
+
+	header = (spool_header_t *)s_info.tail.base;
+	if (header->write_off + entry_size > s_info.segment_size) {
+		if (!_tail_roll()) {
+			pthread_mutex_unlock(&s_info.lock);
+			return false;
+		}
+		header = (spool_header_t *)s_info.tail.base;
+	}
+
+	entry = s_info.tail.base + header->write_off;
+	word = (unsigned int)len;
+	memcpy(entry, &word, sizeof(word));
+	word = _checksum(data, len);
+	memcpy(entry + 4, &word, sizeof(word));
+	memcpy(entry + SPOOL_ENTRY_HEADER, data, len);
+
+	/* the entry only becomes visible once the write offset covers it */
+	__sync_synchronize();
+	header->write_off += entry_size;
+	msync(s_info.tail.base, s_info.segment_size, MS_ASYNC);
+
+	s_info.stats.appended++;
+
+	pthread_mutex_unlock(&s_info.lock);
+
+	return true;
+}
+
+/**
+ * @brief Copies the oldest entry of the spool without removing it.
+ * @param[out] data The payload (the returned value should be freed).
+ * @param[out] len The size of the payload.
+ * @param[out] pos The position of the entry, to be passed to spool_consume() once it is delivered.
+ * @return 1 if an entry was read, 0 if the spool is empty, -1 on error.
+ */
+int spool_peek(void **data, size_t *len, spool_pos_t *pos)
+{
+	spool_header_t *header;
+	unsigned char *entry;
+	unsigned int entry_len;
+	unsigned int checksum;
+	int ret = 0;
+
+	pthread_mutex_lock(&s_info.lock);
+
+	while (s_info.opened) {
+		header = (spool_header_t *)s_info.head.base;
+
+		if (header->read_off >= header->write_off) {
+			if (s_info.head_seq == s_info.tail_seq || !_head_advance())
+				break;
+			continue;
+		}
+
+		/* drop the segments that outlived the retention, except the one being written */
+		if (s_info.retention_s > 0 && s_info.head_seq != s_info.tail_seq &&
+				(long long)time(NULL) - (long long)header->created_s > s_info.retention_s) {
+			s_info.stats.dropped += _segment_pending(&s_info.head);
+			if (!_head_advance())
+				break;
+			continue;
+		}
+
+		entry = s_info.head.base + header->read_off;
+		memcpy(&entry_len, entry, sizeof(entry_len));
+		memcpy(&checksum, entry + 4, sizeof(checksum));
+
+		if (entry_len == 0 || SPOOL_ALIGN(SPOOL_ENTRY_HEADER + entry_len) > header->write_off - header->read_off ||
+				_checksum(entry + SPOOL_ENTRY_HEADER, entry_len) != checksum) {
+			/* torn write of a previous run, the rest of the segment can't be trusted */
+			dlog_print(DLOG_WARN, LOG_TAG, "[%s:%d] Corrupted spool segment %08x at %u", __FILE__, __LINE__, s_info.head_seq, header->read_off);
+			s_info.stats.dropped++;
+			header->read_off = header->write_off;
+			continue;
+		}
+
+		*data = malloc(entry_len);
+		if (!*data) {
+			ret = -1;
+			break;
+		}
+
+		memcpy(*data, entry + SPOOL_ENTRY_HEADER, entry_len);
+		*len = entry_len;
+		pos->seq = s_info.head_seq;
+		pos->offset = header->read_off;
+		pos->next = header->read_off + SPOOL_ALIGN(SPOOL_ENTRY_HEADER + entry_len);
+		ret = 1;
+		break;
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+
+	return ret;
+}
+
+/**
+ * @brief Removes a peeked entry from the spool. Nothing is done if the entry was evicted in the meantime.
+ * @param pos The position returned by spool_peek().
+ */
+void spool_consume(const spool_pos_t *pos)
+{
+	spool_header_t *header;
+
+	pthread_mutex_lock(&s_info.lock);
+
+	if (s_info.opened && pos->seq == s_info.head_seq) {
+		header = (spool_header_t *)s_info.head.base;
+		if (header->read_off == pos->offset) {
+			header->read_off = pos->next;
+			s_info.stats.consumed++;
+		}
+	}
+
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Checks if the spool has entries waiting to be drained.
+ * @return true - nothing to drain, false - entries are pending.
+ */
+bool spool_is_empty(void)
+{
+	spool_header_t *header;
+	bool empty = true;
+
+	pthread_mutex_lock(&s_info.lock);
+	if (s_info.opened) {
+		header = (spool_header_t *)s_info.head.base;
+		empty = s_info.head_seq == s_info.tail_seq && header->read_off >= header->write_off;
+	}
+	pthread_mutex_unlock(&s_info.lock);
+
+	return empty;
+}
+
+/**
+ * @brief Reads the counters of the spool since it was opened.
+ * @param[out] stats The counters.
+ */
+void spool_get_stats(spool_stats_t *stats)
+{
+	pthread_mutex_lock(&s_info.lock);
+	*stats = s_info.stats;
+	pthread_mutex_unlock(&s_info.lock);
+}
+
+/**
+ * @brief Maps a segment file, creating and formatting it if needed.
+ */
+static bool _segment_map(spool_segment_t *segment, unsigned int seq, bool create)
+{
+	char path[PATH_MAX];
+	spool_header_t *header;
+	struct stat st;
+	void *base;
+	int fd;
+
+	snprintf(path, sizeof(path), SPOOL_FILE_FMT, s_info.dir, seq);
+
+	fd = open(path, O_RDWR | (create ? O_CREAT : 0), 0600);
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) != 0 || ((size_t)st.st_size != s_info.segment_size && ftruncate(fd, s_info.segment_size) != 0)) {
+		close(fd);
+		return false;
+	}
+
+	base = mmap(NULL, s_info.segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		return false;
+
+	header = base;
+	if (header->magic != SPOOL_MAGIC || header->version != SPOOL_VERSION || header->seq != seq ||
+			header->write_off < SPOOL_HEADER_SIZE || header->write_off > s_info.segment_size ||
+			header->read_off < SPOOL_HEADER_SIZE || header->read_off > header->write_off) {
+		/* a new segment, or one written by an incompatible version */
+		memset(header, 0, SPOOL_HEADER_SIZE);
+		header->magic = SPOOL_MAGIC;
+		header->version = SPOOL_VERSION;
+		header->seq = seq;
+		header->write_off = SPOOL_HEADER_SIZE;
+		header->read_off = SPOOL_HEADER_SIZE;
+		header->created_s = time(NULL);
+	}
+
+	segment->seq = seq;
+	segment->base = base;
+
+	return true;
+}
+
+static void _segment_unmap(spool_segment_t *segment)
+{
+	if (!segment->base)
+		return;
+
+	msync(segment->base, s_info.segment_size, MS_SYNC);
+	munmap(segment->base, s_info.segment_size);
+	segment->base = NULL;
+}
+
+static void _segment_remove(unsigned int seq)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), SPOOL_FILE_FMT, s_info.dir, seq);
+	unlink(path);
+}
+
+/**
+ * @brief Counts the entries of a segment that were not drained yet.
+ */
+static int _segment_pending(const spool_segment_t *segment)
+{
+	const spool_header_t *header = (const spool_header_t *)segment->base;
+	unsigned int off = header->read_off;
+	unsigned int entry_len;
+	int count = 0;
+
+	while (off + SPOOL_ENTRY_HEADER <= header->write_off) {
+		memcpy(&entry_len, segment->base + off, sizeof(entry_len));
+		if (entry_len == 0)
+			break;
+		off += SPOOL_ALIGN(SPOOL_ENTRY_HEADER + entry_len);
+		count++;
+	}
+
+	return count;
+}
+
+/**
+ * @brief Deletes the head segment and maps the next one.
+ * Notice: Caller MUST hold the lock and the head MUST NOT be the tail.
+ */
+static bool _head_advance(void)
+{
+	unsigned int seq = s_info.head_seq;
+
+	_segment_unmap(&s_info.head);
+	_segment_remove(seq);
+	s_info.stats.segments--;
+
+	/* the tail is mapped a second time, shared mappings of a file stay coherent */
+	while (seq != s_info.tail_seq) {
+		seq++;
+		if (_segment_map(&s_info.head, seq, seq == s_info.tail_seq)) {
+			s_info.head_seq = seq;
+			return true;
+		}
+	}
+
+	s_info.opened = false;
+	dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] Can't map the spool head segment", __FILE__, __LINE__);
+	return false;
+}
+
+/**
+ * @brief Starts a new tail segment, evicting the oldest one if the spool is full.
+ * Notice: Caller MUST hold the lock.
+ */
+static bool _tail_roll(void)
+{
+	_segment_unmap(&s_info.tail);
+
+	if (!_segment_map(&s_info.tail, s_info.tail_seq + 1, true)) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] Can't create a spool segment", __FILE__, __LINE__);
+		/* the previous tail is full, the next append retries the roll */
+		if (!_segment_map(&s_info.tail, s_info.tail_seq, true))
+			s_info.opened = false;
+		return false;
+	}
+
+	s_info.tail_seq++;
+	s_info.stats.segments++;
+
+	if (s_info.stats.segments > s_info.max_segments) {
+		s_info.stats.dropped += _segment_pending(&s_info.head);
+		return _head_advance();
+	}
+
+	return true;
+}
+
+/**
+ * @brief FNV-1a hash of an entry, used to detect the entries torn by a crash.
+ */
+static unsigned int _checksum(const unsigned char *data, size_t len)
+{
+	unsigned int hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		hash ^= data[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
@@ -0,0 +1,353 @@
+/*
+ * replay.c
+ */
+
+#include <Ecore.h>
+#include <sensors.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "replay.h"
+#include "data.h"
+#include "mqtt.h"
+#include "histogram.h"
+#include "view_defines.h"
+
+#define REPLAY_TICK			0.01	// seconds between two deliveries at the trace speed
+#define REPLAY_CHUNK		512		// events delivered per idler call at full speed
+#define REPLAY_GROUP		64		// events of a sensor delivered in one call, like a hardware FIFO
+#define REPLAY_REPORT_DELAY	5.0		// seconds left to the last batches to be acknowledged
+
+static struct replay_info {
+	FILE *record;
+	pthread_mutex_t record_lock;
+	FILE *trace;
+	int speed;
+	bool pending_valid;
+	int pending_type;
+	sensor_event_s pending;
+	unsigned long long trace_start_us;
+	long long start_us;
+	long long end_us;
+	long long cpu_start_us;
+	long long cpu_end_us;
+	unsigned long long samples;
+	Ecore_Timer *timer;
+	Ecore_Idler *idler;
+	Ecore_Timer *report_timer;
+} s_info = {
+	.record = NULL,
+	.record_lock = PTHREAD_MUTEX_INITIALIZER,
+	.trace = NULL,
+	.timer = NULL,
+	.idler = NULL,
+	.report_timer = NULL,
+};
+
+static long long _clock_us(clockid_t clock);
+static bool _read_event(void);
+static int _deliver(unsigned long long until_us, int max_events);
+static void _finish(void);
+static Eina_Bool _tick_cb(void *data);
+static Eina_Bool _report_timer_cb(void *data);
+
+/**
+ * @brief Starts writing the events of the captured sensors to a trace file.
+ * @param path The trace file, truncated if it exists.
+ * @return True on success or false on error.
+ */
+bool replay_record_start(const char *path)
+{
+	FILE *file = fopen(path, "w");
+
+	if (!file) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] Can't create the trace %s", __FILE__, __LINE__, path);
+		return false;
+	}
+
+	replay_record_stop();
+
+	pthread_mutex_lock(&s_info.record_lock);
+	s_info.record = file;
+	pthread_mutex_unlock(&s_info.record_lock);
+
+	return true;
+}
+
+/**
+ * @brief Stops the recording and closes the trace file.
+ */
+void replay_record_stop(void)
+{
+	pthread_mutex_lock(&s_info.record_lock);
+	if (s_info.record) {
+		fclose(s_info.record);
+		s_info.record = NULL;
+	}
+	pthread_mutex_unlock(&s_info.record_lock);
+}
+
+/**
+ * @brief Appends the events delivered by a listener to the trace, if a recording is running.
+ * @param sensor_type The sensor the events come from.
+ * @param events The events.
+ * @param events_count Number of events.
+ */
+void replay_record_events(int sensor_type, const sensor_event_s events[], int events_count)
+{
+	int i;
+	int j;
+
+	if (!s_info.record)
+		return;
+
+	pthread_mutex_lock(&s_info.record_lock);
+	for (i = 0; s_info.record && i < events_count; ++i) {
+		fprintf(s_info.record, "%d %llu %d", sensor_type, events[i].timestamp, events[i].value_count);
+		for (j = 0; j < events[i].value_count && j < MAX_VALUE_SIZE; ++j)
+			fprintf(s_info.record, " %.9g", events[i].values[j]);
+		fputc('\n', s_info.record);
+	}
+	pthread_mutex_unlock(&s_info.record_lock);
+}
+
+/**
+ * @brief Replays a trace through the capture path. The replay runs in the main loop.
+ * @param path The trace file.
+ * @param speed REPLAY_SPEED_REALTIME or REPLAY_SPEED_MAX.
+ * @return True on success or false on error.
+ */
+bool replay_start(const char *path, int speed)
+{
+	replay_stop();
+
+	s_info.trace = fopen(path, "r");
+	if (!s_info.trace) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] Can't open the trace %s", __FILE__, __LINE__, path);
+		return false;
+	}
+
+	if (!_read_event()) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "[%s:%d] The trace %s is empty", __FILE__, __LINE__, path);
+		replay_stop();
+		return false;
+	}
+
+	data_set_replay_mode(true);
+	s_info.speed = speed;
+	s_info.samples = 0;
+	s_info.trace_start_us = s_info.pending.timestamp;
+	s_info.start_us = _clock_us(CLOCK_MONOTONIC);
+	s_info.cpu_start_us = _clock_us(CLOCK_PROCESS_CPUTIME_ID);
+	mqttGetAckLatency(NULL, true);
+
+	if (speed == REPLAY_SPEED_MAX)
+		s_info.idler = ecore_idler_add(_tick_cb, NULL);
+	else
+		s_info.timer = ecore_timer_add(REPLAY_TICK, _tick_cb, NULL);
+
+	dlog_print(DLOG_INFO, LOG_TAG, "Replaying %s at %s speed", path, speed == REPLAY_SPEED_MAX ? "max" : "trace");
+
+	return true;
+}
+
+/**
+ * @brief Stops the replay without reporting and unmutes the listeners.
+ */
+void replay_stop(void)
+{
+	if (s_info.timer) {
+		ecore_timer_del(s_info.timer);
+		s_info.timer = NULL;
+	}
+	if (s_info.idler) {
+		ecore_idler_del(s_info.idler);
+		s_info.idler = NULL;
+	}
+	if (s_info.report_timer) {
+		ecore_timer_del(s_info.report_timer);
+		s_info.report_timer = NULL;
+	}
+	if (s_info.trace) {
+		fclose(s_info.trace);
+		s_info.trace = NULL;
+	}
+	s_info.pending_valid = false;
+	data_set_replay_mode(false);
+}
+
+/**
+ * @brief Checks if a replay is running.
+ */
+bool replay_is_running(void)
+{
+	return s_info.trace != NULL;
+}
+
+/**
+ * @brief Computes the figures of the last replay. The latencies keep growing until its last batch is acknowledged.
+ * @param[out] report The figures.
+ */
+void replay_get_report(replay_report_t *report)
+{
+	static histogram_t latency;
+	long long end_us = s_info.trace ? _clock_us(CLOCK_MONOTONIC) : s_info.end_us;
+	long long cpu_end_us = s_info.trace ? _clock_us(CLOCK_PROCESS_CPUTIME_ID) : s_info.cpu_end_us;
+
+	memset(report, 0, sizeof(*report));
+	report->samples = s_info.samples;
+	report->elapsed_s = (end_us - s_info.start_us) / 1000000.0;
+	if (report->elapsed_s > 0)
+		report->samples_per_s = report->samples / report->elapsed_s;
+	if (report->samples > 0)
+		report->cpu_us_per_sample = (double)(cpu_end_us - s_info.cpu_start_us) / report->samples;
+
+	mqttGetAckLatency(&latency, false);
+	report->latency_p50_us = histogram_percentile(&latency, 50.0);
+	report->latency_p90_us = histogram_percentile(&latency, 90.0);
+	report->latency_p99_us = histogram_percentile(&latency, 99.0);
+	report->latency_max_us = latency.max;
+}
+
+static long long _clock_us(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Reads the next event of the trace into the pending slot, skipping malformed lines.
+ * @return False at the end of the trace.
+ */
+static bool _read_event(void)
+{
+	char line[512];
+	char *cursor;
+	char *end;
+	int i;
+
+	s_info.pending_valid = false;
+
+	while (fgets(line, sizeof(line), s_info.trace)) {
+		memset(&s_info.pending, 0, sizeof(s_info.pending));
+
+		if (sscanf(line, "%d %llu %d", &s_info.pending_type, &s_info.pending.timestamp, &s_info.pending.value_count) != 3 ||
+				s_info.pending_type < 0 || s_info.pending_type >= SENSOR_COUNT ||
+				s_info.pending.value_count < 0 || s_info.pending.value_count > MAX_VALUE_SIZE)
+			continue;
+
+		/* skip the three header fields */
+		cursor = line;
+		for (i = 0; i < 3; ++i) {
+			strtod(cursor, &end);
+			cursor = end;
+		}
+
+		for (i = 0; i < s_info.pending.value_count; ++i) {
+			s_info.pending.values[i] = strtof(cursor, &end);
+			if (end == cursor)
+				break;
+			cursor = end;
+		}
+
+		if (i < s_info.pending.value_count)
+			continue;
+
+		s_info.pending_valid = true;
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Hands the events of the trace up to the given trace time to the capture path.
+ * Consecutive events of a sensor are delivered together, the way the hardware FIFO does.
+ * @param until_us Trace time of the last event to deliver.
+ * @param max_events Maximum number of events to deliver.
+ * @return Number of delivered events.
+ */
+static int _deliver(unsigned long long until_us, int max_events)
+{
+	sensor_event_s group[REPLAY_GROUP];
+	int group_type = -1;
+	int n = 0;
+	int delivered = 0;
+
+	while (s_info.pending_valid && delivered < max_events && s_info.pending.timestamp - s_info.trace_start_us <= until_us) {
+		if (n > 0 && (s_info.pending_type != group_type || n == REPLAY_GROUP)) {
+			data_inject_events(group_type, group, n);
+			n = 0;
+		}
+
+		group_type = s_info.pending_type;
+		group[n++] = s_info.pending;
+		delivered++;
+		_read_event();
+	}
+
+	if (n > 0)
+		data_inject_events(group_type, group, n);
+
+	s_info.samples += delivered;
+
+	return delivered;
+}
+
+/**
+ * @brief Closes the trace, flushes the last batch and schedules the report.
+ */
+static void _finish(void)
+{
+	s_info.end_us = _clock_us(CLOCK_MONOTONIC);
+	s_info.cpu_end_us = _clock_us(CLOCK_PROCESS_CPUTIME_ID);
+	s_info.timer = NULL;
+	s_info.idler = NULL;
+	replay_stop();
+
+	batch_flush();
+	s_info.report_timer = ecore_timer_add(REPLAY_REPORT_DELAY, _report_timer_cb, NULL);
+}
+
+/**
+ * @brief Ecore timer or idler callback delivering the due events.
+ */
+static Eina_Bool _tick_cb(void *data)
+{
+	unsigned long long until_us;
+
+	if (s_info.speed == REPLAY_SPEED_MAX) {
+		_deliver((unsigned long long)-1, REPLAY_CHUNK);
+	} else {
+		until_us = (unsigned long long)(_clock_us(CLOCK_MONOTONIC) - s_info.start_us) * s_info.speed;
+		_deliver(until_us, REPLAY_CHUNK * 64);
+	}
+
+	if (s_info.pending_valid)
+		return ECORE_CALLBACK_RENEW;
+
+	_finish();
+	return ECORE_CALLBACK_CANCEL;
+}
+
+/**
+ * @brief Ecore timer callback logging the figures of the replay once its last batches had time to be acknowledged.
+ */
+static Eina_Bool _report_timer_cb(void *data)
+{
+	replay_report_t report;
+
+	s_info.report_timer = NULL;
+	replay_get_report(&report);
+
+	dlog_print(DLOG_INFO, LOG_TAG, "Replay: %llu samples in %.3f s, %.0f samples/s, %.2f us CPU/sample",
+			report.samples, report.elapsed_s, report.samples_per_s, report.cpu_us_per_sample);
+	dlog_print(DLOG_INFO, LOG_TAG, "Replay latency (us): p50 %llu, p90 %llu, p99 %llu, max %llu",
+			report.latency_p50_us, report.latency_p90_us, report.latency_p99_us, report.latency_max_us);
+
+	return ECORE_CALLBACK_CANCEL;
+}
@@ -0,0 +1,387 @@
+/*
+ * async.cpp
+ */
+
+#include "restclient/async.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "restclient/helpers.h"
+#include "restclient/version.h"
+
+/**
+ * @brief constructor, starts the thread of the client
+ *
+ * @param maxConcurrent - transfers in progress at the same time, the
+ * following requests wait in the queue
+ *
+ */
+RestClient::AsyncClient::AsyncClient(int maxConcurrent)
+: multi(NULL), maxConcurrent(maxConcurrent > 0 ? maxConcurrent : 1),
+	defaultTimeoutMs(0), headerFields(), running(), freeHandles(),
+	queue(), pending(0), stopping(false) {
+	this->multi = curl_multi_init();
+	if (!this->multi) {
+		throw std::runtime_error("Couldn't initialize curl multi handle");
+	}
+	if (pipe(this->wakeFds) != 0) {
+		curl_multi_cleanup(this->multi);
+		throw std::runtime_error("Couldn't create the wake-up pipe");
+	}
+	fcntl(this->wakeFds[0], F_SETFL, O_NONBLOCK);
+	fcntl(this->wakeFds[1], F_SETFL, O_NONBLOCK);
+
+	curl_multi_setopt(this->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS,
+			static_cast<long>(this->maxConcurrent));
+
+	this->worker = std::thread(&RestClient::AsyncClient::run, this);
+}
+
+RestClient::AsyncClient::~AsyncClient() {
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->stopping = true;
+	}
+	this->wake();
+	this->worker.join();
+
+	for (size_t i = 0; i < this->freeHandles.size(); i++) {
+		curl_easy_cleanup(this->freeHandles[i]);
+	}
+	curl_multi_cleanup(this->multi);
+	close(this->wakeFds[0]);
+	close(this->wakeFds[1]);
+}
+
+/**
+ * @brief set the timeout of the requests submitted afterwards without one
+ *
+ * @param milliseconds - whole transfer timeout, 0 for none
+ *
+ */
+void
+RestClient::AsyncClient::SetTimeout(int milliseconds) {
+	std::lock_guard<std::mutex> guard(this->lock);
+	this->defaultTimeoutMs = milliseconds;
+}
+
+/**
+ * @brief append a header sent with the requests submitted afterwards
+ *
+ * @param key for the header field
+ * @param value for the header field
+ *
+ */
+void
+RestClient::AsyncClient::AppendHeader(const std::string& key,
+		const std::string& value) {
+	std::lock_guard<std::mutex> guard(this->lock);
+	this->headerFields[key] = value;
+}
+
+/**
+ * @brief HTTP GET method
+ *
+ * @param url to query
+ * @param timeoutMs - timeout of the request, < 0 for the default one
+ *
+ * @return future of the response
+ */
+std::future<RestClient::Response>
+RestClient::AsyncClient::get(const std::string& url, int timeoutMs) {
+	Request* request = this->newRequest(url, false, "", "", timeoutMs);
+	request->promise = std::make_shared<std::promise<RestClient::Response> >();
+	std::future<RestClient::Response> response = request->promise->get_future();
+	this->submit(request);
+	return response;
+}
+
+/**
+ * @brief HTTP POST method
+ *
+ * @param url to query
+ * @param ctype content type as string
+ * @param data HTTP POST body
+ * @param timeoutMs - timeout of the request, < 0 for the default one
+ *
+ * @return future of the response
+ */
+std::future<RestClient::Response>
+RestClient::AsyncClient::post(const std::string& url, const std::string& ctype,
+		const std::string& data, int timeoutMs) {
+	Request* request = this->newRequest(url, true, ctype, data, timeoutMs);
+	request->promise = std::make_shared<std::promise<RestClient::Response> >();
+	std::future<RestClient::Response> response = request->promise->get_future();
+	this->submit(request);
+	return response;
+}
+
+/**
+ * @brief HTTP GET method
+ *
+ * @param url to query
+ * @param callback - receives the response on the thread of the client
+ * @param timeoutMs - timeout of the request, < 0 for the default one
+ */
+void
+RestClient::AsyncClient::get(const std::string& url, Callback callback,
+		int timeoutMs) {
+	Request* request = this->newRequest(url, false, "", "", timeoutMs);
+	request->callback = callback;
+	this->submit(request);
+}
+
+/**
+ * @brief HTTP POST method
+ *
+ * @param url to query
+ * @param ctype content type as string
+ * @param data HTTP POST body
+ * @param callback - receives the response on the thread of the client
+ * @param timeoutMs - timeout of the request, < 0 for the default one
+ */
+void
+RestClient::AsyncClient::post(const std::string& url, const std::string& ctype,
+		const std::string& data, Callback callback, int timeoutMs) {
+	Request* request = this->newRequest(url, true, ctype, data, timeoutMs);
+	request->callback = callback;
+	this->submit(request);
+}
+
+/**
+ * @brief wait until all the requests submitted so far are finished, their
+ * callbacks included
+ */
+void
+RestClient::AsyncClient::Wait() {
+	std::unique_lock<std::mutex> guard(this->lock);
+	this->idle.wait(guard, [this] { return this->pending == 0; });
+}
+
+/**
+ * @brief get the number of requests queued or in progress
+ *
+ * @return number of requests
+ */
+int
+RestClient::AsyncClient::Pending() {
+	std::lock_guard<std::mutex> guard(this->lock);
+	return this->pending;
+}
+
+RestClient::AsyncClient::Request*
+RestClient::AsyncClient::newRequest(const std::string& url, bool post,
+		const std::string& ctype, const std::string& data, int timeoutMs) {
+	Request* request = new Request();
+	std::string headerString;
+
+	request->url = url;
+	request->post = post;
+	request->data = data;
+	request->headers = NULL;
+
+	std::lock_guard<std::mutex> guard(this->lock);
+	request->timeoutMs = timeoutMs < 0 ? this->defaultTimeoutMs : timeoutMs;
+	for (HeaderFields::const_iterator it = this->headerFields.begin();
+			it != this->headerFields.end(); ++it) {
+		headerString = it->first + ": " + it->second;
+		request->headers = curl_slist_append(request->headers, headerString.c_str());
+	}
+	if (post) {
+		headerString = "Content-Type: " + ctype;
+		request->headers = curl_slist_append(request->headers, headerString.c_str());
+	}
+
+	return request;
+}
+
+void
+RestClient::AsyncClient::submit(Request* request) {
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->queue.push_back(request);
+		this->pending++;
+	}
+	this->wake();
+}
+
+/**
+ * @brief hand a request to the multi handle, on the thread of the client
+ */
+void
+RestClient::AsyncClient::start(Request* request) {
+	CURL* handle;
+
+	if (this->freeHandles.empty()) {
+		handle = curl_easy_init();
+	} else {
+		handle = this->freeHandles.back();
+		this->freeHandles.pop_back();
+	}
+
+	if (!handle) {
+		request->response.code = -1;
+		request->response.body = "Couldn't initialize curl handle";
+		this->complete(request);
+		return;
+	}
+
+	curl_easy_setopt(handle, CURLOPT_PRIVATE, request);
+	curl_easy_setopt(handle, CURLOPT_URL, request->url.c_str());
+	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, Helpers::write_callback);
+	curl_easy_setopt(handle, CURLOPT_WRITEDATA, &request->response);
+	curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, Helpers::header_callback);
+	curl_easy_setopt(handle, CURLOPT_HEADERDATA, &request->response);
+	curl_easy_setopt(handle, CURLOPT_HTTPHEADER, request->headers);
+	curl_easy_setopt(handle, CURLOPT_USERAGENT, "restclient-cpp/" RESTCLIENT_VERSION);
+	curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+	if (request->timeoutMs > 0) {
+		curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, request->timeoutMs);
+	}
+	if (request->post) {
+		curl_easy_setopt(handle, CURLOPT_POST, 1L);
+		curl_easy_setopt(handle, CURLOPT_POSTFIELDS, request->data.c_str());
+		curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE,
+				static_cast<long>(request->data.size()));
+	}
+
+	curl_multi_add_handle(this->multi, handle);
+	this->running.push_back(handle);
+}
+
+/**
+ * @brief take a finished transfer out of the multi handle and deliver its
+ * response, the handle is kept for the next request
+ */
+void
+RestClient::AsyncClient::finish(CURL* handle, CURLcode result) {
+	Request* request = NULL;
+	long httpCode = 0;
+
+	curl_easy_getinfo(handle, CURLINFO_PRIVATE, reinterpret_cast<char**>(&request));
+	curl_multi_remove_handle(this->multi, handle);
+	this->running.erase(std::find(this->running.begin(), this->running.end(), handle));
+
+	if (result != CURLE_OK) {
+		request->response.code = result > 99 ? -1 : static_cast<int>(result);
+		request->response.body = curl_easy_strerror(result);
+	} else {
+		curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &httpCode);
+		request->response.code = static_cast<int>(httpCode);
+	}
+
+	curl_easy_reset(handle);
+	if (this->freeHandles.size() < static_cast<size_t>(this->maxConcurrent)) {
+		this->freeHandles.push_back(handle);
+	} else {
+		curl_easy_cleanup(handle);
+	}
+
+	this->complete(request);
+}
+
+void
+RestClient::AsyncClient::complete(Request* request) {
+	if (request->callback) {
+		request->callback(request->response);
+	} else if (request->promise) {
+		request->promise->set_value(request->response);
+	}
+	curl_slist_free_all(request->headers);
+	delete request;
+
+	std::lock_guard<std::mutex> guard(this->lock);
+	if (--this->pending == 0) {
+		this->idle.notify_all();
+	}
+}
+
+void
+RestClient::AsyncClient::wake() {
+	char byte = 0;
+	// a full pipe already wakes the client up
+	if (write(this->wakeFds[1], &byte, 1) < 0) {
+		return;
+	}
+}
+
+/**
+ * @brief loop of the thread of the client: starts the queued requests up
+ * to the concurrency limit, drives the transfers and delivers the results
+ */
+void
+RestClient::AsyncClient::run() {
+	std::vector<Request*> starting;
+	struct curl_waitfd wakeFd;
+	CURLMsg* message;
+	char drain[64];
+	int stillRunning = 0;
+	int left = 0;
+	int finished;
+	bool stop = false;
+
+	wakeFd.fd = this->wakeFds[0];
+	wakeFd.events = CURL_WAIT_POLLIN;
+
+	while (!stop) {
+		{
+			std::lock_guard<std::mutex> guard(this->lock);
+			stop = this->stopping;
+			while (!stop && !this->queue.empty() &&
+					this->running.size() + starting.size() <
+					static_cast<size_t>(this->maxConcurrent)) {
+				starting.push_back(this->queue.front());
+				this->queue.pop_front();
+			}
+		}
+		if (stop) {
+			break;
+		}
+
+		for (size_t i = 0; i < starting.size(); i++) {
+			this->start(starting[i]);
+		}
+		starting.clear();
+
+		curl_multi_perform(this->multi, &stillRunning);
+
+		finished = 0;
+		while ((message = curl_multi_info_read(this->multi, &left)) != NULL) {
+			if (message->msg == CURLMSG_DONE) {
+				this->finish(message->easy_handle, message->data.result);
+				finished++;
+			}
+		}
+		// the freed slots go to the queued requests right away
+		if (finished > 0) {
+			continue;
+		}
+
+		curl_multi_wait(this->multi, &wakeFd, 1, 1000, NULL);
+		while (read(this->wakeFds[0], drain, sizeof(drain)) > 0) {
+		}
+	}
+
+	// abort what is left
+	while (!this->running.empty()) {
+		this->finish(this->running.back(), CURLE_ABORTED_BY_CALLBACK);
+	}
+	for (;;) {
+		Request* request;
+		{
+			std::lock_guard<std::mutex> guard(this->lock);
+			if (this->queue.empty()) {
+				break;
+			}
+			request = this->queue.front();
+			this->queue.pop_front();
+		}
+		request->response.code = CURLE_ABORTED_BY_CALLBACK;
+		request->response.body = curl_easy_strerror(CURLE_ABORTED_BY_CALLBACK);
+		this->complete(request);
+	}
+}
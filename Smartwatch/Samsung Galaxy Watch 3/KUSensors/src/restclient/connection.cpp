@@ -38,6 +38,27 @@ RestClient::Connection::Connection(const std::string& baseUrl)
 	if (!this->curlHandle) {
 		throw std::runtime_error("Couldn't initialize curl handle");
 	}
+	this->init(baseUrl);
+}
+
+/**
+ * @brief constructor for a Connection object on an existing curl handle,
+ * which belongs to the Connection until Detach() is called
+ *
+ * @param baseUrl - base URL for the connection to use
+ * @param handle - curl easy handle in its default state
+ *
+ */
+RestClient::Connection::Connection(const std::string& baseUrl, CURL* handle)
+: headerFields(), lastRequest() {
+	this->curlHandle = handle;
+	if (!this->curlHandle) {
+		throw std::runtime_error("Couldn't initialize curl handle");
+	}
+	this->init(baseUrl);
+}
+
+void RestClient::Connection::init(const std::string& baseUrl) {
 	this->baseUrl = baseUrl;
 	this->timeout = 0;
 	this->followRedirects = false;
@@ -67,6 +88,18 @@ void RestClient::Connection::Terminate() {
 	this->curlHandle = NULL;
 }
 
+/**
+ * @brief hand the curl handle over to the caller, e.g. back to the
+ * ConnectionPool. The Connection can't be used afterwards.
+ *
+ * @return the curl handle, NULL if already terminated
+ */
+CURL* RestClient::Connection::Detach() {
+	CURL* handle = this->curlHandle;
+	this->curlHandle = NULL;
+	return handle;
+}
+
 RestClient::Connection::~Connection() {
 	this->Terminate();
 }
@@ -0,0 +1,248 @@
+/*
+ * pool.cpp
+ */
+
+#include "restclient/pool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+/**
+ * @brief the pool of the process, created on first use
+ *
+ * @return the pool
+ */
+RestClient::ConnectionPool&
+RestClient::ConnectionPool::Instance() {
+	static RestClient::ConnectionPool pool;
+	return pool;
+}
+
+RestClient::ConnectionPool::ConnectionPool()
+: idle(), share(NULL), stats() {
+}
+
+RestClient::ConnectionPool::~ConnectionPool() {
+	this->Close();
+}
+
+/**
+ * @brief take a handle for a request, with an open connection to the
+ * origin of the url when one is idle. The handle is in its default state
+ * apart from the shared caches.
+ *
+ * @param url - the URL of the request
+ *
+ * @return a curl handle, or NULL if none can be created
+ */
+CURL*
+RestClient::ConnectionPool::Acquire(const std::string& url) {
+	std::string origin = Origin(url);
+	CURL* handle = NULL;
+	CURLSH* share;
+	std::vector<CURL*> expired;
+	time_t now = time(NULL);
+
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		std::map<std::string, std::vector<IdleHandle> >::iterator it =
+				this->idle.find(origin);
+
+		// the most recently used handle is the most likely to be still connected
+		while (it != this->idle.end() && !it->second.empty() && !handle) {
+			IdleHandle entry = it->second.back();
+			it->second.pop_back();
+			this->stats.idle--;
+			if (now - entry.since <= RESTCLIENT_POOL_IDLE_TIMEOUT) {
+				handle = entry.handle;
+				this->stats.reused++;
+			} else {
+				expired.push_back(entry.handle);
+				this->stats.evicted++;
+			}
+		}
+
+		if (!handle) {
+			this->stats.created++;
+		}
+		this->stats.acquired++;
+
+		// created after curl_global_init(), and again after a Close()
+		if (!this->share) {
+			this->share = NewShare();
+		}
+		share = this->share;
+	}
+
+	// closing a connection may block, not under the lock
+	for (size_t i = 0; i < expired.size(); i++) {
+		curl_easy_cleanup(expired[i]);
+	}
+
+	if (!handle) {
+		handle = curl_easy_init();
+	}
+	if (handle && share) {
+		curl_easy_setopt(handle, CURLOPT_SHARE, share);
+	}
+
+	return handle;
+}
+
+/**
+ * @brief give back a handle taken with Acquire() once its request is
+ * done, the connection it holds stays open for the next request
+ *
+ * @param url - the URL of the request
+ * @param handle - the handle, reset to its default state
+ */
+void
+RestClient::ConnectionPool::Release(const std::string& url, CURL* handle) {
+	std::string origin = Origin(url);
+	IdleHandle entry = { handle, time(NULL) };
+	CURL* evicted = NULL;
+
+	if (!handle) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		std::vector<IdleHandle>& handles = this->idle[origin];
+
+		if (handles.size() >= RESTCLIENT_POOL_MAX_IDLE) {
+			evicted = handles.front().handle;
+			handles.erase(handles.begin());
+			this->stats.idle--;
+			this->stats.evicted++;
+		}
+		handles.push_back(entry);
+		this->stats.idle++;
+	}
+
+	// closing a connection may block, not under the lock
+	if (evicted) {
+		curl_easy_cleanup(evicted);
+	}
+}
+
+/**
+ * @brief close all the idle handles
+ */
+void
+RestClient::ConnectionPool::Clear() {
+	std::map<std::string, std::vector<IdleHandle> > handles;
+
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		handles.swap(this->idle);
+		this->stats.evicted += this->stats.idle;
+		this->stats.idle = 0;
+	}
+
+	for (std::map<std::string, std::vector<IdleHandle> >::iterator it =
+			handles.begin(); it != handles.end(); ++it) {
+		for (size_t i = 0; i < it->second.size(); i++) {
+			curl_easy_cleanup(it->second[i].handle);
+		}
+	}
+}
+
+/**
+ * @brief close all the idle handles and the share handle of their caches.
+ * Call before curl_global_cleanup().
+ */
+void
+RestClient::ConnectionPool::Close() {
+	CURLSH* share;
+
+	this->Clear();
+
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		share = this->share;
+		this->share = NULL;
+	}
+
+	// fails while handles handed out still use it, they outlive the process anyway
+	if (share) {
+		curl_share_cleanup(share);
+	}
+}
+
+/**
+ * @brief get the counters of the pool
+ *
+ * @return a RestClient::PoolStats struct
+ */
+RestClient::PoolStats
+RestClient::ConnectionPool::GetStats() {
+	std::lock_guard<std::mutex> guard(this->lock);
+	return this->stats;
+}
+
+/**
+ * @brief key of the pool: the lowercase scheme://host:port of a URL, with
+ * the default port of the scheme when it has none
+ *
+ * @param url - the URL
+ *
+ * @return the origin
+ */
+std::string
+RestClient::ConnectionPool::Origin(const std::string& url) {
+	size_t schemeEnd = url.find("://");
+	std::string scheme = schemeEnd == std::string::npos ?
+			"http" : url.substr(0, schemeEnd);
+	size_t hostStart = schemeEnd == std::string::npos ? 0 : schemeEnd + 3;
+	size_t hostEnd = url.find_first_of("/?#", hostStart);
+	std::string authority = url.substr(hostStart,
+			hostEnd == std::string::npos ? std::string::npos : hostEnd - hostStart);
+	size_t at = authority.rfind('@');
+	std::string host = at == std::string::npos ?
+			authority : authority.substr(at + 1);
+
+	std::transform(scheme.begin(), scheme.end(), scheme.begin(), ::tolower);
+	std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+
+	// a colon after the closing bracket of an IPv6 address starts the port
+	size_t bracket = host.rfind(']');
+	size_t colon = host.rfind(':');
+	if (colon == std::string::npos ||
+			(bracket != std::string::npos && colon < bracket)) {
+		host += scheme == "https" ? ":443" : ":80";
+	}
+
+	return scheme + "://" + host;
+}
+
+/**
+ * @brief create the share handle of the DNS cache and the TLS sessions
+ *
+ * @return the share handle, or NULL if it can't be created
+ */
+CURLSH*
+RestClient::ConnectionPool::NewShare() {
+	CURLSH* share = curl_share_init();
+	if (share) {
+		curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShare);
+		curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+		curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+		curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	}
+	return share;
+}
+
+void
+RestClient::ConnectionPool::lockShare(CURL* handle, curl_lock_data data,
+		curl_lock_access access, void* userptr) {
+	static_cast<RestClient::ConnectionPool*>(userptr)->shareLocks[data].lock();
+}
+
+void
+RestClient::ConnectionPool::unlockShare(CURL* handle, curl_lock_data data,
+		void* userptr) {
+	static_cast<RestClient::ConnectionPool*>(userptr)->shareLocks[data].unlock();
+}
@@ -9,12 +9,32 @@
 #include "restclient/restclient.h"
 
 #include <curl/curl.h>
-#if __cplusplus >= 201402L
-#include <memory>
-#endif
 
 //#include "restclient-cpp/version.h"
 #include "restclient/connection.h"
+#include "restclient/pool.h"
+
+namespace {
+
+/**
+ * @brief run a request of the simple API on a handle of the ConnectionPool,
+ * which gets it back with its open connection afterwards
+ *
+ * @param url to query
+ * @param request issues the request on the Connection
+ *
+ * @return response struct
+ */
+template <typename Request>
+RestClient::Response pooledRequest(const std::string& url, Request request) {
+	RestClient::ConnectionPool& pool = RestClient::ConnectionPool::Instance();
+	RestClient::Connection conn("", pool.Acquire(url));
+	RestClient::Response ret = request(conn);
+	pool.Release(url, conn.Detach());
+	return ret;
+}
+
+}  // namespace
 
 /**
  * @brief global init function. Call this before you start any threads.
@@ -33,6 +53,7 @@ int RestClient::init() {
  * program.
  */
 void RestClient::disable() {
+	RestClient::ConnectionPool::Instance().Close();
 	curl_global_cleanup();
 }
 
@@ -44,16 +65,9 @@ void RestClient::disable() {
  * @return response struct
  */
 RestClient::Response RestClient::get(const std::string& url) {
-#if __cplusplus >= 201402L
-	auto conn = std::make_unique<RestClient::Connection>("");
-	return conn->get(url);
-#else
-	RestClient::Response ret;
-	RestClient::Connection *conn = new RestClient::Connection("");
-	ret = conn->get(url);
-	delete conn;
-	return ret;
-#endif
+	return pooledRequest(url, [&](RestClient::Connection& conn) -> RestClient::Response {
+		return conn.get(url);
+	});
 }
 
 /**
@@ -68,18 +82,10 @@ RestClient::Response RestClient::get(const std::string& url) {
 RestClient::Response RestClient::post(const std::string& url,
 		const std::string& ctype,
 		const std::string& data) {
-#if __cplusplus >= 201402L
-auto conn = std::make_unique<RestClient::Connection>("");
-conn->AppendHeader("Content-Type", ctype);
-return conn->post(url, data);
-#else
-RestClient::Response ret;
-RestClient::Connection *conn = new RestClient::Connection("");
-conn->AppendHeader("Content-Type", ctype);
-ret = conn->post(url, data);
-delete conn;
-return ret;
-#endif
+	return pooledRequest(url, [&](RestClient::Connection& conn) -> RestClient::Response {
+		conn.AppendHeader("Content-Type", ctype);
+		return conn.post(url, data);
+	});
 }
 
 /**
@@ -94,18 +100,10 @@ return ret;
 RestClient::Response RestClient::put(const std::string& url,
 		const std::string& ctype,
 		const std::string& data) {
-#if __cplusplus >= 201402L
-auto conn = std::make_unique<RestClient::Connection>("");
-conn->AppendHeader("Content-Type", ctype);
-return conn->put(url, data);
-#else
-RestClient::Response ret;
-RestClient::Connection *conn = new RestClient::Connection("");
-conn->AppendHeader("Content-Type", ctype);
-ret = conn->put(url, data);
-delete conn;
-return ret;
-#endif
+	return pooledRequest(url, [&](RestClient::Connection& conn) -> RestClient::Response {
+		conn.AppendHeader("Content-Type", ctype);
+		return conn.put(url, data);
+	});
 }
 
 /**
@@ -120,12 +118,10 @@ return ret;
 RestClient::Response RestClient::patch(const std::string& url,
 		const std::string& ctype,
 		const std::string& data) {
-	RestClient::Response ret;
-	RestClient::Connection *conn = new RestClient::Connection("");
-	conn->AppendHeader("Content-Type", ctype);
-	ret = conn->patch(url, data);
-	delete conn;
-	return ret;
+	return pooledRequest(url, [&](RestClient::Connection& conn) -> RestClient::Response {
+		conn.AppendHeader("Content-Type", ctype);
+		return conn.patch(url, data);
+	});
 }
 
 /**
@@ -136,16 +132,9 @@ RestClient::Response RestClient::patch(const std::string& url,
  * @return response struct
  */
 RestClient::Response RestClient::del(const std::string& url) {
-#if __cplusplus >= 201402L
-	auto conn = std::make_unique<RestClient::Connection>("");
-	return conn->del(url);
-#else
-	RestClient::Response ret;
-	RestClient::Connection *conn = new RestClient::Connection("");
-	ret = conn->del(url);
-	delete conn;
-	return ret;
-#endif
+	return pooledRequest(url, [&](RestClient::Connection& conn) -> RestClient::Response {
+		return conn.del(url);
+	});
 }
 
 /**
@@ -156,16 +145,9 @@ RestClient::Response RestClient::del(const std::string& url) {
  * @return response struct
  */
 RestClient::Response RestClient::head(const std::string& url) {
-#if __cplusplus >= 201402L
-	auto conn = std::make_unique<RestClient::Connection>("");
-	return conn->head(url);
-#else
-	RestClient::Response ret;
-	RestClient::Connection *conn = new RestClient::Connection("");
-	ret = conn->head(url);
-	delete conn;
-	return ret;
-#endif
+	return pooledRequest(url, [&](RestClient::Connection& conn) -> RestClient::Response {
+		return conn.head(url);
+	});
 }
 
 /**
@@ -176,10 +158,8 @@ RestClient::Response RestClient::head(const std::string& url) {
  * @return response struct
  */
 RestClient::Response RestClient::options(const std::string& url) {
-	RestClient::Response ret;
-	RestClient::Connection *conn = new RestClient::Connection("");
-	ret = conn->options(url);
-	delete conn;
-	return ret;
+	return pooledRequest(url, [&](RestClient::Connection& conn) -> RestClient::Response {
+		return conn.options(url);
+	});
 }
 
@@ -1,8 +1,41 @@
 /*************************** HEADER FILES ***************************/
 #include <stdlib.h>
 #include <memory.h>
+#include <pthread.h>
 #include "sha256.h"
 
+#if !defined(SHA256_NO_ACCELERATION) && (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SHA256_SHANI
+#include <cpuid.h>
+#include <immintrin.h>
+#define SHA256_SHANI_TARGET __attribute__((target("sha,sse4.1")))
+#endif
+
+#if !defined(SHA256_NO_ACCELERATION) && (defined(__aarch64__) || (defined(__arm__) && (defined(__ARM_NEON) || defined(__ARM_NEON__)))) && defined(__GNUC__) && defined(__linux__)
+#define SHA256_ARMV8
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#if defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+#define SHA256_ARMV8_TARGET                                   // the whole build targets the extension
+#elif defined(__aarch64__) && defined(__clang__)
+#define SHA256_ARMV8_TARGET __attribute__((target("crypto")))
+#elif defined(__aarch64__)
+#define SHA256_ARMV8_TARGET __attribute__((target("+crypto")))
+#else
+#define SHA256_ARMV8_TARGET __attribute__((target("fpu=crypto-neon-fp-armv8")))
+#endif
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)                                   // aarch64 AT_HWCAP
+#endif
+#ifndef HWCAP2_SHA2
+#define HWCAP2_SHA2 (1 << 3)                                  // arm AT_HWCAP2
+#endif
+#endif
+
+#if defined(__GNUC__)
+#define SHA256_VECTOR_LANES
+#endif
+
 /****************************** MACROS ******************************/
 #define ROTLEFT(a,b) (((a) << (b)) | ((a) >> (32-(b))))
 #define ROTRIGHT(a,b) (((a) >> (b)) | ((a) << (32-(b))))
@@ -14,6 +47,15 @@
 #define SIG0(x) (ROTRIGHT(x,7) ^ ROTRIGHT(x,18) ^ ((x) >> 3))
 #define SIG1(x) (ROTRIGHT(x,17) ^ ROTRIGHT(x,19) ^ ((x) >> 10))
 
+/**************************** DATA TYPES ****************************/
+// Compresses consecutive 64 byte blocks into the state.
+typedef void (*sha256_blocks_fn)(WORD state[8], const BYTE *data, size_t blocks);
+
+#ifdef SHA256_VECTOR_LANES
+// One word of each of the SHA256_LANES messages, the C operators apply to every lane.
+typedef WORD sha256_lanes_t __attribute__((vector_size(SHA256_LANES * sizeof(WORD))));
+#endif
+
 /**************************** VARIABLES *****************************/
 static const WORD k[64] = {
 	0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5,
@@ -26,71 +68,262 @@ static const WORD k[64] = {
 	0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
 };
 
+static const WORD iv[8] = {
+	0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19
+};
+
+static pthread_once_t s_once = PTHREAD_ONCE_INIT;
+static sha256_blocks_fn s_blocks;
+static const char *s_name;
+
 /*********************** FUNCTION DEFINITIONS ***********************/
-void sha256_transform(SHA256_CTX *ctx, const BYTE data[])
+static void sha256_blocks_c(WORD state[8], const BYTE *data, size_t blocks)
 {
 	WORD a, b, c, d, e, f, g, h, i, j, t1, t2, m[64];
 
-	for (i = 0, j = 0; i < 16; ++i, j += 4)
-		m[i] = (data[j] << 24) | (data[j + 1] << 16) | (data[j + 2] << 8) | (data[j + 3]);
-	for ( ; i < 64; ++i)
-		m[i] = SIG1(m[i - 2]) + m[i - 7] + SIG0(m[i - 15]) + m[i - 16];
+	for ( ; blocks > 0; --blocks, data += 64) {
+		for (i = 0, j = 0; i < 16; ++i, j += 4)
+			m[i] = (data[j] << 24) | (data[j + 1] << 16) | (data[j + 2] << 8) | (data[j + 3]);
+		for ( ; i < 64; ++i)
+			m[i] = SIG1(m[i - 2]) + m[i - 7] + SIG0(m[i - 15]) + m[i - 16];
 
-	a = ctx->state[0];
-	b = ctx->state[1];
-	c = ctx->state[2];
-	d = ctx->state[3];
-	e = ctx->state[4];
-	f = ctx->state[5];
-	g = ctx->state[6];
-	h = ctx->state[7];
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+		f = state[5];
+		g = state[6];
+		h = state[7];
 
-	for (i = 0; i < 64; ++i) {
-		t1 = h + EP1(e) + CH(e,f,g) + k[i] + m[i];
-		t2 = EP0(a) + MAJ(a,b,c);
-		h = g;
-		g = f;
-		f = e;
-		e = d + t1;
-		d = c;
-		c = b;
-		b = a;
-		a = t1 + t2;
+		for (i = 0; i < 64; ++i) {
+			t1 = h + EP1(e) + CH(e,f,g) + k[i] + m[i];
+			t2 = EP0(a) + MAJ(a,b,c);
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+		state[5] += f;
+		state[6] += g;
+		state[7] += h;
+	}
+}
+
+#ifdef SHA256_SHANI
+// Four rounds on the message words m, i is the index of the group of four rounds.
+#define SHANI_ROUNDS(m,i) \
+	tmp = _mm_add_epi32(m, _mm_loadu_si128((const __m128i *) &k[(i) * 4])); \
+	state1 = _mm_sha256rnds2_epu32(state1, state0, tmp); \
+	state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(tmp, 0x0e))
+// Replaces the words t-16..t-13 in m0 by the words t..t+3, m1..m3 hold t-12..t-1.
+#define SHANI_SCHEDULE(m0,m1,m2,m3) \
+	m0 = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), _mm_alignr_epi8(m3, m2, 4)), m3)
+
+SHA256_SHANI_TARGET
+static void sha256_blocks_shani(WORD state[8], const BYTE *data, size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i state0, state1, abef, cdgh, tmp, m0, m1, m2, m3;
+
+	// The instructions take the state as ABEF and CDGH.
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &state[0]), 0xb1);
+	state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &state[4]), 0x1b);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+	for ( ; blocks > 0; --blocks, data += 64) {
+		abef = state0;
+		cdgh = state1;
+
+		m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 0)), mask);
+		m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), mask);
+		m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), mask);
+		m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), mask);
+
+		SHANI_ROUNDS(m0, 0);
+		SHANI_ROUNDS(m1, 1);
+		SHANI_ROUNDS(m2, 2);
+		SHANI_ROUNDS(m3, 3);
+		SHANI_SCHEDULE(m0, m1, m2, m3); SHANI_ROUNDS(m0, 4);
+		SHANI_SCHEDULE(m1, m2, m3, m0); SHANI_ROUNDS(m1, 5);
+		SHANI_SCHEDULE(m2, m3, m0, m1); SHANI_ROUNDS(m2, 6);
+		SHANI_SCHEDULE(m3, m0, m1, m2); SHANI_ROUNDS(m3, 7);
+		SHANI_SCHEDULE(m0, m1, m2, m3); SHANI_ROUNDS(m0, 8);
+		SHANI_SCHEDULE(m1, m2, m3, m0); SHANI_ROUNDS(m1, 9);
+		SHANI_SCHEDULE(m2, m3, m0, m1); SHANI_ROUNDS(m2, 10);
+		SHANI_SCHEDULE(m3, m0, m1, m2); SHANI_ROUNDS(m3, 11);
+		SHANI_SCHEDULE(m0, m1, m2, m3); SHANI_ROUNDS(m0, 12);
+		SHANI_SCHEDULE(m1, m2, m3, m0); SHANI_ROUNDS(m1, 13);
+		SHANI_SCHEDULE(m2, m3, m0, m1); SHANI_ROUNDS(m2, 14);
+		SHANI_SCHEDULE(m3, m0, m1, m2); SHANI_ROUNDS(m3, 15);
+
+		state0 = _mm_add_epi32(state0, abef);
+		state1 = _mm_add_epi32(state1, cdgh);
+	}
+
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i *) &state[0], state0);
+	_mm_storeu_si128((__m128i *) &state[4], state1);
+}
+
+static int sha256_has_shani(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+
+	__cpuid(1, eax, ebx, ecx, edx);
+	if (!(ecx & bit_SSE4_1))
+		return 0;
+
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return (ebx >> 29) & 1;
+}
+#endif
+
+#ifdef SHA256_ARMV8
+#define ARMV8_ROUNDS(m,i) \
+	tmp = vaddq_u32(m, vld1q_u32(&k[(i) * 4])); \
+	abcd_prev = abcd; \
+	abcd = vsha256hq_u32(abcd, efgh, tmp); \
+	efgh = vsha256h2q_u32(efgh, abcd_prev, tmp)
+#define ARMV8_SCHEDULE(m0,m1,m2,m3) \
+	m0 = vsha256su1q_u32(vsha256su0q_u32(m0, m1), m2, m3)
+
+SHA256_ARMV8_TARGET
+static void sha256_blocks_armv8(WORD state[8], const BYTE *data, size_t blocks)
+{
+	uint32x4_t abcd, efgh, abcd_save, efgh_save, abcd_prev, tmp, m0, m1, m2, m3;
+
+	abcd = vld1q_u32(&state[0]);
+	efgh = vld1q_u32(&state[4]);
+
+	for ( ; blocks > 0; --blocks, data += 64) {
+		abcd_save = abcd;
+		efgh_save = efgh;
+
+		m0 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 0)));
+		m1 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16)));
+		m2 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 32)));
+		m3 = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 48)));
+
+		ARMV8_ROUNDS(m0, 0);
+		ARMV8_ROUNDS(m1, 1);
+		ARMV8_ROUNDS(m2, 2);
+		ARMV8_ROUNDS(m3, 3);
+		ARMV8_SCHEDULE(m0, m1, m2, m3); ARMV8_ROUNDS(m0, 4);
+		ARMV8_SCHEDULE(m1, m2, m3, m0); ARMV8_ROUNDS(m1, 5);
+		ARMV8_SCHEDULE(m2, m3, m0, m1); ARMV8_ROUNDS(m2, 6);
+		ARMV8_SCHEDULE(m3, m0, m1, m2); ARMV8_ROUNDS(m3, 7);
+		ARMV8_SCHEDULE(m0, m1, m2, m3); ARMV8_ROUNDS(m0, 8);
+		ARMV8_SCHEDULE(m1, m2, m3, m0); ARMV8_ROUNDS(m1, 9);
+		ARMV8_SCHEDULE(m2, m3, m0, m1); ARMV8_ROUNDS(m2, 10);
+		ARMV8_SCHEDULE(m3, m0, m1, m2); ARMV8_ROUNDS(m3, 11);
+		ARMV8_SCHEDULE(m0, m1, m2, m3); ARMV8_ROUNDS(m0, 12);
+		ARMV8_SCHEDULE(m1, m2, m3, m0); ARMV8_ROUNDS(m1, 13);
+		ARMV8_SCHEDULE(m2, m3, m0, m1); ARMV8_ROUNDS(m2, 14);
+		ARMV8_SCHEDULE(m3, m0, m1, m2); ARMV8_ROUNDS(m3, 15);
+
+		abcd = vaddq_u32(abcd, abcd_save);
+		efgh = vaddq_u32(efgh, efgh_save);
+	}
+
+	vst1q_u32(&state[0], abcd);
+	vst1q_u32(&state[4], efgh);
+}
+
+static int sha256_has_armv8(void)
+{
+#if defined(__aarch64__)
+	return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+#else
+	return (getauxval(AT_HWCAP2) & HWCAP2_SHA2) != 0;
+#endif
+}
+#endif
+
+static void sha256_select(void)
+{
+	s_blocks = sha256_blocks_c;
+	s_name = "portable";
+
+#ifdef SHA256_SHANI
+	if (sha256_has_shani()) {
+		s_blocks = sha256_blocks_shani;
+		s_name = "sha-ni";
 	}
+#endif
+#ifdef SHA256_ARMV8
+	if (sha256_has_armv8()) {
+		s_blocks = sha256_blocks_armv8;
+		s_name = "armv8-ce";
+	}
+#endif
+}
+
+static sha256_blocks_fn sha256_kernel(void)
+{
+	pthread_once(&s_once, sha256_select);
+	return s_blocks;
+}
+
+// Name of the transform picked for this CPU, for the logs.
+const char *sha256_implementation(void)
+{
+	sha256_kernel();
+	return s_name;
+}
 
-	ctx->state[0] += a;
-	ctx->state[1] += b;
-	ctx->state[2] += c;
-	ctx->state[3] += d;
-	ctx->state[4] += e;
-	ctx->state[5] += f;
-	ctx->state[6] += g;
-	ctx->state[7] += h;
+void sha256_transform(SHA256_CTX *ctx, const BYTE data[])
+{
+	sha256_kernel()(ctx->state, data, 1);
 }
 
 void sha256_init(SHA256_CTX *ctx)
 {
 	ctx->datalen = 0;
 	ctx->bitlen = 0;
-	ctx->state[0] = 0x6a09e667;
-	ctx->state[1] = 0xbb67ae85;
-	ctx->state[2] = 0x3c6ef372;
-	ctx->state[3] = 0xa54ff53a;
-	ctx->state[4] = 0x510e527f;
-	ctx->state[5] = 0x9b05688c;
-	ctx->state[6] = 0x1f83d9ab;
-	ctx->state[7] = 0x5be0cd19;
+	memcpy(ctx->state, iv, sizeof(iv));
 }
 
 void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len)
 {
-	WORD i;
+	sha256_blocks_fn blocks = sha256_kernel();
+	size_t n;
 
-	for (i = 0; i < len; ++i) {
-		ctx->data[ctx->datalen] = data[i];
-		ctx->datalen++;
+	while (len > 0) {
+		// Whole blocks are compressed straight from the input.
+		if (ctx->datalen == 0 && len >= 64) {
+			n = len / 64;
+			blocks(ctx->state, data, n);
+			ctx->bitlen += (unsigned long long)n * 512;
+			data += n * 64;
+			len -= n * 64;
+			continue;
+		}
+
+		n = 64 - ctx->datalen < len ? 64 - ctx->datalen : len;
+		memcpy(ctx->data + ctx->datalen, data, n);
+		ctx->datalen += n;
+		data += n;
+		len -= n;
 		if (ctx->datalen == 64) {
-			sha256_transform(ctx, ctx->data);
+			blocks(ctx->state, ctx->data, 1);
 			ctx->bitlen += 512;
 			ctx->datalen = 0;
 		}
@@ -99,6 +332,7 @@ void sha256_update(SHA256_CTX *ctx, const BYTE data[], size_t len)
 
 void sha256_final(SHA256_CTX *ctx, BYTE hash[])
 {
+	sha256_blocks_fn blocks = sha256_kernel();
 	WORD i;
 
 	i = ctx->datalen;
@@ -113,7 +347,7 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
 		ctx->data[i++] = 0x80;
 		while (i < 64)
 			ctx->data[i++] = 0x00;
-		sha256_transform(ctx, ctx->data);
+		blocks(ctx->state, ctx->data, 1);
 		memset(ctx->data, 0, 56);
 	}
 
@@ -127,7 +361,7 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
 	ctx->data[58] = ctx->bitlen >> 40;
 	ctx->data[57] = ctx->bitlen >> 48;
 	ctx->data[56] = ctx->bitlen >> 56;
-	sha256_transform(ctx, ctx->data);
+	blocks(ctx->state, ctx->data, 1);
 
 	// Since this implementation uses little endian byte ordering and SHA uses big endian,
 	// reverse all the bytes when copying the final state to the output hash.
@@ -142,3 +376,143 @@ void sha256_final(SHA256_CTX *ctx, BYTE hash[])
 		hash[i + 28] = (ctx->state[7] >> (24 - i * 8)) & 0x000000ff;
 	}
 }
+
+#ifdef SHA256_VECTOR_LANES
+#define VROTRIGHT(a,b) (((a) >> (b)) | ((a) << (32-(b))))
+
+// Compresses one block of each lane into the lanes of the state.
+static void sha256_lanes_block(sha256_lanes_t state[8], const BYTE *const block[SHA256_LANES])
+{
+	sha256_lanes_t a, b, c, d, e, f, g, h, t1, t2, m[64];
+	int i, j;
+
+	for (i = 0; i < 16; ++i) {
+		for (j = 0; j < SHA256_LANES; ++j)
+			m[i][j] = (block[j][i * 4] << 24) | (block[j][i * 4 + 1] << 16) | (block[j][i * 4 + 2] << 8) | (block[j][i * 4 + 3]);
+	}
+	for ( ; i < 64; ++i) {
+		m[i] = (VROTRIGHT(m[i - 2], 17) ^ VROTRIGHT(m[i - 2], 19) ^ (m[i - 2] >> 10)) + m[i - 7]
+			+ (VROTRIGHT(m[i - 15], 7) ^ VROTRIGHT(m[i - 15], 18) ^ (m[i - 15] >> 3)) + m[i - 16];
+	}
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
+	f = state[5];
+	g = state[6];
+	h = state[7];
+
+	for (i = 0; i < 64; ++i) {
+		t1 = h + (VROTRIGHT(e, 6) ^ VROTRIGHT(e, 11) ^ VROTRIGHT(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + m[i];
+		t2 = (VROTRIGHT(a, 2) ^ VROTRIGHT(a, 13) ^ VROTRIGHT(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+	state[5] += f;
+	state[6] += g;
+	state[7] += h;
+}
+
+// Returns block n of the padded message, built in tail when it is not a whole block of the input.
+static const BYTE *sha256_padded_block(const BYTE *data, size_t len, size_t n, BYTE tail[64])
+{
+	size_t offset = n * 64;
+	unsigned long long bitlen = (unsigned long long)len * 8;
+	int i;
+
+	if (offset + 64 <= len)
+		return data + offset;
+
+	memset(tail, 0, 64);
+	if (offset <= len) {
+		memcpy(tail, data + offset, len - offset);
+		tail[len - offset] = 0x80;
+	}
+
+	// The last block ends with the length.
+	if (n == (len + 8) / 64) {
+		for (i = 0; i < 8; ++i)
+			tail[63 - i] = bitlen >> (i * 8);
+	}
+
+	return tail;
+}
+#endif
+
+// Hashes count independent messages. The crypto extensions take one message after the other,
+// the portable transform runs SHA256_LANES messages side by side in the lanes of the vector unit.
+void sha256_multi(const BYTE *const data[], const size_t len[], BYTE hash[][SHA256_BLOCK_SIZE], int count)
+{
+#ifdef SHA256_VECTOR_LANES
+	static const BYTE idle[64];
+	sha256_lanes_t state[8];
+	const BYTE *block[SHA256_LANES];
+	BYTE tail[SHA256_LANES][64];
+	int message[SHA256_LANES];
+	size_t next_block[SHA256_LANES];
+	int next = 0;
+	int active = 0;
+	int i, j;
+#endif
+	SHA256_CTX ctx;
+
+#ifdef SHA256_VECTOR_LANES
+	if (sha256_kernel() == sha256_blocks_c && count > 1) {
+		for (j = 0; j < SHA256_LANES; ++j) {
+			message[j] = -1;
+			for (i = 0; i < 8; ++i)
+				state[i][j] = iv[i];
+		}
+
+		for (;;) {
+			// Idle lanes take the next message, a finished lane starts over from the IV.
+			for (j = 0; j < SHA256_LANES; ++j) {
+				if (message[j] < 0 && next < count) {
+					message[j] = next++;
+					next_block[j] = 0;
+					for (i = 0; i < 8; ++i)
+						state[i][j] = iv[i];
+					active++;
+				}
+				block[j] = message[j] < 0 ? idle : sha256_padded_block(data[message[j]], len[message[j]], next_block[j], tail[j]);
+			}
+
+			if (active == 0)
+				break;
+
+			sha256_lanes_block(state, block);
+
+			for (j = 0; j < SHA256_LANES; ++j) {
+				if (message[j] < 0 || ++next_block[j] <= (len[message[j]] + 8) / 64)
+					continue;
+
+				for (i = 0; i < SHA256_BLOCK_SIZE; ++i)
+					hash[message[j]][i] = state[i / 4][j] >> (24 - (i % 4) * 8);
+				message[j] = -1;
+				active--;
+			}
+		}
+		return;
+	}
+#endif
+
+	for ( ; count > 0; --count, ++data, ++len, ++hash) {
+		sha256_init(&ctx);
+		sha256_update(&ctx, *data, *len);
+		sha256_final(&ctx, *hash);
+	}
+}
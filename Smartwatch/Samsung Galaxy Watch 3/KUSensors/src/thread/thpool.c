@@ -28,6 +28,29 @@
 #define THPOOL_DEBUG 0
 #endif
 
+/* Job slots of the lock-free ring, a power of two. Jobs beyond that wait
+ * in a locked list. */
+#ifndef THPOOL_QUEUE_SIZE
+#define THPOOL_QUEUE_SIZE 256
+#endif
+
+/* Polls of an empty queue before an idle thread goes to sleep */
+#ifndef THPOOL_SPIN_COUNT
+#define THPOOL_SPIN_COUNT 128
+#endif
+
+/* Give each thread its own deque of THPOOL_QUEUE_SIZE jobs. The jobs added
+ * by a thread of the pool go to its deque, and idle threads steal from the
+ * deques of the others before going to sleep. */
+#ifndef THPOOL_WORK_STEALING
+#define THPOOL_WORK_STEALING 0
+#endif
+
+#define THPOOL_CACHE_LINE 64
+
+typedef char thpool_queue_size_is_a_power_of_two[
+		(THPOOL_QUEUE_SIZE & (THPOOL_QUEUE_SIZE - 1)) == 0 ? 1 : -1];
+
 #if !defined(DISABLE_PRINT) || defined(THPOOL_DEBUG)
 #define err(str) fprintf(stderr, str)
 #else
@@ -37,17 +60,12 @@
 static volatile int threads_keepalive;
 static volatile int threads_on_hold;
 
+/* the pool thread running the caller, NULL outside of the pools */
+static __thread struct thread* thread_current;
 
 
-/* ========================== STRUCTURES ============================ */
 
-
-/* Binary semaphore */
-typedef struct bsem {
-	pthread_mutex_t mutex;
-	pthread_cond_t   cond;
-	int v;
-} bsem;
+/* ========================== STRUCTURES ============================ */
 
 
 /* Job */
@@ -58,16 +76,55 @@ typedef struct job{
 } job;
 
 
-/* Job queue */
+/* Slot of the job ring */
+typedef struct jobslot{
+	unsigned long seq;                   /* turn of the slot, see below */
+	void   (*function)(void* arg);       /* function pointer          */
+	void*  arg;                          /* function's argument       */
+} jobslot;
+
+
+/* Job queue
+ *
+ * A bounded multi-producer multi-consumer ring (D. Vyukov). The slot at
+ * position pos is free to push when its seq is pos, and holds a job to pull
+ * when its seq is pos + 1. Pulling hands the slot to the push one lap later.
+ * Jobs that find the ring full go to the overflow list, under rwmutex. Until
+ * the list is empty again, new jobs queue behind it, so that the jobs of one
+ * producer are pulled in the order they were added.
+ */
 typedef struct jobqueue{
-	pthread_mutex_t rwmutex;             /* used for queue r/w access */
-	job  *front;                         /* pointer to front of queue */
-	job  *rear;                          /* pointer to rear  of queue */
-	bsem *has_jobs;                      /* flag as binary semaphore  */
-	int   len;                           /* number of jobs in queue   */
+	volatile unsigned long push_pos;     /* next position to push     */
+	char pad0[THPOOL_CACHE_LINE - sizeof(unsigned long)];
+	volatile unsigned long pull_pos;     /* next position to pull     */
+	char pad1[THPOOL_CACHE_LINE - sizeof(unsigned long)];
+	jobslot *slots;                      /* THPOOL_QUEUE_SIZE slots   */
+	volatile int len;                    /* number of jobs in the pool */
+	pthread_mutex_t rwmutex;             /* used for the overflow list */
+	job  *front;                         /* front of the overflow list */
+	job  *rear;                          /* rear  of the overflow list */
+	volatile int overflow_len;           /* number of jobs in the list */
+	pthread_mutex_t sleep_mutex;         /* protects the sleep on has_jobs */
+	pthread_cond_t has_jobs;             /* signaled when jobs are pushed */
+	volatile int sleepers;               /* threads waiting on has_jobs */
+	int spin_count;                      /* polls before sleeping     */
 } jobqueue;
 
 
+/* Work-stealing deque (Chase and Lev, with the C11 orderings of Le et al.)
+ *
+ * The owner pushes and takes jobs at the bottom, the other threads steal
+ * them at the top. Only taking the last job and stealing race on top.
+ */
+typedef struct jobdeque{
+	long top;                            /* next position to steal    */
+	char pad0[THPOOL_CACHE_LINE - sizeof(long)];
+	long bottom;                         /* next position to push     */
+	char pad1[THPOOL_CACHE_LINE - sizeof(long)];
+	job  slots[THPOOL_QUEUE_SIZE];       /* prev is not used          */
+} jobdeque;
+
+
 /* Thread */
 typedef struct thread{
 	int       id;                        /* friendly id               */
@@ -79,6 +136,10 @@ typedef struct thread{
 /* Threadpool */
 typedef struct thpool_{
 	thread**   threads;                  /* pointer to threads        */
+	int        num_threads;              /* threads in the pool       */
+#if THPOOL_WORK_STEALING
+	jobdeque*  deques;                   /* deque of each thread      */
+#endif
 	volatile int num_threads_alive;      /* threads currently alive   */
 	volatile int num_threads_working;    /* threads currently working */
 	pthread_mutex_t  thcount_lock;       /* used for thread count etc */
@@ -93,23 +154,28 @@ typedef struct thpool_{
 /* ========================== PROTOTYPES ============================ */
 
 
+static int  thpool_add(thpool_* thpool_p, void (*function_p)(void*), void** args_p, int count, int shared);
 static int  thread_init(thpool_* thpool_p, struct thread** thread_p, int id);
 static void* thread_do(struct thread* thread_p);
+static int   thread_next_job(struct thread* thread_p, struct job* job_p);
 static void  thread_hold(int sig_id);
 static void  thread_destroy(struct thread* thread_p);
 
+#if THPOOL_WORK_STEALING
+static int   jobdeque_push(jobdeque* jobdeque_p, void (*function_p)(void*), void* arg_p);
+static int   jobdeque_take(jobdeque* jobdeque_p, struct job* job_p);
+static int   jobdeque_steal(jobdeque* jobdeque_p, struct job* job_p);
+#endif
+
 static int   jobqueue_init(jobqueue* jobqueue_p);
 static void  jobqueue_clear(jobqueue* jobqueue_p);
-static void  jobqueue_push(jobqueue* jobqueue_p, struct job* newjob_p);
-static struct job* jobqueue_pull(jobqueue* jobqueue_p);
+static int   jobqueue_put(jobqueue* jobqueue_p, void (*function_p)(void*), void* arg_p);
+static int   jobqueue_pull(jobqueue* jobqueue_p, struct job* job_p);
+static void  jobqueue_notify(jobqueue* jobqueue_p, int count);
+static void  jobqueue_wait(jobqueue* jobqueue_p);
+static void  jobqueue_wake_all(jobqueue* jobqueue_p);
 static void  jobqueue_destroy(jobqueue* jobqueue_p);
 
-static void  bsem_init(struct bsem *bsem_p, int value);
-static void  bsem_reset(struct bsem *bsem_p);
-static void  bsem_post(struct bsem *bsem_p);
-static void  bsem_post_all(struct bsem *bsem_p);
-static void  bsem_wait(struct bsem *bsem_p);
-
 
 
 
@@ -134,6 +200,7 @@ struct thpool_* thpool_init(int num_threads){
 		err("thpool_init(): Could not allocate memory for thread pool\n");
 		return NULL;
 	}
+	thpool_p->num_threads         = num_threads;
 	thpool_p->num_threads_alive   = 0;
 	thpool_p->num_threads_working = 0;
 
@@ -153,6 +220,18 @@ struct thpool_* thpool_init(int num_threads){
 		return NULL;
 	}
 
+#if THPOOL_WORK_STEALING
+	/* The deques are all set up before a thread can steal from them */
+	thpool_p->deques = (struct jobdeque*)calloc(num_threads ? num_threads : 1, sizeof(struct jobdeque));
+	if (thpool_p->deques == NULL){
+		err("thpool_init(): Could not allocate memory for job deques\n");
+		free(thpool_p->threads);
+		jobqueue_destroy(&thpool_p->jobqueue);
+		free(thpool_p);
+		return NULL;
+	}
+#endif
+
 	pthread_mutex_init(&(thpool_p->thcount_lock), NULL);
 	pthread_cond_init(&thpool_p->threads_all_idle, NULL);
 
@@ -174,21 +253,51 @@ struct thpool_* thpool_init(int num_threads){
 
 /* Add work to the thread pool */
 int thpool_add_work(thpool_* thpool_p, void (*function_p)(void*), void* arg_p){
-	job* newjob;
+	return thpool_add(thpool_p, function_p, &arg_p, 1, 0);
+}
 
-	newjob=(struct job*)malloc(sizeof(struct job));
-	if (newjob==NULL){
-		err("thpool_add_work(): Could not allocate memory for new job\n");
-		return -1;
+
+/* Add work to the shared queue, behind the jobs already queued */
+int thpool_add_work_shared(thpool_* thpool_p, void (*function_p)(void*), void* arg_p){
+	return thpool_add(thpool_p, function_p, &arg_p, 1, 1);
+}
+
+
+/* Add several jobs to the thread pool, with a single wakeup */
+int thpool_add_work_batch(thpool_* thpool_p, void (*function_p)(void*), void** args_p, int count){
+	return thpool_add(thpool_p, function_p, args_p, count, 0);
+}
+
+
+/* Add jobs to the deque of the calling thread when it is one of the pool and
+ * shared is 0, else to the shared queue */
+static int thpool_add(thpool_* thpool_p, void (*function_p)(void*), void** args_p, int count, int shared){
+	jobqueue* jobqueue_p = &thpool_p->jobqueue;
+	int n;
+
+	if (count <= 0){
+		return 0;
 	}
 
-	/* add function and argument */
-	newjob->function=function_p;
-	newjob->arg=arg_p;
+	/* Counted first, so that len never underflows in thpool_wait */
+	__sync_fetch_and_add(&jobqueue_p->len, count);
 
-	/* add job to queue */
-	jobqueue_push(&thpool_p->jobqueue, newjob);
+	for (n=0; n<count; n++){
+#if THPOOL_WORK_STEALING
+		if (!shared && thread_current && thread_current->thpool_p == thpool_p &&
+				jobdeque_push(&thpool_p->deques[thread_current->id], function_p, args_p[n]) == 0){
+			continue;
+		}
+#endif
+		if (jobqueue_put(jobqueue_p, function_p, args_p[n]) == -1){
+			err("thpool_add_work(): Could not allocate memory for new job\n");
+			__sync_fetch_and_sub(&jobqueue_p->len, count - n);
+			jobqueue_notify(jobqueue_p, n);
+			return -1;
+		}
+	}
 
+	jobqueue_notify(jobqueue_p, count);
 	return 0;
 }
 
@@ -219,14 +328,14 @@ void thpool_destroy(thpool_* thpool_p){
 	double tpassed = 0.0;
 	time (&start);
 	while (tpassed < TIMEOUT && thpool_p->num_threads_alive){
-		bsem_post_all(thpool_p->jobqueue.has_jobs);
+		jobqueue_wake_all(&thpool_p->jobqueue);
 		time (&end);
 		tpassed = difftime(end,start);
 	}
 
 	/* Poll remaining threads */
 	while (thpool_p->num_threads_alive){
-		bsem_post_all(thpool_p->jobqueue.has_jobs);
+		jobqueue_wake_all(&thpool_p->jobqueue);
 		sleep(1);
 	}
 
@@ -238,6 +347,9 @@ void thpool_destroy(thpool_* thpool_p){
 		thread_destroy(thpool_p->threads[n]);
 	}
 	free(thpool_p->threads);
+#if THPOOL_WORK_STEALING
+	free(thpool_p->deques);
+#endif
 	free(thpool_p);
 }
 
@@ -341,6 +453,8 @@ static void* thread_do(struct thread* thread_p){
 		err("thread_do(): cannot handle SIGUSR1");
 	}
 
+	thread_current = thread_p;
+
 	/* Mark thread as alive (initialized) */
 	pthread_mutex_lock(&thpool_p->thcount_lock);
 	thpool_p->num_threads_alive += 1;
@@ -348,31 +462,24 @@ static void* thread_do(struct thread* thread_p){
 
 	while(threads_keepalive){
 
-		bsem_wait(thpool_p->jobqueue.has_jobs);
+		jobqueue_wait(&thpool_p->jobqueue);
 
 		if (threads_keepalive){
 
-			pthread_mutex_lock(&thpool_p->thcount_lock);
-			thpool_p->num_threads_working++;
-			pthread_mutex_unlock(&thpool_p->thcount_lock);
+			/* Counted as working before the job leaves the queue, for thpool_wait */
+			__sync_fetch_and_add(&thpool_p->num_threads_working, 1);
 
 			/* Read job from queue and execute it */
-			void (*func_buff)(void*);
-			void*  arg_buff;
-			job* job_p = jobqueue_pull(&thpool_p->jobqueue);
-			if (job_p) {
-				func_buff = job_p->function;
-				arg_buff  = job_p->arg;
-				func_buff(arg_buff);
-				free(job_p);
+			job job_buff;
+			if (thread_next_job(thread_p, &job_buff)) {
+				job_buff.function(job_buff.arg);
 			}
 
-			pthread_mutex_lock(&thpool_p->thcount_lock);
-			thpool_p->num_threads_working--;
-			if (!thpool_p->num_threads_working) {
+			if (__sync_sub_and_fetch(&thpool_p->num_threads_working, 1) == 0) {
+				pthread_mutex_lock(&thpool_p->thcount_lock);
 				pthread_cond_signal(&thpool_p->threads_all_idle);
+				pthread_mutex_unlock(&thpool_p->thcount_lock);
 			}
-			pthread_mutex_unlock(&thpool_p->thcount_lock);
 
 		}
 	}
@@ -384,6 +491,43 @@ static void* thread_do(struct thread* thread_p){
 }
 
 
+/* Find the next job of a thread
+ *
+ * With THPOOL_WORK_STEALING, the newest job of its own deque, else the oldest
+ * job of the shared queue, else one stolen from the other threads.
+ * @return 1 if a job was copied to job_p, 0 if none was found
+ */
+static int thread_next_job(struct thread* thread_p, struct job* job_p){
+	thpool_* thpool_p = thread_p->thpool_p;
+#if THPOOL_WORK_STEALING
+	int n;
+	int victim;
+
+	if (jobdeque_take(&thpool_p->deques[thread_p->id], job_p)){
+		__sync_fetch_and_sub(&thpool_p->jobqueue.len, 1);
+		return 1;
+	}
+#endif
+
+	if (jobqueue_pull(&thpool_p->jobqueue, job_p)){
+		return 1;
+	}
+
+#if THPOOL_WORK_STEALING
+	/* start after itself so that the threads do not all rob the first one */
+	for (n=1; n<thpool_p->num_threads; n++){
+		victim = (thread_p->id + n) % thpool_p->num_threads;
+		if (jobdeque_steal(&thpool_p->deques[victim], job_p)){
+			__sync_fetch_and_sub(&thpool_p->jobqueue.len, 1);
+			return 1;
+		}
+	}
+#endif
+
+	return 0;
+}
+
+
 /* Frees a thread  */
 static void thread_destroy (thread* thread_p){
 	free(thread_p);
@@ -393,22 +537,118 @@ static void thread_destroy (thread* thread_p){
 
 
 
+/* ========================== WORK STEALING ========================== */
+
+#if THPOOL_WORK_STEALING
+
+/* Push a job at the bottom of a deque, by its owner only
+ * @return 0 on success, -1 if the deque is full
+ */
+static int jobdeque_push(jobdeque* jobdeque_p, void (*function_p)(void*), void* arg_p){
+	long b = __atomic_load_n(&jobdeque_p->bottom, __ATOMIC_RELAXED);
+	long t = __atomic_load_n(&jobdeque_p->top, __ATOMIC_ACQUIRE);
+	job* slot_p;
+
+	if (b - t >= THPOOL_QUEUE_SIZE){
+		return -1;
+	}
+
+	slot_p = &jobdeque_p->slots[b & (THPOOL_QUEUE_SIZE - 1)];
+	__atomic_store_n(&slot_p->function, function_p, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot_p->arg, arg_p, __ATOMIC_RELAXED);
+	__atomic_store_n(&jobdeque_p->bottom, b + 1, __ATOMIC_RELEASE);
+	return 0;
+}
+
+
+/* Take the newest job of a deque, by its owner only
+ * @return 1 if a job was taken, 0 if the deque is empty
+ */
+static int jobdeque_take(jobdeque* jobdeque_p, struct job* job_p){
+	long b = __atomic_load_n(&jobdeque_p->bottom, __ATOMIC_RELAXED) - 1;
+	long t;
+	job* slot_p;
+	int taken = 1;
+
+	__atomic_store_n(&jobdeque_p->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&jobdeque_p->top, __ATOMIC_RELAXED);
+
+	if (t > b){
+		/* empty */
+		__atomic_store_n(&jobdeque_p->bottom, b + 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	slot_p = &jobdeque_p->slots[b & (THPOOL_QUEUE_SIZE - 1)];
+	job_p->function = __atomic_load_n(&slot_p->function, __ATOMIC_RELAXED);
+	job_p->arg = __atomic_load_n(&slot_p->arg, __ATOMIC_RELAXED);
+	if (t == b){
+		/* the last job: race the thieves for it */
+		taken = __atomic_compare_exchange_n(&jobdeque_p->top, &t, t + 1, 0,
+				__ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+		__atomic_store_n(&jobdeque_p->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+	return taken;
+}
+
+
+/* Steal the oldest job of a deque, from any thread
+ * @return 1 if a job was stolen, 0 if the deque is empty or another thread won
+ */
+static int jobdeque_steal(jobdeque* jobdeque_p, struct job* job_p){
+	long t = __atomic_load_n(&jobdeque_p->top, __ATOMIC_ACQUIRE);
+	long b;
+	job* slot_p;
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	b = __atomic_load_n(&jobdeque_p->bottom, __ATOMIC_ACQUIRE);
+	if (t >= b){
+		return 0;
+	}
+
+	/* the slot may be reused as soon as top moves, the CAS tells */
+	slot_p = &jobdeque_p->slots[t & (THPOOL_QUEUE_SIZE - 1)];
+	job_p->function = __atomic_load_n(&slot_p->function, __ATOMIC_RELAXED);
+	job_p->arg = __atomic_load_n(&slot_p->arg, __ATOMIC_RELAXED);
+	return __atomic_compare_exchange_n(&jobdeque_p->top, &t, t + 1, 0,
+			__ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+#endif
+
+
+
+
+
 /* ============================ JOB QUEUE =========================== */
 
 
 /* Initialize queue */
 static int jobqueue_init(jobqueue* jobqueue_p){
+	unsigned long n;
+
 	jobqueue_p->len = 0;
+	jobqueue_p->push_pos = 0;
+	jobqueue_p->pull_pos = 0;
 	jobqueue_p->front = NULL;
 	jobqueue_p->rear  = NULL;
+	jobqueue_p->overflow_len = 0;
+	jobqueue_p->sleepers = 0;
+	/* a single core only makes the producer wait longer */
+	jobqueue_p->spin_count = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? THPOOL_SPIN_COUNT : 0;
 
-	jobqueue_p->has_jobs = (struct bsem*)malloc(sizeof(struct bsem));
-	if (jobqueue_p->has_jobs == NULL){
+	jobqueue_p->slots = (struct jobslot*)malloc(THPOOL_QUEUE_SIZE * sizeof(struct jobslot));
+	if (jobqueue_p->slots == NULL){
 		return -1;
 	}
+	for (n=0; n<THPOOL_QUEUE_SIZE; n++){
+		jobqueue_p->slots[n].seq = n;
+	}
 
 	pthread_mutex_init(&(jobqueue_p->rwmutex), NULL);
-	bsem_init(jobqueue_p->has_jobs, 0);
+	pthread_mutex_init(&(jobqueue_p->sleep_mutex), NULL);
+	pthread_cond_init(&(jobqueue_p->has_jobs), NULL);
 
 	return 0;
 }
@@ -416,132 +656,207 @@ static int jobqueue_init(jobqueue* jobqueue_p){
 
 /* Clear the queue */
 static void jobqueue_clear(jobqueue* jobqueue_p){
+	job job_buff;
 
-	while(jobqueue_p->len){
-		free(jobqueue_pull(jobqueue_p));
+	while(jobqueue_pull(jobqueue_p, &job_buff)){
 	}
 
-	jobqueue_p->front = NULL;
-	jobqueue_p->rear  = NULL;
-	bsem_reset(jobqueue_p->has_jobs);
-	jobqueue_p->len = 0;
-
 }
 
 
-/* Add (allocated) job to queue
+/* Put a job in a free slot of the ring
+ * @return 0 on success, -1 if the ring is full
  */
-static void jobqueue_push(jobqueue* jobqueue_p, struct job* newjob){
-
-	pthread_mutex_lock(&jobqueue_p->rwmutex);
-	newjob->prev = NULL;
-
-	switch(jobqueue_p->len){
-
-		case 0:  /* if no jobs in queue */
-					jobqueue_p->front = newjob;
-					jobqueue_p->rear  = newjob;
-					break;
-
-		default: /* if jobs in queue */
-					jobqueue_p->rear->prev = newjob;
-					jobqueue_p->rear = newjob;
-
+static int jobqueue_ring_push(jobqueue* jobqueue_p, void (*function_p)(void*), void* arg_p){
+	unsigned long pos = jobqueue_p->push_pos;
+	jobslot* slot_p;
+	long dif;
+
+	for (;;){
+		slot_p = &jobqueue_p->slots[pos & (THPOOL_QUEUE_SIZE - 1)];
+		dif = (long)(__atomic_load_n(&slot_p->seq, __ATOMIC_ACQUIRE) - pos);
+		if (dif == 0){
+			if (__sync_bool_compare_and_swap(&jobqueue_p->push_pos, pos, pos + 1))
+				break;
+			pos = jobqueue_p->push_pos;
+		}
+		else if (dif < 0){
+			return -1;
+		}
+		else {
+			pos = jobqueue_p->push_pos;
+		}
 	}
-	jobqueue_p->len++;
 
-	bsem_post(jobqueue_p->has_jobs);
-	pthread_mutex_unlock(&jobqueue_p->rwmutex);
+	slot_p->function = function_p;
+	slot_p->arg = arg_p;
+	/* publish the job with the slot */
+	__atomic_store_n(&slot_p->seq, pos + 1, __ATOMIC_RELEASE);
+	return 0;
 }
 
 
-/* Get first job from queue(removes it from queue)
- * Notice: Caller MUST hold a mutex
+/* Take the oldest job of the ring
+ * @return 1 if a job was taken, 0 if the ring is empty
  */
-static struct job* jobqueue_pull(jobqueue* jobqueue_p){
-
-	pthread_mutex_lock(&jobqueue_p->rwmutex);
-	job* job_p = jobqueue_p->front;
+static int jobqueue_ring_pull(jobqueue* jobqueue_p, struct job* job_p){
+	unsigned long pos = jobqueue_p->pull_pos;
+	jobslot* slot_p;
+	long dif;
+
+	for (;;){
+		slot_p = &jobqueue_p->slots[pos & (THPOOL_QUEUE_SIZE - 1)];
+		dif = (long)(__atomic_load_n(&slot_p->seq, __ATOMIC_ACQUIRE) - (pos + 1));
+		if (dif == 0){
+			if (__sync_bool_compare_and_swap(&jobqueue_p->pull_pos, pos, pos + 1))
+				break;
+			pos = jobqueue_p->pull_pos;
+		}
+		else if (dif < 0){
+			return 0;
+		}
+		else {
+			pos = jobqueue_p->pull_pos;
+		}
+	}
 
-	switch(jobqueue_p->len){
+	job_p->function = slot_p->function;
+	job_p->arg = slot_p->arg;
+	/* read the job before handing the slot back */
+	__atomic_store_n(&slot_p->seq, pos + THPOOL_QUEUE_SIZE, __ATOMIC_RELEASE);
+	return 1;
+}
 
-		case 0:  /* if no jobs in queue */
-		  			break;
 
-		case 1:  /* if one job in queue */
-					jobqueue_p->front = NULL;
-					jobqueue_p->rear  = NULL;
-					jobqueue_p->len = 0;
-					break;
+/* Add job to queue
+ *
+ * The caller counts the job in len and calls jobqueue_notify().
+ * @return 0 on success, -1 if the ring is full and no memory is left
+ */
+static int jobqueue_put(jobqueue* jobqueue_p, void (*function_p)(void*), void* arg_p){
+	job* newjob;
 
-		default: /* if >1 jobs in queue */
-					jobqueue_p->front = job_p->prev;
-					jobqueue_p->len--;
-					/* more than one job in queue -> post it */
-					bsem_post(jobqueue_p->has_jobs);
+	/* the ring is only newer than the list once the list is empty */
+	if (!jobqueue_p->overflow_len && jobqueue_ring_push(jobqueue_p, function_p, arg_p) == 0){
+		return 0;
+	}
 
+	newjob=(struct job*)malloc(sizeof(struct job));
+	if (newjob==NULL){
+		return -1;
 	}
+	newjob->function=function_p;
+	newjob->arg=arg_p;
+	newjob->prev = NULL;
 
+	pthread_mutex_lock(&jobqueue_p->rwmutex);
+	if (jobqueue_p->rear == NULL){
+		jobqueue_p->front = newjob;
+	}
+	else {
+		jobqueue_p->rear->prev = newjob;
+	}
+	jobqueue_p->rear = newjob;
+	jobqueue_p->overflow_len++;
 	pthread_mutex_unlock(&jobqueue_p->rwmutex);
-	return job_p;
+
+	return 0;
 }
 
 
-/* Free all queue resources back to the system */
-static void jobqueue_destroy(jobqueue* jobqueue_p){
-	jobqueue_clear(jobqueue_p);
-	free(jobqueue_p->has_jobs);
-}
+/* Wake sleeping threads for count new jobs
+ *
+ * The increment of len before the jobs were added is a full barrier: either
+ * this sees a sleeper, or the sleeper sees len before it waits.
+ */
+static void jobqueue_notify(jobqueue* jobqueue_p, int count){
+	if (count <= 0 || !jobqueue_p->sleepers){
+		return;
+	}
 
+	pthread_mutex_lock(&jobqueue_p->sleep_mutex);
+	if (count == 1){
+		pthread_cond_signal(&jobqueue_p->has_jobs);
+	}
+	else {
+		pthread_cond_broadcast(&jobqueue_p->has_jobs);
+	}
+	pthread_mutex_unlock(&jobqueue_p->sleep_mutex);
+}
 
 
+/* Get first job from queue(removes it from queue)
+ * @return 1 if a job was copied to job_p, 0 if the queue is empty
+ */
+static int jobqueue_pull(jobqueue* jobqueue_p, struct job* job_p){
+	job* oldjob = NULL;
 
+	if (jobqueue_ring_pull(jobqueue_p, job_p)){
+		__sync_fetch_and_sub(&jobqueue_p->len, 1);
+		return 1;
+	}
 
-/* ======================== SYNCHRONISATION ========================= */
+	if (!jobqueue_p->overflow_len){
+		return 0;
+	}
 
+	pthread_mutex_lock(&jobqueue_p->rwmutex);
+	oldjob = jobqueue_p->front;
+	if (oldjob){
+		jobqueue_p->front = oldjob->prev;
+		if (jobqueue_p->front == NULL){
+			jobqueue_p->rear = NULL;
+		}
+		jobqueue_p->overflow_len--;
+	}
+	pthread_mutex_unlock(&jobqueue_p->rwmutex);
 
-/* Init semaphore to 1 or 0 */
-static void bsem_init(bsem *bsem_p, int value) {
-	if (value < 0 || value > 1) {
-		err("bsem_init(): Binary semaphore can take only values 1 or 0");
-		exit(1);
+	if (oldjob == NULL){
+		return 0;
 	}
-	pthread_mutex_init(&(bsem_p->mutex), NULL);
-	pthread_cond_init(&(bsem_p->cond), NULL);
-	bsem_p->v = value;
+
+	*job_p = *oldjob;
+	free(oldjob);
+	__sync_fetch_and_sub(&jobqueue_p->len, 1);
+	return 1;
 }
 
 
-/* Reset semaphore to 0 */
-static void bsem_reset(bsem *bsem_p) {
-	bsem_init(bsem_p, 0);
-}
+/* Wait until the queue may have jobs or the pool is destroyed
+ *
+ * Polls the queue THPOOL_SPIN_COUNT times before sleeping on a multi-core
+ * system, so that a busy pool hands jobs over without going through the
+ * kernel.
+ */
+static void jobqueue_wait(jobqueue* jobqueue_p){
+	int n;
 
+	for (n=0; n<jobqueue_p->spin_count; n++){
+		if (jobqueue_p->len || !threads_keepalive){
+			return;
+		}
+	}
 
-/* Post to at least one thread */
-static void bsem_post(bsem *bsem_p) {
-	pthread_mutex_lock(&bsem_p->mutex);
-	bsem_p->v = 1;
-	pthread_cond_signal(&bsem_p->cond);
-	pthread_mutex_unlock(&bsem_p->mutex);
+	pthread_mutex_lock(&jobqueue_p->sleep_mutex);
+	__sync_fetch_and_add(&jobqueue_p->sleepers, 1);
+	while (!jobqueue_p->len && threads_keepalive){
+		pthread_cond_wait(&jobqueue_p->has_jobs, &jobqueue_p->sleep_mutex);
+	}
+	__sync_fetch_and_sub(&jobqueue_p->sleepers, 1);
+	pthread_mutex_unlock(&jobqueue_p->sleep_mutex);
 }
 
 
-/* Post to all threads */
-static void bsem_post_all(bsem *bsem_p) {
-	pthread_mutex_lock(&bsem_p->mutex);
-	bsem_p->v = 1;
-	pthread_cond_broadcast(&bsem_p->cond);
-	pthread_mutex_unlock(&bsem_p->mutex);
+/* Wake all the sleeping threads */
+static void jobqueue_wake_all(jobqueue* jobqueue_p){
+	pthread_mutex_lock(&jobqueue_p->sleep_mutex);
+	pthread_cond_broadcast(&jobqueue_p->has_jobs);
+	pthread_mutex_unlock(&jobqueue_p->sleep_mutex);
 }
 
 
-/* Wait on semaphore until semaphore has value 0 */
-static void bsem_wait(bsem* bsem_p) {
-	pthread_mutex_lock(&bsem_p->mutex);
-	while (bsem_p->v != 1) {
-		pthread_cond_wait(&bsem_p->cond, &bsem_p->mutex);
-	}
-	bsem_p->v = 0;
-	pthread_mutex_unlock(&bsem_p->mutex);
+/* Free all queue resources back to the system */
+static void jobqueue_destroy(jobqueue* jobqueue_p){
+	jobqueue_clear(jobqueue_p);
+	free(jobqueue_p->slots);
 }
@@ -23,7 +23,6 @@
 #include "data.h"
 #include "view_defines.h"
 // added by dmkang
-#include "mqtt.h"
 #include <system_info.h>
 
 typedef struct _sensor_text_format {
@@ -186,13 +185,6 @@ void view_data_update_sensor_values(int count, float *values)
 	char value_part[NAME_MAX];
 	char name_string[NAME_MAX];
 	char value_string[NAME_MAX];
-	// added by dmkang
-	char mqtt_string[1024] = {0,};
-	char mqtt_string_buf[1024] = {0,};
-	char temp[128] = {0,};
-	static int transactionId = 0;
-	time_t timestamp = 0;
-
 
 	if (current_sensor_count != count) {
 		current_sensor_count = count;
@@ -204,49 +196,20 @@ void view_data_update_sensor_values(int count, float *values)
 	if (s_info.position == SENSOR_HRM)
 		values[1] = values[2];
 
-	// added by dmkang
-	timestamp = time(NULL);
-	snprintf(mqtt_string, sizeof(mqtt_string),
-			"{\"transaction_id\":%d,"
-			"\"timestamp\":%ld,"
-			"\"sensor_type\":%d,"
-			"\"sensor_data\":{", transactionId++, timestamp, s_info.position);
-
 	for (i = 0; i < MAX_VALUES_PER_SENSOR; ++i) {
 		snprintf(name_part, NAME_MAX, "%s%d", PART_DATA_PARAM_NAME, i);
 		snprintf(value_part, NAME_MAX, "%s%d", PART_DATA_PARAM_VALUE, i);
 
-		if (strlen(s_info.text_formats[s_info.position].param_name[i]) > 0) {
+		if (strlen(s_info.text_formats[s_info.position].param_name[i]) > 0)
 			snprintf(name_string, NAME_MAX, "%s=", s_info.text_formats[s_info.position].param_name[i]);
-			// added by dmkang
-			memcpy(mqtt_string_buf, mqtt_string, sizeof(mqtt_string_buf));
-			snprintf(temp, sizeof(temp), "\"%s\":%0.2f,", s_info.text_formats[s_info.position].param_name[i], values[i]);
-			snprintf(mqtt_string, sizeof(mqtt_string), "%s%s", mqtt_string_buf, temp);
-			memset(temp, 0, sizeof(temp));
-			memset(mqtt_string_buf, 0, sizeof(mqtt_string_buf));
-		}
-		else {
+		else
 			snprintf(name_string, NAME_MAX, "");
-		}
 
 		snprintf(value_string, NAME_MAX, s_info.text_formats[s_info.position].value_format[i], values[i]);
 
 		elm_layout_text_set(elm_object_item_content_get(s_info.naviframe_item), name_part, name_string);
 		elm_layout_text_set(elm_object_item_content_get(s_info.naviframe_item), value_part, value_string);
 	}
-
-	// added by dmkang
-#if 0
-	memcpy(mqtt_string_buf, mqtt_string, sizeof(mqtt_string_buf));
-	snprintf(temp, sizeof(temp), "\"BP\":{\"high\":120,\"low\":80},");
-	snprintf(mqtt_string, sizeof(mqtt_string), "%s%s", mqtt_string_buf, temp);
-#endif
-
-	mqtt_string[strlen(mqtt_string)-1] = '}';
-	mqtt_string[strlen(mqtt_string)] = '}';
-
-	//TODO - porting JSON parser lib.
-	mqttPublish(mqtt_string);
 }
 
 /**
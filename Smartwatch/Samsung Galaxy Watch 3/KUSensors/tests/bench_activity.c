@@ -0,0 +1,137 @@
+/*
+ * bench_activity.c
+ *
+ * Time per sample of the activity classifier, fed in the batch sizes of the
+ * capture, and the summaries it writes.
+ *
+ * The accelerometer samples come from a trace recorded by the host build
+ * (kusensors-host -r trace) when one is given, from a synthetic 6 min capture
+ * at 100 Hz otherwise: 2 min still, 2 min walking, 2 min running.
+ *
+ * usage: bench_activity [trace]
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include "activity.h"
+#include "test.h"
+
+#define MAX_SAMPLES		200000
+#define MIN_SECONDS		0.5
+
+static record_t s_samples[MAX_SAMPLES];
+static record_t s_work[MAX_SAMPLES];
+static int s_count;
+
+/* the accelerometer records of the trace, the only source of the summaries on the host */
+static bool _load_trace(const char *path)
+{
+	unsigned long long timestamp_us;
+	record_t *record;
+	float value;
+	int type;
+	int value_count;
+	int i;
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+		return false;
+
+	while (s_count < MAX_SAMPLES && fscanf(f, "%d %llu %d", &type, &timestamp_us, &value_count) == 3) {
+		record = &s_samples[s_count];
+		record->sensor_type = type;
+		record->timestamp_ms = timestamp_us / 1000;
+		record->value_count = value_count < RECORD_MAX_VALUES ? value_count : RECORD_MAX_VALUES;
+		for (i = 0; i < value_count; ++i) {
+			if (fscanf(f, "%f", &value) != 1)
+				break;
+			if (i < RECORD_MAX_VALUES)
+				record->values[i] = value;
+		}
+		if (type == 0 && value_count >= 3)
+			s_count++;
+	}
+	fclose(f);
+
+	return s_count > 0;
+}
+
+static void _synthesize(void)
+{
+	static const double frequencies[] = { 0, 1.8, 2.7 };
+	static const double amplitudes[] = { 0.02, 2.0, 5.0 };
+	unsigned long long seed = 4;
+	record_t *record;
+	double t;
+	int segment;
+	int i;
+
+	for (segment = 0; segment < 3; ++segment) {
+		for (i = 0; i < 12000; ++i) {
+			t = i / 100.0;
+			record = &s_samples[s_count];
+			record->sensor_type = 0;
+			record->timestamp_ms = 1700000000000LL + s_count * 10LL;
+			record->value_count = 3;
+			record->values[0] = 0.3 * sin(t);
+			record->values[1] = amplitudes[segment] * 0.3 * sin(2 * M_PI * frequencies[segment] * t + 1);
+			record->values[2] = 9.8 + amplitudes[segment] * sin(2 * M_PI * frequencies[segment] * t) +
+					0.05 * ((int)(test_random(&seed) % 101) - 50) / 50.0;
+			s_count++;
+		}
+	}
+}
+
+/* feeds a copy of the samples in batches until MIN_SECONDS went by, returns the seconds per round */
+static double _run(int batch_size, int *summaries)
+{
+	record_t summary;
+	double start;
+	double busy = 0;
+	double t0;
+	int rounds = 0;
+	int base;
+	int n;
+
+	start = test_now();
+	do {
+		memcpy(s_work, s_samples, s_count * sizeof(record_t));
+		activity_reset();
+		*summaries = 0;
+
+		t0 = test_now();
+		for (base = 0; base < s_count; base += n) {
+			n = s_count - base < batch_size ? s_count - base : batch_size;
+			*summaries += activity_summarize(s_work + base, n);
+		}
+		*summaries += activity_flush(&summary);
+		busy += test_now() - t0;
+		rounds++;
+	} while (test_now() - start < MIN_SECONDS);
+
+	return busy / rounds;
+}
+
+int main(int argc, char *argv[])
+{
+	const int batch_sizes[] = { 1, 10, 64, 100, 1000 };
+	double seconds;
+	int summaries;
+	int i;
+
+	if (argc > 1 && !_load_trace(argv[1])) {
+		fprintf(stderr, "Can't read the accelerometer of the trace %s\n", argv[1]);
+		return 1;
+	}
+	if (s_count == 0)
+		_synthesize();
+
+	printf("%d samples from %s\n", s_count, argc > 1 ? argv[1] : "the synthetic capture");
+	printf("batch  ns/sample  summaries\n");
+	for (i = 0; i < sizeof(batch_sizes) / sizeof(batch_sizes[0]); ++i) {
+		seconds = _run(batch_sizes[i], &summaries);
+		printf("%5d  %9.1f  %9d\n", batch_sizes[i], seconds * 1e9 / s_count, summaries);
+	}
+
+	return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * bench_columnar.c
+ *
+ * Bytes per sample and encode/decode time per sample of the batch formats:
+ * the JSON records, the binary records, the columnar batches and the
+ * deflated columnar batches, for the batch size of the app and a larger one.
+ *
+ * The samples come from a trace recorded by the host build (kusensors-host
+ * -r trace) when one is given, from a synthetic 60 s capture otherwise:
+ * accelerometer and gyroscope at 100 Hz, magnetic at 50 Hz, pressure at
+ * 25 Hz and the HRM at 4 Hz, with the noise and the timer jitter of a watch.
+ *
+ * usage: bench_columnar [trace]
+ */
+
+#include <stdlib.h>
+#include "batch.h"
+#include "columnar.h"
+#include "record.h"
+#include "test.h"
+
+#define MAX_SAMPLES		100000
+#define BIG_BATCH		500
+#define MIN_SECONDS		0.5
+
+/* the resolutions reported by host/stubs/sensor.c, which batch_set_quantum() gets in the app */
+static const float s_resolutions[14] = {
+	0.0023946f, 0.0023946f, 0.0023946f, 0.15f, 0.000001f, 0.01f, 0.0175f,
+	1.0f, 5.0f, 0.01f, 0.01f, 0.01f, 0.01f, 1.0f,
+};
+
+static record_t s_samples[MAX_SAMPLES];
+static int s_count;
+static float s_quantum[COLUMNAR_MAX_TYPES];
+
+static bool _load_trace(const char *path)
+{
+	unsigned long long timestamp_us;
+	record_t *record;
+	int type;
+	int value_count;
+	int i;
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+		return false;
+
+	while (s_count < MAX_SAMPLES && fscanf(f, "%d %llu %d", &type, &timestamp_us, &value_count) == 3) {
+		record = &s_samples[s_count++];
+		record->sensor_type = type;
+		record->timestamp_ms = timestamp_us / 1000;
+		record->value_count = value_count < RECORD_MAX_VALUES ? value_count : RECORD_MAX_VALUES;
+		for (i = 0; i < value_count; ++i) {
+			float value;
+
+			if (fscanf(f, "%f", &value) != 1)
+				break;
+			if (i < RECORD_MAX_VALUES)
+				record->values[i] = value;
+		}
+	}
+	fclose(f);
+
+	return s_count > 0;
+}
+
+/* a value of the sensor, with a few steps of noise */
+static float _noisy(unsigned long long *seed, double value, int type)
+{
+	int steps = (int)(test_random(seed) % 7) - 3;
+
+	return (float)(value + steps * s_resolutions[type]);
+}
+
+static void _add(unsigned long long *seed, int type, long long t_ms, int value_count, const double *values)
+{
+	record_t *record;
+	int i;
+
+	if (s_count == MAX_SAMPLES)
+		return;
+
+	record = &s_samples[s_count++];
+	record->sensor_type = type;
+	/* the timer of the sensor hub is late by a millisecond now and then */
+	record->timestamp_ms = 1600000000000LL + t_ms + (test_random(seed) % 8 == 0);
+	record->value_count = value_count;
+	for (i = 0; i < value_count; ++i)
+		record->values[i] = _noisy(seed, values[i], type);
+}
+
+/* the samples sorted by time, the way the capture hands them to the batches */
+static void _synthesize(void)
+{
+	unsigned long long seed = 3;
+	double values[4];
+	double t;
+	long long ms;
+
+	for (ms = 0; ms < 60000; ms += 10) {
+		t = ms / 1000.0;
+		values[0] = 0.6 * cos(2 * M_PI * 1.8 * t);
+		values[1] = 0.4 * sin(2 * M_PI * 1.8 * t);
+		values[2] = 9.81 + 2.5 * sin(2 * M_PI * 1.8 * t);
+		_add(&seed, 0, ms, 3, values);
+
+		values[0] = 5.0 * cos(2 * M_PI * 1.8 * t);
+		values[1] = 3.0 * sin(2 * M_PI * 1.8 * t);
+		values[2] = 0.3 * cos(2 * M_PI * 0.05 * t);
+		_add(&seed, 6, ms, 3, values);
+
+		if (ms % 20 == 0) {
+			values[0] = 20.0 * cos(0.3 * sin(2 * M_PI * 0.05 * t));
+			values[1] = -20.0 * sin(0.3 * sin(2 * M_PI * 0.05 * t));
+			values[2] = -40.0;
+			_add(&seed, 3, ms, 3, values);
+		}
+		if (ms % 40 == 0) {
+			values[0] = 1013.25 + 0.02 * sin(2 * M_PI * 0.01 * t);
+			_add(&seed, 9, ms, 1, values);
+		}
+		if (ms % 250 == 0) {
+			values[0] = 70;
+			values[1] = 0;
+			values[2] = 857 + 40 * sin(2 * M_PI * ms / 3428.0);
+			_add(&seed, 13, ms, 3, values);
+		}
+	}
+}
+
+typedef struct result {
+	size_t bytes;
+	double encode_s;
+	double decode_s;
+	int rounds;
+} result_t;
+
+/* encodes, then decodes, every batch of the samples until MIN_SECONDS went by */
+static void _run(int format, int batch_size, result_t *result)
+{
+	static unsigned char buf[COLUMNAR_MAX_SIZE(BIG_BATCH) + BIG_BATCH * RECORD_MAX_JSON_SIZE];
+	static record_t decoded[BIG_BATCH];
+	record_reader_t reader;
+	double start;
+	double t0;
+	double t1;
+	size_t len;
+	int first;
+	int count;
+	int i;
+
+	memset(result, 0, sizeof(*result));
+	start = test_now();
+	do {
+		result->bytes = 0;
+		for (first = 0; first < s_count; first += batch_size) {
+			count = s_count - first < batch_size ? s_count - first : batch_size;
+			t0 = test_now();
+
+			len = 0;
+			switch (format) {
+			case 0:
+				/* the JSON array of the records */
+				for (i = 0; i < count; ++i)
+					len += record_write_json(&s_samples[first + i], first + i, (char *)buf + len, sizeof(buf) - len) + 1;
+				len++;
+				break;
+			case 1:
+				len = record_write_header(buf, sizeof(buf), first, s_samples[first].timestamp_ms);
+				for (i = 0; i < count; ++i)
+					len += record_write_binary(&s_samples[first + i],
+							i ? s_samples[first + i - 1].timestamp_ms : s_samples[first].timestamp_ms, buf + len, sizeof(buf) - len);
+				record_set_header_count(buf, count);
+				break;
+			default:
+				len = columnar_encode(&s_samples[first], count, first, s_quantum, format == 3, buf, sizeof(buf));
+				break;
+			}
+
+			t1 = test_now();
+
+			if (format == 1) {
+				record_reader_init(&reader, buf, len);
+				while (record_reader_next(&reader, &decoded[0]) == 1)
+					;
+			} else if (format > 1 && columnar_decode(buf, len, NULL, decoded, count) != count) {
+				fprintf(stderr, "batch %d does not decode\n", first);
+				exit(1);
+			}
+
+			result->encode_s += t1 - t0;
+			result->decode_s += test_now() - t1;
+			result->bytes += len;
+		}
+		result->rounds++;
+	} while (test_now() - start < MIN_SECONDS);
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *formats[] = { "JSON", "binary", "columnar", "columnar+deflate" };
+	const int batch_sizes[] = { BATCH_MAX_SAMPLES, BIG_BATCH };
+	result_t result;
+	char decode[32];
+	double samples;
+	int format;
+	int i;
+
+	if (argc > 1 && !_load_trace(argv[1])) {
+		fprintf(stderr, "Can't read the trace %s\n", argv[1]);
+		return 1;
+	}
+	if (s_count == 0)
+		_synthesize();
+
+	for (i = 0; i < sizeof(s_resolutions) / sizeof(s_resolutions[0]); ++i)
+		s_quantum[i] = s_resolutions[i];
+
+	printf("%d samples from %s\n", s_count, argc > 1 ? argv[1] : "the synthetic capture");
+	printf("batch  format            bytes/sample  encode ns/sample  decode ns/sample\n");
+	for (i = 0; i < sizeof(batch_sizes) / sizeof(batch_sizes[0]); ++i) {
+		for (format = 0; format < 4; ++format) {
+			_run(format, batch_sizes[i], &result);
+			samples = (double)s_count * result.rounds;
+			/* the JSON is not parsed on the watch */
+			if (format == 0)
+				snprintf(decode, sizeof(decode), "-");
+			else
+				snprintf(decode, sizeof(decode), "%.1f", result.decode_s * 1e9 / samples);
+			printf("%5d  %-16s  %12.2f  %16.1f  %16s\n", batch_sizes[i], formats[format],
+					(double)result.bytes / s_count, result.encode_s * 1e9 / samples, decode);
+		}
+	}
+
+	return 0;
+}
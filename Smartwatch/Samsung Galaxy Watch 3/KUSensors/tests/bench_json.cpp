@@ -0,0 +1,149 @@
+/*
+ * bench_json.cpp
+ *
+ * Parsing, lookups, serialization and copies of Json::Value trees, built
+ * with the std::map storage and, as bench_json_flat, with the flat storage
+ * of JSON_USE_FLAT_OBJECT, on a sensor document (200 records of 6 fields)
+ * and on one object of 10000 members. The allocations are counted by
+ * replacing the global operator new.
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <json/json.h>
+#include "test.h"
+
+#define LARGE_MEMBERS	10000
+
+static size_t s_allocations;
+
+void *operator new(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+
+	if (!p)
+		throw std::bad_alloc();
+	s_allocations++;
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+static std::string _sensor_document(void)
+{
+	std::string text = "[";
+	int i;
+
+	for (i = 0; i < 200; ++i) {
+		if (i)
+			text += ",";
+		text += "{\"type\":\"accel\",\"ts\":" + std::to_string(1700000000000LL + i) +
+				",\"x\":0.12,\"y\":-9.81,\"z\":0.33,\"acc\":3}";
+	}
+
+	return text + "]";
+}
+
+static std::string _large_document(void)
+{
+	std::string text = "{";
+	int i;
+
+	for (i = 0; i < LARGE_MEMBERS; ++i) {
+		if (i)
+			text += ",";
+		text += "\"member" + std::to_string(i) + "\":{\"v\":" + std::to_string(i) + ",\"n\":\"x\"}";
+	}
+
+	return text + "}";
+}
+
+static long _lookups(const Json::Value& root, bool sensor, int *count)
+{
+	long sum = 0;
+	int i;
+
+	if (sensor) {
+		for (i = 0; i < (int)root.size(); ++i) {
+			sum += root[i]["acc"].asInt();
+			sum += root[i]["ts"].asInt64() & 1;
+			*count += 2;
+		}
+	} else {
+		for (i = 0; i < LARGE_MEMBERS; ++i) {
+			sum += root["member" + std::to_string(i)]["v"].asInt();
+			*count += 2;
+		}
+	}
+
+	return sum;
+}
+
+static void _run(const char *name, const std::string& text, bool sensor, int iterations)
+{
+	Json::CharReaderBuilder reader_builder;
+	std::unique_ptr<Json::CharReader> reader(reader_builder.newCharReader());
+	Json::StreamWriterBuilder builder;
+	Json::Value root;
+	double parse, lookup, write, copy;
+	size_t allocations;
+	size_t written = 0;
+	long sum = 0;
+	int lookups = 0;
+	double start;
+	int i;
+
+	builder["indentation"] = "";
+
+	start = test_now();
+	for (i = 0; i < iterations; ++i) {
+		root = Json::Value();
+		reader->parse(text.data(), text.data() + text.size(), &root, NULL);
+	}
+	parse = (test_now() - start) / iterations;
+
+	start = test_now();
+	for (i = 0; i < iterations; ++i)
+		sum += _lookups(root, sensor, &lookups);
+	lookup = (test_now() - start) / lookups;
+
+	start = test_now();
+	for (i = 0; i < iterations; ++i)
+		written += Json::writeString(builder, root).size();
+	write = (test_now() - start) / iterations;
+
+	allocations = s_allocations;
+	start = test_now();
+	for (i = 0; i < iterations; ++i) {
+		Json::Value tree(root);
+
+		sum += tree.size();
+	}
+	copy = (test_now() - start) / iterations;
+	allocations = (s_allocations - allocations) / iterations;
+
+	printf("%-6s  %7.1f  %5.0f  %9.1f  %8.1f  %7.1f  %11zu\n", name, parse * 1e6, text.size() / parse / 1e6,
+			lookup * 1e9, write * 1e6, copy * 1e6, allocations);
+	if (sum == 0 || written == 0)
+		fprintf(stderr, "%s: nothing parsed\n", name);
+}
+
+int main(void)
+{
+	printf("storage: %s\n", JSON_USE_FLAT_OBJECT ? "flat" : "std::map");
+	printf("doc     parse us  MB/s  lookup ns  write us  copy us  copy allocs\n");
+	_run("sensor", _sensor_document(), true, 2000);
+	_run("large", _large_document(), false, 20);
+
+	return 0;
+}
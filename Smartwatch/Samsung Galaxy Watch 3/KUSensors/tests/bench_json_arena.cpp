@@ -0,0 +1,94 @@
+/*
+ * bench_json_arena.cpp
+ *
+ * Allocations per parse and messages per second of the ingest path, a
+ * reused CharReader parsing a 150-byte sensor message over and over, with
+ * the trees on the heap and in a Json::Arena reset after each message. It is
+ * built with the std::map storage and, as bench_json_arena_flat, with the
+ * flat storage. The allocations are counted by replacing the global operator
+ * new and wrapping malloc at link time.
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <json/json.h>
+#include "test.h"
+
+#define MESSAGES	100000
+
+static size_t s_allocations;
+
+extern "C" void *__real_malloc(size_t size);
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+	s_allocations++;
+	return __real_malloc(size);
+}
+
+void *operator new(size_t size)
+{
+	void *p = __real_malloc(size ? size : 1);
+
+	if (!p)
+		throw std::bad_alloc();
+	s_allocations++;
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+static void _run(const std::string& text, bool use_arena)
+{
+	Json::CharReaderBuilder builder;
+	std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+	Json::Arena arena;
+	size_t allocations = s_allocations;
+	double start = test_now();
+	int failures = 0;
+	int i;
+
+	for (i = 0; i < MESSAGES; ++i) {
+		if (use_arena) {
+			Json::Arena::Scope scope(arena);
+			Json::Value root;
+
+			if (!reader->parse(text.data(), text.data() + text.size(), &root, NULL))
+				failures++;
+			root = Json::Value();
+			arena.reset();
+		} else {
+			Json::Value root;
+
+			if (!reader->parse(text.data(), text.data() + text.size(), &root, NULL))
+				failures++;
+		}
+	}
+
+	printf("%-7s  %-5s  %12.2f  %6.0f\n", JSON_USE_FLAT_OBJECT ? "flat" : "map", use_arena ? "arena" : "heap",
+			(double)(s_allocations - allocations) / MESSAGES, MESSAGES / (test_now() - start));
+	if (failures)
+		fprintf(stderr, "%d messages not parsed\n", failures);
+}
+
+int main(void)
+{
+	const std::string message = "{\"type\":\"HRM\",\"timestamp\":1700000000123,\"device\":\"R850-3f2a9c1b7d\","
+			"\"values\":[72.0,0.98,1.25],\"accuracy\":3,\"meta\":{\"batch\":17,\"seq\":42}}";
+
+	printf("storage  tree   allocs/parse  msg/s\n");
+	_run(message, false);
+	_run(message, true);
+
+	return 0;
+}
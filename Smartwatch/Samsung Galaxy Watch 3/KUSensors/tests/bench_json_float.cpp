@@ -0,0 +1,135 @@
+/*
+ * bench_json_float.cpp
+ *
+ * Reals through jsoncpp: nanoseconds to print a value with valueToString()
+ * and to read it with a CharReader, next to snprintf("%.17g") and strtod(),
+ * for values of 2 and 6 decimals and of 17 significant digits. Then the
+ * size, parse and write times of a numbers-heavy document of 2000 records
+ * of 3-axis samples.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "test.h"
+
+#define VALUES		200000
+#define RECORDS		2000
+
+/* -50..50 */
+static double _random_value(unsigned long long *seed)
+{
+	return (double)(test_random(seed) >> 11) / (1ULL << 53) * 100 - 50;
+}
+
+static void _run_values(const char *name, const std::vector<double>& values)
+{
+	Json::CharReaderBuilder builder;
+	std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+	std::vector<std::string> texts;
+	char printed[32];
+	double print, parse, c_print, c_parse;
+	double sum = 0;
+	double start;
+	int i;
+
+	start = test_now();
+	for (i = 0; i < VALUES; ++i)
+		texts.push_back(Json::valueToString(values[i]));
+	print = (test_now() - start) / VALUES;
+
+	start = test_now();
+	for (i = 0; i < VALUES; ++i) {
+		Json::Value value;
+
+		reader->parse(texts[i].data(), texts[i].data() + texts[i].size(), &value, NULL);
+		sum += value.asDouble();
+	}
+	parse = (test_now() - start) / VALUES;
+
+	start = test_now();
+	for (i = 0; i < VALUES; ++i)
+		sum += snprintf(printed, sizeof(printed), "%.17g", values[i]);
+	c_print = (test_now() - start) / VALUES;
+
+	start = test_now();
+	for (i = 0; i < VALUES; ++i)
+		sum += strtod(texts[i].c_str(), NULL);
+	c_parse = (test_now() - start) / VALUES;
+
+	printf("%-10s  %5.0f  %5.0f  %5.0f  %5.0f  %s\n", name, print * 1e9, parse * 1e9, c_print * 1e9, c_parse * 1e9,
+			texts[0].c_str());
+	if (sum == 0)
+		fprintf(stderr, "%s: nothing read\n", name);
+}
+
+static void _run_document(void)
+{
+	const char *axes[] = { "x", "y", "z" };
+	Json::CharReaderBuilder builder;
+	std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+	Json::StreamWriterBuilder writer;
+	Json::Value root(Json::arrayValue);
+	unsigned long long seed = 7;
+	std::string text;
+	double parse, write;
+	size_t written = 0;
+	double start;
+	int i, j;
+
+	for (i = 0; i < RECORDS; ++i) {
+		Json::Value record;
+
+		for (j = 0; j < 3; ++j)
+			record[axes[j]] = round(_random_value(&seed) * 100) / 100;
+		record["hr"] = round(_random_value(&seed) * 1e6) / 1e6;
+		record["t"] = 1600000000.123 + i;
+		record["raw"] = _random_value(&seed);
+		root.append(record);
+	}
+	writer["indentation"] = "";
+	text = Json::writeString(writer, root);
+
+	start = test_now();
+	for (i = 0; i < 50; ++i) {
+		Json::Value value;
+
+		reader->parse(text.data(), text.data() + text.size(), &value, NULL);
+		written += value.size();
+	}
+	parse = (test_now() - start) / 50;
+
+	start = test_now();
+	for (i = 0; i < 50; ++i)
+		written += Json::writeString(writer, root).size();
+	write = (test_now() - start) / 50;
+
+	printf("\n%d records, %zu bytes: parse %.2f ms, write %.2f ms\n%.100s...\n", RECORDS, text.size(),
+			parse * 1e3, write * 1e3, text.c_str());
+	if (written == 0)
+		fprintf(stderr, "nothing written\n");
+}
+
+int main(void)
+{
+	std::vector<double> two(VALUES), six(VALUES), all(VALUES);
+	unsigned long long seed = 7;
+	int i;
+
+	for (i = 0; i < VALUES; ++i) {
+		two[i] = round(_random_value(&seed) * 100) / 100;
+		six[i] = round(_random_value(&seed) * 1e6) / 1e6;
+		all[i] = _random_value(&seed);
+	}
+
+	printf("ns/value    print  parse  %%.17g  strtod  e.g.\n");
+	_run_values("2 decimals", two);
+	_run_values("6 decimals", six);
+	_run_values("17 digits", all);
+	_run_document();
+
+	return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * bench_json_sax.cpp
+ *
+ * Time and peak heap of reading a 1.3 MB document of 10000 sensor records
+ * and a 125-byte record: with the CharReader, which builds the tree, and
+ * with Json::SaxReader summing a field of every record, the whole document
+ * at once and in 1 KB chunks, or stopping at the first wanted field. The
+ * heap is measured by wrapping malloc and free at link time.
+ */
+
+#include <malloc.h>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <json/json.h>
+#include "test.h"
+
+#define RECORD		"{\"type\":\"HRM\",\"timestamp\":1700000000123,\"device\":\"R850-3f2a9c1b7d\"," \
+			"\"values\":[72,98,125],\"acc\":3,\"meta\":{\"batch\":17,\"seq\":42}}"
+#define CHUNK_SIZE	1024
+
+static size_t s_live;
+static size_t s_peak;
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void __real_free(void *p);
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+	void *p = __real_malloc(size);
+
+	if (p) {
+		s_live += malloc_usable_size(p);
+		s_peak = std::max(s_peak, s_live);
+	}
+	return p;
+}
+
+extern "C" void __wrap_free(void *p)
+{
+	if (p)
+		s_live -= malloc_usable_size(p);
+	__real_free(p);
+}
+
+void *operator new(size_t size)
+{
+	void *p = __wrap_malloc(size ? size : 1);
+
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	__wrap_free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	__wrap_free(p);
+}
+
+/* the sum of the "acc" members */
+class SumHandler : public Json::SaxHandler {
+public:
+	double sum = 0;
+
+	bool key(const Json::String& name) override { wanted_ = name == "acc"; return true; }
+	bool scalar(const Json::Value& value) override
+	{
+		if (wanted_)
+			sum += value.asDouble();
+		return true;
+	}
+
+private:
+	bool wanted_ = false;
+};
+
+/* the first "device" member, then stops */
+class FirstHandler : public Json::SaxHandler {
+public:
+	std::string device;
+
+	bool key(const Json::String& name) override { wanted_ = name == "device"; return true; }
+	bool scalar(const Json::Value& value) override
+	{
+		if (!wanted_)
+			return true;
+		device = value.asString();
+		return false;
+	}
+
+private:
+	bool wanted_ = false;
+};
+
+/* starts the measure of the peak heap and of the time */
+static double _start(size_t *base)
+{
+	*base = s_live;
+	s_peak = s_live;
+	return test_now();
+}
+
+static void _print(const char *reader, double start, int iterations, size_t base)
+{
+	printf("  %-16s  %9.1f  %10zu\n", reader, (test_now() - start) / iterations * 1e6, s_peak - base);
+}
+
+static void _run(const char *name, const std::string& text, int iterations)
+{
+	Json::CharReaderBuilder builder;
+	std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+	SumHandler sum;
+	FirstHandler first;
+	Json::SaxReader sax(sum, builder);
+	Json::SaxReader sax_first(first, builder);
+	double dom_sum = 0;
+	double start;
+	size_t offset;
+	size_t base;
+	int i;
+
+	printf("%s, %zu bytes\n", name, text.size());
+
+	start = _start(&base);
+	for (i = 0; i < iterations; ++i) {
+		Json::Value root;
+
+		reader->parse(text.data(), text.data() + text.size(), &root, NULL);
+		dom_sum += root.isArray() ? root[0]["acc"].asDouble() : root["acc"].asDouble();
+	}
+	_print("CharReader", start, iterations, base);
+
+	start = _start(&base);
+	for (i = 0; i < iterations; ++i) {
+		sax.reset();
+		sax.parse(text.data(), text.data() + text.size());
+	}
+	_print("SaxReader", start, iterations, base);
+
+	start = _start(&base);
+	for (i = 0; i < iterations; ++i) {
+		sax.reset();
+		for (offset = 0; offset < text.size(); offset += CHUNK_SIZE)
+			sax.feed(text.data() + offset, text.data() + std::min(text.size(), offset + CHUNK_SIZE));
+		sax.finish();
+	}
+	_print("SaxReader, 1 KB", start, iterations, base);
+
+	start = _start(&base);
+	for (i = 0; i < iterations; ++i) {
+		sax_first.reset();
+		sax_first.parse(text.data(), text.data() + text.size());
+	}
+	_print("SaxReader, first", start, iterations, base);
+
+	if (dom_sum == 0 || sum.sum == 0 || first.device.empty())
+		fprintf(stderr, "%s: nothing read\n", name);
+}
+
+int main(void)
+{
+	std::string large = "[";
+	int i;
+
+	for (i = 0; i < 10000; ++i)
+		large += std::string(i ? "," : "") + RECORD;
+	large += "]";
+
+	printf("  reader            us/parse  peak bytes\n");
+	_run("large", large, 10);
+	_run("small", RECORD, 50000);
+
+	return 0;
+}
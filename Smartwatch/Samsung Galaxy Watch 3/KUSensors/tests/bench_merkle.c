@@ -0,0 +1,85 @@
+/*
+ * bench_merkle.c
+ *
+ * Hashes per second of the Merkle commitment of a batch, for batches of 16
+ * to 4096 records of the size of a binary and of a JSON record: the records
+ * added one by one with merkle_add(), the way the binary and JSON batches are
+ * built, and hashed MERKLE_LEAF_BATCH at a time with merkle_leaf_hashes(),
+ * the way the columnar batches and the verifier hash them. A tree of n
+ * records takes n leaf hashes and n - 1 node hashes.
+ */
+
+#include "merkle.h"
+#include "test.h"
+
+#define MAX_RECORDS		4096
+#define MIN_SECONDS		0.3
+
+static unsigned char s_records[MAX_RECORDS][128];
+
+/* returns the seconds per tree */
+static double _run(int count, size_t record_size, bool together)
+{
+	const void *pointers[MERKLE_LEAF_BATCH];
+	size_t lens[MERKLE_LEAF_BATCH];
+	merkle_hash_t leaves[MERKLE_LEAF_BATCH];
+	merkle_hash_t root;
+	merkle_t tree;
+	double start = test_now();
+	int rounds = 0;
+	int n;
+	int i;
+	int j;
+
+	do {
+		merkle_init(&tree);
+		if (!together) {
+			for (i = 0; i < count; ++i)
+				merkle_add(&tree, s_records[i], record_size);
+		} else {
+			for (i = 0; i < count; i += n) {
+				n = count - i < MERKLE_LEAF_BATCH ? count - i : MERKLE_LEAF_BATCH;
+				for (j = 0; j < n; ++j) {
+					pointers[j] = s_records[i + j];
+					lens[j] = record_size;
+				}
+				merkle_leaf_hashes(pointers, lens, n, leaves);
+				for (j = 0; j < n; ++j)
+					merkle_add_leaf(&tree, leaves[j]);
+			}
+		}
+		merkle_root(&tree, root);
+		rounds++;
+	} while (test_now() - start < MIN_SECONDS);
+
+	return (test_now() - start) / rounds;
+}
+
+int main(void)
+{
+	const size_t record_sizes[] = { 24, 120 };
+	unsigned long long seed = 1;
+	double one;
+	double together;
+	int count;
+	int i;
+	int j;
+
+	for (i = 0; i < MAX_RECORDS; ++i) {
+		for (j = 0; j < sizeof(s_records[i]); ++j)
+			s_records[i][j] = (unsigned char)test_random(&seed);
+	}
+
+	printf("SHA-256 transform: %s\n", sha256_implementation());
+	printf("record  batch  merkle_add hashes/s  merkle_leaf_hashes hashes/s  records/s\n");
+	for (i = 0; i < sizeof(record_sizes) / sizeof(record_sizes[0]); ++i) {
+		for (count = 16; count <= MAX_RECORDS; count *= 2) {
+			one = _run(count, record_sizes[i], false);
+			together = _run(count, record_sizes[i], true);
+			printf("%4zu B  %5d  %19.0f  %27.0f  %9.0f\n", record_sizes[i], count,
+					(2 * count - 1) / one, (2 * count - 1) / together, count / (one < together ? one : together));
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * bench_record.c
+ *
+ * Size of a batch of BATCH_MAX_SAMPLES records in the JSON and the binary
+ * format, and the time to encode and decode a record. The JSON encoding is
+ * also timed with the snprintf writer of the previous releases.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "record.h"
+#include "record_snprintf.h"
+#include "test.h"
+
+#define RECORDS	1024
+#define ROUNDS	2000
+
+static record_t s_records[RECORDS];
+
+/* 3 axis sensors at 50 Hz and the HRM, the values of a wrist at rest */
+static void _fill(void)
+{
+	unsigned long long seed = 1;
+	int i;
+	int j;
+
+	for (i = 0; i < RECORDS; ++i) {
+		s_records[i].sensor_type = (i % 8 == 7) ? 13 : i % 4;
+		s_records[i].timestamp_ms = 1600000000000LL + i * 20;
+		s_records[i].value_count = s_records[i].sensor_type == 13 ? 4 : 3;
+		for (j = 0; j < RECORD_MAX_VALUES; ++j)
+			s_records[i].values[j] = ((int)(test_random(&seed) % 4001) - 2000) / 100.0f;
+	}
+}
+
+int main(void)
+{
+	static unsigned char binary[RECORD_HEADER_SIZE + RECORDS * RECORD_MAX_BINARY_SIZE];
+	static char json[RECORDS * RECORD_MAX_JSON_SIZE];
+	size_t json_len = 0;
+	size_t binary_len;
+	size_t len = 0;
+	record_reader_t reader;
+	record_t record;
+	double start;
+	double json_s;
+	double snprintf_s;
+	double binary_s;
+	double decode_s;
+	int round;
+	int i;
+
+	_fill();
+
+	/* one batch, with the separators of the JSON array */
+	binary_len = record_write_header(binary, sizeof(binary), 0, s_records[0].timestamp_ms);
+	for (i = 0; i < BATCH_MAX_SAMPLES; ++i) {
+		json_len += record_write_json(&s_records[i], i, json, RECORD_MAX_JSON_SIZE) + 1;
+		binary_len += record_write_binary(&s_records[i], i ? s_records[i - 1].timestamp_ms : s_records[0].timestamp_ms,
+				binary + binary_len, sizeof(binary) - binary_len);
+	}
+	printf("batch of %d records: JSON %zu bytes, binary %zu bytes\n", BATCH_MAX_SAMPLES, json_len + 1, binary_len);
+
+	start = test_now();
+	for (round = 0; round < ROUNDS; ++round) {
+		for (i = 0; i < RECORDS; ++i)
+			len += record_write_json(&s_records[i], i, json + (i * RECORD_MAX_JSON_SIZE) % sizeof(json), RECORD_MAX_JSON_SIZE);
+	}
+	json_s = test_now() - start;
+
+	start = test_now();
+	for (round = 0; round < ROUNDS; ++round) {
+		for (i = 0; i < RECORDS; ++i)
+			len += record_write_json_snprintf(&s_records[i], i, json + (i * RECORD_MAX_JSON_SIZE) % sizeof(json),
+					RECORD_MAX_JSON_SIZE);
+	}
+	snprintf_s = test_now() - start;
+
+	start = test_now();
+	for (round = 0; round < ROUNDS; ++round) {
+		binary_len = record_write_header(binary, sizeof(binary), round, s_records[0].timestamp_ms);
+		for (i = 0; i < RECORDS; ++i)
+			binary_len += record_write_binary(&s_records[i], i ? s_records[i - 1].timestamp_ms : s_records[0].timestamp_ms,
+					binary + binary_len, sizeof(binary) - binary_len);
+		record_set_header_count(binary, RECORDS);
+	}
+	binary_s = test_now() - start;
+
+	start = test_now();
+	for (round = 0; round < ROUNDS; ++round) {
+		record_reader_init(&reader, binary, binary_len);
+		while (record_reader_next(&reader, &record) == 1)
+			len += record.value_count;
+	}
+	decode_s = test_now() - start;
+
+	printf("JSON encode   %6.1f ns/record, %6.1f ns/record with snprintf\n", json_s * 1e9 / ROUNDS / RECORDS,
+			snprintf_s * 1e9 / ROUNDS / RECORDS);
+	printf("binary encode %6.1f ns/record\n", binary_s * 1e9 / ROUNDS / RECORDS);
+	printf("binary decode %6.1f ns/record\n", decode_s * 1e9 / ROUNDS / RECORDS);
+
+	return len == 0;
+}
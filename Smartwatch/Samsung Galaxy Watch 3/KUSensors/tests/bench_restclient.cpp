@@ -0,0 +1,81 @@
+/*
+ * bench_restclient.cpp
+ *
+ * Requests per second of the restclient simple API, whose handles come from
+ * the connection pool, against a Connection created for each request, the
+ * way the simple API worked before the pool, from 1 and 8 threads against
+ * the local HTTP/1.1 server of http_server.h.
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+#include "restclient/restclient.h"
+#include "restclient/connection.h"
+#include "restclient/pool.h"
+#include "http_server.h"
+#include "test.h"
+
+#define REQUESTS	1000
+
+static http_server_t s_server;
+
+/* returns the requests per second */
+static double _run(int thread_count, bool pooled)
+{
+	std::string url = "http://127.0.0.1:" + std::to_string(s_server.port) + "/bench";
+	std::vector<std::thread> threads;
+	double start = test_now();
+	int failures = 0;
+	int i;
+
+	for (i = 0; i < thread_count; ++i) {
+		threads.push_back(std::thread([&url, &failures, thread_count, pooled]() {
+			for (int j = 0; j < REQUESTS / thread_count; ++j) {
+				RestClient::Response response;
+
+				if (pooled) {
+					response = RestClient::get(url);
+				} else {
+					RestClient::Connection conn("");
+					response = conn.get(url);
+				}
+				if (response.code != 200)
+					__sync_fetch_and_add(&failures, 1);
+			}
+		}));
+	}
+	for (i = 0; i < thread_count; ++i)
+		threads[i].join();
+
+	if (failures)
+		fprintf(stderr, "%d requests failed\n", failures);
+
+	return REQUESTS / (test_now() - start);
+}
+
+int main(void)
+{
+	const int thread_counts[] = { 1, 8 };
+	const int count = sizeof(thread_counts) / sizeof(thread_counts[0]);
+	RestClient::PoolStats stats;
+	int i;
+
+	if (http_server_start(&s_server) != 0) {
+		fprintf(stderr, "Can't start the HTTP server\n");
+		return 1;
+	}
+	RestClient::init();
+
+	printf("threads  per call req/s  pooled req/s\n");
+	for (i = 0; i < count; ++i)
+		printf("%7d  %14.0f  %12.0f\n", thread_counts[i], _run(thread_counts[i], false), _run(thread_counts[i], true));
+
+	stats = RestClient::ConnectionPool::Instance().GetStats();
+	printf("pool: %llu acquired, %llu reused, %llu created\n", stats.acquired, stats.reused, stats.created);
+
+	RestClient::disable();
+	http_server_stop(&s_server);
+
+	return 0;
+}
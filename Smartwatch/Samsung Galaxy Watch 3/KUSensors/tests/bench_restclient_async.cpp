@@ -0,0 +1,78 @@
+/*
+ * bench_restclient_async.cpp
+ *
+ * Requests per second of the asynchronous restclient posting small JSON
+ * bodies to the local HTTP/1.1 server of http_server.h, which answers after
+ * 10 ms like a remote endpoint, for 1 to 64 concurrent transfers, against
+ * the blocking simple API.
+ */
+
+#include <future>
+#include <string>
+#include <vector>
+#include "restclient/async.h"
+#include "restclient/restclient.h"
+#include "http_server.h"
+#include "test.h"
+
+#define BODY		"{\"batch_id\":1,\"records\":[]}"
+
+static http_server_t s_server;
+
+/* returns the requests per second, *failures gets the requests that did not succeed */
+static double _run(int concurrency, int requests, int *failures)
+{
+	std::string url = "http://127.0.0.1:" + std::to_string(s_server.port) + "/delay/10";
+	double start = test_now();
+	int i;
+
+	*failures = 0;
+	if (concurrency == 0) {
+		for (i = 0; i < requests; ++i) {
+			if (RestClient::post(url, "application/json", BODY).code != 200)
+				(*failures)++;
+		}
+	} else {
+		RestClient::AsyncClient client(concurrency);
+		std::vector<std::future<RestClient::Response> > futures;
+
+		for (i = 0; i < requests; ++i)
+			futures.push_back(client.post(url, "application/json", BODY));
+		for (i = 0; i < requests; ++i) {
+			if (futures[i].get().code != 200)
+				(*failures)++;
+		}
+	}
+
+	return requests / (test_now() - start);
+}
+
+int main(void)
+{
+	const int concurrencies[] = { 0, 1, 4, 16, 64 };
+	const int count = sizeof(concurrencies) / sizeof(concurrencies[0]);
+	double rate;
+	int failures;
+	int requests;
+	int i;
+
+	if (http_server_start(&s_server) != 0) {
+		fprintf(stderr, "Can't start the HTTP server\n");
+		return 1;
+	}
+	RestClient::init();
+
+	printf("client       concurrency  requests  req/s  failed\n");
+	for (i = 0; i < count; ++i) {
+		/* about a second per run */
+		requests = concurrencies[i] < 2 ? 90 : 90 * concurrencies[i];
+		rate = _run(concurrencies[i], requests, &failures);
+		printf("%-11s  %11d  %8d  %5.0f  %6d\n", concurrencies[i] ? "AsyncClient" : "simple API",
+				concurrencies[i] ? concurrencies[i] : 1, requests, rate, failures);
+	}
+
+	RestClient::disable();
+	http_server_stop(&s_server);
+
+	return 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * bench_sensor.c
+ *
+ * Wake-ups and CPU time of the capture layer on the host sensor shim, with
+ * the motion sensors sampled at 100 Hz and delivered one by one or batched
+ * in the FIFO for up to a second.
+ */
+
+#include <stdlib.h>
+#include <Ecore.h>
+#include <sensor.h>
+#include "data.h"
+#include "test.h"
+
+#define SECONDS 2.0
+
+static const struct {
+	sensor_type_e type;
+	int interval_ms;
+} s_captured[] = {
+	{ SENSOR_ACCELEROMETER, 10 },
+	{ SENSOR_GRAVITY, 10 },
+	{ SENSOR_GYROSCOPE, 10 },
+	{ SENSOR_MAGNETIC, 20 },
+};
+
+static const int s_latencies_ms[] = { 0, 100, 1000 };
+
+static unsigned long long s_records;
+
+void replay_record_events(int sensor_type, const sensor_event_s events[], int events_count)
+{
+}
+
+static bool _publish_cb(const record_t *records, int count)
+{
+	s_records += count;
+	return true;
+}
+
+static Eina_Bool _quit_cb(void *data)
+{
+	ecore_main_loop_quit();
+	return ECORE_CALLBACK_CANCEL;
+}
+
+static double _cpu_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+	sensor_shim_stats_t before;
+	sensor_shim_stats_t after;
+	unsigned long long events;
+	double cpu;
+	int i;
+	int j;
+
+	data_initialize(NULL, _publish_cb);
+
+	printf("latency   wake-ups/s   events/s   records/s   CPU us/event\n");
+	for (i = 0; i < sizeof(s_latencies_ms) / sizeof(s_latencies_ms[0]); ++i) {
+		for (j = 0; j < sizeof(s_captured) / sizeof(s_captured[0]); ++j)
+			data_capture_start(s_captured[j].type, s_captured[j].interval_ms, s_latencies_ms[i]);
+
+		/* let the FIFOs of the previous latency drain */
+		ecore_timer_add(0.1, _quit_cb, NULL);
+		ecore_main_loop_begin();
+
+		s_records = 0;
+		sensor_shim_get_stats(&before);
+		cpu = _cpu_now();
+		ecore_timer_add(SECONDS, _quit_cb, NULL);
+		ecore_main_loop_begin();
+		cpu = _cpu_now() - cpu;
+		sensor_shim_get_stats(&after);
+
+		events = after.events - before.events;
+		printf("%5d ms %12.1f %10.1f %11.1f %14.2f\n", s_latencies_ms[i],
+				(after.deliveries - before.deliveries) / SECONDS, events / SECONDS, s_records / SECONDS,
+				events ? cpu * 1e6 / events : 0.0);
+	}
+
+	data_finalize();
+
+	return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * bench_sha256.c
+ *
+ * Throughput of SHA-256 for messages of 64 B, 1 KB and 64 KB, hashed one by
+ * one and SHA256_LANES * 16 at a time with sha256_multi(). Also built with
+ * SHA256_NO_ACCELERATION as bench_sha256_portable.
+ */
+
+#include <stdbool.h>
+#include "sha256.h"
+#include "test.h"
+
+#define MAX_LEN			65536
+#define GROUP			(SHA256_LANES * 16)
+#define MIN_SECONDS		0.3
+
+static BYTE s_data[MAX_LEN];
+
+/* returns the bytes hashed per second */
+static double _run(size_t len, bool multi)
+{
+	const BYTE *data[GROUP];
+	size_t lens[GROUP];
+	BYTE hashes[GROUP][SHA256_BLOCK_SIZE];
+	SHA256_CTX ctx;
+	double bytes = 0;
+	double start;
+	int i;
+
+	for (i = 0; i < GROUP; ++i) {
+		data[i] = s_data;
+		lens[i] = len;
+	}
+
+	start = test_now();
+	do {
+		if (multi) {
+			sha256_multi(data, lens, hashes, GROUP);
+			bytes += (double)len * GROUP;
+		} else {
+			sha256_init(&ctx);
+			sha256_update(&ctx, s_data, len);
+			sha256_final(&ctx, hashes[0]);
+			bytes += len;
+		}
+	} while (test_now() - start < MIN_SECONDS);
+
+	return bytes / (test_now() - start);
+}
+
+int main(void)
+{
+	const size_t lens[] = { 64, 1024, MAX_LEN };
+	int i;
+
+	for (i = 0; i < MAX_LEN; ++i)
+		s_data[i] = (BYTE)i;
+
+	printf("SHA-256 transform: %s\n", sha256_implementation());
+	printf("message  single MB/s  sha256_multi MB/s\n");
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); ++i)
+		printf("%7zu  %11.1f  %17.1f\n", lens[i], _run(lens[i], false) / 1e6, _run(lens[i], true) / 1e6);
+
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * bench_thpool.c
+ *
+ * Job queue of the thread pool: ns per tiny job added by 1, 2 and 4
+ * producer threads to a pool of 4 threads, the latency from
+ * thpool_add_work() to the start of the job on an idle pool, and the
+ * same with the jobs arriving back to back.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include "thpool.h"
+#include "test.h"
+
+#define POOL_THREADS	4
+#define MAX_PRODUCERS	4
+#define LATENCY_JOBS	2000
+
+typedef struct producer {
+	threadpool pool;
+	long jobs;
+} producer_t;
+
+static long s_count;
+static volatile double s_added;
+static volatile int s_started;
+static double s_latency;
+
+static void _job_count(void *arg)
+{
+	__sync_fetch_and_add(&s_count, 1);
+}
+
+static void *_producer(void *arg)
+{
+	producer_t *producer = arg;
+	long i;
+
+	for (i = 0; i < producer->jobs; ++i)
+		thpool_add_work(producer->pool, _job_count, NULL);
+
+	return NULL;
+}
+
+static void _job_latency(void *arg)
+{
+	s_latency += test_now() - s_added;
+	__sync_synchronize();
+	s_started = 1;
+}
+
+/* us from thpool_add_work() to the job, after `idle_us` without jobs */
+static double _latency(threadpool pool, long idle_us)
+{
+	struct timespec idle = { 0, idle_us * 1000 };
+	int i;
+
+	s_latency = 0;
+	for (i = 0; i < LATENCY_JOBS; ++i) {
+		if (idle_us)
+			nanosleep(&idle, NULL);
+		s_started = 0;
+		s_added = test_now();
+		thpool_add_work(pool, _job_latency, NULL);
+		while (!s_started)
+			;
+	}
+	thpool_wait(pool);
+
+	return s_latency / LATENCY_JOBS * 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+	long total = argc > 1 ? atol(argv[1]) : 2000000;
+	threadpool pool = thpool_init(POOL_THREADS);
+	producer_t producer;
+	pthread_t threads[MAX_PRODUCERS];
+	double start, elapsed;
+	int count;
+	int i;
+
+	printf("producers  ns/job  Mjobs/s\n");
+	for (count = 1; count <= MAX_PRODUCERS; count *= 2) {
+		producer.pool = pool;
+		producer.jobs = total / count;
+		s_count = 0;
+		start = test_now();
+		for (i = 0; i < count; ++i)
+			pthread_create(&threads[i], NULL, _producer, &producer);
+		for (i = 0; i < count; ++i)
+			pthread_join(threads[i], NULL);
+		thpool_wait(pool);
+		elapsed = test_now() - start;
+
+		if (s_count != producer.jobs * count)
+			fprintf(stderr, "%ld jobs run out of %ld\n", s_count, producer.jobs * count);
+		printf("%9d  %6.0f  %7.2f\n", count, elapsed * 1e9 / s_count, s_count / elapsed / 1e6);
+	}
+
+	printf("idle wakeup latency: %.1f us\n", _latency(pool, 200));
+	printf("back to back latency: %.2f us\n", _latency(pool, 0));
+
+	thpool_destroy(pool);
+
+	return 0;
+}
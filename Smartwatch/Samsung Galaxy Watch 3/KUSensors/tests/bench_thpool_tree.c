@@ -0,0 +1,108 @@
+/*
+ * bench_thpool_tree.c
+ *
+ * Scaling of the thread pool on fine-grained jobs, for 1 thread up to the
+ * number of CPUs (at least 4): ns per job for flat jobs added one by one
+ * and in batches of 64 from the main thread, and for a fork-join tree whose
+ * jobs add their 4 children from the pool threads. bench_thpool_tree uses
+ * the shared ring, bench_thpool_tree_ws the THPOOL_WORK_STEALING deques.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "thpool.h"
+#include "test.h"
+
+#define FLAT_JOBS	400000
+#define BATCH_SIZE	64		/* divides FLAT_JOBS */
+#define TREE_DEPTH	8		/* 4^8 leaves */
+
+/* as in thpool.c, for the report */
+#ifndef THPOOL_WORK_STEALING
+#define THPOOL_WORK_STEALING 0
+#endif
+
+static threadpool s_pool;
+static long s_leaves;
+static long s_sink;
+
+/* about 50 multiplications of work */
+static void _job_tiny(void *arg)
+{
+	unsigned long x = (unsigned long)arg;
+	int i;
+
+	for (i = 0; i < 50; ++i)
+		x = x * 1103515245 + 12345;
+	if (x == 42)
+		s_sink++;
+	__sync_fetch_and_add(&s_leaves, 1);
+}
+
+static void _job_node(void *arg)
+{
+	long depth = (long)arg;
+	void *children[4] = { (void *)(depth - 1), (void *)(depth - 1), (void *)(depth - 1), (void *)(depth - 1) };
+
+	if (depth == 0)
+		_job_tiny(arg);
+	else
+		thpool_add_work_batch(s_pool, _job_node, children, 4);
+}
+
+int main(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	long max_threads = cpus > 4 ? cpus : 4;
+	void *args[BATCH_SIZE];
+	double flat, batch, tree;
+	long tree_leaves = 1;
+	double start;
+	int threads;
+	long i;
+	int j;
+
+	for (i = 0; i < TREE_DEPTH; ++i)
+		tree_leaves *= 4;
+
+	printf("mode: %s, %ld CPUs\n", THPOOL_WORK_STEALING ? "work stealing" : "shared ring", cpus);
+	printf("threads  flat ns/job  batch ns/job  tree ns/job\n");
+	for (threads = 1; threads <= max_threads; threads *= 2) {
+		s_pool = thpool_init(threads);
+
+		s_leaves = 0;
+		start = test_now();
+		for (i = 0; i < FLAT_JOBS; ++i)
+			thpool_add_work(s_pool, _job_tiny, (void *)i);
+		thpool_wait(s_pool);
+		flat = (test_now() - start) / FLAT_JOBS;
+		if (s_leaves != FLAT_JOBS)
+			fprintf(stderr, "%ld flat jobs run out of %d\n", s_leaves, FLAT_JOBS);
+
+		s_leaves = 0;
+		start = test_now();
+		for (i = 0; i < FLAT_JOBS; i += BATCH_SIZE) {
+			for (j = 0; j < BATCH_SIZE; ++j)
+				args[j] = (void *)(i + j);
+			thpool_add_work_batch(s_pool, _job_tiny, args, BATCH_SIZE);
+		}
+		thpool_wait(s_pool);
+		batch = (test_now() - start) / FLAT_JOBS;
+		if (s_leaves != FLAT_JOBS)
+			fprintf(stderr, "%ld batched jobs run out of %d\n", s_leaves, FLAT_JOBS);
+
+		s_leaves = 0;
+		start = test_now();
+		thpool_add_work(s_pool, _job_node, (void *)(long)TREE_DEPTH);
+		thpool_wait(s_pool);
+		/* the leaves and the inner nodes */
+		tree = (test_now() - start) / ((4 * tree_leaves - 1) / 3);
+		if (s_leaves != tree_leaves)
+			fprintf(stderr, "%ld leaves run out of %ld\n", s_leaves, tree_leaves);
+
+		printf("%7d  %11.0f  %12.0f  %11.0f\n", threads, flat * 1e9, batch * 1e9, tree * 1e9);
+		thpool_destroy(s_pool);
+	}
+
+	return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * http_server.h
+ *
+ * HTTP/1.1 server of the restclient tests, on a free port of 127.0.0.1.
+ * Every connection is kept alive and served by its own thread. The response
+ * to METHOD /path is 200 with "METHOD /path <body bytes>" as body, except:
+ *   /delay/<ms>     answers after ms milliseconds
+ *   /status/<code>  answers with that status
+ * The server counts the connections it accepted and the requests it served.
+ */
+
+#ifndef HTTP_SERVER_H_
+#define HTTP_SERVER_H_
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define HTTP_SERVER_BUF_SIZE	65536
+
+typedef struct http_server {
+	int fd;
+	int port;
+	pthread_t thread;
+	int connections;		/* accepted so far, read with __sync_fetch_and_add(.., 0) */
+	int requests;
+} http_server_t;
+
+typedef struct http_server_connection {
+	http_server_t *server;
+	int fd;
+} http_server_connection_t;
+
+/* serves the requests of one connection until the client closes it */
+static void *_http_server_connection(void *data)
+{
+	http_server_connection_t *connection = (http_server_connection_t *)data;
+	char *buf = (char *)malloc(HTTP_SERVER_BUF_SIZE);
+	char response[512];
+	char body[300];
+	char method[16];
+	char path[256];
+	const char *header;
+	char *end;
+	size_t used = 0;
+	size_t request_len;
+	long body_len;
+	ssize_t n;
+	bool expect;
+	int status;
+	int len;
+
+	while (buf) {
+		end = NULL;
+		while (used < HTTP_SERVER_BUF_SIZE - 1) {
+			buf[used] = '\0';
+			end = strstr(buf, "\r\n\r\n");
+			if (end)
+				break;
+			n = read(connection->fd, buf + used, HTTP_SERVER_BUF_SIZE - 1 - used);
+			if (n <= 0)
+				break;
+			used += n;
+		}
+		if (!end || sscanf(buf, "%15s %255s", method, path) != 2)
+			break;
+
+		body_len = 0;
+		expect = false;
+		for (header = buf; (header = strstr(header, "\r\n")) != NULL && header < end; header += 2) {
+			if (strncasecmp(header + 2, "Content-Length:", 15) == 0)
+				body_len = strtol(header + 17, NULL, 10);
+			else if (strncasecmp(header + 2, "Expect: 100-continue", 20) == 0)
+				expect = true;
+		}
+		request_len = end + 4 - buf + body_len;
+		if (request_len > HTTP_SERVER_BUF_SIZE - 1)
+			break;
+
+		/* curl waits a second for it before sending the body of a PUT */
+		if (expect && used < request_len && write(connection->fd, "HTTP/1.1 100 Continue\r\n\r\n", 25) != 25)
+			break;
+		while (used < request_len) {
+			n = read(connection->fd, buf + used, request_len - used);
+			if (n <= 0)
+				break;
+			used += n;
+		}
+		if (used < request_len)
+			break;
+
+		status = 200;
+		if (strncmp(path, "/delay/", 7) == 0)
+			usleep(atoi(path + 7) * 1000);
+		else if (strncmp(path, "/status/", 8) == 0)
+			status = atoi(path + 8);
+
+		__sync_fetch_and_add(&connection->server->requests, 1);
+		len = snprintf(body, sizeof(body), "%s %s %ld", method, path, body_len);
+		len = snprintf(response, sizeof(response), "HTTP/1.1 %d X\r\nContent-Type: text/plain\r\nContent-Length: %d\r\n\r\n%s",
+				status, len, body);
+		if (write(connection->fd, response, len) != len)
+			break;
+
+		/* the pipelined bytes of the next request */
+		memmove(buf, buf + request_len, used - request_len);
+		used -= request_len;
+	}
+
+	close(connection->fd);
+	free(buf);
+	free(connection);
+
+	return NULL;
+}
+
+static void *_http_server_accept(void *data)
+{
+	http_server_t *server = (http_server_t *)data;
+	http_server_connection_t *connection;
+	pthread_t thread;
+	int fd;
+
+	while ((fd = accept(server->fd, NULL, NULL)) >= 0) {
+		connection = (http_server_connection_t *)malloc(sizeof(*connection));
+		if (!connection) {
+			close(fd);
+			continue;
+		}
+		connection->server = server;
+		connection->fd = fd;
+		__sync_fetch_and_add(&server->connections, 1);
+		if (pthread_create(&thread, NULL, _http_server_connection, connection) == 0) {
+			pthread_detach(thread);
+		} else {
+			close(fd);
+			free(connection);
+		}
+	}
+
+	return NULL;
+}
+
+static inline int http_server_start(http_server_t *server)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+
+	memset(server, 0, sizeof(*server));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	server->fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (server->fd < 0)
+		return -1;
+	if (bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server->fd, 256) != 0 ||
+			getsockname(server->fd, (struct sockaddr *)&addr, &len) != 0) {
+		close(server->fd);
+		return -1;
+	}
+	server->port = ntohs(addr.sin_port);
+
+	if (pthread_create(&server->thread, NULL, _http_server_accept, server) != 0) {
+		close(server->fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* stops accepting, the open connections are served until their clients close them */
+static inline void http_server_stop(http_server_t *server)
+{
+	shutdown(server->fd, SHUT_RDWR);
+	pthread_join(server->thread, NULL);
+	close(server->fd);
+}
+
+static inline int http_server_count(int *counter)
+{
+	return __sync_fetch_and_add(counter, 0);
+}
+
+#endif /* HTTP_SERVER_H_ */
@@ -0,0 +1,93 @@
+/*
+ * record_snprintf.h
+ *
+ * The JSON record writer as it was before record_write_json() wrote its
+ * output in one pass: one snprintf for the header and one per field with
+ * "%0.2f". test_record checks the new writer byte for byte against it,
+ * bench_record compares their speed.
+ */
+
+#ifndef RECORD_SNPRINTF_H_
+#define RECORD_SNPRINTF_H_
+
+#include <stdio.h>
+#include <string.h>
+#include "record.h"
+
+/* JSON field names of each sensor, in the order of the sensor_type_e enum */
+static const char *s_snprintf_field_names[14][RECORD_MAX_VALUES] = {
+	{"x", "y", "z", ""},			/* acceleration */
+	{"x", "y", "z", ""},			/* gravity */
+	{"x", "y", "z", ""},			/* linear acc */
+	{"x", "y", "z", ""},			/* magnetic */
+	{"x", "y", "z", "v"},			/* rot vector */
+	{"x", "y", "z", ""},			/* orientation */
+	{"x", "y", "z", ""},			/* gyroscope */
+	{"lux", "", "", ""},			/* light */
+	{"proximity", "", "", ""},		/* proximity */
+	{"hPa", "", "", ""},			/* pressure */
+	{"UV", "", "", ""},				/* UV */
+	{"temperature", "", "", ""},	/* temp */
+	{"humidity", "", "", ""},		/* humidity */
+	{"HeartRate", "P2P", "RMSSD", "SDNN"},	/* hrm */
+};
+
+/* JSON field names of the records computed on the watch */
+static const char *s_snprintf_derived_field_names[][RECORD_MAX_VALUES] = {
+	{"steps", "activity", "intensity", "cadence"},	/* RECORD_TYPE_ACTIVITY */
+	{"w", "x", "y", "z"},							/* RECORD_TYPE_QUATERNION */
+};
+
+static inline const char *record_snprintf_field_name(int sensor_type, int index)
+{
+	if (sensor_type >= 0 && sensor_type < 14)
+		return s_snprintf_field_names[sensor_type][index];
+
+	if (sensor_type >= RECORD_TYPE_ACTIVITY && sensor_type <= RECORD_TYPE_QUATERNION)
+		return s_snprintf_derived_field_names[sensor_type - RECORD_TYPE_ACTIVITY][index];
+
+	return "";
+}
+
+/* record_write_json() of the previous releases, unchanged */
+static inline size_t record_write_json_snprintf(const record_t *record, int transaction_id, char *buf, size_t size)
+{
+	const char *name;
+	size_t len;
+	int i;
+	int n;
+
+	n = snprintf(buf, size,
+			"{\"transaction_id\":%d,"
+			"\"timestamp\":%lld,"
+			"\"sensor_type\":%d,"
+			"\"sensor_data\":{", transaction_id, record->timestamp_ms / 1000, record->sensor_type);
+	if (n < 0 || (size_t)n >= size)
+		return 0;
+	len = n;
+
+	for (i = 0; i < record->value_count; ++i) {
+		name = record_snprintf_field_name(record->sensor_type, i);
+		if (strlen(name) == 0)
+			continue;
+
+		n = snprintf(buf + len, size - len, "\"%s\":%0.2f,", name, record->values[i]);
+		if (n < 0 || (size_t)n >= size - len)
+			return 0;
+		len += n;
+	}
+
+	if (len + 2 >= size)
+		return 0;
+
+	/* replace the trailing comma, or close the empty object */
+	if (buf[len - 1] == ',')
+		len--;
+	buf[len++] = '}';
+	buf[len++] = '}';
+	buf[len] = '\0';
+
+	return len;
+}
+
+#endif /* RECORD_SNPRINTF_H_ */
@@ -0,0 +1,70 @@
+/*
+ * test.h
+ *
+ * Checks of the host tests. A failed check prints its location and the test
+ * goes on, main() returns TEST_RESULT() so that make stops at the first test
+ * program with a failure.
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static int test_failures __attribute__((unused));
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		test_failures++; \
+		fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+	} \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+	long long _a = (long long)(a), _b = (long long)(b); \
+	if (_a != _b) { \
+		test_failures++; \
+		fprintf(stderr, "%s:%d: %s == %s failed, %lld != %lld\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+	} \
+} while (0)
+
+#define CHECK_NEAR(a, b, tolerance) do { \
+	double _a = (double)(a), _b = (double)(b); \
+	if (!(fabs(_a - _b) <= (tolerance))) { \
+		test_failures++; \
+		fprintf(stderr, "%s:%d: %s ~ %s failed, %g != %g\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+	} \
+} while (0)
+
+#define CHECK_STR(a, b) do { \
+	const char *_a = (a), *_b = (b); \
+	if (strcmp(_a, _b) != 0) { \
+		test_failures++; \
+		fprintf(stderr, "%s:%d: %s == %s failed\n  \"%s\"\n  \"%s\"\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+	} \
+} while (0)
+
+#define TEST_RESULT() (test_failures ? (fprintf(stderr, "%d check(s) failed\n", test_failures), 1) : 0)
+
+/* monotonic seconds, for the benchmarks */
+static inline double test_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* xorshift64, the tests are deterministic */
+static inline unsigned long long test_random(unsigned long long *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+#endif /* TEST_H_ */
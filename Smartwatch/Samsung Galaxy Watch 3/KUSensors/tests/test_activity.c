@@ -0,0 +1,162 @@
+/*
+ * test_activity.c
+ *
+ * Minute summaries of the activity classifier: still, walking at 1.8 Hz and
+ * running at 2.7 Hz, fed in the chunks of the capture, then the flush of the
+ * minute in progress, the gaps and the reset.
+ */
+
+#include <stdlib.h>
+#include "activity.h"
+#include "test.h"
+
+#define PERIOD_MS		100
+#define MINUTE_SAMPLES	(ACTIVITY_SUMMARY_MS / PERIOD_MS)
+#define MAX_RECORDS		(8 * MINUTE_SAMPLES)
+#define CHUNK			64		/* the chunk of the magnitudes in activity.c */
+
+static record_t s_records[MAX_RECORDS];
+
+/* a wrist swinging at frequency Hz with an amplitude in m/s^2, 0 Hz for a watch lying on a table */
+static int _segment(record_t *records, long long start_ms, int samples, double frequency, double amplitude,
+		unsigned long long *seed)
+{
+	double t;
+	int i;
+
+	for (i = 0; i < samples; ++i) {
+		t = i * PERIOD_MS / 1000.0;
+		records[i].sensor_type = 0;
+		records[i].timestamp_ms = start_ms + (long long)i * PERIOD_MS;
+		records[i].value_count = 3;
+		records[i].values[0] = 0.3 * sin(t);
+		records[i].values[1] = amplitude * 0.3 * sin(2 * M_PI * frequency * t + 1);
+		records[i].values[2] = 9.8 + amplitude * sin(2 * M_PI * frequency * t) + 0.05 * ((int)(test_random(seed) % 101) - 50) / 50.0;
+	}
+
+	return samples;
+}
+
+/* feeds the records in chunks of the given size, the summaries are compacted at the front */
+static int _summarize(record_t *records, int count, int chunk)
+{
+	int summaries = 0;
+	int kept;
+	int base;
+	int n;
+
+	for (base = 0; base < count; base += n) {
+		n = count - base < chunk ? count - base : chunk;
+		kept = activity_summarize(records + base, n);
+		memmove(records + summaries, records + base, kept * sizeof(record_t));
+		summaries += kept;
+	}
+
+	return summaries;
+}
+
+static void _check_summary(const record_t *summary, long long start_ms, int class, int steps, int cadence)
+{
+	CHECK_EQ(summary->sensor_type, RECORD_TYPE_ACTIVITY);
+	CHECK_EQ(summary->value_count, 4);
+	CHECK_EQ(summary->timestamp_ms, start_ms);
+	CHECK_EQ((int)summary->values[1], class);
+	CHECK_NEAR(summary->values[0], steps, 2);
+	CHECK_NEAR(summary->values[3], cadence, 2);
+}
+
+static void _test_classes(void)
+{
+	static const int chunks[] = { 1, 7, CHUNK, MAX_RECORDS };
+	unsigned long long seed = 1;
+	long long start_ms = 1700000000000LL - 1700000000000LL % ACTIVITY_SUMMARY_MS;
+	int summaries;
+	int count;
+	int i;
+
+	for (i = 0; i < sizeof(chunks) / sizeof(chunks[0]); ++i) {
+		activity_reset();
+		count = _segment(s_records, start_ms, 2 * MINUTE_SAMPLES, 0, 0.02, &seed);
+		count += _segment(s_records + count, start_ms + 2 * ACTIVITY_SUMMARY_MS, 2 * MINUTE_SAMPLES, 1.8, 2.0, &seed);
+		count += _segment(s_records + count, start_ms + 4 * ACTIVITY_SUMMARY_MS, 2 * MINUTE_SAMPLES, 2.7, 5.0, &seed);
+
+		/* the last minute is closed by the next sample */
+		s_records[count] = s_records[count - 1];
+		s_records[count++].timestamp_ms = start_ms + 6 * ACTIVITY_SUMMARY_MS;
+
+		summaries = _summarize(s_records, count, chunks[i]);
+		CHECK_EQ(summaries, 6);
+		_check_summary(&s_records[0], start_ms, ACTIVITY_STILL, 0, 0);
+		_check_summary(&s_records[1], start_ms + ACTIVITY_SUMMARY_MS, ACTIVITY_STILL, 0, 0);
+		/* a step per swing */
+		_check_summary(&s_records[2], start_ms + 2 * ACTIVITY_SUMMARY_MS, ACTIVITY_WALKING, 108, 108);
+		_check_summary(&s_records[3], start_ms + 3 * ACTIVITY_SUMMARY_MS, ACTIVITY_WALKING, 108, 108);
+		_check_summary(&s_records[4], start_ms + 4 * ACTIVITY_SUMMARY_MS, ACTIVITY_RUNNING, 162, 162);
+		_check_summary(&s_records[5], start_ms + 5 * ACTIVITY_SUMMARY_MS, ACTIVITY_RUNNING, 162, 162);
+		CHECK(s_records[0].values[2] < 0.15);
+		CHECK(s_records[4].values[2] > s_records[2].values[2]);
+	}
+}
+
+static void _test_flush(void)
+{
+	unsigned long long seed = 2;
+	long long start_ms = 1700000000000LL - 1700000000000LL % ACTIVITY_SUMMARY_MS;
+	record_t summary;
+	int count;
+
+	/* nothing fed, nothing to flush */
+	activity_reset();
+	CHECK_EQ(activity_flush(&summary), 0);
+
+	/* half a minute of walking, flushed before the end of the minute */
+	count = _segment(s_records, start_ms, MINUTE_SAMPLES / 2, 1.8, 2.0, &seed);
+	CHECK_EQ(_summarize(s_records, count, CHUNK), 0);
+	CHECK_EQ(activity_flush(&summary), 1);
+	_check_summary(&summary, start_ms, ACTIVITY_WALKING, 54, 108);
+	CHECK_EQ(activity_flush(&summary), 0);
+
+	/* the rest of the minute gets its own summary with the same timestamp */
+	count = _segment(s_records, start_ms + ACTIVITY_SUMMARY_MS / 2, MINUTE_SAMPLES / 2, 1.8, 2.0, &seed);
+	s_records[count] = s_records[count - 1];
+	s_records[count++].timestamp_ms = start_ms + ACTIVITY_SUMMARY_MS;
+	CHECK_EQ(_summarize(s_records, count, CHUNK), 1);
+	_check_summary(&s_records[0], start_ms, ACTIVITY_WALKING, 54, 108);
+
+	/* the sample that closed the minute is in the next one */
+	CHECK_EQ(activity_flush(&summary), 1);
+	CHECK_EQ(summary.timestamp_ms, start_ms + ACTIVITY_SUMMARY_MS);
+	CHECK_EQ((int)summary.values[0], 0);
+}
+
+static void _test_gap_and_reset(void)
+{
+	unsigned long long seed = 3;
+	long long start_ms = 1700000000000LL - 1700000000000LL % ACTIVITY_SUMMARY_MS;
+	record_t summary;
+	int count;
+
+	/* walking, then the screen goes off for ten minutes: a single summary for the minute before the gap */
+	activity_reset();
+	count = _segment(s_records, start_ms, MINUTE_SAMPLES, 1.8, 2.0, &seed);
+	count += _segment(s_records + count, start_ms + 11 * ACTIVITY_SUMMARY_MS, MINUTE_SAMPLES / 2, 0, 0.02, &seed);
+	CHECK_EQ(_summarize(s_records, count, CHUNK), 1);
+	_check_summary(&s_records[0], start_ms, ACTIVITY_WALKING, 108, 108);
+	CHECK_EQ(activity_flush(&summary), 1);
+	_check_summary(&summary, start_ms + 11 * ACTIVITY_SUMMARY_MS, ACTIVITY_STILL, 0, 0);
+
+	/* the reset drops the minute in progress */
+	count = _segment(s_records, start_ms + 20 * ACTIVITY_SUMMARY_MS, MINUTE_SAMPLES / 2, 2.7, 5.0, &seed);
+	_summarize(s_records, count, CHUNK);
+	activity_reset();
+	CHECK_EQ(activity_flush(&summary), 0);
+}
+
+int main(void)
+{
+	_test_classes();
+	_test_flush();
+	_test_gap_and_reset();
+
+	return TEST_RESULT();
+}
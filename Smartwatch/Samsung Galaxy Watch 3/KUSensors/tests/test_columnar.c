@@ -0,0 +1,200 @@
+/*
+ * test_columnar.c
+ *
+ * Round trip of random batches through the columnar encoder and decoder:
+ * the quantized values within half a quantum, the float bits exact, the
+ * timestamps exact whatever their order. Also built with COLUMNAR_USE_ZLIB
+ * as test_columnar_zlib.
+ */
+
+#include <stdlib.h>
+#include "columnar.h"
+#include "test.h"
+
+#define ROUNDS		2000
+#define MAX_RECORDS	600
+
+static record_t s_records[MAX_RECORDS];
+static record_t s_expected[MAX_RECORDS];
+static record_t s_decoded[MAX_RECORDS];
+static float s_quantum[COLUMNAR_MAX_TYPES];
+
+/* the decoder's order: stream by stream in the order of their first record, the input order within a stream */
+static void _expected_order(int count)
+{
+	bool taken[MAX_RECORDS] = { false };
+	int n = 0;
+	int i;
+	int j;
+
+	for (i = 0; i < count; ++i) {
+		if (taken[i])
+			continue;
+		for (j = i; j < count; ++j) {
+			if (!taken[j] && s_records[j].sensor_type == s_records[i].sensor_type &&
+					s_records[j].value_count == s_records[i].value_count) {
+				s_expected[n++] = s_records[j];
+				taken[j] = true;
+			}
+		}
+	}
+}
+
+static float _random_value(unsigned long long *seed, int type)
+{
+	unsigned int bits;
+	float value;
+
+	switch (test_random(seed) % 8) {
+	case 0:
+		/* anything, NaN and infinities included */
+		bits = (unsigned int)test_random(seed);
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	case 1:
+		return (float)((int)(test_random(seed) % 2000001) - 1000000);
+	default:
+		/* a slow signal with some noise */
+		return (float)(type * 10 + sin(test_random(seed) % 1000 / 100.0) + (test_random(seed) % 100) / 1000.0);
+	}
+}
+
+static void _test_round_trip(bool deflate)
+{
+	static unsigned char buf[COLUMNAR_MAX_SIZE(MAX_RECORDS)];
+	unsigned long long seed = deflate ? 11 : 12;
+	unsigned int batch_id;
+	long long ts;
+	double tolerance;
+	size_t len;
+	int round;
+	int count;
+	int type;
+	int i;
+	int j;
+
+	for (round = 0; round < ROUNDS; ++round) {
+		count = test_random(&seed) % MAX_RECORDS;
+		ts = 1600000000000LL + (long long)(test_random(&seed) % 1000000000);
+
+		/* a few sensors, most with a quantum */
+		for (i = 0; i < COLUMNAR_MAX_TYPES; ++i)
+			s_quantum[i] = (i % 4 == 3) ? 0.0f : 0.001f * (1 + i % 5);
+
+		for (i = 0; i < count; ++i) {
+			type = test_random(&seed) % 8 == 0 ? 64 + test_random(&seed) % 2 : test_random(&seed) % 14;
+			s_records[i].sensor_type = type;
+			s_records[i].value_count = type < 4 ? 3 : test_random(&seed) % (RECORD_MAX_VALUES + 1);
+			/* mostly steady, sometimes late or out of order */
+			ts += test_random(&seed) % 10 ? 10 : (long long)(test_random(&seed) % 2000) - 1000;
+			s_records[i].timestamp_ms = ts;
+			for (j = 0; j < RECORD_MAX_VALUES; ++j)
+				s_records[i].values[j] = test_random(&seed) % 64 ? (float)(type + sin(ts / 1000.0) + j) : _random_value(&seed, type);
+		}
+
+		len = columnar_encode(s_records, count, round, s_quantum, deflate, buf, sizeof(buf));
+		CHECK(len >= COLUMNAR_HEADER_SIZE);
+		CHECK_EQ(columnar_decode(buf, len, &batch_id, s_decoded, count), count);
+		CHECK_EQ(batch_id, round);
+
+		_expected_order(count);
+		for (i = 0; i < count; ++i) {
+			CHECK_EQ(s_decoded[i].sensor_type, s_expected[i].sensor_type);
+			CHECK_EQ(s_decoded[i].value_count, s_expected[i].value_count);
+			CHECK_EQ(s_decoded[i].timestamp_ms, s_expected[i].timestamp_ms);
+			tolerance = s_quantum[s_expected[i].sensor_type] * 0.5 * (1 + 1e-6);
+
+			for (j = 0; j < s_expected[i].value_count; ++j) {
+				/* a stream falls back to the float bits when a value does not fit the quantum */
+				if (memcmp(&s_decoded[i].values[j], &s_expected[i].values[j], sizeof(float)) == 0)
+					continue;
+				CHECK_NEAR(s_decoded[i].values[j], s_expected[i].values[j],
+						tolerance + fabs(s_expected[i].values[j]) * 1e-7);
+			}
+		}
+
+		if (test_failures)
+			break;
+	}
+}
+
+static void _test_size(void)
+{
+	static unsigned char buf[COLUMNAR_MAX_SIZE(MAX_RECORDS)];
+	size_t len;
+	int i;
+
+	/* 100 Hz, a constant: a few bytes for the stream, then one byte per timestamp and per value */
+	for (i = 0; i < 500; ++i) {
+		s_records[i].sensor_type = 1;
+		s_records[i].value_count = 3;
+		s_records[i].timestamp_ms = 1600000000000LL + i * 10;
+		s_records[i].values[0] = 0.0f;
+		s_records[i].values[1] = 0.0f;
+		s_records[i].values[2] = 9.81f;
+	}
+	s_quantum[1] = 0.0023946f;
+	len = columnar_encode(s_records, 500, 0, s_quantum, false, buf, sizeof(buf));
+	CHECK(len < COLUMNAR_HEADER_SIZE + 30 + 4 * 500);
+
+#if defined(COLUMNAR_USE_ZLIB)
+	/* the runs of zeros deflate */
+	len = columnar_encode(s_records, 500, 0, s_quantum, true, buf, sizeof(buf));
+	CHECK(buf[3] & COLUMNAR_FLAG_DEFLATE);
+	CHECK(len < 100);
+	CHECK_EQ(columnar_decode(buf, len, NULL, s_decoded, 500), 500);
+	CHECK_EQ(s_decoded[499].timestamp_ms, s_records[499].timestamp_ms);
+#endif
+}
+
+static void _test_malformed(void)
+{
+	static unsigned char buf[COLUMNAR_MAX_SIZE(64)];
+	unsigned long long seed = 5;
+	size_t len;
+	size_t cut;
+	int ret;
+	int i;
+
+	for (i = 0; i < 64; ++i) {
+		s_records[i].sensor_type = i % 3;
+		s_records[i].value_count = 3;
+		s_records[i].timestamp_ms = 1600000000000LL + i * 20;
+		s_records[i].values[0] = i;
+		s_records[i].values[1] = -i;
+		s_records[i].values[2] = i * 0.5f;
+	}
+	len = columnar_encode(s_records, 64, 1, s_quantum, false, buf, sizeof(buf));
+
+	/* too small an output buffer, too many records, unknown types */
+	CHECK_EQ(columnar_encode(s_records, 64, 1, s_quantum, false, buf, COLUMNAR_MAX_SIZE(64) - 1), 0);
+	CHECK_EQ(columnar_encode(s_records, -1, 1, s_quantum, false, buf, sizeof(buf)), 0);
+	s_records[3].sensor_type = COLUMNAR_MAX_TYPES;
+	CHECK_EQ(columnar_encode(s_records, 64, 1, s_quantum, false, buf, sizeof(buf)), 0);
+	s_records[3].sensor_type = 0;
+
+	CHECK_EQ(columnar_decode(buf, len, NULL, s_decoded, 63), -1);
+
+	for (cut = 0; cut < len; ++cut)
+		CHECK_EQ(columnar_decode(buf, cut, NULL, s_decoded, 64), -1);
+
+	/* random bytes never read out of bounds */
+	for (i = 0; i < ROUNDS * 10; ++i) {
+		unsigned char copy[sizeof(buf)];
+
+		memcpy(copy, buf, len);
+		copy[test_random(&seed) % len] = (unsigned char)test_random(&seed);
+		ret = columnar_decode(copy, len, NULL, s_decoded, 64);
+		CHECK(ret == -1 || ret == 64);
+	}
+}
+
+int main(void)
+{
+	_test_round_trip(false);
+	_test_round_trip(true);
+	_test_size();
+	_test_malformed();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,140 @@
+/*
+ * test_deadband.c
+ *
+ * Change detection of the slow sensors: the bands, the heartbeat of an
+ * unchanged sensor, the fast interval after a change and the counters.
+ */
+
+#include <stdlib.h>
+#include "deadband.h"
+#include "test.h"
+
+#define LIGHT		7
+#define PRESSURE	9
+#define GRAVITY		1
+
+static record_t _record(int type, long long timestamp_ms, float value)
+{
+	record_t record = { type, timestamp_ms, 1, { value } };
+
+	return record;
+}
+
+/* filters one record, true when it is kept */
+static bool _filter(int type, long long timestamp_ms, float value)
+{
+	record_t record = _record(type, timestamp_ms, value);
+
+	return deadband_filter(&record, 1) == 1;
+}
+
+static void _test_bands(void)
+{
+	deadband_policy_t policy = { 2.0f, 0.05f, 0, 0, 0 };
+	deadband_stats_t stats;
+	record_t records[3];
+
+	deadband_set_policy(LIGHT, &policy);
+
+	/* the first record is always sent, the band is the larger of 2 lx and 5% */
+	CHECK(_filter(LIGHT, 0, 10.0f));
+	CHECK(!_filter(LIGHT, 100, 12.0f));
+	CHECK(_filter(LIGHT, 200, 12.01f));
+	CHECK(!_filter(LIGHT, 300, 10.02f));
+	CHECK(_filter(LIGHT, 400, 1000.0f));
+	CHECK(!_filter(LIGHT, 500, 1049.0f));
+	CHECK(_filter(LIGHT, 600, 1051.0f));
+
+	/* a slow drift is measured from the last sent value, not the previous one */
+	CHECK(!_filter(LIGHT, 700, 1080.0f));
+	CHECK(!_filter(LIGHT, 800, 1100.0f));
+	CHECK(_filter(LIGHT, 900, 1110.0f));
+
+	/* any value of a multi-value record, a new layout, a NaN */
+	records[0] = _record(LIGHT, 1000, 1110.0f);
+	records[0].value_count = 2;
+	records[0].values[1] = 5.0f;
+	records[1] = records[0];
+	records[1].timestamp_ms = 1100;
+	records[1].values[1] = 5.5f;
+	records[2] = records[1];
+	records[2].timestamp_ms = 1200;
+	records[2].values[1] = 8.0f;
+	CHECK_EQ(deadband_filter(records, 3), 2);
+	CHECK_EQ(records[0].timestamp_ms, 1000);
+	CHECK_EQ(records[1].timestamp_ms, 1200);
+	CHECK(_filter(LIGHT, 1300, NAN));
+
+	deadband_get_stats(LIGHT, &stats);
+	CHECK_EQ(stats.sent, 8);
+	CHECK_EQ(stats.suppressed, 6);
+
+	/* the next record after a restart is sent, the counters are kept */
+	CHECK(_filter(LIGHT, 1400, 1110.0f));
+	CHECK(!_filter(LIGHT, 1500, 1110.0f));
+	deadband_reset(LIGHT);
+	CHECK(_filter(LIGHT, 1600, 1110.0f));
+	deadband_get_stats(LIGHT, &stats);
+	CHECK_EQ(stats.sent, 10);
+	CHECK_EQ(stats.suppressed, 7);
+
+	/* no policy, every record */
+	deadband_set_policy(LIGHT, NULL);
+	CHECK(_filter(LIGHT, 1700, 1110.0f));
+	CHECK(_filter(LIGHT, 1800, 1110.0f));
+	CHECK(_filter(GRAVITY, 0, 9.81f));
+	CHECK(_filter(GRAVITY, 10, 9.81f));
+	CHECK(_filter(64, 0, 1.0f));
+	CHECK(_filter(64, 0, 1.0f));
+}
+
+static void _test_heartbeat(void)
+{
+	deadband_policy_t policy = { 0.05f, 0.0f, 60000, 0, 0 };
+	int sent = 0;
+	int i;
+
+	deadband_set_policy(PRESSURE, &policy);
+
+	/* ten minutes of a constant reading at 1 Hz, one record a minute */
+	for (i = 0; i < 600; ++i)
+		sent += _filter(PRESSURE, i * 1000LL, 1013.25f);
+	CHECK_EQ(sent, 10);
+}
+
+static void _test_fast_interval(void)
+{
+	deadband_policy_t policy = { 0.05f, 0.0f, 60000, 250, 5000 };
+
+	deadband_set_policy(PRESSURE, &policy);
+
+	CHECK_EQ(deadband_interval(PRESSURE, 1000), 1000);
+	_filter(PRESSURE, 0, 1013.0f);
+	/* the first record counts as a change */
+	CHECK_EQ(deadband_interval(PRESSURE, 1000), 250);
+	_filter(PRESSURE, 4000, 1013.0f);
+	CHECK_EQ(deadband_interval(PRESSURE, 1000), 250);
+	_filter(PRESSURE, 5000, 1013.0f);
+	CHECK_EQ(deadband_interval(PRESSURE, 1000), 1000);
+
+	_filter(PRESSURE, 6000, 1013.5f);
+	CHECK_EQ(deadband_interval(PRESSURE, 1000), 250);
+	_filter(PRESSURE, 10999, 1013.5f);
+	CHECK_EQ(deadband_interval(PRESSURE, 1000), 250);
+	_filter(PRESSURE, 11000, 1013.5f);
+	CHECK_EQ(deadband_interval(PRESSURE, 1000), 1000);
+
+	/* never slower than the capture interval */
+	_filter(PRESSURE, 12000, 1014.0f);
+	CHECK_EQ(deadband_interval(PRESSURE, 100), 100);
+	CHECK_EQ(deadband_interval(GRAVITY, 10), 10);
+}
+
+int main(void)
+{
+	_test_bands();
+	_test_heartbeat();
+	_test_fast_interval();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,243 @@
+/*
+ * test_fusion.c
+ *
+ * Orientation filter against a simulated watch turning on the wrist: the
+ * gyroscope at 25 Hz with a bias, the accelerometer at 12.5 Hz and the
+ * magnetic sensor at 6.25 Hz, derived from the true attitude. Checks the
+ * tracking error once the filter has converged, the output period, the
+ * stale references and the restarts. Also built with FUSION_FIXED_POINT as
+ * test_fusion_fixed.
+ */
+
+#include "fusion.h"
+#include "test.h"
+
+#define GYRO_US			40000ULL
+#define RAD_TO_DEG		57.29578
+
+static const double s_gravity[3] = { 0, 0, 9.81 };
+static const double s_field[3] = { 22, 0, -40 };
+
+static double s_q[4];
+static unsigned long long s_t;
+
+static void _mul(const double *a, const double *b, double *r)
+{
+	r[0] = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+	r[1] = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+	r[2] = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+	r[3] = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+}
+
+/* an earth vector seen from the watch, q* v q */
+static void _to_device(const double *v, float *out)
+{
+	double conj[4] = { s_q[0], -s_q[1], -s_q[2], -s_q[3] };
+	double p[4] = { 0, v[0], v[1], v[2] };
+	double t[4];
+	double r[4];
+
+	_mul(conj, p, t);
+	_mul(t, s_q, r);
+	out[0] = r[1];
+	out[1] = r[2];
+	out[2] = r[3];
+}
+
+/* angle in degrees between the true attitude and an estimate, whatever the sign of the estimate */
+static double _error(const float *q)
+{
+	double d = fabs(q[0] * s_q[0] + q[1] * s_q[1] + q[2] * s_q[2] + q[3] * s_q[3]);
+
+	return 2 * acos(d > 1 ? 1 : d) * RAD_TO_DEG;
+}
+
+static void _start(double angle, double x, double y, double z)
+{
+	s_q[0] = cos(angle / 2);
+	s_q[1] = sin(angle / 2) * x;
+	s_q[2] = sin(angle / 2) * y;
+	s_q[3] = sin(angle / 2) * z;
+	s_t = 1000000;
+	fusion_reset();
+}
+
+/*
+ * Turns the watch for the given seconds, at a rate varying with rate_scale (0 for a watch at rest),
+ * feeding the filter with a gyroscope biased by bias deg/s and, if references is set, the gravity
+ * and the field. Returns the number of outputs, their mean error after skip_s in *mean and the
+ * largest in *max.
+ */
+static int _run(double seconds, double rate_scale, double bias, bool references, double skip_s, double *mean, double *max)
+{
+	unsigned long long end = s_t + (unsigned long long)(seconds * 1000000);
+	unsigned long long skip = s_t + (unsigned long long)(skip_s * 1000000);
+	double half = GYRO_US / 2000000.0;
+	double t;
+	double w[3];
+	double dq[4];
+	double r[4];
+	double norm;
+	double error;
+	double sum = 0;
+	float gyro[3];
+	float v[3];
+	float out[4];
+	int outputs = 0;
+	int measured = 0;
+	int k;
+	int i;
+
+	*max = 0;
+	for (k = 0; s_t < end; ++k) {
+		t = s_t / 1000000.0;
+		w[0] = rate_scale * 0.8 * sin(0.5 * t);
+		w[1] = rate_scale * 0.5 * cos(0.3 * t);
+		w[2] = rate_scale * 0.3;
+
+		/* the attitude at the end of the step */
+		dq[0] = 0;
+		dq[1] = w[0] * half;
+		dq[2] = w[1] * half;
+		dq[3] = w[2] * half;
+		_mul(s_q, dq, r);
+		for (i = 0; i < 4; ++i)
+			s_q[i] += r[i];
+		norm = sqrt(s_q[0] * s_q[0] + s_q[1] * s_q[1] + s_q[2] * s_q[2] + s_q[3] * s_q[3]);
+		for (i = 0; i < 4; ++i)
+			s_q[i] /= norm;
+		s_t += GYRO_US;
+
+		if (references && k % 2 == 0) {
+			_to_device(s_gravity, v);
+			fusion_set_gravity(s_t, v);
+		}
+		if (references && k % 4 == 0) {
+			_to_device(s_field, v);
+			fusion_set_magnetic(s_t, v);
+		}
+
+		for (i = 0; i < 3; ++i)
+			gyro[i] = (float)((w[i] + (i == 0 ? bias : -bias) / RAD_TO_DEG) * RAD_TO_DEG);
+		if (fusion_update(s_t, gyro, out)) {
+			outputs++;
+			CHECK_NEAR(out[0] * out[0] + out[1] * out[1] + out[2] * out[2] + out[3] * out[3], 1.0, 1e-3);
+			if (s_t >= skip) {
+				error = _error(out);
+				sum += error;
+				measured++;
+				if (error > *max)
+					*max = error;
+			}
+		}
+	}
+
+	*mean = measured ? sum / measured : 0;
+
+	return outputs;
+}
+
+static void _test_tracking(void)
+{
+	double mean;
+	double max;
+	int outputs;
+
+	/* from the identity to an attitude far from it, with a gyroscope off by 0.6 deg/s */
+	_start(0.6, 0.6, 0, 0.8);
+	outputs = _run(120, 1, 0.6, true, 10, &mean, &max);
+
+	/* an output per 100 ms, the gyroscope period rounds it up to 120 ms */
+	CHECK(outputs >= 120 * 1000 / 120 - 2 && outputs <= 120 * 1000 / FUSION_OUTPUT_INTERVAL_MS);
+	CHECK(mean < 2.0);
+	CHECK(max < 5.0);
+
+	/* at rest the error settles further */
+	_run(30, 0, 0.6, true, 20, &mean, &max);
+	CHECK(max < 1.0);
+}
+
+static void _test_stale_references(void)
+{
+	double mean;
+	double max;
+	float wrong[3] = { 9.81f, 0, 0 };
+	float out[4];
+	float gyro[3] = { 0, 0, 0 };
+	int k;
+
+	/*
+	 * Converged at rest, then the references stop. They are still used for FUSION_REFERENCE_MAX_AGE_MS,
+	 * for the samples of the other sensors delivered late, then the unbiased gyroscope is integrated alone.
+	 */
+	_start(1.0, 0, 1, 0);
+	_run(30, 1, 0, true, 0, &mean, &max);
+	_run(10, 0, 0, true, 5, &mean, &max);
+	CHECK(max < 1.0);
+	_run(FUSION_REFERENCE_MAX_AGE_MS / 1000.0 + 1, 0, 0, false, 0, &mean, &max);
+	_run(20, 1, 0, false, 0, &mean, &max);
+	CHECK(max < 1.5);
+
+	/* a gravity older than FUSION_REFERENCE_MAX_AGE_MS is not used, a fresh one pulls the attitude */
+	fusion_set_gravity(s_t - FUSION_REFERENCE_MAX_AGE_MS * 1000ULL - GYRO_US, wrong);
+	_run(5, 0, 0, false, 0, &mean, &max);
+	CHECK(max < 1.5);
+
+	fusion_set_gravity(s_t, wrong);
+	for (k = 0; k < 25 * 5; ++k) {
+		s_t += GYRO_US;
+		fusion_set_gravity(s_t, wrong);
+		fusion_update(s_t, gyro, out);
+	}
+	CHECK(_error(out) > 45.0);
+}
+
+static void _test_restarts(void)
+{
+	float gyro[3] = { 10, 0, 0 };
+	float out[4] = { 0 };
+	float v[3];
+
+	/* the first sample and the samples after a gap only set the time */
+	_start(0, 1, 0, 0);
+	CHECK(!fusion_update(s_t, gyro, out));
+	CHECK(!fusion_update(s_t, gyro, out));						/* the same timestamp */
+	CHECK(!fusion_update(s_t - GYRO_US, gyro, out));			/* back in time */
+	s_t += 2000000;
+	CHECK(!fusion_update(s_t, gyro, out));						/* longer than a second */
+	s_t += GYRO_US;
+	CHECK(fusion_update(s_t, gyro, out));
+	/* 10 deg/s around x for 40 ms */
+	CHECK_NEAR(out[0], cos(0.2 / RAD_TO_DEG), 1e-4);
+	CHECK_NEAR(out[1], sin(0.2 / RAD_TO_DEG), 1e-4);
+
+	/* the reset goes back to the identity and drops the references */
+	_to_device(s_gravity, v);
+	v[0] = 5;
+	fusion_set_gravity(s_t, v);
+	fusion_reset();
+	gyro[0] = 0;
+	s_t += GYRO_US;
+	CHECK(!fusion_update(s_t, gyro, out));
+	s_t += GYRO_US;
+	CHECK(fusion_update(s_t, gyro, out));
+	CHECK_NEAR(out[0], 1.0, 1e-5);
+	CHECK_NEAR(out[1], 0.0, 1e-5);
+
+	/* a null vector is no reference */
+	v[0] = v[1] = v[2] = 0;
+	fusion_set_gravity(s_t, v);
+	do {
+		s_t += GYRO_US;
+	} while (!fusion_update(s_t, gyro, out));
+	CHECK_NEAR(out[0], 1.0, 1e-5);
+}
+
+int main(void)
+{
+	_test_tracking();
+	_test_stale_references();
+	_test_restarts();
+
+	return TEST_RESULT();
+}
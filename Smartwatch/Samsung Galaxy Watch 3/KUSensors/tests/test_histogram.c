@@ -0,0 +1,137 @@
+/*
+ * test_histogram.c
+ *
+ * Percentiles of the latency histogram against the exact ones of sorted
+ * samples, the clamping of the values out of range and the recording from
+ * several threads.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "histogram.h"
+#include "test.h"
+
+#define SAMPLES		100000
+#define THREADS		4
+
+static histogram_t s_histogram;
+static unsigned long long s_values[SAMPLES];
+
+static int _compare(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* the exact percentile with the rank of histogram_percentile() */
+static unsigned long long _exact(const unsigned long long *sorted, int count, double percentile)
+{
+	unsigned long long rank = (unsigned long long)(percentile / 100.0 * count + 0.5);
+
+	return sorted[rank < 1 ? 0 : rank - 1];
+}
+
+static void _test_percentiles(void)
+{
+	static const double percentiles[] = { 0, 1, 10, 50, 90, 99, 99.9, 100 };
+	unsigned long long seed = 7;
+	unsigned long long exact;
+	unsigned long long value;
+	int distribution;
+	int i;
+	int j;
+
+	for (distribution = 0; distribution < 3; ++distribution) {
+		histogram_reset(&s_histogram);
+		for (i = 0; i < SAMPLES; ++i) {
+			if (distribution == 0)
+				value = test_random(&seed) % 20;						/* the exact buckets */
+			else if (distribution == 1)
+				value = 1000 + test_random(&seed) % 100000;				/* uniform */
+			else
+				value = 1ULL << (test_random(&seed) % 36) | test_random(&seed) % 1024;	/* heavy tail */
+			s_values[i] = value;
+			histogram_record(&s_histogram, value);
+		}
+		qsort(s_values, SAMPLES, sizeof(s_values[0]), _compare);
+
+		CHECK_EQ(s_histogram.count, SAMPLES);
+		CHECK_EQ(s_histogram.max, s_values[SAMPLES - 1]);
+
+		/* the highest value of the bucket, at most 1/8 above the exact percentile */
+		for (j = 0; j < sizeof(percentiles) / sizeof(percentiles[0]); ++j) {
+			exact = _exact(s_values, SAMPLES, percentiles[j]);
+			value = histogram_percentile(&s_histogram, percentiles[j]);
+			CHECK(value >= exact);
+			CHECK(value <= exact + exact / 8);
+			if (exact < 16)
+				CHECK_EQ(value, exact);
+		}
+		CHECK_EQ(histogram_percentile(&s_histogram, 100), s_values[SAMPLES - 1]);
+	}
+}
+
+static void _test_edges(void)
+{
+	histogram_t copy;
+
+	histogram_reset(&s_histogram);
+	CHECK_EQ(histogram_percentile(&s_histogram, 50), 0);
+	CHECK_EQ(histogram_mean(&s_histogram), 0);
+
+	histogram_record(&s_histogram, 10);
+	histogram_record(&s_histogram, 20);
+	histogram_record(&s_histogram, 30);
+	CHECK_EQ(histogram_mean(&s_histogram), 20);
+	CHECK_EQ(histogram_percentile(&s_histogram, 0), 10);
+
+	/* beyond 2^40 the values share the last bucket, the max stays exact */
+	histogram_record(&s_histogram, 1ULL << 45);
+	histogram_record(&s_histogram, ~0ULL >> 1);
+	CHECK_EQ(histogram_percentile(&s_histogram, 100), ~0ULL >> 1);
+	CHECK_EQ(s_histogram.counts[HISTOGRAM_BUCKETS - 1], 2);
+
+	histogram_copy(&copy, &s_histogram);
+	CHECK(memcmp(&copy, &s_histogram, sizeof(copy)) == 0);
+}
+
+static void *_record_thread(void *data)
+{
+	unsigned long long seed = (unsigned long long)(size_t)data + 1;
+	int i;
+
+	for (i = 0; i < SAMPLES; ++i)
+		histogram_record(&s_histogram, test_random(&seed) % 1000000);
+
+	return NULL;
+}
+
+static void _test_threads(void)
+{
+	pthread_t threads[THREADS];
+	unsigned long long total = 0;
+	int i;
+
+	histogram_reset(&s_histogram);
+	for (i = 0; i < THREADS; ++i)
+		pthread_create(&threads[i], NULL, _record_thread, (void *)(size_t)i);
+	for (i = 0; i < THREADS; ++i)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; ++i)
+		total += s_histogram.counts[i];
+	CHECK_EQ(total, THREADS * SAMPLES);
+	CHECK_EQ(s_histogram.count, THREADS * SAMPLES);
+	CHECK(s_histogram.max < 1000000 && s_histogram.max > 990000);
+}
+
+int main(void)
+{
+	_test_percentiles();
+	_test_edges();
+	_test_threads();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,201 @@
+/*
+ * test_hrv.c
+ *
+ * Beat extraction and rolling HRV of the HRM stream: a beat train sampled
+ * by the 4 Hz HRM events, with the statistics checked against RMSSD and
+ * SDNN computed directly from the last HRV_WINDOW intervals, then the
+ * artifacts, the loss of skin contact and the rate-only reports.
+ */
+
+#include <stdlib.h>
+#include "hrv.h"
+#include "test.h"
+
+#define EVENT_US	250000ULL
+#define MAX_BEATS	2000
+
+static float s_rr[MAX_BEATS];
+
+/* intervals around 800 ms with a respiratory swing and some noise, never twice the same */
+static int _beat_train(unsigned long long *seed, int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		s_rr[i] = 800.0f + 40.0f * sinf(i * 0.3f) + (int)(test_random(seed) % 21) - 10;
+		if (i > 0 && s_rr[i] == s_rr[i - 1])
+			s_rr[i] += 1.0f;
+	}
+
+	return count;
+}
+
+/* RMSSD and SDNN of the last HRV_WINDOW intervals before beat end */
+static void _reference(int end, double *rmssd, double *sdnn, double *heart_rate)
+{
+	int first = end > HRV_WINDOW ? end - HRV_WINDOW : 0;
+	double sum = 0;
+	double sum2 = 0;
+	double mean;
+	int i;
+
+	for (i = first; i < end; ++i)
+		sum += s_rr[i];
+	mean = sum / (end - first);
+	for (i = first; i < end; ++i)
+		sum2 += (s_rr[i] - mean) * (s_rr[i] - mean);
+	*sdnn = sqrt(sum2 / (end - first - 1));
+	*heart_rate = 60000.0 / mean;
+
+	/* the differences of the last HRV_WINDOW pairs */
+	first = end > HRV_WINDOW + 1 ? end - HRV_WINDOW - 1 : 0;
+	sum2 = 0;
+	for (i = first + 1; i < end; ++i)
+		sum2 += (s_rr[i] - s_rr[i - 1]) * (s_rr[i] - s_rr[i - 1]);
+	*rmssd = sqrt(sum2 / (end - first - 1));
+}
+
+/*
+ * Plays the beat train through 4 Hz events reporting the interval of the last beat, the way the
+ * sensor hub does. artifact_every > 0 replaces one report out of artifact_every with a 400 ms one.
+ * Returns the number of beats hrv_add_event() recognized.
+ */
+static int _play(int count, int artifact_every, unsigned long long *seed)
+{
+	unsigned long long beat_us = 1000000;
+	unsigned long long t;
+	hrv_beat_t beat;
+	float report = 0;
+	int next = 0;
+	int recognized = 0;
+
+	for (t = EVENT_US; next < count; t += EVENT_US) {
+		if (beat_us <= t) {
+			report = s_rr[next];
+			beat_us += (unsigned long long)(s_rr[next++] * 1000.0f);
+			if (artifact_every && test_random(seed) % artifact_every == 0)
+				report = 400.0f;
+		}
+		if (report > 0 && hrv_add_event(t, 75.0f, report, &beat)) {
+			recognized++;
+			CHECK_EQ(beat.timestamp_us, t);
+			CHECK_EQ(beat.rr_ms, report);
+		}
+	}
+
+	return recognized;
+}
+
+static void _test_clean_train(void)
+{
+	unsigned long long seed = 1;
+	double heart_rate;
+	double rmssd;
+	double sdnn;
+	hrv_stats_t stats;
+	int count;
+
+	/* fewer beats than the window, then many more */
+	for (count = 20; count <= 500; count += 480) {
+		hrv_reset();
+		_beat_train(&seed, count);
+		CHECK_EQ(_play(count, 0, &seed), count);
+
+		hrv_get_stats(&stats);
+		_reference(count, &rmssd, &sdnn, &heart_rate);
+		CHECK_EQ(stats.accepted, count);
+		CHECK_EQ(stats.rejected, 0);
+		CHECK_EQ(stats.beats, count < HRV_WINDOW ? count : HRV_WINDOW);
+		CHECK_EQ(stats.rr_ms, s_rr[count - 1]);
+		CHECK_NEAR(stats.rmssd_ms, rmssd, 0.01);
+		CHECK_NEAR(stats.sdnn_ms, sdnn, 0.01);
+		CHECK_NEAR(stats.heart_rate, heart_rate, 0.01);
+	}
+}
+
+static void _test_artifacts(void)
+{
+	unsigned long long seed = 2;
+	double heart_rate;
+	double rmssd;
+	double sdnn;
+	hrv_stats_t stats;
+	int count = _beat_train(&seed, 1000);
+
+	/* a 400 ms artifact every 20 beats on average is rejected and barely moves the statistics */
+	hrv_reset();
+	_play(count, 20, &seed);
+	hrv_get_stats(&stats);
+	_reference(count, &rmssd, &sdnn, &heart_rate);
+	CHECK(stats.rejected > 20 && stats.rejected < 100);
+	/* a 400 ms report still there 600 ms later counts as a second beat */
+	CHECK(stats.accepted + stats.rejected >= count);
+	CHECK(stats.accepted <= count);
+	CHECK_NEAR(stats.rmssd_ms, rmssd, rmssd * 0.15);
+	CHECK_NEAR(stats.sdnn_ms, sdnn, sdnn * 0.15);
+	CHECK_NEAR(stats.heart_rate, heart_rate, 1.0);
+}
+
+static void _test_contact_and_range(void)
+{
+	hrv_beat_t beat;
+	hrv_stats_t stats;
+
+	hrv_reset();
+	CHECK(hrv_add_event(1000000, 75.0f, 800.0f, &beat));
+	CHECK(!hrv_add_event(1250000, 75.0f, 800.0f, &beat));		/* the same beat again */
+	CHECK(hrv_add_event(1750000, 75.0f, 820.0f, &beat));
+	CHECK_EQ(beat.rr_ms, 820.0f);
+	CHECK(beat.confidence >= HRV_MIN_CONFIDENCE);
+
+	/* off the wrist: no beat, and no difference across the gap */
+	CHECK(!hrv_add_event(2000000, 0.0f, 820.0f, &beat));
+	CHECK(hrv_add_event(2250000, 75.0f, 790.0f, &beat));
+	CHECK(hrv_add_event(3000000, 75.0f, 800.0f, &beat));
+	hrv_get_stats(&stats);
+	CHECK_EQ(stats.accepted, 4);
+	/* 820 - 800 and 800 - 790, not 790 - 820 */
+	CHECK_NEAR(stats.rmssd_ms, sqrt((20.0 * 20 + 10.0 * 10) / 2), 0.001);
+
+	/* out of the physiological range */
+	CHECK(hrv_add_event(3250000, 75.0f, 250.0f, &beat));
+	CHECK_EQ(beat.confidence, 0.0f);
+	CHECK(hrv_add_event(6000000, 75.0f, 2500.0f, &beat));
+	CHECK_EQ(beat.confidence, 0.0f);
+	hrv_get_stats(&stats);
+	CHECK_EQ(stats.rejected, 2);
+	CHECK_EQ(stats.beats, 4);
+
+	hrv_reset();
+	hrv_get_stats(&stats);
+	CHECK_EQ(stats.beats, 0);
+	CHECK_EQ(stats.accepted, 0);
+	CHECK_EQ(stats.rmssd_ms, 0.0f);
+}
+
+/* without peak-to-peak intervals the beats follow the rate but stay out of the statistics */
+static void _test_rate_only(void)
+{
+	unsigned long long t;
+	hrv_stats_t stats;
+	int beats = 0;
+
+	hrv_reset();
+	for (t = EVENT_US; t <= 60000000ULL; t += EVENT_US)
+		beats += hrv_add_event(t, 60.0f, 0.0f, NULL);
+
+	CHECK(beats >= 58 && beats <= 61);
+	hrv_get_stats(&stats);
+	CHECK_EQ(stats.accepted, 0);
+	CHECK_EQ(stats.beats, 0);
+}
+
+int main(void)
+{
+	_test_clean_train();
+	_test_artifacts();
+	_test_contact_and_range();
+	_test_rate_only();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,214 @@
+/*
+ * test_json.cpp
+ *
+ * Objects and arrays of Json::Value, built with the std::map storage and,
+ * as test_json_flat, with the flat sorted storage of JSON_USE_FLAT_OBJECT:
+ * the iteration and serialization order, lookups, copies, comparisons,
+ * removals and swaps, below and above the members kept inside the container,
+ * and documents with their keys out of order and repeated, which the reader
+ * sorts once per object instead of inserting each member in place.
+ */
+
+#include <string>
+#include <json/json.h>
+#include "test.h"
+
+static std::string _write(const Json::Value& value)
+{
+	Json::StreamWriterBuilder builder;
+
+	builder["indentation"] = "";
+	return Json::writeString(builder, value);
+}
+
+static void _check_written(const Json::Value& value, const char *expected)
+{
+	std::string text = _write(value);
+
+	CHECK_STR(text.c_str(), expected);
+}
+
+/* the names of the members in iteration order, comma separated */
+static std::string _names(const Json::Value& value)
+{
+	std::string names;
+	Json::Value::const_iterator it;
+
+	for (it = value.begin(); it != value.end(); ++it) {
+		if (!names.empty())
+			names += ",";
+		names += it.name();
+	}
+
+	return names;
+}
+
+static void _test_object(void)
+{
+	Json::Value value;
+	Json::Value copy;
+	Json::Value removed;
+	std::string names;
+
+	value["b"] = 1;
+	value["a"] = 2;
+	value["c"]["x"] = 3;
+	value["arr"].append(1);
+	value["arr"].append("s");
+	value["arr"][5] = true;
+
+	names = _names(value);
+	CHECK_STR(names.c_str(), "a,arr,b,c");
+	CHECK_EQ(value.end() - value.begin(), 4);
+	_check_written(value, "{\"a\":2,\"arr\":[1,\"s\",null,null,null,true],\"b\":1,\"c\":{\"x\":3}}");
+
+	CHECK(value.isMember("c"));
+	CHECK(!value.isMember("d"));
+	CHECK(value.find("arr", "arr" + 3) != NULL);
+	CHECK(value.find("ar", "ar" + 2) == NULL);
+	CHECK_EQ(value.get("b", 7).asInt(), 1);
+	CHECK_EQ(value.get("d", 7).asInt(), 7);
+	CHECK_EQ(value.size(), 4);
+
+	copy = value;
+	CHECK(copy == value);
+	copy["a"] = 3;
+	CHECK(!(copy == value));
+	CHECK(value < copy);
+	CHECK_EQ(value["a"].asInt(), 2);
+
+	CHECK(value.removeMember("b", &removed));
+	CHECK_EQ(removed.asInt(), 1);
+	CHECK(!value.isMember("b"));
+	CHECK(!value.removeMember("b", &removed));
+	CHECK(value["arr"].removeIndex(0, &removed));
+	CHECK_EQ(removed.asInt(), 1);
+	CHECK_EQ(value["arr"].size(), 5);
+	CHECK_STR(value["arr"][0].asCString(), "s");
+	_check_written(value, "{\"a\":2,\"arr\":[\"s\",null,null,null,true],\"c\":{\"x\":3}}");
+}
+
+/* objects of `count` members, inserted in a scrambled order: 7 is prime with every count */
+static void _test_sizes(int count)
+{
+	Json::Value value;
+	Json::Value copy;
+	Json::Value small;
+	Json::Value::const_iterator it;
+	std::string previous;
+	std::string key;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		key = "k" + std::to_string(1000 + (i * 7) % count);
+		value[key] = i;
+	}
+	CHECK_EQ(value.size(), count);
+
+	for (it = value.begin(); it != value.end(); ++it) {
+		CHECK(previous < it.name());
+		previous = it.name();
+	}
+	for (i = 0; i < count; ++i)
+		CHECK_EQ(value["k" + std::to_string(1000 + (i * 7) % count)].asInt(), i);
+	CHECK_EQ(value.size(), count);
+
+	copy = value;
+	value.swap(copy);
+	CHECK(value == copy);
+
+	/* every other member out, the rest still found */
+	for (i = 0; i < count; i += 2)
+		value.removeMember("k" + std::to_string(1000 + i));
+	CHECK_EQ(value.size(), count / 2);
+	for (i = 0; i < count; ++i)
+		CHECK_EQ(value.isMember("k" + std::to_string(1000 + i)), i % 2 == 1);
+
+	/* a small object swapped with a big one */
+	small["x"] = 1;
+	copy = value;
+	small.swap(copy);
+	CHECK_EQ(copy.size(), 1);
+	CHECK_EQ(copy["x"].asInt(), 1);
+	CHECK(small == value);
+}
+
+static void _test_round_trip(void)
+{
+	const char *text = "{\"type\":\"HRM\",\"timestamp\":1700000000123,\"values\":[72,0.5,-1.25],"
+			"\"accuracy\":3,\"meta\":{\"seq\":42,\"batch\":17},\"empty\":{},\"none\":[]}";
+	Json::CharReaderBuilder builder;
+	std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+	Json::Value value;
+	Json::Value again;
+	std::string written;
+
+	CHECK(reader->parse(text, text + strlen(text), &value, NULL));
+	CHECK_STR(value["type"].asCString(), "HRM");
+	CHECK_EQ(value["timestamp"].asInt64(), 1700000000123LL);
+	CHECK_EQ(value["meta"]["seq"].asInt(), 42);
+	CHECK(value["empty"].isObject());
+	CHECK_EQ(value["empty"].size(), 0);
+
+	written = _write(value);
+	CHECK_STR(written.c_str(), "{\"accuracy\":3,\"empty\":{},\"meta\":{\"batch\":17,\"seq\":42},\"none\":[],"
+			"\"timestamp\":1700000000123,\"type\":\"HRM\",\"values\":[72,0.5,-1.25]}");
+	CHECK(reader->parse(written.data(), written.data() + written.size(), &again, NULL));
+	CHECK(again == value);
+}
+
+/* an object of `count` members in a scrambled order, then member 0 again, each holding an object */
+static void _test_parse_order(int count)
+{
+	Json::CharReaderBuilder builder;
+	std::unique_ptr<Json::CharReader> reader;
+	Json::Value value;
+	Json::Value::const_iterator it;
+	std::string text = " {";
+	std::string previous;
+	std::string errors;
+	int i;
+
+	for (i = 0; i < count; ++i)
+		text += "\"k" + std::to_string(1000 + (i * 7) % count) + "\":{\"v\":" + std::to_string(i) + "},";
+	text += "\"k1000\":{\"v\":-1}}";
+
+	reader.reset(builder.newCharReader());
+	CHECK(reader->parse(text.data(), text.data() + text.size(), &value, NULL));
+	CHECK_EQ(value.size(), count);
+	CHECK_EQ(value.getOffsetStart(), 1);
+	CHECK_EQ(value.getOffsetLimit(), (ptrdiff_t)text.size());
+	for (it = value.begin(); it != value.end(); ++it) {
+		CHECK(previous < it.name());
+		previous = it.name();
+	}
+	/* the last of the repeated keys is kept */
+	CHECK_EQ(value["k1000"]["v"].asInt(), -1);
+	for (i = 1; i < count; ++i)
+		CHECK_EQ(value["k" + std::to_string(1000 + (i * 7) % count)]["v"].asInt(), i);
+	CHECK_EQ(value.size(), count);
+
+	/* the repeated key is found after the members were moved aside */
+	builder["rejectDupKeys"] = true;
+	reader.reset(builder.newCharReader());
+	CHECK(!reader->parse(text.data(), text.data() + text.size(), &value, &errors));
+	CHECK(errors.find("Duplicate key: 'k1000'") != std::string::npos);
+}
+
+int main(void)
+{
+	_test_object();
+	/* around the members kept inside the flat container */
+	_test_sizes(1);
+	_test_sizes(JSON_FLAT_OBJECT_INLINE);
+	_test_sizes(JSON_FLAT_OBJECT_INLINE + 1);
+	_test_sizes(100);
+	_test_sizes(1000);
+	_test_round_trip();
+	_test_parse_order(10);
+	_test_parse_order(64);
+	_test_parse_order(65);
+	_test_parse_order(10000);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,166 @@
+/*
+ * test_json_arena.cpp
+ *
+ * Json::Value trees in a Json::Arena, with the std::map storage and, as
+ * test_json_arena_flat, with the flat storage: parsing in a scope, trees
+ * mutated and copied inside and outside of it, nested scopes, removals,
+ * heap copies that outlive reset(), and no allocation at all when a reused
+ * arena parses one message after the other. The allocations are counted by
+ * replacing the global operator new and wrapping malloc at link time.
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <json/json.h>
+#include "test.h"
+
+#define MESSAGE		"{\"type\":\"HRM\",\"timestamp\":1700000000123,\"device\":\"R850-3f2a9c1b7d\"," \
+			"\"values\":[72.0,0.98,1.25],\"accuracy\":3,\"meta\":{\"batch\":17,\"seq\":42}}"
+#define LONG_STRING	"a string too long for the small string buffer of std::string"
+
+static size_t s_allocations;
+
+extern "C" void *__real_malloc(size_t size);
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+	s_allocations++;
+	return __real_malloc(size);
+}
+
+void *operator new(size_t size)
+{
+	void *p = __real_malloc(size ? size : 1);
+
+	if (!p)
+		throw std::bad_alloc();
+	s_allocations++;
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+static std::string _document(int count)
+{
+	std::string text = "[";
+	int i;
+
+	for (i = 0; i < count; ++i)
+		text += std::string(i ? "," : "") + MESSAGE;
+
+	return text + "]";
+}
+
+static bool _parse(Json::CharReader *reader, const std::string& text, Json::Value *root)
+{
+	return reader->parse(text.data(), text.data() + text.size(), root, NULL);
+}
+
+static void _test_scope(void)
+{
+	Json::CharReaderBuilder builder;
+	std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+	std::string text = _document(200);
+	Json::Arena arena(1024);
+	Json::Value heap;
+	Json::Value root;
+
+	/* mutated, copied and trimmed inside the scope */
+	{
+		Json::Arena::Scope scope(arena);
+		Json::Value copy;
+
+		CHECK(_parse(reader.get(), text, &root));
+		CHECK(Json::Arena::current() == &arena);
+		CHECK(arena.used() > 0);
+		CHECK_STR(root[5]["device"].asCString(), "R850-3f2a9c1b7d");
+		root[3]["extra"] = LONG_STRING;
+		copy = root;
+		CHECK(copy == root);
+
+		/* a nested scope, then the outer arena again */
+		{
+			Json::Arena inner;
+			Json::Arena::Scope inner_scope(inner);
+			Json::Value value(LONG_STRING);
+
+			CHECK(Json::Arena::current() == &inner);
+			CHECK(inner.used() > 0);
+		}
+		CHECK(Json::Arena::current() == &arena);
+
+		CHECK(root[0].removeMember("type", NULL));
+		CHECK(root.removeIndex(1, NULL));
+		CHECK_EQ(root.size(), 199);
+		CHECK_STR(root[2]["extra"].asCString(), LONG_STRING);
+	}
+	CHECK(Json::Arena::current() == NULL);
+
+	/* mutated and copied to the heap after the scope */
+	root[7]["late"] = "added after the scope, " LONG_STRING;
+	root[0]["device"] = "replaced after the scope, " LONG_STRING;
+	heap = root;
+	root = Json::Value();
+	arena.reset();
+	CHECK_EQ(arena.used(), 0);
+
+	CHECK_EQ(heap.size(), 199);
+	CHECK_EQ(heap[198]["meta"]["seq"].asInt(), 42);
+	CHECK_STR(heap[7]["late"].asCString(), "added after the scope, " LONG_STRING);
+	CHECK_STR(heap[0]["device"].asCString(), "replaced after the scope, " LONG_STRING);
+	CHECK(!heap[0].isMember("type"));
+	heap[1]["device"] = "changed on the heap";
+	CHECK(Json::writeString(Json::StreamWriterBuilder(), heap).size() > 199 * strlen(MESSAGE));
+}
+
+static void _test_no_allocation(void)
+{
+	Json::CharReaderBuilder builder;
+	std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+	std::string text = MESSAGE;
+	Json::Arena arena;
+	size_t heap_allocations;
+	size_t allocations;
+	int i;
+
+	allocations = s_allocations;
+	for (i = 0; i < 10; ++i) {
+		Json::Value root;
+
+		CHECK(_parse(reader.get(), text, &root));
+	}
+	heap_allocations = s_allocations - allocations;
+	CHECK(heap_allocations >= 10 * 10);
+
+	/* the first parse opens the chunk that reset() keeps */
+	for (i = 0; i < 11; ++i) {
+		Json::Arena::Scope scope(arena);
+		Json::Value root;
+
+		if (i == 1)
+			allocations = s_allocations;
+		CHECK(_parse(reader.get(), text, &root));
+		CHECK_EQ(root["values"][2].asDouble(), 1.25);
+		root = Json::Value();
+		arena.reset();
+	}
+	CHECK_EQ(s_allocations - allocations, 0);
+}
+
+int main(void)
+{
+	_test_scope();
+	_test_no_allocation();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,197 @@
+/*
+ * test_json_float.cpp
+ *
+ * Reals written and read by jsoncpp against the C library: the writer must
+ * print the shortest digits that strtod() reads back as the same double,
+ * those of the shortest "%.*e", in the layout of "%.17g", and the CharReader
+ * and the old Reader must read what strtod() reads, for special values,
+ * random bit patterns, sensor-like values and random decimal strings.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <memory>
+#include <string>
+#include <json/json.h>
+#include "test.h"
+
+#define RANDOM_VALUES	50000
+
+static std::unique_ptr<Json::CharReader> s_reader;
+static Json::StreamWriterBuilder s_writer;
+static int s_reported;
+
+/* the significant digits of a number text, without the leading and trailing zeros */
+static std::string _digits(const char *text)
+{
+	std::string digits;
+	size_t first;
+
+	for (; *text && *text != 'e' && *text != 'E'; ++text) {
+		if (*text >= '0' && *text <= '9')
+			digits += *text;
+	}
+	first = digits.find_first_not_of('0');
+	digits = first == std::string::npos ? "0" : digits.substr(first);
+	while (digits.size() > 1 && digits.back() == '0')
+		digits.pop_back();
+
+	return digits;
+}
+
+/* the digits of the shortest "%.*e" that reads back as value */
+static std::string _shortest_digits(double value)
+{
+	char text[64];
+	int precision;
+
+	for (precision = 1; precision <= 17; ++precision) {
+		snprintf(text, sizeof(text), "%.*e", precision - 1, value);
+		if (strtod(text, NULL) == value)
+			break;
+	}
+
+	return _digits(text);
+}
+
+/* both readers, false if they don't read the same double */
+static bool _parse(const char *text, double *value)
+{
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+	Json::Reader old_reader;
+#pragma GCC diagnostic pop
+	Json::Value parsed;
+	Json::Value old_parsed;
+	double old_value;
+
+	if (!s_reader->parse(text, text + strlen(text), &parsed, NULL) || !parsed.isDouble())
+		return false;
+	if (!old_reader.parse(text, text + strlen(text), old_parsed) || !old_parsed.isDouble())
+		return false;
+	*value = parsed.asDouble();
+	old_value = old_parsed.asDouble();
+	return memcmp(value, &old_value, sizeof(*value)) == 0;
+}
+
+static void _failed(int line, const char *what, const char *text, double expected)
+{
+	test_failures++;
+	if (s_reported++ < 20)
+		fprintf(stderr, "%s:%d: %s \"%s\", expected %.17g\n", __FILE__, line, what, text, expected);
+}
+
+static void _check_value(double value)
+{
+	std::string written = Json::writeString(s_writer, Json::Value(value));
+	char printed[64];
+	double parsed;
+
+	/* the shortest digits, exponent or not as "%.17g" */
+	snprintf(printed, sizeof(printed), "%.17g", value);
+	if (_digits(written.c_str()) != _shortest_digits(value) ||
+			(written.find('e') == std::string::npos) != (strchr(printed, 'e') == NULL))
+		_failed(__LINE__, "written", written.c_str(), value);
+	parsed = strtod(written.c_str(), NULL);
+	if (parsed != value || signbit(parsed) != signbit(value))
+		_failed(__LINE__, "strtod of", written.c_str(), value);
+
+	/* read back, from the shortest text and from the 17 digits */
+	if (!_parse(written.c_str(), &parsed) || parsed != value || signbit(parsed) != signbit(value))
+		_failed(__LINE__, "read", written.c_str(), value);
+	if (!_parse(printed, &parsed) || parsed != value)
+		_failed(__LINE__, "read", printed, value);
+}
+
+static void _test_special_values(void)
+{
+	const double values[] = {
+		0.0, -0.0, 1, -1, 0.1, 0.2, 0.3, 4.35, 36.52, -36.52, 100, 0.001, 12345.678,
+		1e-8, 9.9999999999999e-9, 1e-5, 1.5e-5, 1e-4, 1e16, 1e17, 1e20, 1e21, 1e22, 1e23,
+		9.999999999999999e22, 123456789012345.0, 1234567890123456.0, 9007199254740993.0,
+		5e-324, 2.2250738585072014e-308, 1.7976931348623157e308,
+	};
+	const int count = sizeof(values) / sizeof(values[0]);
+	std::string written;
+	int i;
+
+	for (i = 0; i < count; ++i)
+		_check_value(values[i]);
+
+	/* no more "%.17g" noise for the values of the sensors */
+	written = Json::writeString(s_writer, Json::Value(36.52));
+	CHECK_STR(written.c_str(), "36.52");
+	written = Json::writeString(s_writer, Json::Value(-9.81));
+	CHECK_STR(written.c_str(), "-9.81");
+	written = Json::writeString(s_writer, Json::Value(1.0));
+	CHECK_STR(written.c_str(), "1.0");
+	written = Json::writeString(s_writer, Json::Value(1e23));
+	CHECK_STR(written.c_str(), "1e+23");
+}
+
+static void _test_random_values(void)
+{
+	unsigned long long seed = 42;
+	uint64_t bits;
+	double sensor;
+	double value;
+	int i;
+
+	for (i = 0; i < RANDOM_VALUES; ++i) {
+		bits = test_random(&seed);
+		memcpy(&value, &bits, sizeof(value));
+		if (isfinite(value))
+			_check_value(value);
+
+		/* -200..200 with 2 and 6 decimals, and with all the digits */
+		sensor = (double)(test_random(&seed) >> 11) / (1ULL << 53) * 400 - 200;
+		_check_value(round(sensor * 100) / 100);
+		_check_value(round(sensor * 1e6) / 1e6);
+		_check_value(sensor);
+
+		/* up to 5 digits times 10^-30..10^29 */
+		_check_value((double)(test_random(&seed) % 100000) * pow(10.0, (int)(test_random(&seed) % 60) - 30));
+	}
+}
+
+static void _test_random_strings(void)
+{
+	unsigned long long seed = 7;
+	std::string text;
+	double expected;
+	double parsed;
+	int point;
+	int i;
+
+	/* 1 to 19 digits, a decimal point anywhere and an exponent or not */
+	for (i = 0; i < RANDOM_VALUES; ++i) {
+		text = std::to_string(test_random(&seed) % 1000000000000000000ULL).substr(0, 1 + test_random(&seed) % 19);
+		point = test_random(&seed) % (text.size() + 1);
+		text.insert(point, ".");
+		if (point == 0)
+			text = "0" + text;
+		if (text.back() == '.')
+			text += "0";
+		if (test_random(&seed) % 2)
+			text += "e" + std::to_string((int)(test_random(&seed) % 80) - 40);
+
+		expected = strtod(text.c_str(), NULL);
+		if (!_parse(text.c_str(), &parsed) || parsed != expected)
+			_failed(__LINE__, "read", text.c_str(), expected);
+	}
+}
+
+int main(void)
+{
+	Json::CharReaderBuilder builder;
+
+	s_reader.reset(builder.newCharReader());
+	s_writer["indentation"] = "";
+
+	_test_special_values();
+	_test_random_values();
+	_test_random_strings();
+
+	return TEST_RESULT();
+}
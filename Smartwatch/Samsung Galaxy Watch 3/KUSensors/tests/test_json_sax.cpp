@@ -0,0 +1,213 @@
+/*
+ * test_json_sax.cpp
+ *
+ * Json::SaxReader against the CharReader with the same settings: a handler
+ * rebuilds the tree from the events, which must be the tree of the
+ * CharReader, for valid and invalid documents fed in chunks of every size
+ * from 1 byte to the whole document. Also the search of uri_with_port that
+ * stops at the member, streams, errors and reset().
+ */
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "test.h"
+
+/* builds a Value from the events */
+class TreeHandler : public Json::SaxHandler {
+public:
+	Json::Value root;
+
+	bool startObject() override { return open(Json::objectValue); }
+	bool startArray() override { return open(Json::arrayValue); }
+	bool endObject() override { stack_.pop_back(); return true; }
+	bool endArray() override { stack_.pop_back(); return true; }
+	bool key(const Json::String& name) override { name_ = name; return true; }
+	bool scalar(const Json::Value& value) override { slot() = value; return true; }
+
+	/* for a new document, the containers of a failed one are left open */
+	void clear()
+	{
+		root = Json::Value();
+		stack_.clear();
+	}
+
+private:
+	std::vector<Json::Value *> stack_;
+	std::string name_;
+
+	Json::Value& slot()
+	{
+		if (stack_.empty())
+			return root;
+		if (stack_.back()->isArray())
+			return stack_.back()->append(Json::Value());
+		return (*stack_.back())[name_];
+	}
+
+	bool open(Json::ValueType type)
+	{
+		Json::Value& value = slot();
+
+		value = Json::Value(type);
+		stack_.push_back(&value);
+		return true;
+	}
+};
+
+/* the uri_with_port member of the root object, as _mqttDiscover() reads it */
+class UriHandler : public Json::SaxHandler {
+public:
+	std::string uri;
+	int events = 0;
+
+	bool startObject() override { events++; depth_++; wanted_ = false; return true; }
+	bool endObject() override { events++; depth_--; return true; }
+	bool startArray() override { events++; wanted_ = false; return true; }
+	bool key(const Json::String& name) override
+	{
+		events++;
+		wanted_ = depth_ == 1 && name == "uri_with_port";
+		return true;
+	}
+	bool scalar(const Json::Value& value) override
+	{
+		events++;
+		if (wanted_ && value.isString()) {
+			uri = value.asString();
+			return false;
+		}
+		wanted_ = false;
+		return true;
+	}
+
+private:
+	int depth_ = 0;
+	bool wanted_ = false;
+};
+
+static void _check(const std::string& text, bool valid,
+		const Json::CharReaderBuilder& builder = Json::CharReaderBuilder())
+{
+	std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+	Json::Value expected;
+	size_t chunk;
+	size_t offset;
+	bool ok;
+
+	CHECK_EQ(reader->parse(text.data(), text.data() + text.size(), &expected, NULL), valid);
+
+	for (chunk = 1; chunk <= text.size() + 1; ++chunk) {
+		TreeHandler handler;
+		Json::SaxReader sax(handler, builder);
+
+		for (offset = 0; offset < text.size(); offset += chunk)
+			sax.feed(text.data() + offset, text.data() + std::min(text.size(), offset + chunk));
+		ok = sax.finish();
+		if (ok != valid || (ok && !(handler.root == expected))) {
+			test_failures++;
+			fprintf(stderr, "%s:%d: chunks of %zu bytes, %s\n  %s\n%s", __FILE__, __LINE__, chunk,
+					ok != valid ? "wrong result" : "wrong tree", text.c_str(),
+					sax.getFormattedErrorMessages().c_str());
+			return;
+		}
+	}
+}
+
+static void _test_documents(void)
+{
+	Json::CharReaderBuilder strict;
+	Json::CharReaderBuilder relaxed;
+
+	_check("{\"a\":1,\"b\":[true,false,null,-1.5e3,\"x\\u00e9\\n\"],\"c\":{\"d\":{}},\"e\":[], "
+			"\"big\":123456789012345678901234}", true);
+	_check("  [1, 2 , /* c */ 3 // x\n, \"\\ud83d\\ude00\"]  ", true);
+	_check("\xEF\xBB\xBF{\"bom\":1}", true);
+	_check("{\"a\":[1,2,],}", true);
+	_check("42", true);
+	_check("\"str\"", true);
+	_check("{\"a\":1} trailing garbage", true);
+	_check("[0.1,36.52,-9.81,1e-7,1.7976931348623157e308,5e-324]", true);
+
+	_check("{\"a\" 1}", false);
+	_check("{\"a\":tru}", false);
+	_check("[1,2", false);
+	_check("[1 2]", false);
+	_check("{\"a\":\"\\q\"}", false);
+	_check("", false);
+	_check("{,}", false);
+
+	Json::CharReaderBuilder::strictMode(&strict.settings_);
+	_check("{\"a\":1} x", false, strict);
+	_check("[1,]", false, strict);
+	_check("1", false, strict);
+	_check("{\"a\":[1,{\"b\":null}]}", true, strict);
+
+	relaxed["allowDroppedNullPlaceholders"] = true;
+	relaxed["allowSpecialFloats"] = true;
+	relaxed["allowNumericKeys"] = true;
+	_check("[1,,2]", true, relaxed);
+	_check("{\"a\":Infinity,\"b\":-Infinity, 12: Infinity}", true, relaxed);
+}
+
+static void _test_early_stop(void)
+{
+	std::string text = "{\"uri_with_port\":\"tcp://10.0.0.1:1883\",\"rest\":[" + std::string(100000, ' ') + "1]}";
+	std::string nested = "{\"x\":{\"uri_with_port\":\"no\"},\"uri_with_port\":\"yes\"}";
+	UriHandler handler;
+	UriHandler nested_handler;
+	Json::SaxReader sax(handler);
+	Json::SaxReader nested_sax(nested_handler);
+
+	/* stopped at the third event, the rest is not read */
+	CHECK(sax.parse(text.data(), text.data() + text.size()));
+	CHECK(sax.stopped());
+	CHECK_STR(handler.uri.c_str(), "tcp://10.0.0.1:1883");
+	CHECK_EQ(handler.events, 3);
+	CHECK(!sax.feed("]", "]" + 1));
+	CHECK(sax.finish());
+
+	CHECK(nested_sax.parse(nested.data(), nested.data() + nested.size()));
+	CHECK_STR(nested_handler.uri.c_str(), "yes");
+}
+
+static void _test_errors_and_reset(void)
+{
+	const char *truncated = "{\"a\":1,";
+	const char *text = "[1,[2,[3]]]";
+	std::istringstream stream(text);
+	TreeHandler handler;
+	Json::SaxReader sax(handler);
+	std::string errors;
+
+	CHECK(!sax.parse(truncated, truncated + strlen(truncated)));
+	CHECK(!sax.stopped());
+	errors = sax.getFormattedErrorMessages();
+	CHECK(!errors.empty());
+
+	/* the same reader and handler, a new document */
+	sax.reset();
+	handler.clear();
+	CHECK(sax.parse(text, text + strlen(text)));
+	errors = sax.getFormattedErrorMessages();
+	CHECK_STR(errors.c_str(), "");
+	CHECK_EQ(handler.root[1][1][0].asInt(), 3);
+
+	sax.reset();
+	handler.clear();
+	CHECK(sax.parse(stream));
+	CHECK_EQ(handler.root.size(), 2);
+	CHECK_EQ(handler.root[1][0].asInt(), 2);
+}
+
+int main(void)
+{
+	_test_documents();
+	_test_early_stop();
+	_test_errors_and_reset();
+
+	return TEST_RESULT();
+}
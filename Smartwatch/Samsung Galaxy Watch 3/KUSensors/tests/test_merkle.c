@@ -0,0 +1,237 @@
+/*
+ * test_merkle.c
+ *
+ * Merkle commitments of the batches: the roots of the RFC 6962 test vectors,
+ * the audit paths of every leaf of trees of 1 to 70 leaves, the leaves
+ * hashed together against the ones hashed one by one, then JSON, binary and
+ * columnar batches verified, chained across a restart, with the last root
+ * in the preference store, and rejected once tampered with.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <app_preference.h>
+#include "batch.h"
+#include "merkle.h"
+#include "test.h"
+
+#define MAX_LEAVES		70
+#define MAX_BATCHES		16
+#define RECORDS			100
+
+/* the inputs of the tests of the RFC 6962 reference implementation, and the roots of their first n */
+static const char *s_inputs[] = {
+	"", "\x00", "\x10", "\x20\x21", "\x30\x31", "\x40\x41\x42\x43",
+	"\x50\x51\x52\x53\x54\x55\x56\x57", "\x60\x61\x62\x63\x64\x65\x66\x67\x68\x69\x6a\x6b\x6c\x6d\x6e\x6f",
+};
+static const size_t s_input_lens[] = { 0, 1, 1, 2, 2, 4, 8, 16 };
+static const char *s_roots[] = {
+	"6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d",
+	"fac54203e7cc696cf0dfcb42c92a1d9dbaf70ad9e621f4bd8d98662f00e3c125",
+	"aeb6bcfe274b70a14fb067a5e5578264db0fa9b51af5e0ba159158f329e06e77",
+	"d37ee418976dd95753c1c73862b9398fa2a2cf9b4ff0fdfe8b30cd95209614b7",
+	"4e3bbb1f7b478dcfe71fb631631519a3bca12c9aefca1612bfce4c13a86264d4",
+	"76e67dadbcdf1e10e1b74ddc608abd2f98dfb16fbce75277b5232a127f2087ef",
+	"ddb89be403809e325750d3d263cd78929c2942b7942a34b77e122c9594a74c8c",
+	"5dc9da79a70659a9ad559cb701ded9a2ab9d823aad2f4960cfe370eff4604328",
+};
+
+static char s_dir[] = "/tmp/test_merkle.XXXXXX";
+static batch_t *s_batches[MAX_BATCHES];
+static int s_batch_count;
+
+static void _test_vectors(void)
+{
+	merkle_hash_t root;
+	merkle_t tree;
+	char hex[MERKLE_HASH_SIZE * 2 + 1];
+	int n;
+
+	merkle_init(&tree);
+	for (n = 0; n < sizeof(s_roots) / sizeof(s_roots[0]); ++n) {
+		merkle_add(&tree, s_inputs[n], s_input_lens[n]);
+		merkle_root(&tree, root);
+		merkle_to_hex(root, hex);
+		CHECK_STR(hex, s_roots[n]);
+	}
+}
+
+static void _test_proofs(void)
+{
+	merkle_hash_t leaves[MAX_LEAVES];
+	merkle_hash_t path[MERKLE_MAX_DEPTH];
+	merkle_hash_t root;
+	merkle_hash_t wrong;
+	merkle_t tree;
+	unsigned char data;
+	int path_len;
+	int n;
+	int i;
+
+	for (n = 1; n <= MAX_LEAVES; ++n) {
+		merkle_init(&tree);
+		for (i = 0; i < n; ++i) {
+			data = i;
+			merkle_leaf_hash(&data, 1, leaves[i]);
+			merkle_add_leaf(&tree, leaves[i]);
+		}
+		merkle_root(&tree, root);
+
+		for (i = 0; i < n; ++i) {
+			path_len = merkle_proof(leaves, n, i, path, MERKLE_MAX_DEPTH);
+			CHECK(path_len >= 0);
+			CHECK(merkle_verify_proof(leaves[i], i, n, path, path_len, root));
+
+			/* the path of a leaf proves neither another position nor another root */
+			if (n > 1)
+				CHECK(!merkle_verify_proof(leaves[i], (i + 1) % n, n, path, path_len, root));
+			memcpy(wrong, root, sizeof(wrong));
+			wrong[i % MERKLE_HASH_SIZE] ^= 1;
+			CHECK(!merkle_verify_proof(leaves[i], i, n, path, path_len, wrong));
+		}
+	}
+}
+
+/* merkle_leaf_hashes() hashes several records together, in lanes or with the crypto extensions */
+static void _test_leaf_hashes(void)
+{
+	static unsigned char data[MAX_LEAVES][200];
+	const void *pointers[MAX_LEAVES];
+	size_t lens[MAX_LEAVES];
+	merkle_hash_t together[MAX_LEAVES];
+	merkle_hash_t one;
+	unsigned long long seed = 5;
+	int count;
+	int i;
+	int j;
+
+	for (count = 1; count <= MAX_LEAVES; count += 3) {
+		for (i = 0; i < count; ++i) {
+			lens[i] = test_random(&seed) % sizeof(data[i]);
+			for (j = 0; j < lens[i]; ++j)
+				data[i][j] = (unsigned char)test_random(&seed);
+			pointers[i] = data[i];
+		}
+		merkle_leaf_hashes(pointers, lens, count, together);
+		for (i = 0; i < count; ++i) {
+			merkle_leaf_hash(data[i], lens[i], one);
+			CHECK(memcmp(one, together[i], MERKLE_HASH_SIZE) == 0);
+		}
+	}
+}
+
+static void _flush_cb(batch_t *batch)
+{
+	if (s_batch_count < MAX_BATCHES)
+		s_batches[s_batch_count++] = batch;
+	else
+		batch_destroy(batch);
+}
+
+/* the last byte of the root the batch carries, a hex digit in JSON */
+static size_t _root_end(const batch_t *batch)
+{
+	if (batch->format == RECORD_FORMAT_JSON)
+		return strstr(batch->data, "\"root\":\"") - batch->data + strlen("\"root\":\"") + MERKLE_HASH_SIZE * 2 - 1;
+
+	return batch->len - 1;
+}
+
+static void _add_records(int first)
+{
+	record_t records[RECORDS];
+	int i;
+	int j;
+
+	for (i = 0; i < RECORDS; ++i) {
+		records[i].sensor_type = i % 3 == 0 ? 9 : 0;
+		records[i].timestamp_ms = 1700000000000LL + (first + i) * 100LL;
+		records[i].value_count = records[i].sensor_type == 9 ? 1 : 3;
+		for (j = 0; j < RECORD_MAX_VALUES; ++j)
+			records[i].values[j] = (first + i) * 0.37f + j * 1.1f;
+	}
+	CHECK(batch_add_records(records, RECORDS));
+	batch_flush();
+}
+
+static void _test_batches(void)
+{
+	static const int formats[] = { RECORD_FORMAT_JSON, RECORD_FORMAT_BINARY, RECORD_FORMAT_COLUMNAR };
+	merkle_hash_t prev_root = { 0 };
+	merkle_hash_t root;
+	char path[sizeof(s_dir) + 16];
+	char hex[MERKLE_HASH_SIZE * 2 + 1];
+	char *saved = NULL;
+	batch_t *batch;
+	size_t pos;
+	int f;
+	int i;
+
+	/* the last root is kept in the preference store of the data directory */
+	CHECK(mkdtemp(s_dir) != NULL);
+	setenv("KUSENSORS_DATA_DIR", s_dir, 1);
+
+	CHECK(batch_initialize(37, 100000, _flush_cb));
+	batch_set_quantum(0, 0.01f);
+	for (f = 0; f < sizeof(formats) / sizeof(formats[0]); ++f) {
+		batch_set_format(formats[f]);
+		_add_records(f * RECORDS);
+	}
+	batch_finalize();
+
+	/* a restart continues the chain */
+	CHECK(batch_initialize(37, 100000, _flush_cb));
+	batch_set_format(RECORD_FORMAT_BINARY);
+	_add_records(3 * RECORDS);
+	batch_finalize();
+
+	/* 37 + 37 + 26 records per format */
+	CHECK_EQ(s_batch_count, 12);
+	for (i = 0; i < s_batch_count; ++i) {
+		batch = s_batches[i];
+		CHECK(memcmp(batch->prev_root, prev_root, MERKLE_HASH_SIZE) == 0);
+		CHECK_EQ(merkle_verify_batch(batch->data, batch->len, prev_root, root), batch->count);
+		CHECK(memcmp(root, batch->root, MERKLE_HASH_SIZE) == 0);
+		memcpy(prev_root, root, MERKLE_HASH_SIZE);
+	}
+
+	/* the root of the last batch is saved once the batch lock is released */
+	merkle_to_hex(prev_root, hex);
+	CHECK_EQ(preference_get_string("batch_last_root", &saved), PREFERENCE_ERROR_NONE);
+	CHECK_STR(saved ? saved : "", hex);
+	free(saved);
+
+	for (i = 0; i < s_batch_count; ++i) {
+		batch = s_batches[i];
+
+		/* out of the chain */
+		if (i > 0)
+			CHECK_EQ(merkle_verify_batch(batch->data, batch->len, s_batches[i]->root, NULL), -1);
+
+		/* a flipped bit anywhere in the records or the commitment */
+		batch->data[batch->len / 2] ^= 1;
+		CHECK_EQ(merkle_verify_batch(batch->data, batch->len, NULL, NULL), -1);
+		batch->data[batch->len / 2] ^= 1;
+		pos = _root_end(batch);
+		batch->data[pos] ^= 1;
+		CHECK_EQ(merkle_verify_batch(batch->data, batch->len, NULL, NULL), -1);
+		batch->data[pos] ^= 1;
+		CHECK_EQ(merkle_verify_batch(batch->data, batch->len, NULL, NULL), batch->count);
+
+		batch_destroy(batch);
+	}
+
+	snprintf(path, sizeof(path), "%s/preference", s_dir);
+	unlink(path);
+	rmdir(s_dir);
+}
+
+int main(void)
+{
+	_test_vectors();
+	_test_proofs();
+	_test_leaf_hashes();
+	_test_batches();
+
+	return TEST_RESULT();
+}
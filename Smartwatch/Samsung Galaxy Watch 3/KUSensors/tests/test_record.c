@@ -0,0 +1,302 @@
+/*
+ * test_record.c
+ *
+ * JSON layout of the records, the JSON output byte for byte against the
+ * snprintf writer of the previous releases for every record type, and round
+ * trip of the binary batches through the decoder, including truncated and
+ * corrupted payloads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "record.h"
+#include "record_snprintf.h"
+#include "test.h"
+
+#define ROUNDS 20000
+
+static void _test_json_layout(void)
+{
+	record_t acc = { 0, 1600000000123LL, 3, { 1.5f, -0.004f, 9.81f } };
+	record_t hrm = { 13, 1600000001999LL, 4, { 72.0f, 833.0f, 41.25f, 30.5f } };
+	record_t activity = { RECORD_TYPE_ACTIVITY, 1600000060000LL, 4, { 96.0f, 2.0f, 1.75f, 1.6f } };
+	record_t quaternion = { RECORD_TYPE_QUATERNION, 1600000000040LL, 4, { 1.0f, 0.0f, -0.5f, 0.25f } };
+	record_t unknown = { 20, 1600000000000LL, 2, { 1.0f, 2.0f } };
+	char buf[RECORD_MAX_JSON_SIZE];
+
+	CHECK(record_write_json(&acc, 7, buf, sizeof(buf)) == strlen(buf));
+	CHECK_STR(buf, "{\"transaction_id\":7,\"timestamp\":1600000000,\"sensor_type\":0,"
+			"\"sensor_data\":{\"x\":1.50,\"y\":-0.00,\"z\":9.81}}");
+
+	record_write_json(&hrm, -1, buf, sizeof(buf));
+	CHECK_STR(buf, "{\"transaction_id\":-1,\"timestamp\":1600000001,\"sensor_type\":13,"
+			"\"sensor_data\":{\"HeartRate\":72.00,\"P2P\":833.00,\"RMSSD\":41.25,\"SDNN\":30.50}}");
+
+	record_write_json(&activity, 0, buf, sizeof(buf));
+	CHECK_STR(buf, "{\"transaction_id\":0,\"timestamp\":1600000060,\"sensor_type\":64,"
+			"\"sensor_data\":{\"steps\":96.00,\"activity\":2.00,\"intensity\":1.75,\"cadence\":1.60}}");
+
+	record_write_json(&quaternion, 0, buf, sizeof(buf));
+	CHECK_STR(buf, "{\"transaction_id\":0,\"timestamp\":1600000000,\"sensor_type\":65,"
+			"\"sensor_data\":{\"w\":1.00,\"x\":0.00,\"y\":-0.50,\"z\":0.25}}");
+
+	/* no field names, no values */
+	record_write_json(&unknown, 0, buf, sizeof(buf));
+	CHECK_STR(buf, "{\"transaction_id\":0,\"timestamp\":1600000000,\"sensor_type\":20,\"sensor_data\":{}}");
+
+	/* the terminating null byte must fit */
+	CHECK_EQ(record_write_json(&acc, 7, buf, 10), 0);
+	CHECK_EQ(record_write_json(&unknown, 0, buf, 77), 0);
+	CHECK_EQ(record_write_json(&unknown, 0, buf, 78), 77);
+}
+
+/* the values are written as "%0.2f" writes them */
+static void _test_json_values(void)
+{
+	unsigned long long seed = 88172645463325252ULL;
+	record_t record = { 9, 0, 1, { 0 } };
+	char buf[RECORD_MAX_JSON_SIZE];
+	char expected[RECORD_MAX_JSON_SIZE];
+	char *value;
+	unsigned int bits;
+	int i;
+
+	for (i = 0; i < ROUNDS * 10; ++i) {
+		switch (test_random(&seed) % 4) {
+		case 0:
+			bits = (unsigned int)test_random(&seed);
+			memcpy(&record.values[0], &bits, sizeof(bits));
+			break;
+		case 1:
+			record.values[0] = (float)((int)(test_random(&seed) % 2000001) - 1000000) / 1000.0f;
+			break;
+		case 2:
+			/* the ties of the rounding */
+			record.values[0] = ((int)(test_random(&seed) % 20001) - 10000) / 200.0f;
+			break;
+		default:
+			record.values[0] = (float)((test_random(&seed) % 1000) * pow(10, (int)(test_random(&seed) % 40) - 20));
+			break;
+		}
+
+		snprintf(expected, sizeof(expected), "%0.2f}}", record.values[0]);
+		if (record_write_json(&record, 0, buf, sizeof(buf)) == 0) {
+			/* only the huge values do not fit */
+			CHECK(strlen(expected) > 300);
+			continue;
+		}
+		value = strstr(buf, "\"hPa\":");
+		CHECK(value != NULL);
+		if (value && strcmp(value + 6, expected) != 0) {
+			CHECK_STR(value + 6, expected);
+			break;
+		}
+	}
+}
+
+/* the same bytes as the snprintf writer, and the same buffers too small */
+static void _test_json_snprintf(void)
+{
+	static const int types[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,
+			RECORD_TYPE_ACTIVITY, RECORD_TYPE_QUATERNION, -1, 14, 20, 63, 66, 255 };
+	unsigned long long seed = 0x2545f4914f6cdd1dULL;
+	record_t record;
+	char buf[1024];
+	char expected[1024];
+	char scratch[1024];
+	size_t expected_len;
+	size_t len;
+	size_t size;
+	unsigned int bits;
+	int transaction_id;
+	int round;
+	int mismatches = 0;
+	int j;
+
+	for (round = 0; round < ROUNDS * 5 && mismatches == 0; ++round) {
+		record.sensor_type = types[round % (sizeof(types) / sizeof(types[0]))];
+		record.timestamp_ms = (long long)(test_random(&seed) % 4000000000000ULL) - 400000000000LL;
+		record.value_count = test_random(&seed) % (RECORD_MAX_VALUES + 1);
+		for (j = 0; j < RECORD_MAX_VALUES; ++j) {
+			switch (test_random(&seed) % 4) {
+			case 0:
+				/* any float, the NaNs and the infinities too */
+				bits = (unsigned int)test_random(&seed);
+				memcpy(&record.values[j], &bits, sizeof(bits));
+				break;
+			case 1:
+				/* the ties of the rounding */
+				record.values[j] = ((int)(test_random(&seed) % 20001) - 10000) / 200.0f;
+				break;
+			default:
+				record.values[j] = ((int)(test_random(&seed) % 2000001) - 1000000) / 100.0f;
+				break;
+			}
+		}
+		transaction_id = round % 7 == 0 ? -2147483647 - 1 : (int)test_random(&seed);
+
+		expected_len = record_write_json_snprintf(&record, transaction_id, expected, sizeof(expected));
+		len = record_write_json(&record, transaction_id, buf, sizeof(buf));
+		CHECK(expected_len > 0);
+		if (len != expected_len || memcmp(buf, expected, len + 1) != 0) {
+			CHECK_STR(buf, expected);
+			mismatches++;
+			continue;
+		}
+
+		/*
+		 * The snprintf writer wanted one byte more than it wrote when the record had
+		 * fields, the new writer only needs the terminating null byte.
+		 */
+		if (round % 16 != 0)
+			continue;
+		for (size = 0; size <= len + 2; ++size) {
+			memset(buf, '#', sizeof(buf));
+			CHECK_EQ(record_write_json(&record, transaction_id, buf, size), size > len ? len : 0);
+			if (size > len && memcmp(buf, expected, len + 1) != 0) {
+				CHECK(!"short buffer output differs");
+				mismatches++;
+			}
+			if (record_write_json_snprintf(&record, transaction_id, scratch, size) != 0)
+				CHECK(size > len);
+		}
+	}
+}
+
+static float _random_value(unsigned long long *seed)
+{
+	switch (test_random(seed) % 3) {
+	case 0:
+		return ((int)(test_random(seed) % 4001) - 2000) / 100.0f;		/* int16 hundredths */
+	case 1:
+		return ((int)(test_random(seed) % 2000001) - 1000000) / 100.0f;	/* int32 hundredths */
+	default:
+		return (float)(test_random(seed) % 1000000) / 7.0f;				/* float32 */
+	}
+}
+
+static void _test_binary_round_trip(void)
+{
+	unsigned long long seed = 0x9e3779b97f4a7c15ULL;
+	unsigned char buf[RECORD_HEADER_SIZE + 64 * RECORD_MAX_BINARY_SIZE + RECORD_COMMITMENT_SIZE];
+	record_t records[64];
+	record_t decoded;
+	record_reader_t reader;
+	long long prev_ms;
+	size_t len;
+	int round;
+	int count;
+	int i;
+	int j;
+
+	for (round = 0; round < ROUNDS / 10; ++round) {
+		count = 1 + test_random(&seed) % 64;
+		prev_ms = 1600000000000LL + (long long)(test_random(&seed) % 1000000000);
+		len = record_write_header(buf, sizeof(buf), round, prev_ms);
+		CHECK_EQ(len, RECORD_HEADER_SIZE);
+
+		for (i = 0; i < count; ++i) {
+			records[i].sensor_type = test_random(&seed) % 14;
+			/* out of order by up to a second */
+			records[i].timestamp_ms = prev_ms + (long long)(test_random(&seed) % 2000) - 1000;
+			records[i].value_count = test_random(&seed) % (RECORD_MAX_VALUES + 1);
+			for (j = 0; j < RECORD_MAX_VALUES; ++j)
+				records[i].values[j] = _random_value(&seed);
+
+			len += record_write_binary(&records[i], prev_ms, buf + len, sizeof(buf) - len);
+			prev_ms = records[i].timestamp_ms;
+		}
+		record_set_header_count(buf, count);
+
+		CHECK_EQ(record_reader_init(&reader, buf, len), 0);
+		CHECK_EQ(reader.batch_id, round);
+		CHECK_EQ(reader.count, count);
+
+		for (i = 0; i < count; ++i) {
+			if (record_reader_next(&reader, &decoded) != 1) {
+				CHECK(!"record missing");
+				break;
+			}
+			CHECK_EQ(decoded.sensor_type, records[i].sensor_type);
+			CHECK_EQ(decoded.timestamp_ms, records[i].timestamp_ms);
+			CHECK_EQ(decoded.value_count, records[i].value_count);
+			for (j = 0; j < decoded.value_count; ++j)
+				CHECK_NEAR(decoded.values[j], records[i].values[j], fabs(records[i].values[j]) * 1e-6 + 0.005);
+		}
+		CHECK_EQ(record_reader_next(&reader, &decoded), 0);
+		CHECK_EQ(reader.pos, len);
+	}
+}
+
+static void _test_binary_malformed(void)
+{
+	unsigned long long seed = 42;
+	unsigned char buf[RECORD_HEADER_SIZE + 16 * RECORD_MAX_BINARY_SIZE + RECORD_COMMITMENT_SIZE];
+	unsigned char copy[sizeof(buf)];
+	record_t record = { 4, 1600000000000LL, 4, { 0.25f, -1e6f, 3.0e9f, 1.0f } };
+	record_t decoded;
+	record_reader_t reader;
+	size_t len;
+	size_t cut;
+	int i;
+	int ret;
+
+	len = record_write_header(buf, sizeof(buf), 1, record.timestamp_ms);
+	for (i = 0; i < 16; ++i)
+		len += record_write_binary(&record, record.timestamp_ms, buf + len, sizeof(buf) - len);
+	record_set_header_count(buf, 16);
+
+	CHECK_EQ(record_write_header(buf, RECORD_HEADER_SIZE - 1, 0, 0), 0);
+	CHECK_EQ(record_write_binary(&record, 0, copy, RECORD_MAX_BINARY_SIZE - 1), 0);
+
+	/* every truncation ends with an error, never past the end */
+	for (cut = 0; cut < len; ++cut) {
+		if (record_reader_init(&reader, buf, cut) != 0) {
+			CHECK(cut < RECORD_HEADER_SIZE);
+			continue;
+		}
+		while ((ret = record_reader_next(&reader, &decoded)) == 1)
+			;
+		CHECK_EQ(ret, -1);
+		CHECK(reader.pos <= cut);
+	}
+
+	memcpy(copy, buf, len);
+	copy[0] = 'J';
+	CHECK_EQ(record_reader_init(&reader, copy, len), -1);
+	copy[0] = 'K';
+	copy[2] = RECORD_VERSION + 1;
+	CHECK_EQ(record_reader_init(&reader, copy, len), -1);
+
+	/* random bytes after the header */
+	for (i = 0; i < ROUNDS; ++i) {
+		memcpy(copy, buf, len);
+		copy[RECORD_HEADER_SIZE + test_random(&seed) % (len - RECORD_HEADER_SIZE)] = (unsigned char)test_random(&seed);
+		CHECK_EQ(record_reader_init(&reader, copy, len), 0);
+		while ((ret = record_reader_next(&reader, &decoded)) == 1)
+			CHECK(decoded.value_count <= RECORD_MAX_VALUES);
+		CHECK(reader.pos <= len);
+	}
+
+	/* the commitment is not read as records */
+	record_set_header_flags(buf, RECORD_FLAG_COMMITTED);
+	memset(buf + len, 0xff, RECORD_COMMITMENT_SIZE);
+	CHECK_EQ(record_reader_init(&reader, buf, RECORD_HEADER_SIZE + RECORD_COMMITMENT_SIZE - 1), -1);
+	CHECK_EQ(record_reader_init(&reader, buf, len + RECORD_COMMITMENT_SIZE), 0);
+	CHECK_EQ(reader.flags, RECORD_FLAG_COMMITTED);
+	for (i = 0; i < 16; ++i)
+		CHECK_EQ(record_reader_next(&reader, &decoded), 1);
+	CHECK_EQ(record_reader_next(&reader, &decoded), 0);
+	CHECK_EQ(reader.pos, len);
+}
+
+int main(void)
+{
+	_test_json_layout();
+	_test_json_values();
+	_test_json_snprintf();
+	_test_binary_round_trip();
+	_test_binary_malformed();
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,161 @@
+/*
+ * test_restclient.cpp
+ *
+ * Connection pool of the restclient simple API against the local HTTP/1.1
+ * server of http_server.h: the origins the pool is keyed by, a keep-alive
+ * connection reused by every request of a thread, the idle handles kept per
+ * origin, the requests of several threads and the pool cleared by
+ * RestClient::disable().
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+#include "restclient/restclient.h"
+#include "restclient/pool.h"
+#include "http_server.h"
+#include "test.h"
+
+#define REQUESTS	200
+#define THREADS		8
+
+static http_server_t s_server;
+
+static std::string _url(const char *path, const char *host = "127.0.0.1")
+{
+	return std::string("http://") + host + ":" + std::to_string(s_server.port) + path;
+}
+
+static void _check_origin(const char *url, const char *expected)
+{
+	std::string origin = RestClient::ConnectionPool::Origin(url);
+
+	CHECK_STR(origin.c_str(), expected);
+}
+
+static void _test_origins(void)
+{
+	_check_origin("http://example.com/a?b", "http://example.com:80");
+	_check_origin("HTTPS://User:pw@Example.COM", "https://example.com:443");
+	_check_origin("https://example.com:8443/x", "https://example.com:8443");
+	_check_origin("http://[::1]/x", "http://[::1]:80");
+	_check_origin("http://[::1]:8080#y", "http://[::1]:8080");
+	_check_origin("example.com/path", "http://example.com:80");
+}
+
+static void _test_keep_alive(void)
+{
+	RestClient::ConnectionPool& pool = RestClient::ConnectionPool::Instance();
+	RestClient::PoolStats before = pool.GetStats();
+	RestClient::PoolStats after;
+	RestClient::Response response;
+	int connections = http_server_count(&s_server.connections);
+	int i;
+
+	/* every method, one handle and one connection */
+	for (i = 0; i < REQUESTS; ++i) {
+		switch (i % 4) {
+		case 0:
+			response = RestClient::get(_url("/get"));
+			CHECK_STR(response.body.c_str(), "GET /get 0");
+			break;
+		case 1:
+			response = RestClient::post(_url("/post"), "application/json", "{\"a\":1}");
+			CHECK_STR(response.body.c_str(), "POST /post 7");
+			break;
+		case 2:
+			response = RestClient::put(_url("/put"), "text/plain", "abc");
+			CHECK_STR(response.body.c_str(), "PUT /put 3");
+			break;
+		default:
+			response = RestClient::del(_url("/status/404"));
+			CHECK_EQ(response.code, 404);
+			break;
+		}
+		if (i % 4 != 3)
+			CHECK_EQ(response.code, 200);
+	}
+
+	after = pool.GetStats();
+	CHECK_EQ(after.acquired - before.acquired, REQUESTS);
+	CHECK_EQ(after.created - before.created, 1);
+	CHECK_EQ(after.reused - before.reused, REQUESTS - 1);
+	CHECK_EQ(after.idle, 1);
+	CHECK_EQ(http_server_count(&s_server.connections) - connections, 1);
+
+	/* the host is part of the origin, localhost gets its own handle */
+	RestClient::get(_url("/get", "localhost"));
+	after = pool.GetStats();
+	CHECK_EQ(after.created - before.created, 2);
+	CHECK_EQ(after.idle, 2);
+}
+
+static void _test_threads(void)
+{
+	RestClient::ConnectionPool& pool = RestClient::ConnectionPool::Instance();
+	RestClient::PoolStats before;
+	RestClient::PoolStats after;
+	std::vector<std::thread> threads;
+	int failures[THREADS] = { 0 };
+	int i;
+
+	pool.Clear();
+	before = pool.GetStats();
+
+	for (i = 0; i < THREADS; ++i) {
+		threads.push_back(std::thread([i, &failures]() {
+			for (int j = 0; j < REQUESTS; ++j) {
+				RestClient::Response response = RestClient::get(_url("/thread"));
+				if (response.code != 200 || response.body != "GET /thread 0")
+					failures[i]++;
+			}
+		}));
+	}
+	for (i = 0; i < THREADS; ++i)
+		threads[i].join();
+
+	after = pool.GetStats();
+	for (i = 0; i < THREADS; ++i)
+		CHECK_EQ(failures[i], 0);
+	CHECK_EQ(after.acquired - before.acquired, THREADS * REQUESTS);
+	/* at most a handle per thread, almost all the requests on a pooled one */
+	CHECK(after.created - before.created <= THREADS);
+	CHECK(after.reused - before.reused >= THREADS * (REQUESTS - 1));
+	CHECK(after.idle <= RESTCLIENT_POOL_MAX_IDLE);
+	CHECK_EQ(after.created - before.created - (after.evicted - before.evicted), after.idle);
+}
+
+static void _test_disable(void)
+{
+	RestClient::ConnectionPool& pool = RestClient::ConnectionPool::Instance();
+	RestClient::PoolStats stats;
+
+	RestClient::disable();
+	stats = pool.GetStats();
+	CHECK_EQ(stats.idle, 0);
+
+	/* the pool works again after a new init */
+	CHECK_EQ(RestClient::init(), 0);
+	CHECK_EQ(RestClient::get(_url("/again")).code, 200);
+	stats = pool.GetStats();
+	CHECK_EQ(stats.idle, 1);
+}
+
+int main(void)
+{
+	if (http_server_start(&s_server) != 0) {
+		fprintf(stderr, "Can't start the HTTP server\n");
+		return 1;
+	}
+	RestClient::init();
+
+	_test_origins();
+	_test_keep_alive();
+	_test_threads();
+	_test_disable();
+
+	RestClient::disable();
+	http_server_stop(&s_server);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,159 @@
+/*
+ * test_restclient_async.cpp
+ *
+ * Asynchronous restclient against the local HTTP/1.1 server of
+ * http_server.h: results through futures and callbacks, the callbacks on the
+ * thread of the client, the order of the requests, the cap on the transfers
+ * and the connections, the timeouts, and the requests failed when the client
+ * is destroyed.
+ */
+
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include "restclient/async.h"
+#include "restclient/restclient.h"
+#include "http_server.h"
+#include "test.h"
+
+#define REQUESTS	64
+
+static http_server_t s_server;
+
+static std::string _url(const std::string& path)
+{
+	return "http://127.0.0.1:" + std::to_string(s_server.port) + path;
+}
+
+static void _test_futures_and_callbacks(void)
+{
+	RestClient::AsyncClient client;
+	std::vector<std::future<RestClient::Response> > futures;
+	std::thread::id main_thread = std::this_thread::get_id();
+	std::mutex lock;
+	std::vector<std::string> bodies;
+	bool on_main_thread = false;
+	RestClient::Response response;
+	std::string expected;
+	int i;
+
+	for (i = 0; i < REQUESTS; ++i) {
+		if (i % 2)
+			futures.push_back(client.post(_url("/post/" + std::to_string(i)), "text/plain", std::string(i, 'x')));
+		else
+			futures.push_back(client.get(_url("/get/" + std::to_string(i))));
+	}
+	for (i = 0; i < REQUESTS; ++i) {
+		response = futures[i].get();
+		CHECK_EQ(response.code, 200);
+		if (i % 2)
+			expected = "POST /post/" + std::to_string(i) + " " + std::to_string(i);
+		else
+			expected = "GET /get/" + std::to_string(i) + " 0";
+		CHECK_STR(response.body.c_str(), expected.c_str());
+	}
+
+	for (i = 0; i < REQUESTS; ++i) {
+		client.get(_url("/callback"), [&](const RestClient::Response& response) {
+			std::lock_guard<std::mutex> guard(lock);
+			bodies.push_back(response.body);
+			if (std::this_thread::get_id() == main_thread)
+				on_main_thread = true;
+		});
+	}
+	client.Wait();
+	CHECK_EQ(client.Pending(), 0);
+	CHECK_EQ(bodies.size(), REQUESTS);
+	CHECK(!on_main_thread);
+	for (i = 0; i < (int)bodies.size(); ++i)
+		CHECK_STR(bodies[i].c_str(), "GET /callback 0");
+
+	/* the status is the code of the response, a refused connection the curl error */
+	CHECK_EQ(client.get(_url("/status/503")).get().code, 503);
+	CHECK_EQ(client.get("http://127.0.0.1:1/").get().code, CURLE_COULDNT_CONNECT);
+}
+
+static void _test_order(void)
+{
+	RestClient::AsyncClient client(1);
+	std::vector<int> order;
+	int i;
+
+	/* one transfer at a time: they finish in the order they were submitted */
+	for (i = 0; i < 20; ++i) {
+		client.get(_url("/delay/" + std::to_string(i % 3)), [&order, i](const RestClient::Response&) {
+			order.push_back(i);
+		});
+	}
+	client.Wait();
+	CHECK_EQ(order.size(), 20);
+	for (i = 0; i < (int)order.size(); ++i)
+		CHECK_EQ(order[i], i);
+}
+
+static void _test_concurrency(void)
+{
+	const int max_concurrent = 4;
+	RestClient::AsyncClient client(max_concurrent);
+	int connections = http_server_count(&s_server.connections);
+	double start = test_now();
+	double elapsed;
+	int i;
+
+	/* 16 requests of 100 ms, 4 at a time on 4 connections: 4 rounds */
+	for (i = 0; i < 16; ++i)
+		client.get(_url("/delay/100"), [](const RestClient::Response& response) {});
+	CHECK(client.Pending() > 0);
+	client.Wait();
+	elapsed = test_now() - start;
+
+	CHECK(elapsed >= 0.39);
+	CHECK(elapsed < 1.2);
+	CHECK(http_server_count(&s_server.connections) - connections <= max_concurrent);
+}
+
+static void _test_timeouts(void)
+{
+	RestClient::AsyncClient client;
+	std::future<RestClient::Response> late;
+	std::future<RestClient::Response> in_time;
+	std::future<RestClient::Response> aborted;
+
+	late = client.get(_url("/delay/500"), 100);
+	in_time = client.get(_url("/delay/50"), 1000);
+	CHECK_EQ(late.get().code, CURLE_OPERATION_TIMEDOUT);
+	CHECK_EQ(in_time.get().code, 200);
+
+	/* the default timeout */
+	client.SetTimeout(100);
+	CHECK_EQ(client.get(_url("/delay/500")).get().code, CURLE_OPERATION_TIMEDOUT);
+	CHECK_EQ(client.get(_url("/delay/500"), 0).get().code, 200);
+
+	/* destroyed with a request in progress */
+	{
+		RestClient::AsyncClient doomed;
+
+		aborted = doomed.get(_url("/delay/1000"), 0);
+	}
+	CHECK_EQ(aborted.get().code, CURLE_ABORTED_BY_CALLBACK);
+}
+
+int main(void)
+{
+	if (http_server_start(&s_server) != 0) {
+		fprintf(stderr, "Can't start the HTTP server\n");
+		return 1;
+	}
+	RestClient::init();
+
+	_test_futures_and_callbacks();
+	_test_order();
+	_test_concurrency();
+	_test_timeouts();
+
+	RestClient::disable();
+	http_server_stop(&s_server);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,248 @@
+/*
+ * test_sensor.c
+ *
+ * Batched delivery of the host sensor shim, and the batch path of the
+ * capture layer on top of it: one callback per max batch latency with the
+ * samples of the FIFO, oldest first, and one record per sample.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <Ecore.h>
+#include <sensor.h>
+#include "data.h"
+#include "test.h"
+
+static struct {
+	int calls;
+	int events;
+	int max_events;
+	int gaps;				/* samples not one interval after the previous one */
+	unsigned long long last_us;
+	unsigned int interval_ms;
+	unsigned int stall_ms;	/* the first callback blocks the loop that long */
+} s_seen;
+
+static struct {
+	int calls;
+	int records;
+	int max_records;
+	int gaps;				/* within a call, the calls are stamped at their delivery */
+} s_published;
+
+/* the trace recorder is not under test */
+void replay_record_events(int sensor_type, const sensor_event_s events[], int events_count)
+{
+}
+
+static Eina_Bool _quit_cb(void *data)
+{
+	ecore_main_loop_quit();
+	return ECORE_CALLBACK_CANCEL;
+}
+
+static void _run_loop(double seconds)
+{
+	ecore_timer_add(seconds, _quit_cb, NULL);
+	ecore_main_loop_begin();
+}
+
+static void _reset_seen(unsigned int interval_ms)
+{
+	memset(&s_seen, 0, sizeof(s_seen));
+	s_seen.interval_ms = interval_ms;
+}
+
+static void _events_cb(sensor_h sensor, sensor_event_s events[], int events_count, void *data)
+{
+	int i;
+
+	s_seen.calls++;
+	s_seen.events += events_count;
+	if (events_count > s_seen.max_events)
+		s_seen.max_events = events_count;
+
+	for (i = 0; i < events_count; ++i) {
+		if (s_seen.last_us && events[i].timestamp != s_seen.last_us + s_seen.interval_ms * 1000ULL)
+			s_seen.gaps++;
+		s_seen.last_us = events[i].timestamp;
+	}
+
+	if (s_seen.stall_ms) {
+		usleep(s_seen.stall_ms * 1000);
+		s_seen.stall_ms = 0;
+	}
+}
+
+static void _event_cb(sensor_h sensor, sensor_event_s *event, void *data)
+{
+	_events_cb(sensor, event, 1, data);
+}
+
+static bool _publish_cb(const record_t *records, int count)
+{
+	int i;
+
+	if (records[0].sensor_type != SENSOR_GRAVITY)
+		return true;
+
+	s_published.calls++;
+	s_published.records += count;
+	if (count > s_published.max_records)
+		s_published.max_records = count;
+
+	for (i = 1; i < count; ++i) {
+		if (llabs(records[i].timestamp_ms - records[i - 1].timestamp_ms - 10) > 1)
+			s_published.gaps++;
+	}
+
+	return true;
+}
+
+static void _test_fifo_support(void)
+{
+	sensor_listener_h listener;
+	sensor_h sensor;
+	int fifo_count;
+
+	sensor_get_default_sensor(SENSOR_HRM, &sensor);
+	sensor_get_fifo_count(sensor, &fifo_count);
+	CHECK_EQ(fifo_count, 0);
+	CHECK_EQ(sensor_create_listener(sensor, &listener), SENSOR_ERROR_NONE);
+	CHECK_EQ(sensor_listener_set_max_batch_latency(listener, 1000), SENSOR_ERROR_NOT_SUPPORTED);
+	CHECK_EQ(sensor_listener_set_max_batch_latency(listener, 0), SENSOR_ERROR_NONE);
+	sensor_destroy_listener(listener);
+
+	sensor_get_default_sensor(SENSOR_GRAVITY, &sensor);
+	sensor_get_fifo_count(sensor, &fifo_count);
+	CHECK(fifo_count > 0);
+	CHECK_EQ(sensor_create_listener(sensor, &listener), SENSOR_ERROR_NONE);
+	CHECK_EQ(sensor_listener_set_max_batch_latency(listener, 1000), SENSOR_ERROR_NONE);
+	sensor_destroy_listener(listener);
+}
+
+/* one array per latency, no sample missing in between */
+static void _test_batched_delivery(void)
+{
+	sensor_listener_h listener;
+	sensor_shim_stats_t before;
+	sensor_shim_stats_t after;
+	sensor_h sensor;
+
+	sensor_get_default_sensor(SENSOR_GRAVITY, &sensor);
+	sensor_create_listener(sensor, &listener);
+	sensor_listener_set_events_cb(listener, _events_cb, NULL);
+	sensor_listener_set_interval(listener, 10);
+	CHECK_EQ(sensor_listener_set_max_batch_latency(listener, 200), SENSOR_ERROR_NONE);
+
+	_reset_seen(10);
+	sensor_shim_get_stats(&before);
+	CHECK_EQ(sensor_listener_start(listener), SENSOR_ERROR_NONE);
+	_run_loop(1.05);
+	sensor_listener_stop(listener);
+	sensor_shim_get_stats(&after);
+
+	CHECK(s_seen.calls >= 4 && s_seen.calls <= 6);
+	CHECK(s_seen.events >= 80 && s_seen.events <= 110);
+	CHECK(s_seen.max_events >= 18 && s_seen.max_events <= 22);
+	CHECK_EQ(s_seen.gaps, 0);
+	CHECK_EQ(after.deliveries - before.deliveries, s_seen.calls);
+	CHECK_EQ(after.events - before.events, s_seen.events);
+	CHECK_EQ(after.dropped, before.dropped);
+
+	/* without the latency, one call per interval */
+	sensor_listener_set_max_batch_latency(listener, 0);
+	_reset_seen(10);
+	sensor_listener_start(listener);
+	_run_loop(0.5);
+	sensor_listener_stop(listener);
+	CHECK(s_seen.calls >= 40);
+	CHECK(s_seen.max_events <= 2);
+
+	/* the single event callback gets the same samples one by one */
+	sensor_listener_set_event_cb(listener, 10, _event_cb, NULL);
+	sensor_listener_set_max_batch_latency(listener, 200);
+	_reset_seen(10);
+	sensor_shim_get_stats(&before);
+	sensor_listener_start(listener);
+	_run_loop(0.5);
+	sensor_listener_stop(listener);
+	sensor_shim_get_stats(&after);
+	CHECK(s_seen.events >= 40);
+	CHECK_EQ(s_seen.calls, s_seen.events);
+	CHECK_EQ(s_seen.gaps, 0);
+	CHECK_EQ(after.deliveries - before.deliveries, s_seen.events);
+
+	sensor_destroy_listener(listener);
+}
+
+/* a stalled application loses the oldest samples beyond the queue, not the newest */
+static void _test_overflow(void)
+{
+	sensor_listener_h listener;
+	sensor_shim_stats_t before;
+	sensor_shim_stats_t after;
+	sensor_h sensor;
+
+	sensor_get_default_sensor(SENSOR_GRAVITY, &sensor);
+	sensor_create_listener(sensor, &listener);
+	sensor_listener_set_events_cb(listener, _events_cb, NULL);
+	sensor_listener_set_interval(listener, 10);
+
+	/* 256 samples without a FIFO, 2.56 s at 10 ms */
+	_reset_seen(10);
+	s_seen.stall_ms = 2800;
+	sensor_shim_get_stats(&before);
+	sensor_listener_start(listener);
+	_run_loop(2.9);
+	sensor_listener_stop(listener);
+	sensor_shim_get_stats(&after);
+
+	CHECK_EQ(s_seen.max_events, 256);
+	CHECK(after.dropped - before.dropped >= 10);
+	CHECK(after.dropped - before.dropped <= 40);
+	CHECK_EQ(s_seen.gaps, 1);
+	CHECK_EQ(after.events - before.events, s_seen.events + after.dropped - before.dropped);
+
+	sensor_destroy_listener(listener);
+}
+
+/* the capture layer publishes a whole FIFO in one call, with the sample spacing kept */
+static void _test_capture_batch(void)
+{
+	CHECK(data_initialize(NULL, _publish_cb));
+
+	memset(&s_published, 0, sizeof(s_published));
+	CHECK(data_capture_start(SENSOR_GRAVITY, 10, 200));
+	_run_loop(1.05);
+	CHECK(s_published.calls >= 4 && s_published.calls <= 6);
+	CHECK(s_published.max_records >= 18 && s_published.max_records <= 22);
+	CHECK(s_published.records >= 80);
+	CHECK_EQ(s_published.gaps, 0);
+
+	/* the first call after the change gets what the FIFO still held */
+	CHECK(data_capture_start(SENSOR_GRAVITY, 10, 0));
+	_run_loop(0.05);
+	memset(&s_published, 0, sizeof(s_published));
+	_run_loop(0.5);
+	CHECK(s_published.calls >= 40);
+	CHECK(s_published.max_records <= 2);
+
+	data_capture_stop(SENSOR_GRAVITY);
+	CHECK(!data_capture_is_running(SENSOR_GRAVITY));
+	memset(&s_published, 0, sizeof(s_published));
+	_run_loop(0.3);
+	CHECK_EQ(s_published.records, 0);
+
+	data_finalize();
+}
+
+int main(void)
+{
+	_test_fifo_support();
+	_test_batched_delivery();
+	_test_overflow();
+	_test_capture_batch();
+
+	return TEST_RESULT();
+}
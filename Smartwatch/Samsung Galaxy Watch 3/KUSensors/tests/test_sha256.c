@@ -0,0 +1,144 @@
+/*
+ * test_sha256.c
+ *
+ * Known answers of SHA-256 through the kernel sha256.c picks on this CPU:
+ * the FIPS 180 examples, then every length from 0 to 299 bytes, each hashed
+ * at once, in random update sizes and side by side with sha256_multi(),
+ * against the digest of their digests. Also built with SHA256_NO_ACCELERATION
+ * as test_sha256_portable, for the portable transform and the vector lanes.
+ */
+
+#include <stdlib.h>
+#include "sha256.h"
+#include "test.h"
+
+#define LENGTHS		300
+#define MILLION		1000000
+
+static const struct {
+	const char *message;
+	const char *digest;
+} s_vectors[] = {
+	{ "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+	{ "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+	{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+			"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+	{ "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+			"cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+};
+
+/* one million 'a' */
+static const char *s_million_digest = "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+
+/* SHA-256 of the digests of the first 0 to LENGTHS - 1 bytes of the pattern */
+static const char *s_lengths_digest = "82d1c86ef5eb80a2f7cb650e4770f5293bdbe86a5b577e54026c9295bbcf0e8d";
+
+static void _to_hex(const BYTE *hash, char *hex)
+{
+	int i;
+
+	for (i = 0; i < SHA256_BLOCK_SIZE; ++i)
+		sprintf(hex + 2 * i, "%02x", hash[i]);
+}
+
+static void _hash(const void *data, size_t len, char *hex)
+{
+	BYTE hash[SHA256_BLOCK_SIZE];
+	SHA256_CTX ctx;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, data, len);
+	sha256_final(&ctx, hash);
+	_to_hex(hash, hex);
+}
+
+static void _test_vectors(void)
+{
+	static BYTE million[MILLION];
+	BYTE hash[SHA256_BLOCK_SIZE];
+	SHA256_CTX ctx;
+	char hex[SHA256_BLOCK_SIZE * 2 + 1];
+	size_t n;
+	size_t i;
+
+	for (i = 0; i < sizeof(s_vectors) / sizeof(s_vectors[0]); ++i) {
+		_hash(s_vectors[i].message, strlen(s_vectors[i].message), hex);
+		CHECK_STR(hex, s_vectors[i].digest);
+	}
+
+	/* at once, then in updates of 977 bytes that never fall on a block */
+	memset(million, 'a', sizeof(million));
+	_hash(million, sizeof(million), hex);
+	CHECK_STR(hex, s_million_digest);
+
+	sha256_init(&ctx);
+	for (i = 0; i < MILLION; i += n) {
+		n = MILLION - i < 977 ? MILLION - i : 977;
+		sha256_update(&ctx, million + i, n);
+	}
+	sha256_final(&ctx, hash);
+	_to_hex(hash, hex);
+	CHECK_STR(hex, s_million_digest);
+}
+
+static void _test_lengths(void)
+{
+	static BYTE pattern[LENGTHS];
+	static BYTE digests[LENGTHS][SHA256_BLOCK_SIZE];
+	static BYTE multi[LENGTHS][SHA256_BLOCK_SIZE];
+	const BYTE *data[LENGTHS];
+	size_t lens[LENGTHS];
+	unsigned long long seed = 9;
+	BYTE hash[SHA256_BLOCK_SIZE];
+	SHA256_CTX ctx;
+	char hex[SHA256_BLOCK_SIZE * 2 + 1];
+	size_t pos;
+	size_t n;
+	int count;
+	int i;
+
+	for (i = 0; i < LENGTHS; ++i)
+		pattern[i] = (BYTE)(i * 31 + 7);
+
+	for (i = 0; i < LENGTHS; ++i) {
+		sha256_init(&ctx);
+		sha256_update(&ctx, pattern, i);
+		sha256_final(&ctx, digests[i]);
+
+		/* the same message in random pieces, empty ones included */
+		sha256_init(&ctx);
+		for (pos = 0; pos < i; pos += n) {
+			n = test_random(&seed) % 150;
+			if (n > i - pos)
+				n = i - pos;
+			sha256_update(&ctx, pattern + pos, n);
+		}
+		sha256_final(&ctx, hash);
+		CHECK(memcmp(hash, digests[i], SHA256_BLOCK_SIZE) == 0);
+	}
+
+	_hash(digests, sizeof(digests), hex);
+	CHECK_STR(hex, s_lengths_digest);
+
+	/* side by side, in groups that do not fill the lanes, lengths mixed within a group */
+	for (count = 1; count <= 13; ++count) {
+		for (i = 0; i < LENGTHS; ++i) {
+			data[i] = pattern;
+			lens[i] = (i * 7 + count) % LENGTHS;
+		}
+		for (i = 0; i < LENGTHS; i += count)
+			sha256_multi(data + i, lens + i, multi + i, LENGTHS - i < count ? LENGTHS - i : count);
+		for (i = 0; i < LENGTHS; ++i)
+			CHECK(memcmp(multi[i], digests[lens[i]], SHA256_BLOCK_SIZE) == 0);
+	}
+}
+
+int main(void)
+{
+	printf("SHA-256 transform: %s\n", sha256_implementation());
+
+	_test_vectors();
+	_test_lengths();
+
+	return TEST_RESULT();
+}
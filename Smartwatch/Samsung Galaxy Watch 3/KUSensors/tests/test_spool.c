@@ -0,0 +1,234 @@
+/*
+ * test_spool.c
+ *
+ * Store-and-forward spool: order of the entries across the segments, the
+ * read cursor kept over a restart, the eviction of the oldest segment, the
+ * retention and the torn entries of a crash.
+ */
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "spool.h"
+#include "test.h"
+
+#define SEGMENT_SIZE	1024
+#define MAX_SEGMENTS	3
+#define PAYLOAD_SIZE	100
+#define PER_SEGMENT		9		/* entries of 108 bytes after the 32 bytes header */
+
+static char s_dir[] = "/tmp/test_spool.XXXXXX";
+
+static void _clear_dir(void)
+{
+	char path[PATH_MAX];
+	struct dirent *entry;
+	DIR *d = opendir(s_dir);
+
+	if (!d)
+		return;
+	while ((entry = readdir(d)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", s_dir, entry->d_name);
+		unlink(path);
+	}
+	closedir(d);
+}
+
+static void _payload(int index, char *buf)
+{
+	memset(buf, 'a' + index % 26, PAYLOAD_SIZE);
+	snprintf(buf, PAYLOAD_SIZE, "payload %d", index);
+}
+
+static void _append(int first, int count)
+{
+	char buf[PAYLOAD_SIZE];
+	int i;
+
+	for (i = first; i < first + count; ++i) {
+		_payload(i, buf);
+		CHECK(spool_append(buf, PAYLOAD_SIZE));
+	}
+}
+
+/* drains up to max entries, checks they are contiguous from first, returns the number drained */
+static int _drain(int first, int max)
+{
+	char expected[PAYLOAD_SIZE];
+	spool_pos_t pos;
+	size_t len;
+	void *data;
+	int count = 0;
+
+	while (count < max && spool_peek(&data, &len, &pos) == 1) {
+		_payload(first + count, expected);
+		CHECK_EQ(len, PAYLOAD_SIZE);
+		if (len != PAYLOAD_SIZE || memcmp(data, expected, PAYLOAD_SIZE) != 0) {
+			CHECK_STR((char *)data, expected);
+			free(data);
+			break;
+		}
+		free(data);
+		spool_consume(&pos);
+		count++;
+	}
+
+	return count;
+}
+
+/* overwrites bytes of a segment file, as a crash or an old clock would have left them */
+static void _patch_segment(unsigned int seq, long offset, const void *bytes, size_t len)
+{
+	char path[sizeof(s_dir) + 32];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%08x.seg", s_dir, seq);
+	f = fopen(path, "r+b");
+	CHECK(f != NULL);
+	if (!f)
+		return;
+	fseek(f, offset, SEEK_SET);
+	fwrite(bytes, 1, len, f);
+	fclose(f);
+}
+
+static void _test_order_and_restart(void)
+{
+	spool_stats_t stats;
+	spool_pos_t pos;
+	spool_pos_t again;
+	size_t len;
+	void *data;
+	void *copy;
+
+	_clear_dir();
+	CHECK(spool_open(s_dir, SEGMENT_SIZE, MAX_SEGMENTS, 0));
+	CHECK(spool_is_empty());
+	CHECK_EQ(spool_peek(&data, &len, &pos), 0);
+
+	_append(0, 20);
+	CHECK(!spool_is_empty());
+	spool_get_stats(&stats);
+	CHECK_EQ(stats.appended, 20);
+	CHECK_EQ(stats.segments, 3);
+
+	CHECK_EQ(_drain(0, 5), 5);
+
+	/* an entry stays at the head until it is consumed */
+	CHECK_EQ(spool_peek(&data, &len, &pos), 1);
+	CHECK_EQ(spool_peek(&copy, &len, &again), 1);
+	CHECK(memcmp(data, copy, len) == 0);
+	free(data);
+	free(copy);
+	spool_close();
+
+	/* the cursor and the pending entries survive the restart */
+	CHECK(spool_open(s_dir, SEGMENT_SIZE, MAX_SEGMENTS, 0));
+	CHECK_EQ(_drain(5, 100), 15);
+	CHECK(spool_is_empty());
+	spool_get_stats(&stats);
+	CHECK_EQ(stats.consumed, 15);
+	CHECK_EQ(stats.dropped, 0);
+	CHECK_EQ(stats.segments, 1);
+
+	/* the consumed entries do not come back */
+	_append(20, 1);
+	spool_close();
+	CHECK(spool_open(s_dir, SEGMENT_SIZE, MAX_SEGMENTS, 0));
+	CHECK_EQ(_drain(20, 100), 1);
+
+	/* an entry must fit in a segment */
+	CHECK(!spool_append(s_dir, 0));
+	CHECK(!spool_append(copy = calloc(1, SEGMENT_SIZE), SEGMENT_SIZE - 32));
+	free(copy);
+	spool_close();
+	CHECK(!spool_append(s_dir, 1));
+}
+
+/* the oldest segment goes when the spool is full */
+static void _test_eviction(void)
+{
+	spool_stats_t stats;
+	int drained;
+
+	_clear_dir();
+	CHECK(spool_open(s_dir, SEGMENT_SIZE, MAX_SEGMENTS, 0));
+	_append(0, 40);
+
+	spool_get_stats(&stats);
+	CHECK_EQ(stats.segments, MAX_SEGMENTS);
+	CHECK_EQ(stats.dropped, 2 * PER_SEGMENT);
+
+	drained = _drain(2 * PER_SEGMENT, 100);
+	CHECK_EQ(drained, 40 - 2 * PER_SEGMENT);
+	spool_get_stats(&stats);
+	CHECK_EQ(stats.appended, stats.consumed + stats.dropped);
+	spool_close();
+}
+
+/* a segment older than the retention is dropped, unless it is the one being written */
+static void _test_retention(void)
+{
+	unsigned long long created_s;
+	spool_stats_t stats;
+
+	_clear_dir();
+	CHECK(spool_open(s_dir, SEGMENT_SIZE, MAX_SEGMENTS, 3600));
+	_append(0, 12);
+	spool_close();
+
+	created_s = time(NULL) - 7200;
+	_patch_segment(0, 24, &created_s, sizeof(created_s));
+	_patch_segment(1, 24, &created_s, sizeof(created_s));
+
+	CHECK(spool_open(s_dir, SEGMENT_SIZE, MAX_SEGMENTS, 3600));
+	CHECK_EQ(_drain(PER_SEGMENT, 100), 12 - PER_SEGMENT);
+	spool_get_stats(&stats);
+	CHECK_EQ(stats.dropped, PER_SEGMENT);
+	CHECK(spool_is_empty());
+	spool_close();
+}
+
+/* a torn entry loses the rest of its segment, not the next segments */
+static void _test_torn_entry(void)
+{
+	unsigned int garbage = 0xdeadbeef;
+	spool_stats_t stats;
+
+	_clear_dir();
+	CHECK(spool_open(s_dir, SEGMENT_SIZE, MAX_SEGMENTS, 0));
+	_append(0, 12);
+	spool_close();
+
+	/* the payload of the third entry */
+	_patch_segment(0, 32 + 2 * (8 + PAYLOAD_SIZE) + 8 + 10, &garbage, sizeof(garbage));
+
+	CHECK(spool_open(s_dir, SEGMENT_SIZE, MAX_SEGMENTS, 0));
+	CHECK_EQ(_drain(0, 2), 2);
+	CHECK_EQ(_drain(PER_SEGMENT, 100), 12 - PER_SEGMENT);
+	spool_get_stats(&stats);
+	CHECK(stats.dropped >= 1);
+	CHECK(spool_is_empty());
+	spool_close();
+}
+
+int main(void)
+{
+	if (!mkdtemp(s_dir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	_test_order_and_restart();
+	_test_eviction();
+	_test_retention();
+	_test_torn_entry();
+
+	_clear_dir();
+	rmdir(s_dir);
+
+	return TEST_RESULT();
+}
@@ -0,0 +1,281 @@
+/*
+ * test_thpool.c
+ *
+ * Thread pool: every job of several producers runs once, one producer's
+ * jobs run in order on a one-thread pool, jobs queue jobs as the mqtt drain
+ * does, a job queued by a job to the shared queue runs behind the jobs queued
+ * before it, batches, trees of jobs added by jobs, pause/resume and the working
+ * count. test_thpool_small builds the pool with a ring of 4 slots, where
+ * most jobs go through the overflow list, test_thpool_ws and
+ * test_thpool_ws_small with THPOOL_WORK_STEALING, where the jobs added by
+ * jobs go to the deque of their thread and are stolen from there.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include "thpool.h"
+#include "test.h"
+
+#define PRODUCERS	4
+#define PRODUCER_JOBS	20000
+#define ORDER_JOBS	1000
+#define CHAIN_JOBS	10000
+#define BATCH_JOBS	1000
+#define TREE_DEPTH	6		/* 4^6 leaves */
+#define TREE_LEAVES	4096
+
+typedef struct producer {
+	threadpool pool;
+	int failures;
+} producer_t;
+
+static threadpool s_pool;
+static long s_count;
+static int s_order[ORDER_JOBS];
+static int s_order_len;
+static int s_release;
+static long s_nodes;
+static int s_batch_children;
+
+static void _job_count(void *arg)
+{
+	__sync_fetch_and_add(&s_count, (long)arg);
+}
+
+static void *_producer(void *arg)
+{
+	producer_t *producer = arg;
+	int i;
+
+	for (i = 0; i < PRODUCER_JOBS; ++i) {
+		if (thpool_add_work(producer->pool, _job_count, (void *)1L) != 0)
+			producer->failures++;
+	}
+
+	return NULL;
+}
+
+static void _test_producers(int thread_count)
+{
+	threadpool pool = thpool_init(thread_count);
+	producer_t producers[PRODUCERS];
+	pthread_t threads[PRODUCERS];
+	int i;
+
+	CHECK(pool != NULL);
+	s_count = 0;
+	for (i = 0; i < PRODUCERS; ++i) {
+		producers[i].pool = pool;
+		producers[i].failures = 0;
+		pthread_create(&threads[i], NULL, _producer, &producers[i]);
+	}
+	for (i = 0; i < PRODUCERS; ++i) {
+		pthread_join(threads[i], NULL);
+		CHECK_EQ(producers[i].failures, 0);
+	}
+	thpool_wait(pool);
+	CHECK_EQ(s_count, PRODUCERS * PRODUCER_JOBS);
+	CHECK_EQ(thpool_num_threads_working(pool), 0);
+
+	thpool_destroy(pool);
+}
+
+static void _job_order(void *arg)
+{
+	s_order[s_order_len++] = (int)(long)arg;
+	if ((long)arg < 64)
+		usleep(1000);
+}
+
+static void _test_order(void)
+{
+	threadpool pool = thpool_init(1);
+	int i;
+
+	/* the first jobs slowly, some queued while the ring is full, then a burst */
+	s_order_len = 0;
+	for (i = 0; i < ORDER_JOBS; ++i) {
+		CHECK_EQ(thpool_add_work(pool, _job_order, (void *)(long)i), 0);
+		if (i < 64 && i % 3 == 0)
+			usleep(1500);
+	}
+	thpool_wait(pool);
+
+	CHECK_EQ(s_order_len, ORDER_JOBS);
+	for (i = 0; i < ORDER_JOBS; ++i) {
+		if (s_order[i] != i) {
+			CHECK_EQ(s_order[i], i);
+			break;
+		}
+	}
+
+	thpool_destroy(pool);
+}
+
+/* queues the next one until arg reaches 0 */
+static void _job_chain(void *arg)
+{
+	long left = (long)arg;
+
+	__sync_fetch_and_add(&s_count, 1);
+	if (left > 1 && thpool_add_work(s_pool, _job_chain, (void *)(left - 1)) != 0)
+		fprintf(stderr, "Can't queue the next job\n");
+}
+
+static void _test_chain(void)
+{
+	s_pool = thpool_init(2);
+	s_count = 0;
+	CHECK_EQ(thpool_add_work(s_pool, _job_chain, (void *)(long)CHAIN_JOBS), 0);
+	thpool_wait(s_pool);
+	CHECK_EQ(s_count, CHAIN_JOBS);
+
+	thpool_destroy(s_pool);
+}
+
+static void _job_record(void *arg)
+{
+	s_order[s_order_len++] = (int)(long)arg;
+}
+
+/* waits for the main thread to queue job 1, then queues job 2 behind it */
+static void _job_requeue(void *arg)
+{
+	s_order[s_order_len++] = 0;
+	while (!__atomic_load_n(&s_release, __ATOMIC_ACQUIRE))
+		usleep(1000);
+	if (thpool_add_work_shared(s_pool, _job_record, (void *)2L) != 0)
+		fprintf(stderr, "Can't queue the next job\n");
+}
+
+static void _test_shared(void)
+{
+	s_pool = thpool_init(1);
+	s_order_len = 0;
+	__atomic_store_n(&s_release, 0, __ATOMIC_RELEASE);
+
+	CHECK_EQ(thpool_add_work(s_pool, _job_requeue, NULL), 0);
+	CHECK_EQ(thpool_add_work(s_pool, _job_record, (void *)1L), 0);
+	__atomic_store_n(&s_release, 1, __ATOMIC_RELEASE);
+	thpool_wait(s_pool);
+
+	CHECK_EQ(s_order_len, 3);
+	CHECK_EQ(s_order[1], 1);
+	CHECK_EQ(s_order[2], 2);
+
+	thpool_destroy(s_pool);
+}
+
+static void _test_batch(void)
+{
+	threadpool pool = thpool_init(4);
+	void *args[BATCH_JOBS];
+	int i;
+
+	s_count = 0;
+	for (i = 0; i < BATCH_JOBS; ++i)
+		args[i] = (void *)(long)(i + 1);
+	CHECK_EQ(thpool_add_work_batch(pool, _job_count, args, BATCH_JOBS), 0);
+	CHECK_EQ(thpool_add_work_batch(pool, _job_count, args, 0), 0);
+	CHECK_EQ(thpool_add_work_batch(pool, _job_count, args, 1), 0);
+	thpool_wait(pool);
+	CHECK_EQ(s_count, BATCH_JOBS * (BATCH_JOBS + 1) / 2 + 1);
+
+	thpool_destroy(pool);
+}
+
+/* a node of depth arg adds its 4 children, in a batch or one by one */
+static void _job_node(void *arg)
+{
+	long depth = (long)arg;
+	void *children[4];
+	int i;
+
+	__sync_fetch_and_add(&s_nodes, 1);
+	if (depth == 0) {
+		__sync_fetch_and_add(&s_count, 1);
+		return;
+	}
+	for (i = 0; i < 4; ++i)
+		children[i] = (void *)(depth - 1);
+	if (s_batch_children) {
+		thpool_add_work_batch(s_pool, _job_node, children, 4);
+	} else {
+		for (i = 0; i < 4; ++i)
+			thpool_add_work(s_pool, _job_node, children[i]);
+	}
+}
+
+static void _test_tree(int thread_count, int batch_children)
+{
+	s_pool = thpool_init(thread_count);
+	s_count = 0;
+	s_nodes = 0;
+	s_batch_children = batch_children;
+
+	CHECK_EQ(thpool_add_work(s_pool, _job_node, (void *)(long)TREE_DEPTH), 0);
+	thpool_wait(s_pool);
+	CHECK_EQ(s_count, TREE_LEAVES);
+	CHECK_EQ(s_nodes, (4 * TREE_LEAVES - 1) / 3);
+	CHECK_EQ(thpool_num_threads_working(s_pool), 0);
+
+	thpool_destroy(s_pool);
+}
+
+static void _job_block(void *arg)
+{
+	while (!__atomic_load_n(&s_release, __ATOMIC_ACQUIRE))
+		usleep(1000);
+	__sync_fetch_and_add(&s_count, 1);
+}
+
+static void _test_pause_and_working(void)
+{
+	threadpool pool = thpool_init(2);
+	int i;
+
+	/* nothing runs while paused, the jobs are kept */
+	s_count = 0;
+	thpool_pause(pool);
+	for (i = 0; i < 100; ++i)
+		CHECK_EQ(thpool_add_work(pool, _job_count, (void *)1L), 0);
+	usleep(50000);
+	CHECK_EQ(s_count, 0);
+	CHECK_EQ(thpool_num_threads_working(pool), 0);
+	thpool_resume(pool);
+	thpool_wait(pool);
+	CHECK_EQ(s_count, 100);
+
+	/* two blocked jobs keep both threads working */
+	s_count = 0;
+	__atomic_store_n(&s_release, 0, __ATOMIC_RELEASE);
+	CHECK_EQ(thpool_add_work(pool, _job_block, NULL), 0);
+	CHECK_EQ(thpool_add_work(pool, _job_block, NULL), 0);
+	for (i = 0; i < 1000 && thpool_num_threads_working(pool) < 2; ++i)
+		usleep(1000);
+	CHECK_EQ(thpool_num_threads_working(pool), 2);
+	__atomic_store_n(&s_release, 1, __ATOMIC_RELEASE);
+	thpool_wait(pool);
+	CHECK_EQ(s_count, 2);
+	CHECK_EQ(thpool_num_threads_working(pool), 0);
+
+	thpool_destroy(pool);
+}
+
+int main(void)
+{
+	_test_producers(1);
+	_test_producers(2);
+	_test_producers(4);
+	_test_order();
+	_test_chain();
+	_test_shared();
+	_test_batch();
+	_test_tree(1, 0);
+	_test_tree(4, 0);
+	_test_tree(1, 1);
+	_test_tree(4, 1);
+	_test_pause_and_working();
+
+	return TEST_RESULT();
+}